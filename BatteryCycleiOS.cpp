@@ -1,10 +1,49 @@
-﻿#include <stdio.h>
+﻿#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <io.h>
 #include <zlib.h>
+#ifdef BATTERYCYCLE_WITH_SERVER
+#include <winsock2.h>
+#include <afunix.h>
+#endif
 #include <windows.h>
+#ifdef BATTERYCYCLE_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#ifdef BATTERYCYCLE_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef BATTERYCYCLE_WITH_XZ
+#include <lzma.h>
+#endif
+#ifdef BATTERYCYCLE_WITH_BZIP2
+#include <bzlib.h>
+#endif
 #include <stdbool.h>
 #include <time.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BATTERYCYCLE_X86
+#include <immintrin.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BatteryCycleiOS.h"
 
 /**
  * Constants
@@ -14,6 +53,53 @@
 #define MAX_PATH_LENGTH 260        // Maximum path length
 #define MAX_COLUMNS 256            // Maximum CSV columns
 #define MAX_BUFFER_SIZE 1024       // General buffer size
+#define CSV_TAIL_LINE_SIZE 4096    // Longest header or row the streaming CSV tail keeps
+#define CSV_BLOCK_SIZE 64          // Bytes the CSV tokenizer classifies at a time
+#define SCHEMA_CACHE_SIZE 64       // Distinct CSV headers whose column maps are kept for the whole process
+#define DEFLATE_WINDOW_SIZE 32768  // Deflate back-reference window
+#define PARALLEL_CHUNK_SIZE (1024 * 1024) // Compressed bytes per speculative chunk
+#define PARALLEL_SEARCH_SIZE (256 * 1024) // Compressed bytes at the start of a chunk searched for a block start
+#define PARALLEL_FIXED_BUDGET 8    // Bits decoded per searched bit at most when looking for fixed Huffman blocks
+#define PARALLEL_MAX_PERCENT 80    // Archives whose first chunk compresses to more than this percentage decode sequentially
+#define BENCHMARK_RUNS 3           // Runs per benchmark configuration, best one is reported
+#define BENCHMARK_RANDOM_SIZE (32 * 1024 * 1024) // Bytes of the incompressible payload benchmarked alongside the archive
+#define INPUT_BUFFER_SIZE (256 * 1024) // Compressed input buffer for streaming inflate
+#define OUTPUT_WINDOW_SIZE (4 * 1024) // Streaming inflate output viewed in place, e.g. tar headers
+#define INDEX_SPAN (4 * 1024 * 1024)   // Uncompressed bytes between index checkpoints
+#define INDEX_MAGIC "BCIDX001"     // Archive index file signature and version
+#define INDEX_EXTENSION ".bcidx"   // Archive index file extension
+#define RESULT_CACHE_MAGIC "BCRES001" // Result cache file signature and version
+#define RESULT_CACHE_EXTENSION ".bcres" // Result cache file extension
+#define FINGERPRINT_SPAN (1024 * 1024) // Bytes hashed at the start and at the end of an archive
+#define DEFAULT_MEMORY_BUDGET (1024ULL * 1024 * 1024) // Bytes whole-buffer decompression may use
+#define DEFAULT_READ_AHEAD (8 * 1024 * 1024) // Compressed bytes the I/O thread may read ahead of decoding
+#define PIPELINE_OUTPUT_SIZE (4 * 1024 * 1024) // Tar stream bytes decoding may run ahead of the parser
+#define RING_SPIN_COUNT 256        // Yields before a ring side sleeps
+#define INPUT_FORMAT_UNKNOWN 0     // Input that cannot be opened
+#define INPUT_FORMAT_GZIP 1        // Gzip compressed tar
+#define INPUT_FORMAT_TAR 2         // Uncompressed tar
+#define INPUT_FORMAT_DIRECTORY 3   // Sysdiagnose folder that was already extracted
+#define INPUT_FORMAT_ZSTD 4        // Zstandard compressed tar
+#define INPUT_FORMAT_XZ 5          // Xz compressed tar
+#define INPUT_FORMAT_BZIP2 6       // Bzip2 compressed tar
+#define BDC_COLUMN_INTEGER 0       // History column of whole numbers
+#define BDC_COLUMN_REAL 1          // History column of numbers with a fraction or exponent
+#define BDC_COLUMN_TIMESTAMP 2     // History column of "YYYY-MM-DD HH:MM:SS" times, as seconds since 1970
+#define BDC_COLUMN_TEXT 3          // History column of anything else
+#define BDC_MISSING_INTEGER LLONG_MIN // Empty value in an integer or timestamp history column
+#define CSV_VALUE_TEXT 0           // CSV column request copying the value as written
+#define CSV_VALUE_INTEGER 1        // CSV column request parsing a whole number
+#define CSV_VALUE_REAL 2           // CSV column request parsing any decimal number
+#define CSV_VALUE_TIMESTAMP 3      // CSV column request parsing "YYYY-MM-DD HH:MM:SS" into seconds since 1970
+#define CSV_VALUE_FIELD 4          // CSV column request only locating the value in the CSV data
+#define EXPORT_FORMAT_CSV 0        // Exported rows as CSV with a header line
+#define EXPORT_FORMAT_NDJSON 1     // Exported rows as one JSON object per line
+#define EXPORT_FORMAT_BINARY 2     // Exported rows as little-endian binary records
+#define EXPORT_ROWS_LAST 0         // Export the last row of the newest log
+#define EXPORT_ROWS_ALL 1          // Export every row of every log
+#define EXPORT_ROWS_RANGE 2        // Export a range of rows of the history
+#define EXPORT_MAGIC "BCROWS01"    // Binary export signature and version
+#define OUTPUT_BUFFER_SIZE (1024 * 1024) // Bytes the output writer collects before writing
 
  /**
   * File matcher callback function type
@@ -23,6 +109,20 @@
   */
 typedef int (*pfnFileMatcherCallback)(const char* szFileName, void* pUserData);
 
+/**
+ * File content callback function type, receives every extracted file piece by piece
+ * The pieces arrive in order and are followed by a call with nSize 0 once the file is complete,
+ * so no file is ever held in memory as a whole.
+ * @param szFileName File name that was extracted
+ * @param pData Next piece of the file content, valid during the call only
+ * @param nSize Size of the piece in bytes, 0 at the end of the file
+ * @param ullOffset Offset of the piece in the file, 0 starts a new file
+ * @param pUserData User data for callback
+ * @return 0 to continue scanning, 1 to stop scanning, negative number on error
+ */
+typedef int (*pfnFileContentCallback)(const char* szFileName, const char* pData, size_t nSize,
+    unsigned long long ullOffset, void* pUserData);
+
 /**
  * TAR file header structure according to POSIX standard
  */
@@ -57,9 +157,101 @@ typedef struct {
     int nMinute;
     int nSecond;
     char szFilename[MAX_PATH_LENGTH]; // Store the full filename
-    time_t tTimestamp;               // Unix timestamp for easy comparison
+    time_t tTimestamp;               // Seconds since 1970 of the date as written, like bParseCSVTimeStamp
 } fileDateT;
 
+/**
+ * Header line and last row of a CSV file, collected while the file streams past
+ * Memory use is fixed, however large the file is.
+ */
+typedef struct {
+    char szHeader[CSV_TAIL_LINE_SIZE]; // Header line without its newline
+    char aszRows[2][CSV_TAIL_LINE_SIZE]; // Last complete row and the row being received, by turns
+    size_t nHeaderLen;        // Bytes in szHeader
+    size_t anRowLen[2];       // Bytes in aszRows
+    bool abRowTooLong[2];     // The row did not fit and was cut off
+    int nCurrentRow;          // Index of the row being received in aszRows
+    bool bHeaderDone;         // The header line is complete
+    bool bHeaderTooLong;      // The header did not fit and was cut off
+    bool bHasRow;             // A row after the header is complete
+    bool bComplete;           // The whole file was received
+} csvTailT;
+
+/**
+ * Value of a CSV field where it is in the CSV data, without blanks and quotes around it and not NUL-terminated
+ * Doubled quotes inside it are still doubled, bCopyCSVField undoes them.
+ */
+typedef struct {
+    const char* pData;        // First character, NULL if there is no value
+    size_t nLen;              // Length
+} csvFieldT;
+
+/**
+ * One column of a multi-column CSV lookup
+ */
+typedef struct {
+    const char* szColName;    // Name of the column in the header
+    char* szResult;           // Receives the value, empty if it was not found, NULL for typed requests
+    size_t nBufSize;          // Size of szResult
+    int nStatus;              // 0 if the value was found, the nGetCSVDataByColName error code otherwise
+    int nType;                // One of the CSV_VALUE_ constants, CSV_VALUE_TEXT to copy into szResult
+    long long llValue;        // Receives integers and timestamps
+    double dValue;            // Receives reals
+    csvFieldT stField;        // Receives where the value is in the CSV data, for every type
+} csvColumnRequestT;
+
+/**
+ * Positions of the CSV special characters in one CSV_BLOCK_SIZE block, bit i stands for byte i
+ */
+typedef struct {
+    unsigned long long ullComma;   // Commas
+    unsigned long long ullQuote;   // Double quotes
+    unsigned long long ullNewline; // Newlines
+} csvBlockMasksT;
+
+/**
+ * Kernel that classifies CSV bytes a block at a time
+ */
+typedef struct {
+    const char* szName;       // Name shown by the benchmark
+    // Classify CSV_BLOCK_SIZE bytes, all of which must be readable
+    void (*pfnClassify)(const char* pBlock, csvBlockMasksT* pMasks);
+    // Check whether the CPU can run the kernel
+    bool (*pfnSupported)(void);
+} csvKernelT;
+
+/**
+ * Walks the commas and newlines outside quotes of CSV data, a block at a time
+ */
+typedef struct {
+    const char* pData;        // CSV data
+    size_t nSize;             // Size of the data
+    size_t nBlock;            // Offset of the block ullDelimiters belongs to
+    size_t nNext;             // Offset of the next block to classify
+    unsigned long long ullDelimiters; // Delimiters of the current block not returned yet
+    bool bInQuotes;           // Quote state at the end of the current block
+    const csvKernelT* pKernel; // Kernel classifying the blocks
+} csvScannerT;
+
+/**
+ * Column names of a CSV header with a hash table from name to field, shared by all files with that header
+ */
+typedef struct {
+    std::string strHeader;    // Header line without its newline
+    unsigned long ulFingerprint; // CRC32 of the header line
+    std::vector<std::string> vecNames; // Name of every field, without blanks and quotes around it
+    std::vector<int> vecSlots; // Field of every hash slot, -1 if free, a power of two in size
+} csvSchemaT;
+
+/**
+ * CSV schemas of every header seen so far, shared by all threads, schemas are never removed
+ */
+typedef struct {
+    std::mutex mtxSchemas;    // Guards the slots
+    const csvSchemaT* apSlots[SCHEMA_CACHE_SIZE * 2]; // Schemas by fingerprint, open addressing
+    int nSchemas;             // Schemas in the slots
+} csvSchemaCacheT;
+
 /**
  * Data structure to pass to the callback
  */
@@ -67,8 +259,294 @@ typedef struct {
     const char* szPrefix;     // Prefix to match (e.g., "BDC_Daily_")
     fileDateT stLatestFile;   // Stores information about the latest file found
     int bFoundMatch;          // Flag to indicate if a match was found
+    csvTailT stLatestTail;    // Header and last row of the latest file found so far
 } matcherDataT;
 
+/**
+ * Battery information taken from the latest BDC_Daily_ file
+ */
+typedef struct {
+    char szFilename[MAX_PATH_LENGTH];   // Name of the BDC_Daily_ file the values come from
+    char szCycleCount[MAX_BUFFER_SIZE]; // CycleCount of the last row
+    char szTimeStamp[MAX_BUFFER_SIZE];  // TimeStamp of the last row
+} batteryInfoT;
+
+/**
+ * One typed column of a BDC history table, only the vector of its type holds values
+ * The type is taken from the first value that is not empty, integer columns become real columns
+ * once a value has a fraction. Values that do not fit the type are stored as empty.
+ */
+typedef struct {
+    std::string strName;      // Column name from the header
+    int nType;                // One of the BDC_COLUMN_ constants
+    bool bTyped;              // A value has set the type, until then the column is all empty integers
+    std::vector<long long> vecIntegers; // Integer and timestamp values, BDC_MISSING_INTEGER where empty
+    std::vector<double> vecReals;       // Real values, NaN where empty
+    std::vector<std::string> vecTexts;  // Text values, empty strings where empty
+} bdcColumnT;
+
+/**
+ * A BDC_Daily_ file whose rows are in a history table
+ */
+typedef struct {
+    fileDateT stDate;         // Name and date of the file
+    size_t nFirstRow;         // Table row of its first row
+    size_t nRows;             // Number of its rows
+} bdcMemberT;
+
+/**
+ * Every row of every BDC_Daily_ file of a report, one typed vector per column
+ * Columns are the union of the headers of all files, rows of a file without a column are empty in it.
+ */
+typedef struct {
+    std::vector<bdcColumnT> vecColumns; // Columns in order of first appearance
+    std::vector<bdcMemberT> vecMembers; // Files in date order, their rows follow each other in the same order
+    size_t nRows;             // Number of rows in every column
+} bdcTableT;
+
+/**
+ * Partial results of reducing a history column, value i goes to lane i % 4 so every kernel adds in the same order
+ */
+typedef struct {
+    double adCount[4];        // Values that are not empty
+    double adSum[4];          // Sum of the values minus the shift
+    double adSquares[4];      // Sum of the squares of the values minus the shift
+    double adMin[4];          // Smallest value, +infinity if none
+    double adMax[4];          // Largest value, -infinity if none
+} bdcSumsT;
+
+/**
+ * Reduction kernel over a column of reals, NaN marks empty values
+ */
+typedef struct {
+    const char* szName;       // Name shown by the benchmark
+    void (*pfnReduce)(const double* pValues, size_t nCount, double dShift, bdcSumsT* pSums); // Adds the values to the lanes
+    bool (*pfnSupported)(void); // Whether the CPU runs the kernel
+} bdcReduceKernelT;
+
+/**
+ * Statistics of a history column over a range of rows, all NaN if no value is set
+ */
+typedef struct {
+    unsigned long long ullCount; // Values that are not empty
+    double dMin;              // Smallest value
+    double dMax;              // Largest value
+    double dMean;             // Average
+    double dStdDev;           // Population standard deviation
+    double dP50;              // Median, interpolated between the closest values like the percentiles
+    double dP90;              // 90th percentile
+    double dP99;              // 99th percentile
+} bdcStatsT;
+
+/**
+ * Running least squares fit of one history column over time, x is days since the first value
+ * Sums are kept as means and co-moments updated one value at a time, so no row is kept.
+ */
+typedef struct {
+    unsigned long long ullCount; // Values added
+    long long llOrigin;       // Seconds of the first value, x is measured from it
+    long long llFirst;        // Seconds of the earliest value
+    long long llLast;         // Seconds of the latest value
+    double dMeanX;            // Mean of x
+    double dMeanY;            // Mean of the values
+    double dSxx;              // Sum of the squared deviations of x
+    double dSxy;              // Sum of the products of the deviations of x and the values
+    double dSyy;              // Sum of the squared deviations of the values
+    time_t atFiles[2];        // Dates of the newest and second newest files with a value
+    double adFileX[2];        // x of the last value of those files
+    double adFileY[2];        // Last value of those files
+    int nFiles;               // How many of atFiles are set
+} bdcTrendT;
+
+/**
+ * Trends of the selected columns of a report, fed one BDC_Daily_ file at a time
+ */
+typedef struct {
+    std::vector<std::string> vecColumns; // Column names, "A/B" for ratios
+    std::vector<bdcTrendT> vecTrends;    // Trend of every column
+    unsigned long long ullFiles; // Files added
+} bdcTrendSetT;
+
+/**
+ * Fitted line and rates of change of a trend, NaN where there are too few values
+ */
+typedef struct {
+    double dPerDay;           // Slope of the fitted line, change per day
+    double dStart;            // Fitted value at the earliest value
+    double dEnd;              // Fitted value at the latest value
+    double dR2;               // Coefficient of determination of the fit
+    double dRecentPerDay;     // Change per day from the last value of the second newest file to that of the newest
+} bdcTrendLineT;
+
+/**
+ * Data structure to pass to the callbacks that load a history table
+ */
+typedef struct {
+    const char* szPrefix;     // Prefix of the files to load (e.g., "BDC_Daily_version")
+    bdcTableT* pTable;        // Table receiving the rows
+    std::string strPartialLine; // Start of a line whose newline is in a later piece
+    std::vector<int> vecFieldColumns; // Table column of every header field of the current file, -1 to skip it
+    const csvSchemaT* pFieldSchema; // Cached schema vecFieldColumns was built for, NULL if none
+    csvSchemaT stLocalSchema; // Schema of a header the schema cache does not keep
+    bool bHeaderDone;         // The header of the current file was read
+    std::vector<unsigned int> vecFieldEnds; // Tokenizer output, kept to reuse its memory
+    bdcTrendSetT* pTrend;     // Receives the rows of every file once it is complete, NULL to keep them in pTable
+} bdcHistoryLoaderT;
+
+/**
+ * Cheap identity of an archive's content, independent of its path
+ */
+typedef struct {
+    unsigned long long ullSize; // Archive size
+    unsigned char abTrailer[8]; // Last 8 bytes, CRC32 and ISIZE for gzip
+    unsigned long ulHeadCrc;  // CRC32 of the first FINGERPRINT_SPAN bytes
+    unsigned long ulTailCrc;  // CRC32 of the last FINGERPRINT_SPAN bytes
+} archiveFingerprintT;
+
+/**
+ * Time spent in the stages of an analysis, in milliseconds
+ */
+typedef struct {
+    double dLookupMs;         // Fingerprinting the archive and looking it up in the result cache
+    double dScanMs;           // Decompressing the archive and finding the latest log
+    double dParseMs;          // Reading the values from the log
+    double dTotalMs;          // Whole analysis
+} reportTimingsT;
+
+/**
+ * Statistics of an archive scan
+ */
+typedef struct {
+    unsigned long long ullScanned; // Uncompressed tar bytes the scan went through
+    unsigned long long ullTotal;   // Uncompressed size of the whole archive, 0 if unknown
+    int bStoppedEarly;        // The scan left the target directory and stopped there
+} extractStatsT;
+
+/**
+ * Buffers a worker keeps across archives, so a batch does not allocate them for every scan
+ * Only one reader at a time may use them.
+ */
+typedef struct {
+    unsigned char* pInput;    // Compressed input buffer, INPUT_BUFFER_SIZE bytes
+    unsigned char* pWindow;   // Output window, OUTPUT_WINDOW_SIZE bytes
+    unsigned char* pScratch;  // Output buffer for skipped data, INPUT_BUFFER_SIZE bytes
+    unsigned char* pFingerprint; // Archive fingerprint buffer, FINGERPRINT_SPAN bytes
+    z_stream* pInflate;       // Gzip inflate state, reset for every archive, NULL until first needed
+} workerBuffersT;
+
+/**
+ * Options controlling how archives are read
+ */
+typedef struct {
+    int nThreads;             // Decompression threads, 0 for one per core
+    int bUseIndex;            // Load or build a random access index for the archive
+    const char* szIndexDir;   // Directory for index files, NULL to store them next to the archive
+    const char* szCacheDir;   // Directory of the result cache, NULL to disable it
+    const char* szBackend;    // Inflate backend name, NULL or "auto" to choose at runtime
+    unsigned long long ullMemoryBudget; // Bytes whole-buffer backends may use, 0 for the default
+    int bStopAfterDirectory;  // Stop once the scan has left the target directory again
+    unsigned long long ullReadAhead; // Compressed bytes the pipelined reader reads ahead, 0 for the default
+    workerBuffersT* pBuffers; // Reusable buffers of the calling worker, NULL to allocate per archive
+    extractStatsT* pStats;    // Receives scan statistics, may be NULL
+} extractOptionsT;
+
+/**
+ * Random access checkpoint, a deflate block start and the window preceding it
+ */
+typedef struct {
+    unsigned long long ullBit; // Bit offset of the block in the archive file
+    unsigned long long ullOut; // Uncompressed offset of the block
+    unsigned int uWindowSize; // Uncompressed window size, up to 32 KB
+    unsigned int uPackedSize; // Size of the window after zlib compression
+    unsigned char* pWindow;   // Compressed window
+} indexCheckpointT;
+
+/**
+ * Tar member entry of an archive index
+ */
+typedef struct {
+    unsigned long long ullOffset; // Uncompressed offset of the member data
+    unsigned long long ullSize;   // Member data size
+    char cTypeflag;           // Tar type flag
+    char szName[101];         // Member path
+} indexMemberT;
+
+/**
+ * Random access index of a tar.gz archive
+ */
+typedef struct {
+    unsigned long long ullArchiveSize; // Size of the indexed archive
+    unsigned char abTrailer[8];        // Last 8 bytes of the archive, gzip CRC32 and ISIZE
+    indexCheckpointT* pCheckpoints;    // Checkpoints ordered by offset
+    int nCheckpoints;
+    int nCheckpointCapacity;
+    indexMemberT* pMembers;            // Tar members in archive order
+    int nMembers;
+    int nMemberCapacity;
+} archiveIndexT;
+
+/**
+ * Sequential reader over the uncompressed tar stream
+ */
+typedef struct archiveReaderT {
+    // Read up to nSize bytes, returns the count read (short at end of stream) or -1 on error
+    long long (*pfnRead)(struct archiveReaderT* pReader, void* pBuffer, size_t nSize);
+    // Skip forward ullSize bytes, returns 0 on success or -1 on error
+    int (*pfnSkip)(struct archiveReaderT* pReader, unsigned long long ullSize);
+    // Optional, consume nSize bytes and return them in place, valid until the next call on the reader,
+    // or NULL without consuming anything if they are not contiguous in the reader's buffers
+    const void* (*pfnView)(struct archiveReaderT* pReader, size_t nSize);
+    // Release the reader and its context
+    void (*pfnClose)(struct archiveReaderT* pReader);
+    void* pContext;           // Backend specific state
+} archiveReaderT;
+
+/**
+ * Diagnostics destination of a library call, shared with the threads the call starts
+ */
+typedef struct {
+    pfnBatteryCycleLogCallback pfnLog; // Receives every message, may be NULL
+    void* pUserData;          // User data for pfnLog
+    char* szFirstError;       // Receives the first error, BATTERYCYCLE_VALUE_SIZE bytes
+    std::mutex mtxSink;       // Serializes messages of helper threads
+} logSinkT;
+
+// Sink of the library call running on this thread, NULL to print to stderr
+thread_local logSinkT* g_pLogSink = NULL;
+
+/**
+ * Report an error or warning, on stderr or to the sink of the library call running on this thread
+ * @param szFormat printf format, starting with "Error: " or "Warning: " and ending with a newline
+ */
+void vLogMessage(const char* szFormat, ...) {
+    va_list args;
+    logSinkT* pSink = g_pLogSink;
+    if (!pSink) {
+        va_start(args, szFormat);
+        vfprintf(stderr, szFormat, args);
+        va_end(args);
+        return;
+    }
+
+    char szMessage[MAX_BUFFER_SIZE];
+    va_start(args, szFormat);
+    vsnprintf(szMessage, sizeof(szMessage), szFormat, args);
+    va_end(args);
+    size_t nLen = strlen(szMessage);
+    if (nLen > 0 && szMessage[nLen - 1] == '\n') {
+        szMessage[nLen - 1] = '\0';
+    }
+
+    // Later errors mostly repeat the first one from further up the call chain
+    std::lock_guard<std::mutex> lock(pSink->mtxSink);
+    if (!pSink->szFirstError[0] && strncmp(szMessage, "Error: ", 7) == 0) {
+        strncpy_s(pSink->szFirstError, BATTERYCYCLE_VALUE_SIZE, szMessage + 7, _TRUNCATE);
+    }
+    if (pSink->pfnLog) {
+        pSink->pfnLog(szMessage, pSink->pUserData);
+    }
+}
+
 /**
  * Convert octal string to unsigned long
  * @param szStr Octal string
@@ -109,13 +587,13 @@ int bIsInDirectory(const char* szPath, const char* szTargetDir) {
         // Create a new string with slash added
         char* szDirWithSlash = (char*)malloc(nDirLen + 2);
         if (!szDirWithSlash) {
-            fprintf(stderr, "Error: Memory allocation failed\n");
+            vLogMessage("Error: Memory allocation failed\n");
             return 0;
         }
 
         // Safe string copy
         if (strncpy_s(szDirWithSlash, nDirLen + 2, szTargetDir, nDirLen) != 0) {
-            fprintf(stderr, "Error: String copy failed\n");
+            vLogMessage("Error: String copy failed\n");
             free(szDirWithSlash);
             return 0;
         }
@@ -132,616 +610,9441 @@ int bIsInDirectory(const char* szPath, const char* szTargetDir) {
 }
 
 /**
- * Get data from specified row and column name in a CSV buffer
- * @param szCsvBuffer Pointer to CSV data in memory
- * @param nRow Row number (0 for first row after header, -1 for last row)
- * @param szColName Name of the column to retrieve data from
- * @param szResult Buffer to store the result
- * @param nBufSize Size of the result buffer
- * @return 0 for success, negative number for failure
+ * Get the file name of a tar member that is a regular file inside the target directory
+ * @param szPath Member path
+ * @param cTypeflag Member type flag
+ * @param szTargetDir Target directory
+ * @return File name part of szPath, NULL if the member is not such a file
  */
-int nGetCSVDataByColName(const char* szCsvBuffer, int nRow, const char* szColName,
-    char* szResult, size_t nBufSize) {
-    if (szCsvBuffer == NULL || szColName == NULL || szResult == NULL || nBufSize <= 0) {
-        return -1; // Invalid parameters
-    }
-
-    // Initialize result
-    if (strncpy_s(szResult, nBufSize, "", 1) != 0) {
-        return -1; // Error in initialization
+const char* szGetTargetFileName(const char* szPath, char cTypeflag, const char* szTargetDir) {
+    if ((cTypeflag != '0' && cTypeflag != '\0') || !bIsInDirectory(szPath, szTargetDir)) {
+        return NULL;
     }
 
-    // Make a copy of the buffer to avoid modifying the original
-    size_t nBufferLen = strlen(szCsvBuffer);
-    char* szBufferCopy = (char*)malloc(nBufferLen + 1);
-    if (szBufferCopy == NULL) {
-        return -2; // Memory allocation failed
+    // Extract the filename from the path
+    const char* szFilename = szPath;
+    const char* pSlash = strrchr(szPath, '/');
+    if (pSlash) {
+        szFilename = pSlash + 1;
     }
 
-    if (memcpy_s(szBufferCopy, nBufferLen + 1, szCsvBuffer, nBufferLen + 1) != 0) {
-        free(szBufferCopy);
-        return -2; // Memory copy failed
-    }
+    // Empty filename means a directory entry
+    return *szFilename != '\0' ? szFilename : NULL;
+}
 
-    // Save a pointer to the start for proper memory cleanup
-    char* szBufferStart = szBufferCopy;
+/**
+ * Check for characters trimmed from the start of CSV names and values
+ * @param c Character
+ * @return true for blanks and quotes
+ */
+bool bIsCSVLeadingTrim(char c) {
+    return c == ' ' || c == '\t' || c == '"';
+}
 
-    // Store column names and their positions
-    char* szColumnNames[MAX_COLUMNS] = { 0 };  // Limit maximum columns
-    int nColumnCount = 0;
+/**
+ * Check for characters trimmed from the end of CSV names and values
+ * @param c Character
+ * @return true for blanks, quotes and carriage returns
+ */
+bool bIsCSVTrailingTrim(char c) {
+    return c == ' ' || c == '\t' || c == '"' || c == '\r';
+}
 
-    // Get the header line
-    char* pHeaderEnd = strchr(szBufferCopy, '\n');
-    if (!pHeaderEnd) {
-        // No newline in data, treat entire buffer as header
-        pHeaderEnd = szBufferCopy + nBufferLen;
+/**
+ * Trim blanks and quotes around a CSV field, the first remaining character is always kept
+ * @param ppStart Start of the field, moved past leading blanks and quotes
+ * @param ppEnd End of the field, moved before trailing blanks, quotes and carriage returns
+ */
+void vTrimCSVField(const char** ppStart, const char** ppEnd) {
+    while (*ppStart < *ppEnd && bIsCSVLeadingTrim(**ppStart)) {
+        (*ppStart)++;
     }
+    while (*ppEnd - *ppStart > 1 && bIsCSVTrailingTrim((*ppEnd)[-1])) {
+        (*ppEnd)--;
+    }
+}
 
-    // Temporarily null-terminate the header
-    char cOriginalChar = *pHeaderEnd;
-    *pHeaderEnd = '\0';
-
-    // Parse header to get column names
-    char* szHeaderToken = szBufferCopy;
-    bool bInQuotes = false;
-    int nTokenStart = 0;
-    int i = 0;
-
-    // More careful CSV parsing that handles quoted fields
-    while (szHeaderToken[i] != '\0' && nColumnCount < MAX_COLUMNS) {
-        if (szHeaderToken[i] == '"') {
-            bInQuotes = !bInQuotes;
+/**
+ * Copy the value of a CSV field, undoing doubled quotes
+ * Values without quotes in them, nearly all of them, are copied as they are.
+ * @param pField Field
+ * @param szBuffer Receives the value, NUL-terminated and cut off if it does not fit
+ * @param nBufSize Size of the buffer, not 0
+ * @param pnCopied Receives the length of the copy, NULL if not needed
+ * @return true if the whole value fit
+ */
+bool bCopyCSVField(const csvFieldT* pField, char* szBuffer, size_t nBufSize, size_t* pnCopied) {
+    const char* pValue = pField->pData;
+    const char* pValueEnd = pValue + pField->nLen;
+    size_t nOut = 0;
+    while (pValue < pValueEnd) {
+        const char* pQuote = (const char*)memchr(pValue, '"', pValueEnd - pValue);
+        const char* pCopyEnd = pQuote ? pQuote + 1 : pValueEnd;
+        size_t nCopy = pCopyEnd - pValue;
+        if (nOut + nCopy >= nBufSize) {
+            memcpy(szBuffer + nOut, pValue, nBufSize - 1 - nOut);
+            szBuffer[nBufSize - 1] = '\0';
+            if (pnCopied) {
+                *pnCopied = nBufSize - 1;
+            }
+            return false;
         }
-        else if (szHeaderToken[i] == ',' && !bInQuotes) {
-            // We found a column delimiter
-            szHeaderToken[i] = '\0';  // Replace comma with null terminator
-
-            // Trim whitespace and quotes
-            char* szTrimmedName = szHeaderToken + nTokenStart;
-            while (*szTrimmedName == ' ' || *szTrimmedName == '\t' || *szTrimmedName == '"')
-                szTrimmedName++;
-
-            char* pEnd = szTrimmedName + strlen(szTrimmedName) - 1;
-            while (pEnd > szTrimmedName &&
-                (*pEnd == ' ' || *pEnd == '\t' || *pEnd == '"' || *pEnd == '\r'))
-                pEnd--;
-
-            *(pEnd + 1) = '\0';
+        memcpy(szBuffer + nOut, pValue, nCopy);
+        nOut += nCopy;
 
-            // Store the column name
-            szColumnNames[nColumnCount] = szTrimmedName;
-            nColumnCount++;
-
-            // Move to next token
-            nTokenStart = i + 1;
+        // Of two quotes in a row only the first is kept
+        pValue = pCopyEnd;
+        if (pQuote && pValue < pValueEnd && *pValue == '"') {
+            pValue++;
         }
-        i++;
     }
-
-    // Handle the last column in header
-    if (nColumnCount < MAX_COLUMNS) {
-        char* szTrimmedName = szHeaderToken + nTokenStart;
-        while (*szTrimmedName == ' ' || *szTrimmedName == '\t' || *szTrimmedName == '"')
-            szTrimmedName++;
-
-        char* pEnd = szTrimmedName + strlen(szTrimmedName) - 1;
-        while (pEnd > szTrimmedName &&
-            (*pEnd == ' ' || *pEnd == '\t' || *pEnd == '"' || *pEnd == '\r'))
-            pEnd--;
-
-        *(pEnd + 1) = '\0';
-
-        // Store the last column name
-        szColumnNames[nColumnCount] = szTrimmedName;
-        nColumnCount++;
+    szBuffer[nOut] = '\0';
+    if (pnCopied) {
+        *pnCopied = nOut;
     }
+    return true;
+}
 
-    // Find our target column index
-    int nTargetCol = -1;
-    for (i = 0; i < nColumnCount; i++) {
-        if (strcmp(szColumnNames[i], szColName) == 0) {
-            nTargetCol = i;
-            break;
+/**
+ * Check whether a CSV line holds nothing but blanks and carriage returns
+ * @param pLine Start of the line
+ * @param pLineEnd End of the line, without its newline
+ * @return true if the line is blank
+ */
+bool bIsBlankCSVLine(const char* pLine, const char* pLineEnd) {
+    for (; pLine < pLineEnd; pLine++) {
+        if (*pLine != ' ' && *pLine != '\t' && *pLine != '\r') {
+            return false;
         }
     }
+    return true;
+}
 
-    // Restore the character we replaced
-    *pHeaderEnd = cOriginalChar;
-
-    // If column name not found
-    if (nTargetCol == -1) {
-        free(szBufferStart);
-        return -3; // Column name not found
+/**
+ * Find the last occurrence of a byte, like memrchr
+ * @param pData Start of the data
+ * @param c Byte to find
+ * @param nSize Size of the data
+ * @return Position of the last occurrence, NULL if there is none
+ */
+const char* pFindLastByte(const char* pData, char c, size_t nSize) {
+    while (nSize > 0) {
+        nSize--;
+        if (pData[nSize] == c) {
+            return pData + nSize;
+        }
     }
+    return NULL;
+}
 
-    // Move to the next line (after the header)
-    szBufferCopy = pHeaderEnd + 1;
-
-    // Skip to specified row
-    int nCurrentRow = 0;
-
-    if (nRow >= 0) {
-        while (nCurrentRow < nRow) {
-            char* pNextLine = strchr(szBufferCopy, '\n');
-            if (!pNextLine) {
-                // No more lines
-                free(szBufferStart);
-                return -5; // Row not found
-            }
-            szBufferCopy = pNextLine + 1;
-            nCurrentRow++;
+/**
+ * Find the last row of CSV data by scanning backwards from its end, blank lines at the end are skipped
+ * Only the last row is looked at, however large the data is.
+ * @param pRows Start of the first row after the header
+ * @param pEnd End of the data
+ * @param ppRowEnd Receives the end of the row, without its newline
+ * @return Start of the last row, NULL if every row is blank
+ */
+const char* pFindLastCSVRow(const char* pRows, const char* pEnd, const char** ppRowEnd) {
+    const char* pLineEnd = pEnd;
+    while (true) {
+        const char* pNewline = pFindLastByte(pRows, '\n', pLineEnd - pRows);
+        const char* pLine = pNewline ? pNewline + 1 : pRows;
+        if (!bIsBlankCSVLine(pLine, pLineEnd)) {
+            *ppRowEnd = pLineEnd;
+            return pLine;
+        }
+        if (!pNewline) {
+            return NULL;
         }
+        pLineEnd = pNewline;
     }
-    else if (nRow == -1) {
-        // Find the last row
-        char* pLastRowStart = szBufferCopy;
+}
 
-        while (true) {
-            char* pNextLine = strchr(szBufferCopy, '\n');
-            if (!pNextLine) {
-                break; // No more lines, we're at the last row
-            }
-            pLastRowStart = szBufferCopy;
-            szBufferCopy = pNextLine + 1;
+/**
+ * Find the end of the CSV field starting at pField a byte at a time, commas inside quotes do not end it
+ * The block tokenizer below finds the same ends, this is the reference the CSV benchmark compares against.
+ * @param pField Start of the field
+ * @param pLineEnd End of the line
+ * @return Position of the delimiting comma, or pLineEnd for the last field
+ */
+const char* pFindCSVFieldEnd(const char* pField, const char* pLineEnd) {
+    bool bInQuotes = false;
+    for (const char* p = pField; p < pLineEnd; p++) {
+        if (*p == '"') {
+            bInQuotes = !bInQuotes;
+        }
+        else if (*p == ',' && !bInQuotes) {
+            return p;
         }
-
-        // Use the last row
-        szBufferCopy = pLastRowStart;
     }
+    return pLineEnd;
+}
 
-    // Now szBufferCopy points to the start of our target row
-    // Get end of the row
-    char* pRowEnd = strchr(szBufferCopy, '\n');
-    if (!pRowEnd) {
-        // This is the last row without a newline
-        pRowEnd = szBufferCopy + strlen(szBufferCopy);
+/**
+ * Index of the lowest set bit
+ * @param ull Value, must not be 0
+ * @return Bit index
+ */
+int nLowestBit(unsigned long long ull) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long ulIndex;
+    _BitScanForward64(&ulIndex, ull);
+    return (int)ulIndex;
+#elif defined(_MSC_VER)
+    unsigned long ulIndex;
+    if (_BitScanForward(&ulIndex, (unsigned long)ull)) {
+        return (int)ulIndex;
     }
+    _BitScanForward(&ulIndex, (unsigned long)(ull >> 32));
+    return (int)ulIndex + 32;
+#else
+    return __builtin_ctzll(ull);
+#endif
+}
 
-    // Temporarily terminate the row
-    cOriginalChar = *pRowEnd;
-    *pRowEnd = '\0';
+/**
+ * Count the set bits
+ * @param ull Value
+ * @return Number of set bits
+ */
+int nCountBits(unsigned long long ull) {
+    // Without -mpopcnt the compiler builtins end up as a library call, this is as fast
+    ull = ull - ((ull >> 1) & 0x5555555555555555ULL);
+    ull = (ull & 0x3333333333333333ULL) + ((ull >> 2) & 0x3333333333333333ULL);
+    ull = (ull + (ull >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((ull * 0x0101010101010101ULL) >> 56);
+}
 
-    // Now parse the row to find the target column
-    bInQuotes = false;
-    int nCurrentCol = 0;
-    i = 0;
-    nTokenStart = 0;
+/**
+ * Find the bytes of a 64-bit word that equal c, 8 at a time in plain integer operations
+ * @param ullWord Eight bytes loaded little endian
+ * @param c Byte to find
+ * @return Bit i set if byte i equals c
+ */
+unsigned long long ullMatchWordBytes(unsigned long long ullWord, char c) {
+    unsigned long long ullX = ullWord ^ (0x0101010101010101ULL * (unsigned char)c);
+    // Top bit of every byte that is zero in ullX, exact unlike the shorter (x - 0x01..) & ~x form
+    unsigned long long ullZero = ~(((ullX & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | ullX | 0x7f7f7f7f7f7f7f7fULL);
+    // Gather the eight top bits into the top byte
+    return ((ullZero >> 7) * 0x0102040810204080ULL) >> 56;
+}
 
-    while (szBufferCopy[i] != '\0' && nCurrentCol <= nTargetCol) {
-        if (szBufferCopy[i] == '"') {
-            bInQuotes = !bInQuotes;
-        }
-        else if (szBufferCopy[i] == ',' && !bInQuotes) {
-            if (nCurrentCol == nTargetCol) {
-                // We found our target column
-                szBufferCopy[i] = '\0';  // Replace comma with null terminator
+/**
+ * Classify a CSV block without vector instructions, runs on any CPU including ARM
+ * @param pBlock CSV_BLOCK_SIZE bytes
+ * @param pMasks Receives the positions of commas, quotes and newlines
+ */
+void vClassifyCSVBlockScalar(const char* pBlock, csvBlockMasksT* pMasks) {
+    pMasks->ullComma = 0;
+    pMasks->ullQuote = 0;
+    pMasks->ullNewline = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 8) {
+        unsigned long long ullWord;
+        memcpy(&ullWord, pBlock + i, sizeof(ullWord));
+        pMasks->ullComma |= ullMatchWordBytes(ullWord, ',') << i;
+        pMasks->ullQuote |= ullMatchWordBytes(ullWord, '"') << i;
+        pMasks->ullNewline |= ullMatchWordBytes(ullWord, '\n') << i;
+    }
+}
 
-                // Extract the value, handling quotes and whitespace
-                char* szValue = szBufferCopy + nTokenStart;
-                while (*szValue == ' ' || *szValue == '\t' || *szValue == '"')
-                    szValue++;
+/**
+ * Scalar kernels run everywhere
+ * @return true
+ */
+bool bCpuHasScalar(void) {
+    return true;
+}
 
-                char* pValueEnd = szValue + strlen(szValue) - 1;
-                while (pValueEnd > szValue &&
-                    (*pValueEnd == ' ' || *pValueEnd == '\t' ||
-                        *pValueEnd == '"' || *pValueEnd == '\r'))
-                    pValueEnd--;
+#ifdef BATTERYCYCLE_X86
+// GCC and Clang only emit vector instructions in functions marked for them, MSVC always does
+#if defined(__GNUC__) || defined(__clang__)
+#define CSV_TARGET(szIsa) __attribute__((target(szIsa)))
+#else
+#define CSV_TARGET(szIsa)
+#endif
 
-                *(pValueEnd + 1) = '\0';
+/**
+ * Check whether the CPU supports SSE2
+ * @return true if it does
+ */
+bool bCpuHasSse2(void) {
+#ifdef _MSC_VER
+    int anRegs[4];
+    __cpuid(anRegs, 1);
+    return (anRegs[3] >> 26) & 1;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
 
-                // Copy to result safely
-                if (strncpy_s(szResult, nBufSize, szValue, _TRUNCATE) != 0) {
-                    free(szBufferStart);
-                    return -6; // String copy failed
-                }
+/**
+ * Check whether the CPU supports AVX2 and the OS saves the YMM registers
+ * @return true if both do
+ */
+bool bCpuHasAvx2(void) {
+#ifdef _MSC_VER
+    int anRegs[4];
+    __cpuid(anRegs, 0);
+    if (anRegs[0] < 7) {
+        return false;
+    }
+    __cpuid(anRegs, 1);
+    if (!((anRegs[2] >> 27) & 1) || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(anRegs, 7, 0);
+    return (anRegs[1] >> 5) & 1;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
 
-                *pRowEnd = cOriginalChar;  // Restore original character
-                free(szBufferStart);
-                return 0; // Success
-            }
+/**
+ * Check whether the CPU supports AVX-512 byte instructions and the OS saves the ZMM registers
+ * @return true if both do
+ */
+bool bCpuHasAvx512(void) {
+#ifdef _MSC_VER
+    int anRegs[4];
+    __cpuid(anRegs, 0);
+    if (anRegs[0] < 7) {
+        return false;
+    }
+    __cpuid(anRegs, 1);
+    if (!((anRegs[2] >> 27) & 1) || (_xgetbv(0) & 0xe6) != 0xe6) {
+        return false;
+    }
+    __cpuidex(anRegs, 7, 0);
+    return ((anRegs[1] >> 16) & 1) && ((anRegs[1] >> 30) & 1);
+#else
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+}
 
-            // Move to next column
-            nCurrentCol++;
-            nTokenStart = i + 1;
-        }
-        i++;
+/**
+ * Classify a CSV block 16 bytes at a time with SSE2
+ * @param pBlock CSV_BLOCK_SIZE bytes
+ * @param pMasks Receives the positions of commas, quotes and newlines
+ */
+CSV_TARGET("sse2")
+void vClassifyCSVBlockSse2(const char* pBlock, csvBlockMasksT* pMasks) {
+    const __m128i xComma = _mm_set1_epi8(',');
+    const __m128i xQuote = _mm_set1_epi8('"');
+    const __m128i xNewline = _mm_set1_epi8('\n');
+    pMasks->ullComma = 0;
+    pMasks->ullQuote = 0;
+    pMasks->ullNewline = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 16) {
+        __m128i xBytes = _mm_loadu_si128((const __m128i*)(pBlock + i));
+        pMasks->ullComma |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(xBytes, xComma)) << i;
+        pMasks->ullQuote |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(xBytes, xQuote)) << i;
+        pMasks->ullNewline |= (unsigned long long)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(xBytes, xNewline)) << i;
     }
+}
 
-    // Check if the last column is our target
-    if (nCurrentCol == nTargetCol) {
-        // Extract the value, handling quotes and whitespace
-        char* szValue = szBufferCopy + nTokenStart;
-        while (*szValue == ' ' || *szValue == '\t' || *szValue == '"')
-            szValue++;
+/**
+ * Classify a CSV block 32 bytes at a time with AVX2
+ * @param pBlock CSV_BLOCK_SIZE bytes
+ * @param pMasks Receives the positions of commas, quotes and newlines
+ */
+CSV_TARGET("avx2")
+void vClassifyCSVBlockAvx2(const char* pBlock, csvBlockMasksT* pMasks) {
+    const __m256i yComma = _mm256_set1_epi8(',');
+    const __m256i yQuote = _mm256_set1_epi8('"');
+    const __m256i yNewline = _mm256_set1_epi8('\n');
+    __m256i yLow = _mm256_loadu_si256((const __m256i*)pBlock);
+    __m256i yHigh = _mm256_loadu_si256((const __m256i*)(pBlock + 32));
+    pMasks->ullComma = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(yLow, yComma)) |
+        (unsigned long long)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(yHigh, yComma)) << 32;
+    pMasks->ullQuote = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(yLow, yQuote)) |
+        (unsigned long long)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(yHigh, yQuote)) << 32;
+    pMasks->ullNewline = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(yLow, yNewline)) |
+        (unsigned long long)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(yHigh, yNewline)) << 32;
+}
 
-        char* pValueEnd = szValue + strlen(szValue) - 1;
-        while (pValueEnd > szValue &&
-            (*pValueEnd == ' ' || *pValueEnd == '\t' ||
-                *pValueEnd == '"' || *pValueEnd == '\r'))
-            pValueEnd--;
+/**
+ * Classify a CSV block in one go with AVX-512
+ * @param pBlock CSV_BLOCK_SIZE bytes
+ * @param pMasks Receives the positions of commas, quotes and newlines
+ */
+CSV_TARGET("avx512f,avx512bw")
+void vClassifyCSVBlockAvx512(const char* pBlock, csvBlockMasksT* pMasks) {
+    __m512i zBytes = _mm512_loadu_si512((const void*)pBlock);
+    pMasks->ullComma = _mm512_cmpeq_epi8_mask(zBytes, _mm512_set1_epi8(','));
+    pMasks->ullQuote = _mm512_cmpeq_epi8_mask(zBytes, _mm512_set1_epi8('"'));
+    pMasks->ullNewline = _mm512_cmpeq_epi8_mask(zBytes, _mm512_set1_epi8('\n'));
+}
+#endif
 
-        *(pValueEnd + 1) = '\0';
+/**
+ * Available CSV kernels, each one faster than the one before it
+ */
+const csvKernelT astCsvKernels[] = {
+    { "scalar", vClassifyCSVBlockScalar, bCpuHasScalar },
+#ifdef BATTERYCYCLE_X86
+    { "sse2", vClassifyCSVBlockSse2, bCpuHasSse2 },
+    { "avx2", vClassifyCSVBlockAvx2, bCpuHasAvx2 },
+    { "avx512", vClassifyCSVBlockAvx512, bCpuHasAvx512 },
+#endif
+};
+#define CSV_KERNEL_COUNT (int)(sizeof(astCsvKernels) / sizeof(astCsvKernels[0]))
 
-        // Copy to result safely
-        if (strncpy_s(szResult, nBufSize, szValue, _TRUNCATE) != 0) {
-            free(szBufferStart);
-            return -6; // String copy failed
+/**
+ * Pick the fastest CSV kernel the CPU supports
+ * @return Kernel
+ */
+const csvKernelT* pSelectCSVKernel(void) {
+    for (int i = CSV_KERNEL_COUNT - 1; i > 0; i--) {
+        if (astCsvKernels[i].pfnSupported()) {
+            return &astCsvKernels[i];
         }
-
-        *pRowEnd = cOriginalChar;  // Restore original character
-        free(szBufferStart);
-        return 0; // Success
     }
+    return &astCsvKernels[0];
+}
 
-    // Restore the character we replaced
-    *pRowEnd = cOriginalChar;
+/**
+ * Get the CSV kernel chosen for this CPU, the choice is made on the first call
+ * @return Kernel
+ */
+const csvKernelT* pGetCSVKernel(void) {
+    static const csvKernelT* pKernel = pSelectCSVKernel();
+    return pKernel;
+}
 
-    // Column not found in row
-    free(szBufferStart);
-    return -4;
+/**
+ * Turn quote positions into the quote state at every byte, simdjson style
+ * @param ullQuotes Quote positions
+ * @return Bit i set if an odd number of quotes is at or before byte i
+ */
+unsigned long long ullPrefixXor(unsigned long long ullQuotes) {
+    ullQuotes ^= ullQuotes << 1;
+    ullQuotes ^= ullQuotes << 2;
+    ullQuotes ^= ullQuotes << 4;
+    ullQuotes ^= ullQuotes << 8;
+    ullQuotes ^= ullQuotes << 16;
+    ullQuotes ^= ullQuotes << 32;
+    return ullQuotes;
 }
 
 /**
- * Extract files from a tar.gz file that match the target directory and pass matcher callback
+ * Start walking the delimiters of CSV data
+ * @param pScanner Scanner to set up
+ * @param pData CSV data, need not be NUL-terminated
+ * @param nSize Size of the data
+ * @param pKernel Kernel to classify the data with, NULL for the one chosen for this CPU
+ */
+void vInitCSVScanner(csvScannerT* pScanner, const char* pData, size_t nSize, const csvKernelT* pKernel) {
+    pScanner->pData = pData;
+    pScanner->nSize = nSize;
+    pScanner->nBlock = 0;
+    pScanner->nNext = 0;
+    pScanner->ullDelimiters = 0;
+    pScanner->bInQuotes = false;
+    pScanner->pKernel = pKernel ? pKernel : pGetCSVKernel();
+}
+
+/**
+ * Classify the next block and find its delimiters, the same ones pFindCSVFieldEnd stops at
+ * Commas inside quotes are not delimiters, newlines always are and end any quote left open.
+ * @param pScanner Scanner, must not be at the end of the data
+ */
+void vScanCSVBlock(csvScannerT* pScanner) {
+    csvBlockMasksT stMasks;
+    size_t nLeft = pScanner->nSize - pScanner->nNext;
+    if (nLeft >= CSV_BLOCK_SIZE) {
+        pScanner->pKernel->pfnClassify(pScanner->pData + pScanner->nNext, &stMasks);
+    }
+    else {
+        // The last block is padded with bytes that match nothing
+        char abBlock[CSV_BLOCK_SIZE];
+        memset(abBlock, 0, sizeof(abBlock));
+        memcpy(abBlock, pScanner->pData + pScanner->nNext, nLeft);
+        pScanner->pKernel->pfnClassify(abBlock, &stMasks);
+    }
+
+    unsigned long long ullInside = ullPrefixXor(stMasks.ullQuote);
+    if (pScanner->bInQuotes) {
+        ullInside = ~ullInside;
+    }
+
+    // Restart outside quotes at every newline, the newline itself included so a block that ends in one
+    // carries no open quote over. Rows are rarely shorter than a block, so this loop runs about once.
+    unsigned long long ullNewlines = stMasks.ullNewline;
+    while (ullNewlines) {
+        unsigned long long ullBit = ullNewlines & (0 - ullNewlines);
+        if (ullInside & ullBit) {
+            ullInside ^= ~(ullBit - 1);
+        }
+        ullNewlines ^= ullBit;
+    }
+
+    pScanner->bInQuotes = (ullInside >> 63) != 0;
+    pScanner->ullDelimiters = (stMasks.ullComma & ~ullInside) | stMasks.ullNewline;
+    pScanner->nBlock = pScanner->nNext;
+    pScanner->nNext += CSV_BLOCK_SIZE;
+}
+
+/**
+ * Find the next comma or newline outside quotes
+ * @param pScanner Scanner
+ * @return Position of the delimiter, the end of the data if there is none left
+ */
+const char* pNextCSVDelimiter(csvScannerT* pScanner) {
+    while (pScanner->ullDelimiters == 0) {
+        if (pScanner->nNext >= pScanner->nSize) {
+            return pScanner->pData + pScanner->nSize;
+        }
+        vScanCSVBlock(pScanner);
+    }
+
+    int nBit = nLowestBit(pScanner->ullDelimiters);
+    pScanner->ullDelimiters &= pScanner->ullDelimiters - 1;
+    return pScanner->pData + pScanner->nBlock + nBit;
+}
+
+/**
+ * Find the end of every field of CSV data, a block of CSV_BLOCK_SIZE bytes at a time
+ * A field ends at the comma or newline after it, so the fields of a row end with the one at a newline.
+ * @param pData CSV data, need not be NUL-terminated
+ * @param nSize Size of the data, below 4 GB
+ * @param pKernel Kernel to classify the data with, NULL for the one chosen for this CPU
+ * @param pvecFieldEnds Receives the offset of the delimiter after each field, and nSize if the last line has no newline
+ * @return 0 on success, -1 if the data is too large
+ */
+int nTokenizeCSV(const char* pData, size_t nSize, const csvKernelT* pKernel, std::vector<unsigned int>* pvecFieldEnds) {
+    pvecFieldEnds->clear();
+    if ((unsigned long long)nSize > 0xffffffffULL) {
+        vLogMessage("Error: CSV data larger than 4 GB\n");
+        return -1;
+    }
+
+    // Offsets are written straight into the vector, which grows ahead of them
+    size_t nCount = 0;
+    csvScannerT stScanner;
+    vInitCSVScanner(&stScanner, pData, nSize, pKernel);
+    while (stScanner.nNext < nSize) {
+        if (nCount + CSV_BLOCK_SIZE + 1 > pvecFieldEnds->size()) {
+            pvecFieldEnds->resize(std::max(pvecFieldEnds->size() * 2, (size_t)CSV_BLOCK_SIZE * 64));
+        }
+        unsigned int* pnEnds = pvecFieldEnds->data() + nCount;
+
+        vScanCSVBlock(&stScanner);
+        unsigned int uBlock = (unsigned int)stScanner.nBlock;
+        unsigned long long ull = stScanner.ullDelimiters;
+        int nFields = nCountBits(ull);
+
+        // Eight offsets are written whether the block has them or not, the ones past nFields are overwritten
+        // later, which saves a hard to predict branch per field. The top bit keeps nLowestBit from seeing 0.
+        for (int i = 0; i < nFields; i += 8) {
+            for (int j = 0; j < 8; j++) {
+                pnEnds[i + j] = uBlock + nLowestBit(ull | 0x8000000000000000ULL);
+                ull &= ull - 1;
+            }
+        }
+        nCount += nFields;
+    }
+
+    if (nSize > 0 && pData[nSize - 1] != '\n') {
+        pvecFieldEnds->resize(nCount + 1);
+        (*pvecFieldEnds)[nCount++] = (unsigned int)nSize;
+    }
+    pvecFieldEnds->resize(nCount);
+    return 0;
+}
+
+/**
+ * Count the days from 1970-01-01 to a date of the proleptic Gregorian calendar
+ * Days past the end of a month run into the next one, like mktime does.
+ * @param nYear Year, 1970 or later
+ * @param nMonth Month, 1 to 12
+ * @param nDay Day of the month, 1 to 31
+ * @return Days since 1970-01-01
+ */
+long long llDaysFromCivil(int nYear, int nMonth, int nDay) {
+    // Years start in March, so the leap day is the last day of a year
+    nYear -= nMonth <= 2;
+    int nEra = nYear / 400;
+    int nYearOfEra = nYear - nEra * 400;
+    int nDayOfYear = (153 * (nMonth + (nMonth > 2 ? -3 : 9)) + 2) / 5 + nDay - 1;
+    int nDayOfEra = nYearOfEra * 365 + nYearOfEra / 4 - nYearOfEra / 100 + nDayOfYear;
+    return (long long)nEra * 146097 + nDayOfEra - 719468;
+}
+
+/**
+ * Parse a CSV timestamp like "2025-05-14 20:15:23"
+ * The time is taken as it is written, without a time zone, so equal times in the log give equal values.
+ * @param pValue Value, need not be NUL-terminated
+ * @param nLen Length of the value
+ * @param pllSeconds Receives the seconds since 1970-01-01 00:00:00
+ * @return true if the value is a valid timestamp
+ */
+bool bParseCSVTimeStamp(const char* pValue, size_t nLen, long long* pllSeconds) {
+    if (nLen != 19 || pValue[4] != '-' || pValue[7] != '-' || (pValue[10] != ' ' && pValue[10] != 'T') ||
+        pValue[13] != ':' || pValue[16] != ':') {
+        return false;
+    }
+
+    // Year, month, day, hour, minute and second
+    static const int anStart[6] = { 0, 5, 8, 11, 14, 17 };
+    int anPart[6];
+    for (int i = 0; i < 6; i++) {
+        int nEnd = i == 0 ? 4 : anStart[i] + 2;
+        anPart[i] = 0;
+        for (int j = anStart[i]; j < nEnd; j++) {
+            if (pValue[j] < '0' || pValue[j] > '9') {
+                return false;
+            }
+            anPart[i] = anPart[i] * 10 + (pValue[j] - '0');
+        }
+    }
+    if (anPart[0] < 1970 || anPart[1] < 1 || anPart[1] > 12 || anPart[2] < 1 || anPart[2] > 31 ||
+        anPart[3] > 23 || anPart[4] > 59 || anPart[5] > 59) {
+        return false;
+    }
+
+    long long llDays = llDaysFromCivil(anPart[0], anPart[1], anPart[2]);
+    *pllSeconds = llDays * 86400 + anPart[3] * 3600 + anPart[4] * 60 + anPart[5];
+    return true;
+}
+
+/**
+ * Format seconds since 1970 the way bParseCSVTimeStamp reads them
+ * @param llSeconds Seconds since 1970-01-01 00:00:00, not negative
+ * @param szBuffer Receives "YYYY-MM-DD HH:MM:SS"
+ * @param nBufSize Size of the buffer
+ */
+void vFormatCSVTimeStamp(long long llSeconds, char* szBuffer, size_t nBufSize) {
+    long long llDays = llSeconds / 86400 + 719468;
+    int nSecondOfDay = (int)(llSeconds % 86400);
+    int nEra = (int)(llDays / 146097);
+    int nDayOfEra = (int)(llDays - (long long)nEra * 146097);
+    int nYearOfEra = (nDayOfEra - nDayOfEra / 1460 + nDayOfEra / 36524 - nDayOfEra / 146096) / 365;
+    int nDayOfYear = nDayOfEra - (365 * nYearOfEra + nYearOfEra / 4 - nYearOfEra / 100);
+    int nMonthIndex = (5 * nDayOfYear + 2) / 153;
+    int nDay = nDayOfYear - (153 * nMonthIndex + 2) / 5 + 1;
+    int nMonth = nMonthIndex < 10 ? nMonthIndex + 3 : nMonthIndex - 9;
+    int nYear = nYearOfEra + nEra * 400 + (nMonth <= 2);
+    snprintf(szBuffer, nBufSize, "%04d-%02d-%02d %02d:%02d:%02d", nYear, nMonth, nDay,
+        nSecondOfDay / 3600, nSecondOfDay / 60 % 60, nSecondOfDay % 60);
+}
+
+/**
+ * Parse a whole CSV value as a decimal integer, accepting what strtoll accepts in base 10
+ * @param pValue Value without blanks around it, need not be NUL-terminated
+ * @param nLen Length of the value
+ * @param pllValue Receives the number
+ * @return true if the value is an integer that fits in a long long
+ */
+bool bParseCSVInteger(const char* pValue, size_t nLen, long long* pllValue) {
+    size_t i = 0;
+    bool bNegative = nLen > 0 && pValue[0] == '-';
+    if (nLen > 0 && (pValue[0] == '-' || pValue[0] == '+')) {
+        i++;
+    }
+    if (i == nLen) {
+        return false;
+    }
+
+    unsigned long long ullLimit = bNegative ? (unsigned long long)LLONG_MAX + 1 : (unsigned long long)LLONG_MAX;
+    unsigned long long ullValue = 0;
+    for (; i < nLen; i++) {
+        unsigned int uDigit = (unsigned char)pValue[i] - '0';
+        if (uDigit > 9 || ullValue > (ullLimit - uDigit) / 10) {
+            return false;
+        }
+        ullValue = ullValue * 10 + uDigit;
+    }
+    *pllValue = bNegative ? -(long long)(ullValue - 1) - 1 : (long long)ullValue;
+    return true;
+}
+
+/**
+ * Parse a whole CSV value as a real number, giving exactly what strtod gives
+ * Decimals of up to 15 digits with a small exponent, which is every number in a BDC log, are converted
+ * with one exact multiplication or division, anything else goes through strtod.
+ * @param pValue Value without blanks around it, need not be NUL-terminated
+ * @param nLen Length of the value
+ * @param pdValue Receives the number
+ * @return true if the value is a number
+ */
+bool bParseCSVReal(const char* pValue, size_t nLen, double* pdValue) {
+    static const double adPowers[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    size_t i = 0;
+    bool bNegative = nLen > 0 && pValue[0] == '-';
+    if (nLen > 0 && (pValue[0] == '-' || pValue[0] == '+')) {
+        i++;
+    }
+
+    // Digits, a fraction and an exponent, the mantissa is kept while it stays exact
+    unsigned long long ullMantissa = 0;
+    int nDigits = 0;
+    int nExponent = 0;
+    bool bHasDigits = false;
+    bool bFraction = false;
+    bool bExact = true;
+    for (; i < nLen; i++) {
+        char c = pValue[i];
+        if (c >= '0' && c <= '9') {
+            bHasDigits = true;
+            if (ullMantissa == 0 && c == '0') {
+                nExponent -= bFraction;
+                continue;
+            }
+            if (++nDigits > 15) {
+                bExact = false;
+                continue;
+            }
+            ullMantissa = ullMantissa * 10 + (c - '0');
+            nExponent -= bFraction;
+        }
+        else if (c == '.' && !bFraction) {
+            bFraction = true;
+        }
+        else {
+            break;
+        }
+    }
+    if (!bHasDigits) {
+        // Hexadecimal, infinity and NaN are left to strtod, anything else without digits is no number
+        bExact = false;
+        if (i == nLen || (pValue[i] != 'i' && pValue[i] != 'I' && pValue[i] != 'n' && pValue[i] != 'N')) {
+            return false;
+        }
+        i = nLen;
+    }
+    else if (i < nLen && (pValue[i] == 'e' || pValue[i] == 'E')) {
+        size_t nStart = ++i;
+        bool bNegativeExponent = i < nLen && pValue[i] == '-';
+        if (i < nLen && (pValue[i] == '-' || pValue[i] == '+')) {
+            nStart = ++i;
+        }
+        int nWritten = 0;
+        for (; i < nLen && pValue[i] >= '0' && pValue[i] <= '9'; i++) {
+            nWritten = nWritten < 10000 ? nWritten * 10 + (pValue[i] - '0') : nWritten;
+        }
+        if (i == nStart) {
+            return false;
+        }
+        nExponent += bNegativeExponent ? -nWritten : nWritten;
+    }
+    else if (i < nLen && (pValue[i] == 'x' || pValue[i] == 'X') && ullMantissa == 0 && !bFraction && i > 0) {
+        bExact = false;
+        i = nLen;
+    }
+    if (i != nLen) {
+        return false;
+    }
+
+    if (bExact && (ullMantissa == 0 || (nExponent >= -22 && nExponent <= 22))) {
+        double dValue = (double)ullMantissa;
+        if (ullMantissa != 0) {
+            dValue = nExponent < 0 ? dValue / adPowers[-nExponent] : dValue * adPowers[nExponent];
+        }
+        *pdValue = bNegative ? -dValue : dValue;
+        return true;
+    }
+
+    std::string strNumber(pValue, nLen);
+    char* szEnd = NULL;
+    double dValue = strtod(strNumber.c_str(), &szEnd);
+    if (szEnd != strNumber.c_str() + nLen) {
+        return false;
+    }
+    *pdValue = dValue;
+    return true;
+}
+
+// Column maps of the CSV headers seen by any thread of the process
+csvSchemaCacheT g_stSchemaCache;
+
+/**
+ * Hash a CSV column name, FNV-1a
+ * @param pName Name, need not be NUL-terminated
+ * @param nLen Length of the name
+ * @return Hash
+ */
+unsigned int uHashCSVName(const char* pName, size_t nLen) {
+    unsigned int uHash = 2166136261u;
+    for (size_t i = 0; i < nLen; i++) {
+        uHash = (uHash ^ (unsigned char)pName[i]) * 16777619u;
+    }
+    return uHash;
+}
+
+/**
+ * Look up a column in a CSV schema
+ * @param pSchema Schema
+ * @param pName Column name, need not be NUL-terminated
+ * @param nLen Length of the name
+ * @return Field of the first column with that name, -1 if there is none
+ */
+int nFindCSVSchemaColumn(const csvSchemaT* pSchema, const char* pName, size_t nLen) {
+    size_t nMask = pSchema->vecSlots.size() - 1;
+    for (size_t nSlot = uHashCSVName(pName, nLen) & nMask; pSchema->vecSlots[nSlot] >= 0; nSlot = (nSlot + 1) & nMask) {
+        const std::string& strName = pSchema->vecNames[pSchema->vecSlots[nSlot]];
+        if (strName.size() == nLen && memcmp(strName.data(), pName, nLen) == 0) {
+            return pSchema->vecSlots[nSlot];
+        }
+    }
+    return -1;
+}
+
+/**
+ * Tokenize a CSV header into a schema, up to MAX_COLUMNS fields
+ * @param pSchema Receives the names and the hash table
+ * @param pHeader Header line without its newline
+ * @param nLen Length of the line
+ * @param ulFingerprint CRC32 of the line
+ */
+void vBuildCSVSchema(csvSchemaT* pSchema, const char* pHeader, size_t nLen, unsigned long ulFingerprint) {
+    pSchema->strHeader.assign(pHeader, nLen);
+    pSchema->ulFingerprint = ulFingerprint;
+    pSchema->vecNames.clear();
+
+    csvScannerT stScanner;
+    vInitCSVScanner(&stScanner, pHeader, nLen, NULL);
+    const char* pHeaderEnd = pHeader + nLen;
+    const char* pField = pHeader;
+    for (int nField = 0; nField < MAX_COLUMNS; nField++) {
+        const char* pFieldEnd = pNextCSVDelimiter(&stScanner);
+        const char* pName = pField;
+        const char* pNameEnd = pFieldEnd;
+        vTrimCSVField(&pName, &pNameEnd);
+        pSchema->vecNames.push_back(std::string(pName, pNameEnd - pName));
+
+        if (pFieldEnd == pHeaderEnd) {
+            break;
+        }
+        pField = pFieldEnd + 1;
+    }
+
+    // At most half full, a name used twice keeps its first field
+    size_t nSlots = 16;
+    while (nSlots < pSchema->vecNames.size() * 2) {
+        nSlots *= 2;
+    }
+    pSchema->vecSlots.assign(nSlots, -1);
+    for (size_t i = 0; i < pSchema->vecNames.size(); i++) {
+        const std::string& strName = pSchema->vecNames[i];
+        size_t nSlot = uHashCSVName(strName.data(), strName.size()) & (nSlots - 1);
+        while (pSchema->vecSlots[nSlot] >= 0 && pSchema->vecNames[pSchema->vecSlots[nSlot]] != strName) {
+            nSlot = (nSlot + 1) & (nSlots - 1);
+        }
+        if (pSchema->vecSlots[nSlot] < 0) {
+            pSchema->vecSlots[nSlot] = (int)i;
+        }
+    }
+}
+
+/**
+ * Get the schema of a CSV header, from the schema cache if any thread has seen the header before
+ * BDC files of one iOS version share their header, so it is tokenized once per process instead of once per file.
+ * @param pHeader Header line without its newline
+ * @param nLen Length of the line
+ * @param pLocal Receives the schema if the cache is full or the header too long to keep
+ * @return Schema, valid as long as pLocal
+ */
+const csvSchemaT* pGetCSVSchema(const char* pHeader, size_t nLen, csvSchemaT* pLocal) {
+    unsigned long ulFingerprint = crc32(0L, (const Bytef*)pHeader, (uInt)nLen);
+    if (nLen >= CSV_TAIL_LINE_SIZE) {
+        vBuildCSVSchema(pLocal, pHeader, nLen, ulFingerprint);
+        return pLocal;
+    }
+
+    // The fingerprint picks the slot, the header itself tells collisions apart
+    csvSchemaCacheT* pCache = &g_stSchemaCache;
+    const int nSlots = SCHEMA_CACHE_SIZE * 2;
+    {
+        std::lock_guard<std::mutex> lock(pCache->mtxSchemas);
+        for (int nSlot = ulFingerprint % nSlots; pCache->apSlots[nSlot]; nSlot = (nSlot + 1) % nSlots) {
+            const csvSchemaT* pSchema = pCache->apSlots[nSlot];
+            if (pSchema->ulFingerprint == ulFingerprint && pSchema->strHeader.size() == nLen &&
+                memcmp(pSchema->strHeader.data(), pHeader, nLen) == 0) {
+                return pSchema;
+            }
+        }
+    }
+
+    // Tokenized outside the lock, another thread may add the same header meanwhile and win
+    csvSchemaT* pSchema = new csvSchemaT();
+    vBuildCSVSchema(pSchema, pHeader, nLen, ulFingerprint);
+    std::lock_guard<std::mutex> lock(pCache->mtxSchemas);
+    int nSlot = ulFingerprint % nSlots;
+    for (; pCache->apSlots[nSlot]; nSlot = (nSlot + 1) % nSlots) {
+        const csvSchemaT* pOther = pCache->apSlots[nSlot];
+        if (pOther->ulFingerprint == ulFingerprint && pOther->strHeader == pSchema->strHeader) {
+            delete pSchema;
+            return pOther;
+        }
+    }
+    if (pCache->nSchemas >= SCHEMA_CACHE_SIZE) {
+        *pLocal = *pSchema;
+        delete pSchema;
+        return pLocal;
+    }
+    pCache->apSlots[nSlot] = pSchema;
+    pCache->nSchemas++;
+    return pSchema;
+}
+
+/**
+ * Get the values of several columns of one CSV row in a single pass
+ * The header is looked up in the schema cache, the row is tokenized once a block at a time and only the
+ * requested columns are copied, typed requests are parsed straight from the row instead. Nothing is allocated
+ * once the header is in the schema cache, CSV_VALUE_FIELD requests only get where their value is.
+ * The last row is found from the end of the data, trailing blank lines do not count as rows
+ * and neither does a missing newline at the end matter.
+ * @param pCsvData Pointer to CSV data in memory, not modified or copied, need not be NUL-terminated
+ * @param nCsvLen Size of the CSV data
+ * @param nRow Row number (0 for first row after header, -1 for last row)
+ * @param pColumns Requested columns, each receives its value and status
+ * @param nColumns Number of requested columns, at most MAX_COLUMNS
+ * @return 0 if every column was found, otherwise the status of the first column that was not
+ */
+int nGetCSVDataByColNames(const char* pCsvData, size_t nCsvLen, int nRow, csvColumnRequestT* pColumns, int nColumns) {
+    if (pCsvData == NULL || pColumns == NULL || nColumns <= 0 || nColumns > MAX_COLUMNS) {
+        return -1; // Invalid parameters
+    }
+
+    // Columns start out empty and unresolved
+    int anFieldIndex[MAX_COLUMNS];
+    int nMaxField = -1;
+    for (int i = 0; i < nColumns; i++) {
+        if (pColumns[i].szColName == NULL ||
+            (pColumns[i].nType == CSV_VALUE_TEXT && (pColumns[i].szResult == NULL || pColumns[i].nBufSize == 0))) {
+            return -1; // Invalid parameters
+        }
+        if (pColumns[i].szResult && pColumns[i].nBufSize > 0) {
+            pColumns[i].szResult[0] = '\0';
+        }
+        pColumns[i].stField.pData = NULL;
+        pColumns[i].stField.nLen = 0;
+        pColumns[i].nStatus = -3; // Column name not found
+    }
+
+    const char* pEnd = pCsvData + nCsvLen;
+    const char* pHeaderEnd = (const char*)memchr(pCsvData, '\n', nCsvLen);
+    if (!pHeaderEnd) {
+        // No newline in data, treat entire buffer as header
+        pHeaderEnd = pEnd;
+    }
+
+    // Resolve every requested column with one lookup in the schema of the header
+    csvSchemaT stLocalSchema;
+    const csvSchemaT* pSchema = pGetCSVSchema(pCsvData, pHeaderEnd - pCsvData, &stLocalSchema);
+    for (int i = 0; i < nColumns; i++) {
+        int nField = nFindCSVSchemaColumn(pSchema, pColumns[i].szColName, strlen(pColumns[i].szColName));
+        if (nField >= 0) {
+            pColumns[i].nStatus = -4; // Column not found in row, until it is
+            anFieldIndex[i] = nField;
+            nMaxField = nField > nMaxField ? nField : nMaxField;
+        }
+    }
+
+    // Locate the row after the header
+    const char* pRow = pHeaderEnd < pEnd ? pHeaderEnd + 1 : pEnd;
+    const char* pRowEnd = NULL;
+    if (nMaxField >= 0 && nRow >= 0) {
+        for (int nCurrentRow = 0; nCurrentRow < nRow && pRow; nCurrentRow++) {
+            const char* pNextLine = (const char*)memchr(pRow, '\n', pEnd - pRow);
+            pRow = pNextLine ? pNextLine + 1 : NULL;
+        }
+    }
+    else if (nMaxField >= 0 && nRow == -1) {
+        pRow = pFindLastCSVRow(pRow, pEnd, &pRowEnd);
+    }
+    if (nMaxField >= 0 && !pRow) {
+        // No more lines
+        for (int i = 0; i < nColumns; i++) {
+            if (pColumns[i].nStatus == -4) {
+                pColumns[i].nStatus = -5; // Row not found
+            }
+        }
+        nMaxField = -1;
+    }
+
+    // Walk the fields of the row up to the last requested one and copy the requested values
+    if (nMaxField >= 0) {
+        if (!pRowEnd) {
+            pRowEnd = (const char*)memchr(pRow, '\n', pEnd - pRow);
+            pRowEnd = pRowEnd ? pRowEnd : pEnd;
+        }
+
+        csvScannerT stScanner;
+        vInitCSVScanner(&stScanner, pRow, pRowEnd - pRow, NULL);
+        const char* pField = pRow;
+        for (int nField = 0; nField <= nMaxField; nField++) {
+            const char* pFieldEnd = pNextCSVDelimiter(&stScanner);
+            const char* pValue = pField;
+            const char* pValueEnd = pFieldEnd;
+            vTrimCSVField(&pValue, &pValueEnd);
+
+            for (int i = 0; i < nColumns; i++) {
+                if (pColumns[i].nStatus != -4 || anFieldIndex[i] != nField) {
+                    continue;
+                }
+
+                // Typed values are parsed straight from the row
+                size_t nLen = pValueEnd - pValue;
+                pColumns[i].stField.pData = pValue;
+                pColumns[i].stField.nLen = nLen;
+                bool bParsed = true;
+                switch (pColumns[i].nType) {
+                case CSV_VALUE_INTEGER:
+                    bParsed = bParseCSVInteger(pValue, nLen, &pColumns[i].llValue);
+                    break;
+                case CSV_VALUE_REAL:
+                    bParsed = bParseCSVReal(pValue, nLen, &pColumns[i].dValue);
+                    break;
+                case CSV_VALUE_TIMESTAMP:
+                    bParsed = bParseCSVTimeStamp(pValue, nLen, &pColumns[i].llValue);
+                    break;
+                case CSV_VALUE_FIELD:
+                    break;
+                default:
+                    // Values that do not fit are cut off and reported, like strncpy_s does
+                    pColumns[i].nStatus = bCopyCSVField(&pColumns[i].stField, pColumns[i].szResult,
+                        pColumns[i].nBufSize, NULL) ? 0 : -6; // String copy failed
+                    continue;
+                }
+                pColumns[i].nStatus = bParsed ? 0 : -7; // Value is not of the requested type
+            }
+
+            if (pFieldEnd == pRowEnd) {
+                break;
+            }
+            pField = pFieldEnd + 1;
+        }
+    }
+
+    for (int i = 0; i < nColumns; i++) {
+        if (pColumns[i].nStatus != 0) {
+            return pColumns[i].nStatus;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Get data from specified row and column name in a CSV buffer
+ * @param szCsvBuffer Pointer to CSV data in memory
+ * @param nRow Row number (0 for first row after header, -1 for last row)
+ * @param szColName Name of the column to retrieve data from
+ * @param szResult Buffer to store the result
+ * @param nBufSize Size of the result buffer
+ * @return 0 for success, negative number for failure
+ */
+int nGetCSVDataByColName(const char* szCsvBuffer, int nRow, const char* szColName,
+    char* szResult, size_t nBufSize) {
+    if (szCsvBuffer == NULL || szColName == NULL || szResult == NULL || nBufSize <= 0) {
+        return -1; // Invalid parameters
+    }
+
+    csvColumnRequestT stColumn = { szColName, szResult, nBufSize, 0, CSV_VALUE_TEXT, 0, 0, { NULL, 0 } };
+    return nGetCSVDataByColNames(szCsvBuffer, strlen(szCsvBuffer), nRow, &stColumn, 1);
+}
+
+/**
+ * Read callback for the zlib gzFile reader
+ * @param pReader Reader instance
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes to read
+ * @return Number of bytes read, -1 on error
+ */
+long long llGzReaderRead(archiveReaderT* pReader, void* pBuffer, size_t nSize) {
+    gzFile gzTarFile = (gzFile)pReader->pContext;
+    size_t nDone = 0;
+
+    // gzread takes an unsigned int length, split very large requests
+    while (nDone < nSize) {
+        size_t nToRead = nSize - nDone;
+        if (nToRead > 0x40000000) {
+            nToRead = 0x40000000;
+        }
+
+        int nRead = gzread(gzTarFile, (char*)pBuffer + nDone, (unsigned int)nToRead);
+        if (nRead < 0) {
+            return -1;
+        }
+
+        nDone += nRead;
+        if ((size_t)nRead < nToRead) {
+            break; // End of stream
+        }
+    }
+
+    return (long long)nDone;
+}
+
+/**
+ * Skip callback for the zlib gzFile reader
+ * @param pReader Reader instance
+ * @param ullSize Number of bytes to skip
+ * @return 0 on success, -1 on error
+ */
+int nGzReaderSkip(archiveReaderT* pReader, unsigned long long ullSize) {
+    return gzseek((gzFile)pReader->pContext, (z_off_t)ullSize, SEEK_CUR) < 0 ? -1 : 0;
+}
+
+/**
+ * Close callback for the zlib gzFile reader
+ * @param pReader Reader instance
+ */
+void vGzReaderClose(archiveReaderT* pReader) {
+    gzclose((gzFile)pReader->pContext);
+    free(pReader);
+}
+
+/**
+ * Open a tar.gz file with zlib's single threaded gzFile API
  * @param szTargzPath Path to the tar.gz file
- * @param szTargetDir Target directory to extract from
- * @param pfnMatcher Callback function for file matching
- * @param pUserData User data for callback
+ * @return Reader instance, NULL on error
+ */
+archiveReaderT* pOpenGzReader(const char* szTargzPath) {
+    gzFile gzTarFile = gzopen(szTargzPath, "rb");
+    if (!gzTarFile) {
+        vLogMessage("Error: Cannot open %s\n", szTargzPath);
+        return NULL;
+    }
+
+    // The default 8 KB input buffer costs a read call per few tar blocks
+    gzbuffer(gzTarFile, INPUT_BUFFER_SIZE);
+
+    archiveReaderT* pReader = (archiveReaderT*)calloc(1, sizeof(archiveReaderT));
+    if (!pReader) {
+        vLogMessage("Error: Memory allocation failed\n");
+        gzclose(gzTarFile);
+        return NULL;
+    }
+
+    pReader->pfnRead = llGzReaderRead;
+    pReader->pfnSkip = nGzReaderSkip;
+    pReader->pfnClose = vGzReaderClose;
+    pReader->pContext = gzTarFile;
+    return pReader;
+}
+
+/**
+ * Read a whole file into memory
+ * @param szPath Path to the file
+ * @param pnSize Receives the file size
+ * @return Buffer owned by the caller with a NUL byte behind the data, NULL on error
+ */
+unsigned char* pLoadFile(const char* szPath, size_t* pnSize) {
+    FILE* fp = fopen(szPath, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    unsigned char* pData = NULL;
+    long long llSize = -1;
+    if (_fseeki64(fp, 0, SEEK_END) == 0) {
+        llSize = _ftelli64(fp);
+    }
+
+    if (llSize >= 0 && _fseeki64(fp, 0, SEEK_SET) == 0) {
+        pData = (unsigned char*)malloc((size_t)llSize + 1);
+        if (pData && fread(pData, 1, (size_t)llSize, fp) != (size_t)llSize) {
+            free(pData);
+            pData = NULL;
+        }
+        else if (pData) {
+            pData[llSize] = '\0';
+        }
+    }
+
+    fclose(fp);
+    if (pData) {
+        *pnSize = (size_t)llSize;
+    }
+    return pData;
+}
+
+/**
+ * Map the whole file behind an open handle into memory read-only
+ * @param hFile File handle, stays open and owned by the caller if the file cannot be mapped
+ * @param pnSize Receives the file size
+ * @param phMapping Receives the mapping handle
+ * @return View of the file, release it with vUnmapFile; NULL if the file is empty or cannot be mapped
+ */
+unsigned char* pMapFileHandle(HANDLE hFile, size_t* pnSize, HANDLE* phMapping) {
+    // Empty files cannot be mapped, and a 32-bit address space may not fit the whole file
+    LARGE_INTEGER liSize;
+    HANDLE hMapping = NULL;
+    unsigned char* pView = NULL;
+    if (GetFileSizeEx(hFile, &liSize) && liSize.QuadPart > 0 && (unsigned long long)liSize.QuadPart <= (size_t)-1) {
+        hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping) {
+            pView = (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+    if (!pView) {
+        if (hMapping) {
+            CloseHandle(hMapping);
+        }
+        return NULL;
+    }
+
+    *pnSize = (size_t)liSize.QuadPart;
+    *phMapping = hMapping;
+    return pView;
+}
+
+/**
+ * Map a whole file into memory read-only, its pages are read when they are first touched
+ * @param szPath Path to the file
+ * @param pnSize Receives the file size
+ * @param phFile Receives the file handle
+ * @param phMapping Receives the mapping handle
+ * @return View of the file, release it with vUnmapFile; NULL if the file is empty or cannot be mapped
+ */
+unsigned char* pMapFile(const char* szPath, size_t* pnSize, HANDLE* phFile, HANDLE* phMapping) {
+    HANDLE hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    unsigned char* pView = pMapFileHandle(hFile, pnSize, phMapping);
+    if (!pView) {
+        CloseHandle(hFile);
+        return NULL;
+    }
+    *phFile = hFile;
+    return pView;
+}
+
+/**
+ * Release a view from pMapFile
+ * @param pView View of the file
+ * @param hFile File handle
+ * @param hMapping Mapping handle
+ */
+void vUnmapFile(unsigned char* pView, HANDLE hFile, HANDLE hMapping) {
+    UnmapViewOfFile(pView);
+    CloseHandle(hMapping);
+    CloseHandle(hFile);
+}
+
+/**
+ * Resolve the memory budget for whole-buffer decompression
+ * @param pOptions Extraction options, NULL for defaults
+ * @return Budget in bytes
+ */
+unsigned long long ullResolveMemoryBudget(const extractOptionsT* pOptions) {
+    return pOptions && pOptions->ullMemoryBudget ? pOptions->ullMemoryBudget : DEFAULT_MEMORY_BUDGET;
+}
+
+/**
+ * Get the offset of the deflate data behind a gzip member header
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param pnDeflateStart Receives the offset of the first deflate block
+ * @return 1 if a valid gzip header was found, 0 otherwise
+ */
+int bParseGzipHeader(const unsigned char* pData, size_t nSize, size_t* pnDeflateStart) {
+    if (nSize < 18 || pData[0] != 0x1f || pData[1] != 0x8b || pData[2] != 8) {
+        return 0;
+    }
+
+    unsigned char bFlags = pData[3];
+    size_t nPos = 10;
+
+    if (bFlags & 4) { // FEXTRA
+        if (nPos + 2 > nSize) return 0;
+        nPos += 2 + (pData[nPos] | (pData[nPos + 1] << 8));
+    }
+    if (bFlags & 8) { // FNAME
+        while (nPos < nSize && pData[nPos] != 0) nPos++;
+        nPos++;
+    }
+    if (bFlags & 16) { // FCOMMENT
+        while (nPos < nSize && pData[nPos] != 0) nPos++;
+        nPos++;
+    }
+    if (bFlags & 2) { // FHCRC
+        nPos += 2;
+    }
+
+    if (nPos >= nSize) {
+        return 0;
+    }
+
+    *pnDeflateStart = nPos;
+    return 1;
+}
+
+/**
+ * Read the identification of an archive that an index is bound to
+ * @param szTargzPath Path to the tar.gz file
+ * @param pullSize Receives the archive size
+ * @param abTrailer Receives the last 8 bytes of the archive
+ * @return 1 on success, 0 on error
+ */
+int bReadArchiveIdentity(const char* szTargzPath, unsigned long long* pullSize, unsigned char abTrailer[8]) {
+    FILE* fp = fopen(szTargzPath, "rb");
+    if (!fp) {
+        return 0;
+    }
+
+    int bResult = 0;
+    long long llSize = -1;
+    if (_fseeki64(fp, 0, SEEK_END) == 0) {
+        llSize = _ftelli64(fp);
+    }
+
+    if (llSize >= 8 && _fseeki64(fp, llSize - 8, SEEK_SET) == 0 && fread(abTrailer, 1, 8, fp) == 8) {
+        *pullSize = (unsigned long long)llSize;
+        bResult = 1;
+    }
+
+    fclose(fp);
+    return bResult;
+}
+
+/**
+ * Create an empty index for an archive
+ * @param szTargzPath Path to the tar.gz file
+ * @return Index owned by the caller, NULL on error
+ */
+archiveIndexT* pCreateArchiveIndex(const char* szTargzPath) {
+    archiveIndexT* pIndex = (archiveIndexT*)calloc(1, sizeof(archiveIndexT));
+    if (!pIndex) {
+        return NULL;
+    }
+
+    if (!bReadArchiveIdentity(szTargzPath, &pIndex->ullArchiveSize, pIndex->abTrailer)) {
+        free(pIndex);
+        return NULL;
+    }
+
+    return pIndex;
+}
+
+/**
+ * Release an archive index
+ * @param pIndex Index to release
+ */
+void vFreeArchiveIndex(archiveIndexT* pIndex) {
+    if (!pIndex) {
+        return;
+    }
+
+    for (int i = 0; i < pIndex->nCheckpoints; i++) {
+        free(pIndex->pCheckpoints[i].pWindow);
+    }
+    free(pIndex->pCheckpoints);
+    free(pIndex->pMembers);
+    free(pIndex);
+}
+
+/**
+ * Append a checkpoint to an index
+ * @param pIndex Index to extend
+ * @param ullBit Bit offset of the deflate block in the archive
+ * @param ullOut Uncompressed offset of the block
+ * @param pWindow Uncompressed data preceding the block
+ * @param uWindowSize Size of the window, at most 32 KB
+ * @return 0 on success, -1 on error
+ */
+int nAddIndexCheckpoint(archiveIndexT* pIndex, unsigned long long ullBit, unsigned long long ullOut,
+    const unsigned char* pWindow, unsigned int uWindowSize) {
+    if (pIndex->nCheckpoints == pIndex->nCheckpointCapacity) {
+        int nCapacity = pIndex->nCheckpointCapacity ? pIndex->nCheckpointCapacity * 2 : 64;
+        indexCheckpointT* pCheckpoints = (indexCheckpointT*)realloc(pIndex->pCheckpoints,
+            nCapacity * sizeof(indexCheckpointT));
+        if (!pCheckpoints) {
+            return -1;
+        }
+        pIndex->pCheckpoints = pCheckpoints;
+        pIndex->nCheckpointCapacity = nCapacity;
+    }
+
+    // Windows are stored compressed, text windows shrink to a fraction
+    uLongf ulPacked = compressBound(uWindowSize);
+    unsigned char* pPacked = (unsigned char*)malloc(ulPacked);
+    if (!pPacked || compress2(pPacked, &ulPacked, pWindow, uWindowSize, Z_BEST_SPEED) != Z_OK) {
+        free(pPacked);
+        return -1;
+    }
+
+    indexCheckpointT* pCheckpoint = &pIndex->pCheckpoints[pIndex->nCheckpoints++];
+    pCheckpoint->ullBit = ullBit;
+    pCheckpoint->ullOut = ullOut;
+    pCheckpoint->uWindowSize = uWindowSize;
+    pCheckpoint->uPackedSize = (unsigned int)ulPacked;
+    pCheckpoint->pWindow = pPacked;
+    return 0;
+}
+
+/**
+ * Append a tar member to an index
+ * @param pIndex Index to extend
+ * @param pHeader Tar header of the member
+ * @param ullOffset Uncompressed offset of the member data
+ * @return 0 on success, -1 on error
+ */
+int nAddIndexMember(archiveIndexT* pIndex, const tarHeaderT* pHeader, unsigned long long ullOffset) {
+    if (pIndex->nMembers == pIndex->nMemberCapacity) {
+        int nCapacity = pIndex->nMemberCapacity ? pIndex->nMemberCapacity * 2 : 1024;
+        indexMemberT* pMembers = (indexMemberT*)realloc(pIndex->pMembers, nCapacity * sizeof(indexMemberT));
+        if (!pMembers) {
+            return -1;
+        }
+        pIndex->pMembers = pMembers;
+        pIndex->nMemberCapacity = nCapacity;
+    }
+
+    indexMemberT* pMember = &pIndex->pMembers[pIndex->nMembers++];
+    size_t nNameLen = strnlen(pHeader->szName, sizeof(pHeader->szName));
+    memcpy(pMember->szName, pHeader->szName, nNameLen);
+    pMember->szName[nNameLen] = '\0';
+    pMember->cTypeflag = pHeader->cTypeflag;
+    pMember->ullOffset = ullOffset;
+    pMember->ullSize = ulParseOctal(pHeader->szSize, sizeof(pHeader->szSize));
+    return 0;
+}
+
+/**
+ * Build the index file path for an archive
+ * @param szTargzPath Path to the tar.gz file
+ * @param szIndexDir Index directory, NULL for next to the archive
+ * @param szIndexPath Buffer receiving the index path
+ * @param nBufSize Size of the buffer
+ * @return 1 on success, 0 if the path does not fit
+ */
+int bGetIndexPath(const char* szTargzPath, const char* szIndexDir, char* szIndexPath, size_t nBufSize) {
+    int nLen;
+
+    if (szIndexDir) {
+        const char* szBaseName = szTargzPath;
+        for (const char* p = szTargzPath; *p; p++) {
+            if (*p == '/' || *p == '\\') {
+                szBaseName = p + 1;
+            }
+        }
+        nLen = snprintf(szIndexPath, nBufSize, "%s/%s%s", szIndexDir, szBaseName, INDEX_EXTENSION);
+    }
+    else {
+        nLen = snprintf(szIndexPath, nBufSize, "%s%s", szTargzPath, INDEX_EXTENSION);
+    }
+
+    return nLen > 0 && (size_t)nLen < nBufSize;
+}
+
+/**
+ * Write an index to disk, replacing an older one
+ * @param pIndex Index to write
+ * @param szIndexPath Index file path
+ * @return 0 on success, -1 on error
+ */
+int nSaveArchiveIndex(const archiveIndexT* pIndex, const char* szIndexPath) {
+    char szTempPath[MAX_PATH_LENGTH * 2];
+    if (snprintf(szTempPath, sizeof(szTempPath), "%s.tmp", szIndexPath) >= (int)sizeof(szTempPath)) {
+        return -1;
+    }
+
+    FILE* fp = fopen(szTempPath, "wb");
+    if (!fp) {
+        vLogMessage("Warning: Cannot write index %s\n", szTempPath);
+        return -1;
+    }
+
+    // The index is a local cache, records are written in native layout
+    int bOk = fwrite(INDEX_MAGIC, 1, 8, fp) == 8 &&
+        fwrite(&pIndex->ullArchiveSize, sizeof(pIndex->ullArchiveSize), 1, fp) == 1 &&
+        fwrite(pIndex->abTrailer, 1, 8, fp) == 8 &&
+        fwrite(&pIndex->nCheckpoints, sizeof(pIndex->nCheckpoints), 1, fp) == 1 &&
+        fwrite(&pIndex->nMembers, sizeof(pIndex->nMembers), 1, fp) == 1;
+
+    for (int i = 0; bOk && i < pIndex->nCheckpoints; i++) {
+        const indexCheckpointT* pCheckpoint = &pIndex->pCheckpoints[i];
+        bOk = fwrite(&pCheckpoint->ullBit, sizeof(pCheckpoint->ullBit), 1, fp) == 1 &&
+            fwrite(&pCheckpoint->ullOut, sizeof(pCheckpoint->ullOut), 1, fp) == 1 &&
+            fwrite(&pCheckpoint->uWindowSize, sizeof(pCheckpoint->uWindowSize), 1, fp) == 1 &&
+            fwrite(&pCheckpoint->uPackedSize, sizeof(pCheckpoint->uPackedSize), 1, fp) == 1 &&
+            fwrite(pCheckpoint->pWindow, 1, pCheckpoint->uPackedSize, fp) == pCheckpoint->uPackedSize;
+    }
+
+    for (int i = 0; bOk && i < pIndex->nMembers; i++) {
+        const indexMemberT* pMember = &pIndex->pMembers[i];
+        unsigned char bNameLen = (unsigned char)strlen(pMember->szName);
+        bOk = fwrite(&pMember->ullOffset, sizeof(pMember->ullOffset), 1, fp) == 1 &&
+            fwrite(&pMember->ullSize, sizeof(pMember->ullSize), 1, fp) == 1 &&
+            fwrite(&pMember->cTypeflag, 1, 1, fp) == 1 &&
+            fwrite(&bNameLen, 1, 1, fp) == 1 &&
+            fwrite(pMember->szName, 1, bNameLen, fp) == bNameLen;
+    }
+
+    if (fclose(fp) != 0) {
+        bOk = 0;
+    }
+
+    if (!bOk) {
+        vLogMessage("Warning: Failed to write index %s\n", szTempPath);
+        remove(szTempPath);
+        return -1;
+    }
+
+    remove(szIndexPath);
+    if (rename(szTempPath, szIndexPath) != 0) {
+        remove(szTempPath);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Load the index of an archive, if one exists and still matches the archive
+ * @param szIndexPath Index file path
+ * @param szTargzPath Path to the tar.gz file the index must belong to
+ * @return Index owned by the caller, NULL if missing, stale or corrupt
+ */
+archiveIndexT* pLoadArchiveIndex(const char* szIndexPath, const char* szTargzPath) {
+    FILE* fp = fopen(szIndexPath, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    archiveIndexT* pIndex = (archiveIndexT*)calloc(1, sizeof(archiveIndexT));
+    unsigned long long ullArchiveSize = 0;
+    unsigned char abTrailer[8];
+    char szMagic[8];
+    int nCheckpoints = 0, nMembers = 0;
+
+    int bOk = pIndex != NULL &&
+        bReadArchiveIdentity(szTargzPath, &ullArchiveSize, abTrailer) &&
+        fread(szMagic, 1, 8, fp) == 8 && memcmp(szMagic, INDEX_MAGIC, 8) == 0 &&
+        fread(&pIndex->ullArchiveSize, sizeof(pIndex->ullArchiveSize), 1, fp) == 1 &&
+        fread(pIndex->abTrailer, 1, 8, fp) == 8 &&
+        fread(&nCheckpoints, sizeof(nCheckpoints), 1, fp) == 1 &&
+        fread(&nMembers, sizeof(nMembers), 1, fp) == 1 &&
+        nCheckpoints > 0 && nMembers >= 0;
+
+    // An index of a different or modified archive is useless
+    if (bOk && (pIndex->ullArchiveSize != ullArchiveSize || memcmp(pIndex->abTrailer, abTrailer, 8) != 0)) {
+        bOk = 0;
+    }
+
+    if (bOk) {
+        pIndex->pCheckpoints = (indexCheckpointT*)calloc(nCheckpoints, sizeof(indexCheckpointT));
+        pIndex->pMembers = (indexMemberT*)calloc(nMembers > 0 ? nMembers : 1, sizeof(indexMemberT));
+        pIndex->nCheckpointCapacity = nCheckpoints;
+        pIndex->nMemberCapacity = nMembers;
+        bOk = pIndex->pCheckpoints && pIndex->pMembers;
+    }
+
+    for (int i = 0; bOk && i < nCheckpoints; i++) {
+        indexCheckpointT* pCheckpoint = &pIndex->pCheckpoints[i];
+        bOk = fread(&pCheckpoint->ullBit, sizeof(pCheckpoint->ullBit), 1, fp) == 1 &&
+            fread(&pCheckpoint->ullOut, sizeof(pCheckpoint->ullOut), 1, fp) == 1 &&
+            fread(&pCheckpoint->uWindowSize, sizeof(pCheckpoint->uWindowSize), 1, fp) == 1 &&
+            fread(&pCheckpoint->uPackedSize, sizeof(pCheckpoint->uPackedSize), 1, fp) == 1 &&
+            pCheckpoint->uWindowSize <= DEFLATE_WINDOW_SIZE &&
+            pCheckpoint->uPackedSize <= compressBound(DEFLATE_WINDOW_SIZE);
+        if (bOk) {
+            pCheckpoint->pWindow = (unsigned char*)malloc(pCheckpoint->uPackedSize);
+            pIndex->nCheckpoints = i + 1;
+            bOk = pCheckpoint->pWindow &&
+                fread(pCheckpoint->pWindow, 1, pCheckpoint->uPackedSize, fp) == pCheckpoint->uPackedSize;
+        }
+    }
+
+    for (int i = 0; bOk && i < nMembers; i++) {
+        indexMemberT* pMember = &pIndex->pMembers[i];
+        unsigned char bNameLen = 0;
+        bOk = fread(&pMember->ullOffset, sizeof(pMember->ullOffset), 1, fp) == 1 &&
+            fread(&pMember->ullSize, sizeof(pMember->ullSize), 1, fp) == 1 &&
+            fread(&pMember->cTypeflag, 1, 1, fp) == 1 &&
+            fread(&bNameLen, 1, 1, fp) == 1 &&
+            bNameLen < sizeof(pMember->szName) &&
+            fread(pMember->szName, 1, bNameLen, fp) == bNameLen;
+        if (bOk) {
+            pMember->szName[bNameLen] = '\0';
+            pIndex->nMembers = i + 1;
+        }
+    }
+
+    fclose(fp);
+    if (!bOk) {
+        vFreeArchiveIndex(pIndex);
+        return NULL;
+    }
+
+    return pIndex;
+}
+
+/**
+ * Canonical Huffman code description used to validate deflate block headers
+ */
+typedef struct {
+    short anCount[16];        // Number of codes of each length
+    short anSymbol[320];      // Symbols ordered by code
+} huffmanT;
+
+/**
+ * Peek up to 24 bits at a bit offset, deflate bit order
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Bit offset to read from
+ * @param nCount Number of bits
+ * @return Bits read, missing bits past the end read as zero
+ */
+unsigned int uPeekBits(const unsigned char* pData, size_t nSize, long long llBit, int nCount) {
+    size_t nByte = (size_t)(llBit >> 3);
+    unsigned int uValue = 0;
+
+    for (int i = 0; i < 4 && nByte + i < nSize; i++) {
+        uValue |= (unsigned int)pData[nByte + i] << (8 * i);
+    }
+
+    return (uValue >> (llBit & 7)) & ((1u << nCount) - 1);
+}
+
+/**
+ * Build a canonical Huffman code from code lengths
+ * @param pHuffman Code to fill
+ * @param pLengths Code length of every symbol
+ * @param nSymbols Number of symbols
+ * @return 0 for a complete code, positive if incomplete, negative if over-subscribed
+ */
+int nBuildHuffman(huffmanT* pHuffman, const unsigned char* pLengths, int nSymbols) {
+    short anOffsets[16];
+    int nLeft = 1;
+
+    memset(pHuffman->anCount, 0, sizeof(pHuffman->anCount));
+    for (int i = 0; i < nSymbols; i++) {
+        pHuffman->anCount[pLengths[i]]++;
+    }
+
+    if (pHuffman->anCount[0] == nSymbols) {
+        return 0; // No codes at all, decoding will fail
+    }
+
+    for (int nLen = 1; nLen < 16; nLen++) {
+        nLeft <<= 1;
+        nLeft -= pHuffman->anCount[nLen];
+        if (nLeft < 0) {
+            return nLeft; // Over-subscribed
+        }
+    }
+
+    anOffsets[1] = 0;
+    for (int nLen = 1; nLen < 15; nLen++) {
+        anOffsets[nLen + 1] = anOffsets[nLen] + pHuffman->anCount[nLen];
+    }
+
+    for (int i = 0; i < nSymbols; i++) {
+        if (pLengths[i] != 0) {
+            pHuffman->anSymbol[anOffsets[pLengths[i]]++] = (short)i;
+        }
+    }
+
+    return nLeft;
+}
+
+/**
+ * Decode one symbol of a canonical Huffman code
+ * @param pHuffman Code to decode with
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param pllBit Bit offset, advanced past the symbol
+ * @return Decoded symbol, -1 if no valid code was found
+ */
+int nDecodeHuffman(const huffmanT* pHuffman, const unsigned char* pData, size_t nSize, long long* pllBit) {
+    int nCode = 0, nFirst = 0, nIndex = 0;
+
+    for (int nLen = 1; nLen < 16; nLen++) {
+        nCode |= (int)uPeekBits(pData, nSize, (*pllBit)++, 1);
+        int nCount = pHuffman->anCount[nLen];
+        if (nCode - nCount < nFirst) {
+            return pHuffman->anSymbol[nIndex + (nCode - nFirst)];
+        }
+        nIndex += nCount;
+        nFirst += nCount;
+        nFirst <<= 1;
+        nCode <<= 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Check whether a dynamic Huffman deflate block header starts at a bit offset
+ * The checks mirror the ones inflate performs, so a match decodes at least as far as the header
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Candidate bit offset
+ * @param bFinalOk Accept the last block of the stream as well
+ * @return 1 if the header is valid, 0 otherwise
+ */
+int bIsDynamicBlockHeader(const unsigned char* pData, size_t nSize, long long llBit, bool bFinalOk) {
+    static const unsigned char abOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    long long llEnd = (long long)nSize * 8;
+
+    if (llBit + 17 > llEnd) {
+        return 0;
+    }
+
+    // BFINAL = 0 and BTYPE = 10, then HLIT, HDIST and HCLEN
+    unsigned int uHead = uPeekBits(pData, nSize, llBit, 17);
+    if ((uHead & (bFinalOk ? 6 : 7)) != 4) {
+        return 0;
+    }
+
+    int nLit = (int)((uHead >> 3) & 31) + 257;
+    int nDist = (int)((uHead >> 8) & 31) + 1;
+    int nCodeLen = (int)((uHead >> 13) & 15) + 4;
+    if (nLit > 286 || nDist > 30) {
+        return 0;
+    }
+    llBit += 17;
+
+    // Code length code, must be complete
+    unsigned char abCodeLen[19] = { 0 };
+    if (llBit + 3 * nCodeLen > llEnd) {
+        return 0;
+    }
+    // Most candidates are over-subscribed after a few lengths, long before the code is built
+    int nKraft = 0;
+    for (int i = 0; i < nCodeLen; i++) {
+        unsigned int uLen = uPeekBits(pData, nSize, llBit, 3);
+        nKraft += uLen ? 128 >> uLen : 0;
+        if (nKraft > 128) {
+            return 0;
+        }
+        abCodeLen[abOrder[i]] = (unsigned char)uLen;
+        llBit += 3;
+    }
+
+    huffmanT stHuffman;
+    if (nKraft != 128 || nBuildHuffman(&stHuffman, abCodeLen, 19) != 0) {
+        return 0;
+    }
+
+    // Literal/length and distance code lengths
+    unsigned char abLengths[286 + 30];
+    int nIndex = 0;
+    while (nIndex < nLit + nDist) {
+        int nSym = nDecodeHuffman(&stHuffman, pData, nSize, &llBit);
+        if (nSym < 0 || llBit > llEnd) {
+            return 0;
+        }
+
+        if (nSym < 16) {
+            abLengths[nIndex++] = (unsigned char)nSym;
+            continue;
+        }
+
+        unsigned char bLen = 0;
+        int nRepeat;
+        if (nSym == 16) {
+            if (nIndex == 0) {
+                return 0; // Nothing to repeat
+            }
+            bLen = abLengths[nIndex - 1];
+            nRepeat = 3 + (int)uPeekBits(pData, nSize, llBit, 2);
+            llBit += 2;
+        }
+        else if (nSym == 17) {
+            nRepeat = 3 + (int)uPeekBits(pData, nSize, llBit, 3);
+            llBit += 3;
+        }
+        else {
+            nRepeat = 11 + (int)uPeekBits(pData, nSize, llBit, 7);
+            llBit += 7;
+        }
+
+        if (nIndex + nRepeat > nLit + nDist) {
+            return 0;
+        }
+        while (nRepeat--) {
+            abLengths[nIndex++] = bLen;
+        }
+    }
+
+    // End-of-block code must exist
+    if (abLengths[256] == 0) {
+        return 0;
+    }
+
+    // Incomplete codes are only allowed when they hold a single code
+    int nErr = nBuildHuffman(&stHuffman, abLengths, nLit);
+    if (nErr < 0 || (nErr > 0 && nLit - stHuffman.anCount[0] != 1)) {
+        return 0;
+    }
+
+    nErr = nBuildHuffman(&stHuffman, abLengths + nLit, nDist);
+    if (nErr < 0 || (nErr > 0 && nDist - stHuffman.anCount[0] != 1)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Check whether a stored deflate block starts at a bit offset
+ * Its length is at the next byte boundary and repeated inverted, and the whole block must be in the data.
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Candidate bit offset
+ * @param bFinalOk Accept the last block of the stream as well
+ * @param pllEnd Receives the bit offset behind the block
+ * @return 1 if the header is valid, 0 otherwise
+ */
+int bIsStoredBlockHeader(const unsigned char* pData, size_t nSize, long long llBit, bool bFinalOk,
+    long long* pllEnd) {
+    if ((uPeekBits(pData, nSize, llBit, 3) & (bFinalOk ? 6 : 7)) != 0) {
+        return 0;
+    }
+
+    size_t nByte = (size_t)((llBit + 3 + 7) >> 3);
+    if (nByte + 4 > nSize) {
+        return 0;
+    }
+    unsigned int uLen = pData[nByte] | (pData[nByte + 1] << 8);
+    unsigned int uInverted = pData[nByte + 2] | (pData[nByte + 3] << 8);
+    if (uLen != (~uInverted & 0xffff) || nByte + 4 + uLen > nSize) {
+        return 0;
+    }
+
+    *pllEnd = (long long)(nByte + 4 + uLen) * 8;
+    return 1;
+}
+
+/**
+ * Lookup tables of the fixed Huffman codes of deflate, indexed by the next bits in stream order
+ */
+typedef struct {
+    short anLiteral[512];     // Literal/length symbol starting with these 9 bits
+    unsigned char abLiteralBits[512]; // Length of its code
+    unsigned char abDistance[32]; // Distance symbol of these 5 bits
+} fixedHuffmanT;
+
+/**
+ * Build the lookup tables of the fixed Huffman codes of deflate
+ * @return Tables
+ */
+fixedHuffmanT stBuildFixedHuffman(void) {
+    fixedHuffmanT stFixed;
+    huffmanT stLiterals;
+    huffmanT stDistances;
+    unsigned char abLengths[288];
+    for (int i = 0; i < 288; i++) {
+        abLengths[i] = (unsigned char)(i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+    }
+    nBuildHuffman(&stLiterals, abLengths, 288);
+    memset(abLengths, 5, 32);
+    nBuildHuffman(&stDistances, abLengths, 32);
+
+    // Decode every possible bit pattern once
+    for (int i = 0; i < 512; i++) {
+        unsigned char abBits[2] = { (unsigned char)(i & 0xff), (unsigned char)(i >> 8) };
+        long long llBit = 0;
+        stFixed.anLiteral[i] = (short)nDecodeHuffman(&stLiterals, abBits, sizeof(abBits), &llBit);
+        stFixed.abLiteralBits[i] = (unsigned char)llBit;
+        if (i < 32) {
+            llBit = 0;
+            stFixed.abDistance[i] = (unsigned char)nDecodeHuffman(&stDistances, abBits, sizeof(abBits), &llBit);
+        }
+    }
+    return stFixed;
+}
+
+/**
+ * Get the fixed Huffman codes of deflate, they are built on the first call
+ * @return Codes
+ */
+const fixedHuffmanT* pGetFixedHuffman(void) {
+    static const fixedHuffmanT stFixed = stBuildFixedHuffman();
+    return &stFixed;
+}
+
+/**
+ * Check whether a fixed Huffman deflate block starts at a bit offset by decoding it up to its end
+ * Nothing is written, only the codes are checked: literal/length 286 and 287 and distance 30 and 31 do not exist,
+ * and every distance reaches into a full window.
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Candidate bit offset
+ * @param llLimit Bit offset the block must end before
+ * @param pllEnd Receives the bit offset behind its end-of-block code, or where decoding gave up
+ * @return 1 if the block decodes up to its end-of-block code, 0 otherwise
+ */
+int bIsFixedBlock(const unsigned char* pData, size_t nSize, long long llBit, long long llLimit, long long* pllEnd) {
+    *pllEnd = llBit;
+    if ((uPeekBits(pData, nSize, llBit, 3) & 6) != 2) {
+        return 0;
+    }
+
+    const fixedHuffmanT* pFixed = pGetFixedHuffman();
+    int bResult = 0;
+    llBit += 3;
+    while (llBit < llLimit) {
+        unsigned int uBits = uPeekBits(pData, nSize, llBit, 9);
+        int nSym = pFixed->anLiteral[uBits];
+        llBit += pFixed->abLiteralBits[uBits];
+        if (nSym > 285) {
+            break;
+        }
+        if (nSym == 256) {
+            bResult = 1;
+            break;
+        }
+        if (nSym < 256) {
+            continue;
+        }
+
+        // Extra bits of the length, then the distance and its extra bits
+        llBit += nSym < 265 || nSym == 285 ? 0 : (nSym - 261) / 4;
+        int nDist = pFixed->abDistance[uPeekBits(pData, nSize, llBit, 5)];
+        if (nDist > 29) {
+            break;
+        }
+        llBit += 5 + (nDist < 4 ? 0 : nDist / 2 - 1);
+    }
+
+    *pllEnd = llBit;
+    return bResult;
+}
+
+/**
+ * Check whether the bits at an offset can be the header of any deflate block
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Bit offset
+ * @return 1 for a valid stored or dynamic header or a fixed Huffman block type, 0 otherwise
+ */
+int bIsAnyBlockHeader(const unsigned char* pData, size_t nSize, long long llBit) {
+    long long llEnd;
+    return (uPeekBits(pData, nSize, llBit, 3) & 6) == 2 || bIsStoredBlockHeader(pData, nSize, llBit, true, &llEnd) ||
+        bIsDynamicBlockHeader(pData, nSize, llBit, true);
+}
+
+/**
+ * Check whether a stored deflate block starts at a bit offset
+ * Three zero bits followed by a matching length pair turn up in random bits now and then, so the
+ * block is only accepted if a stored or dynamic header follows right behind it. Any bits decode as
+ * fixed Huffman codes for a while, a fixed block behind it would prove nothing; that one is found
+ * by its own header instead.
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Candidate bit offset
+ * @return 1 if the block and the header behind it are valid, 0 otherwise
+ */
+int bIsStoredBlockStart(const unsigned char* pData, size_t nSize, long long llBit) {
+    long long llEnd = 0;
+    long long llNextEnd = 0;
+    return bIsStoredBlockHeader(pData, nSize, llBit, false, &llEnd) &&
+        (bIsStoredBlockHeader(pData, nSize, llEnd, true, &llNextEnd) || bIsDynamicBlockHeader(pData, nSize, llEnd, true));
+}
+
+/**
+ * Find a block boundary by decoding from a candidate fixed Huffman block start
+ * Bits in the middle of a fixed Huffman block fall into step with its codes after a few symbols, so a
+ * candidate there decodes on to the block's own end-of-block code. The boundary behind it is what is
+ * taken, once the block starting there decodes as well.
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Candidate bit offset
+ * @param llLimit Bit offset the blocks must end before
+ * @param pllBudget Bits left to decode, reduced by the bits decoded here
+ * @return Bit offset of the block behind the candidate, -2 if the candidate does not decode
+ */
+long long llFollowFixedBlock(const unsigned char* pData, size_t nSize, long long llBit, long long llLimit,
+    long long* pllBudget) {
+    long long llEnd = 0;
+    int bFixed = bIsFixedBlock(pData, nSize, llBit, llLimit, &llEnd);
+    *pllBudget -= llEnd - llBit;
+    if (!bFixed) {
+        return -2;
+    }
+
+    long long llNextEnd = 0;
+    if (bIsStoredBlockStart(pData, nSize, llEnd) || bIsDynamicBlockHeader(pData, nSize, llEnd, true)) {
+        return llEnd;
+    }
+    bFixed = bIsFixedBlock(pData, nSize, llEnd, llLimit, &llNextEnd);
+    *pllBudget -= llNextEnd - llEnd;
+    return bFixed && bIsAnyBlockHeader(pData, nSize, llNextEnd) ? llEnd : -2;
+}
+
+/**
+ * Position of a block start that decides how it decodes, for telling whether two starts are the same block
+ * A stored block is read from the byte boundary behind its header, so every start in front of that boundary
+ * whose three header bits are zero decodes the same. Positions are doubled and odd for stored blocks,
+ * so the two kinds never compare equal but keep their order.
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Block start, negative for none
+ * @return Twice the byte boundary as a bit offset plus one for stored blocks, twice llBit for the others,
+ *         llBit if it is negative
+ */
+long long llCanonicalBlockStart(const unsigned char* pData, size_t nSize, long long llBit) {
+    if (llBit < 0) {
+        return llBit;
+    }
+    if ((uPeekBits(pData, nSize, llBit, 3) & 6) == 0) {
+        return ((llBit + 3 + 7) & ~7LL) * 2 + 1;
+    }
+    return llBit * 2;
+}
+
+/**
+ * Position a raw inflate stream at a bit offset of the compressed data
+ * @param pStream Raw inflate stream, freshly reset
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param llBit Bit offset of a deflate block start
+ * @return Z_OK on success, zlib error code otherwise
+ */
+int nPrimeInflate(z_stream* pStream, const unsigned char* pData, size_t nSize, long long llBit) {
+    size_t nByte = (size_t)(llBit >> 3);
+    int nBit = (int)(llBit & 7);
+
+    pStream->next_in = (Bytef*)pData + nByte;
+    pStream->avail_in = (uInt)(nSize - nByte > 0x40000000 ? 0x40000000 : nSize - nByte);
+
+    if (nBit) {
+        int nRet = inflatePrime(pStream, 8 - nBit, pData[nByte] >> nBit);
+        if (nRet != Z_OK) {
+            return nRet;
+        }
+        pStream->next_in++;
+        pStream->avail_in--;
+    }
+
+    return Z_OK;
+}
+
+/**
+ * Current bit offset of a raw inflate stream that stopped at a block boundary
+ * @param pStream Raw inflate stream
+ * @param pData Compressed data the stream reads from
+ * @return Bit offset of the next block
+ */
+long long llInflateBitOffset(const z_stream* pStream, const unsigned char* pData) {
+    return (long long)(pStream->next_in - pData) * 8 - (pStream->data_type & 7);
+}
+
+/**
+ * Top up a raw inflate stream's input, inflate limits avail_in to 32 bits
+ * @param pStream Raw inflate stream
+ * @param pData Compressed data the stream reads from
+ * @param nSize Size of the compressed data
+ */
+void vRefillInflate(z_stream* pStream, const unsigned char* pData, size_t nSize) {
+    size_t nLeft = nSize - (size_t)(pStream->next_in - pData);
+    if (pStream->avail_in < nLeft && pStream->avail_in < 0x10000000) {
+        pStream->avail_in = (uInt)(nLeft > 0x40000000 ? 0x40000000 : nLeft);
+    }
+}
+
+/**
+ * One speculatively decoded chunk of the deflate stream
+ */
+typedef struct {
+    unsigned char* pOut;      // Decoded bytes, window references decode as marker pattern A
+    unsigned char* pOutAlt;   // The same prefix decoded with marker pattern B
+    size_t nOutSize;          // Number of decoded bytes
+    size_t nOutCapacity;      // Allocated size of pOut (and pOutAlt while it is in use)
+    size_t nAltSize;          // Length of the prefix that may reference the unknown window
+    uLong ulTailCrc;          // CRC32 of the bytes after the prefix
+    int nNextChunk;           // Chunk whose start this one ended on, -1 at end of stream
+    size_t nStreamEnd;        // Offset behind the last deflate block when nNextChunk is -1
+    int nStatus;              // 0 pending, 1 done, negative on decode error
+} parallelChunkT;
+
+/**
+ * Parallel gzip reader state
+ * The compressed stream is cut into chunks, each worker searches a deflate block start in
+ * its chunk and decodes from there with two marker dictionaries standing in for the unknown
+ * 32 KB window. The consumer follows the chain of chunks whose starts the previous chunk
+ * really ended on and replaces markers with bytes from the window it has by then.
+ */
+typedef struct parallelReaderT {
+    unsigned char* pData;     // Whole compressed file, a mapped view or a heap copy
+    size_t nDataSize;         // Size of the compressed file
+    HANDLE hFile;             // File behind a mapped view, NULL for a heap copy
+    HANDLE hMapping;          // Mapping behind a mapped view, NULL for a heap copy
+    size_t nDeflateStart;     // Offset of the first deflate block
+    int nChunks;              // Number of chunks
+    parallelChunkT* pChunks;  // Chunk states
+    std::atomic<long long>* pStartBits; // Block start per chunk, -1 unknown, -2 none found, the previous chunk decodes it
+    unsigned char abDictA[DEFLATE_WINDOW_SIZE]; // Marker dictionary A, low index byte
+    unsigned char abDictB[DEFLATE_WINDOW_SIZE]; // Marker dictionary B, high index byte
+
+    std::vector<std::thread> vWorkers;
+    std::mutex mtxState;
+    std::condition_variable cvWork;   // Signalled when workers may take more chunks
+    std::condition_variable cvDone;   // Signalled when a chunk finishes
+    int nNextTask;            // Next chunk to hand out
+    int nMaxAhead;            // How far workers may run ahead of the consumer
+    std::atomic<int> nChainChunk; // Chunk the consumer is reading
+    std::atomic<bool> bStop;  // Tells workers to quit
+
+    int nCurChunk;            // Current chunk, -1 before the first read
+    size_t nCurPos;           // Read position in the current chunk
+    unsigned char abWindow[DEFLATE_WINDOW_SIZE]; // Last 32 KB handed to the consumer
+    uLong ulCrc;              // CRC32 of the first member so far
+    unsigned long long ullTotalOut; // Bytes of the first member so far
+    archiveIndexT* pIndex;    // Index receiving a checkpoint at chunk starts, may be NULL
+    unsigned long long ullLastCheckpoint; // Uncompressed offset of the last checkpoint
+    bool bEnd;                // End of stream reached
+    bool bError;              // A decode error occurred, every later read fails
+    bool bTail;               // Decoding further gzip members sequentially
+    z_stream stTail;          // Sequential inflate state for further members
+} parallelReaderT;
+
+/**
+ * Second byte of the marker pair for a window index, never equal to the first byte
+ * @param nIndex Window index
+ * @return Marker byte for dictionary B
+ */
+unsigned char bMarkerHigh(int nIndex) {
+    int nLow = nIndex & 0xff;
+    int nHigh = nIndex >> 8;
+    return (unsigned char)(nHigh < nLow ? nHigh : nHigh + 1);
+}
+
+/**
+ * Window index encoded by a marker pair
+ * @param bLow Byte decoded with dictionary A
+ * @param bHigh Byte decoded with dictionary B
+ * @return Window index
+ */
+int nMarkerIndex(unsigned char bLow, unsigned char bHigh) {
+    int nHigh = bHigh < bLow ? bHigh : bHigh - 1;
+    return (nHigh << 8) | bLow;
+}
+
+/**
+ * Search a deflate block start in a chunk, confirmed by decoding the whole block
+ * Dynamic and stored blocks are looked for first, they are cheap to rule out and are what large archives
+ * consist of, incompressible data being stored. Fixed Huffman blocks need a decode per candidate and are
+ * only looked for if neither turned up, decoding at most PARALLEL_FIXED_BUDGET times the searched range.
+ * @param pCtx Parallel reader
+ * @param llFrom First bit offset to try
+ * @param llTo Bit offset to stop at
+ * @param llLimit Bit offset a block found must end before
+ * @return Bit offset of the block, -2 if none found or the reader is closing
+ */
+long long llFindBlockStart(parallelReaderT* pCtx, long long llFrom, long long llTo, long long llLimit) {
+    z_stream stStream;
+    unsigned char abScratch[CHUNK];
+    long long llFound = -2;
+
+    memset(&stStream, 0, sizeof(stStream));
+    if (inflateInit2(&stStream, -15) != Z_OK) {
+        return -2;
+    }
+
+    const unsigned char* pData = pCtx->pData;
+    size_t nSize = pCtx->nDataSize;
+    long long llBit = llFrom;
+    long long llBudget = (llTo - llFrom) * PARALLEL_FIXED_BUDGET;
+    bool bFixedPass = false;
+    for (; llFound < 0 && llFrom < llTo; llBit++) {
+        if (llBit == llTo) {
+            if (bFixedPass) {
+                break;
+            }
+            bFixedPass = true;
+            llBit = llFrom;
+        }
+        if (((llBit & 0xffff) == 0 && pCtx->bStop.load()) || llBudget < 0) {
+            break;
+        }
+
+        // BFINAL = 0 and the block type, most bit offsets fail right here
+        unsigned int uType = uPeekBits(pData, nSize, llBit, 3);
+        long long llStart = llBit;
+        if (bFixedPass) {
+            if (uType != 2 || (llStart = llFollowFixedBlock(pData, nSize, llBit, llLimit, &llBudget)) < 0) {
+                continue;
+            }
+        }
+        else if (uType == 4 ? !bIsDynamicBlockHeader(pData, nSize, llBit, false) :
+            uType != 0 || !bIsStoredBlockStart(pData, nSize, llBit)) {
+            continue;
+        }
+
+        // Trial decode of the first block against a placeholder window
+        inflateReset(&stStream);
+        if (inflateSetDictionary(&stStream, pCtx->abDictA, DEFLATE_WINDOW_SIZE) != Z_OK ||
+            nPrimeInflate(&stStream, pData, nSize, llStart) != Z_OK) {
+            continue;
+        }
+
+        int nRet;
+        do {
+            stStream.next_out = abScratch;
+            stStream.avail_out = sizeof(abScratch);
+            nRet = inflate(&stStream, Z_BLOCK);
+        } while (nRet == Z_OK && !(stStream.data_type & 128));
+
+        if (nRet == Z_OK || nRet == Z_STREAM_END) {
+            llFound = llStart;
+        }
+    }
+
+    inflateEnd(&stStream);
+    return llFound;
+}
+
+/**
+ * Get the deflate block start of a chunk, searching for it on first use
+ * Only the first PARALLEL_SEARCH_SIZE bytes are searched. A chunk without a block start there is left to the
+ * previous chunk, which decodes on through it sequentially.
+ * @param pCtx Parallel reader
+ * @param nChunk Chunk index
+ * @return Bit offset of the block, -2 if the chunk holds no usable block start
+ */
+long long llGetChunkStart(parallelReaderT* pCtx, int nChunk) {
+    long long llStart = pCtx->pStartBits[nChunk].load();
+    if (llStart != -1) {
+        return llStart;
+    }
+
+    // Two workers may search the same chunk, they come up with the same answer
+    size_t nFrom = pCtx->nDeflateStart + (size_t)nChunk * PARALLEL_CHUNK_SIZE;
+    size_t nEnd = std::min(nFrom + PARALLEL_CHUNK_SIZE, pCtx->nDataSize);
+    size_t nTo = std::min(nFrom + PARALLEL_SEARCH_SIZE, nEnd);
+
+    llStart = llFindBlockStart(pCtx, (long long)nFrom * 8, (long long)nTo * 8, (long long)nEnd * 8);
+    if (llStart < 0 && pCtx->bStop.load()) {
+        return llStart; // Cut short by closing, not a result to keep
+    }
+    pCtx->pStartBits[nChunk].store(llStart);
+    return llStart;
+}
+
+/**
+ * Grow the output buffers of a chunk
+ * @param pChunk Chunk to grow
+ * @param bDual Whether the alternate buffer is in use
+ * @return 0 on success, -1 on allocation failure
+ */
+int nGrowChunk(parallelChunkT* pChunk, bool bDual) {
+    size_t nCapacity = pChunk->nOutCapacity ? pChunk->nOutCapacity * 2 : (size_t)PARALLEL_CHUNK_SIZE * 4;
+
+    unsigned char* pOut = (unsigned char*)realloc(pChunk->pOut, nCapacity);
+    if (!pOut) {
+        return -1;
+    }
+    pChunk->pOut = pOut;
+
+    if (bDual) {
+        unsigned char* pOutAlt = (unsigned char*)realloc(pChunk->pOutAlt, nCapacity);
+        if (!pOutAlt) {
+            return -1;
+        }
+        pChunk->pOutAlt = pOutAlt;
+    }
+
+    pChunk->nOutCapacity = nCapacity;
+    return 0;
+}
+
+/**
+ * Decode one chunk, from its block start up to the first later chunk start it lands on
+ * @param pCtx Parallel reader
+ * @param nChunk Chunk index
+ * @return 1 when done, negative on decode error
+ */
+int nDecodeParallelChunk(parallelReaderT* pCtx, int nChunk) {
+    parallelChunkT* pChunk = &pCtx->pChunks[nChunk];
+    pChunk->nNextChunk = -1;
+
+    long long llStart = llGetChunkStart(pCtx, nChunk);
+    if (llStart < 0) {
+        return -1; // Nothing to decode, the chain never points here
+    }
+
+    // Every chunk but the first decodes against an unknown window, twice until markers die out
+    bool bDual = nChunk > 0;
+    z_stream stA, stB;
+    memset(&stA, 0, sizeof(stA));
+    memset(&stB, 0, sizeof(stB));
+    if (inflateInit2(&stA, -15) != Z_OK) {
+        return -1;
+    }
+    if (bDual && inflateInit2(&stB, -15) != Z_OK) {
+        inflateEnd(&stA);
+        return -1;
+    }
+
+    int nResult = 1;
+    if (bDual && (inflateSetDictionary(&stA, pCtx->abDictA, DEFLATE_WINDOW_SIZE) != Z_OK ||
+        inflateSetDictionary(&stB, pCtx->abDictB, DEFLATE_WINDOW_SIZE) != Z_OK ||
+        nPrimeInflate(&stB, pCtx->pData, pCtx->nDataSize, llStart) != Z_OK)) {
+        nResult = -1;
+    }
+    if (nResult > 0 && nPrimeInflate(&stA, pCtx->pData, pCtx->nDataSize, llStart) != Z_OK) {
+        nResult = -1;
+    }
+
+    int nTarget = nChunk + 1;
+    size_t nLastMarkerEnd = 0;
+
+    while (nResult > 0) {
+        if (pChunk->nOutCapacity - pChunk->nOutSize < CHUNK * 16 && nGrowChunk(pChunk, bDual) != 0) {
+            nResult = -2;
+            break;
+        }
+
+        uInt uSpace = (uInt)(pChunk->nOutCapacity - pChunk->nOutSize);
+        vRefillInflate(&stA, pCtx->pData, pCtx->nDataSize);
+        stA.next_out = pChunk->pOut + pChunk->nOutSize;
+        stA.avail_out = uSpace;
+        int nRet = inflate(&stA, Z_BLOCK);
+        if (nRet == Z_BUF_ERROR && stA.next_in == pCtx->pData + pCtx->nDataSize) {
+            pChunk->nStreamEnd = pCtx->nDataSize; // Truncated file, ends without a trailer
+            break;
+        }
+        if (nRet != Z_OK && nRet != Z_STREAM_END) {
+            nResult = -1; // Not a real block start, or a corrupt stream
+            break;
+        }
+
+        size_t nProduced = uSpace - stA.avail_out;
+        if (bDual) {
+            // Same bit stream, so B produces exactly as many bytes
+            vRefillInflate(&stB, pCtx->pData, pCtx->nDataSize);
+            stB.next_out = pChunk->pOutAlt + pChunk->nOutSize;
+            stB.avail_out = uSpace;
+            inflate(&stB, Z_BLOCK);
+
+            const unsigned char* pA = pChunk->pOut + pChunk->nOutSize;
+            const unsigned char* pB = pChunk->pOutAlt + pChunk->nOutSize;
+            for (size_t i = nProduced; i > 0; i--) {
+                if (pA[i - 1] != pB[i - 1]) {
+                    nLastMarkerEnd = pChunk->nOutSize + i;
+                    break;
+                }
+            }
+        }
+        pChunk->nOutSize += nProduced;
+
+        // A full window without markers means nothing can reference the unknown window any more
+        if (bDual && pChunk->nOutSize - nLastMarkerEnd >= DEFLATE_WINDOW_SIZE) {
+            inflateEnd(&stB);
+            bDual = false;
+        }
+
+        if (nRet == Z_STREAM_END) {
+            pChunk->nStreamEnd = (size_t)(stA.next_in - pCtx->pData);
+            break;
+        }
+
+        if (!(stA.data_type & 128)) {
+            continue; // Output buffer full in the middle of a block
+        }
+
+        if (pCtx->bStop.load() || nChunk < pCtx->nChainChunk.load()) {
+            break; // Nobody is going to read this chunk
+        }
+
+        // Stop once we land exactly on the start another chunk decodes from, or a start that decodes the same
+        long long llPos = llCanonicalBlockStart(pCtx->pData, pCtx->nDataSize,
+            llInflateBitOffset(&stA, pCtx->pData));
+        long long llTargetStart = -2;
+        while (nTarget < pCtx->nChunks) {
+            llTargetStart = llCanonicalBlockStart(pCtx->pData, pCtx->nDataSize, llGetChunkStart(pCtx, nTarget));
+            if (llTargetStart >= llPos) {
+                break;
+            }
+            nTarget++;
+        }
+
+        if (nTarget < pCtx->nChunks && llTargetStart == llPos) {
+            pChunk->nNextChunk = nTarget;
+            break;
+        }
+    }
+
+    if (bDual) {
+        inflateEnd(&stB);
+    }
+    inflateEnd(&stA);
+
+    pChunk->nAltSize = nChunk > 0 ? nLastMarkerEnd : 0;
+    if (nResult > 0) {
+        pChunk->ulTailCrc = crc32(0L, pChunk->pOut + pChunk->nAltSize,
+            (uInt)(pChunk->nOutSize - pChunk->nAltSize));
+    }
+    return nResult;
+}
+
+/**
+ * Worker thread of the parallel reader
+ * @param pCtx Parallel reader
+ */
+void vParallelWorker(parallelReaderT* pCtx) {
+    while (true) {
+        int nChunk;
+        {
+            std::unique_lock<std::mutex> lock(pCtx->mtxState);
+            while (!pCtx->bStop.load() && pCtx->nNextTask < pCtx->nChunks &&
+                pCtx->nNextTask >= pCtx->nChainChunk.load() + pCtx->nMaxAhead) {
+                pCtx->cvWork.wait(lock);
+            }
+            if (pCtx->bStop.load() || pCtx->nNextTask >= pCtx->nChunks) {
+                return;
+            }
+            nChunk = pCtx->nNextTask++;
+        }
+
+        // Chunks the consumer already moved past are not worth decoding
+        int nStatus = nChunk < pCtx->nChainChunk.load() ? 1 : nDecodeParallelChunk(pCtx, nChunk);
+
+        std::lock_guard<std::mutex> lock(pCtx->mtxState);
+        pCtx->pChunks[nChunk].nStatus = nStatus;
+        pCtx->cvDone.notify_all();
+    }
+}
+
+/**
+ * Wait until a chunk is decoded
+ * @param pCtx Parallel reader
+ * @param nChunk Chunk index
+ * @return Chunk status
+ */
+int nWaitParallelChunk(parallelReaderT* pCtx, int nChunk) {
+    std::unique_lock<std::mutex> lock(pCtx->mtxState);
+    while (pCtx->pChunks[nChunk].nStatus == 0) {
+        pCtx->cvDone.wait(lock);
+    }
+    return pCtx->pChunks[nChunk].nStatus;
+}
+
+/**
+ * Release the buffers of a chunk
+ * @param pChunk Chunk to release
+ */
+void vFreeParallelChunk(parallelChunkT* pChunk) {
+    free(pChunk->pOut);
+    free(pChunk->pOutAlt);
+    pChunk->pOut = NULL;
+    pChunk->pOutAlt = NULL;
+}
+
+/**
+ * Switch the consumer to the next chunk in the chain and resolve its window markers
+ * @param pCtx Parallel reader
+ * @return 1 if a chunk is ready, 0 at end of stream, -1 on error
+ */
+int nAdvanceParallelReader(parallelReaderT* pCtx) {
+    int nNext = 0;
+
+    if (pCtx->nCurChunk >= 0) {
+        parallelChunkT* pCur = &pCtx->pChunks[pCtx->nCurChunk];
+        nNext = pCur->nNextChunk;
+
+        if (nNext < 0) {
+            // End of the first member, check its trailer like gzread does
+            size_t nTrailer = pCur->nStreamEnd;
+            vFreeParallelChunk(pCur);
+            pCtx->bEnd = true;
+            pCtx->bStop.store(true);
+            pCtx->cvWork.notify_all();
+
+            if (nTrailer + 8 > pCtx->nDataSize) {
+                return 0; // Truncated archives end early, the same as with gzread
+            }
+
+            const unsigned char* pTrailer = pCtx->pData + nTrailer;
+            uLong ulCrc = pTrailer[0] | (pTrailer[1] << 8) | (pTrailer[2] << 16) | ((uLong)pTrailer[3] << 24);
+            uLong ulSize = pTrailer[4] | (pTrailer[5] << 8) | (pTrailer[6] << 16) | ((uLong)pTrailer[7] << 24);
+            if (ulCrc != pCtx->ulCrc || ulSize != (uLong)(pCtx->ullTotalOut & 0xffffffff)) {
+                vLogMessage("Error: Gzip data check failed\n");
+                return -1;
+            }
+
+            // Further gzip members are decoded sequentially
+            size_t nRest = nTrailer + 8;
+            if (nRest + 2 <= pCtx->nDataSize && pCtx->pData[nRest] == 0x1f && pCtx->pData[nRest + 1] == 0x8b) {
+                if (inflateInit2(&pCtx->stTail, 15 + 16) != Z_OK) {
+                    return -1;
+                }
+                pCtx->stTail.next_in = pCtx->pData + nRest;
+                pCtx->stTail.avail_in = (uInt)(pCtx->nDataSize - nRest);
+                pCtx->bTail = true;
+                pCtx->bEnd = false;
+            }
+            return 0;
+        }
+
+        vFreeParallelChunk(pCur);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pCtx->mtxState);
+        pCtx->nChainChunk.store(nNext);
+        pCtx->cvWork.notify_all();
+    }
+
+    // Chunks skipped over never become part of the stream, their workers give up early
+    for (int i = pCtx->nCurChunk + 1; i < nNext; i++) {
+        nWaitParallelChunk(pCtx, i);
+        vFreeParallelChunk(&pCtx->pChunks[i]);
+    }
+
+    pCtx->nCurChunk = nNext;
+    pCtx->nCurPos = 0;
+    if (nWaitParallelChunk(pCtx, nNext) < 0) {
+        vLogMessage("Error: Corrupt deflate stream\n");
+        return -1;
+    }
+
+    // Chunk starts are block starts with a known window, exactly what an index needs
+    if (pCtx->pIndex && (nNext == 0 || pCtx->ullTotalOut - pCtx->ullLastCheckpoint >= INDEX_SPAN)) {
+        unsigned int uWindowSize = pCtx->ullTotalOut < DEFLATE_WINDOW_SIZE ?
+            (unsigned int)pCtx->ullTotalOut : DEFLATE_WINDOW_SIZE;
+        if (nAddIndexCheckpoint(pCtx->pIndex, (unsigned long long)pCtx->pStartBits[nNext].load(), pCtx->ullTotalOut,
+            pCtx->abWindow + DEFLATE_WINDOW_SIZE - uWindowSize, uWindowSize) != 0) {
+            return -1;
+        }
+        pCtx->ullLastCheckpoint = pCtx->ullTotalOut;
+    }
+
+    // Replace window markers with the bytes that really preceded this chunk, words without any are skipped
+    parallelChunkT* pChunk = &pCtx->pChunks[nNext];
+    for (size_t i = 0; i < pChunk->nAltSize; i += 8) {
+        unsigned long long ullA = 0, ullB = 0;
+        size_t nWord = pChunk->nAltSize - i < 8 ? pChunk->nAltSize - i : 8;
+        memcpy(&ullA, pChunk->pOut + i, nWord);
+        memcpy(&ullB, pChunk->pOutAlt + i, nWord);
+        if (ullA == ullB) {
+            continue;
+        }
+        for (size_t j = i; j < i + nWord; j++) {
+            if (pChunk->pOut[j] != pChunk->pOutAlt[j]) {
+                pChunk->pOut[j] = pCtx->abWindow[nMarkerIndex(pChunk->pOut[j], pChunk->pOutAlt[j])];
+            }
+        }
+    }
+
+    uLong ulChunkCrc = crc32(0L, pChunk->pOut, (uInt)pChunk->nAltSize);
+    ulChunkCrc = crc32_combine(ulChunkCrc, pChunk->ulTailCrc, (z_off_t)(pChunk->nOutSize - pChunk->nAltSize));
+    pCtx->ulCrc = crc32_combine(pCtx->ulCrc, ulChunkCrc, (z_off_t)pChunk->nOutSize);
+    pCtx->ullTotalOut += pChunk->nOutSize;
+
+    // Keep the last 32 KB for the next chunk's markers
+    if (pChunk->nOutSize >= DEFLATE_WINDOW_SIZE) {
+        memcpy(pCtx->abWindow, pChunk->pOut + pChunk->nOutSize - DEFLATE_WINDOW_SIZE, DEFLATE_WINDOW_SIZE);
+    }
+    else {
+        memmove(pCtx->abWindow, pCtx->abWindow + pChunk->nOutSize, DEFLATE_WINDOW_SIZE - pChunk->nOutSize);
+        memcpy(pCtx->abWindow + DEFLATE_WINDOW_SIZE - pChunk->nOutSize, pChunk->pOut, pChunk->nOutSize);
+    }
+
+    return 1;
+}
+
+/**
+ * Copy or discard decoded bytes of the parallel reader
+ * @param pCtx Parallel reader
+ * @param pDest Destination buffer, NULL to discard
+ * @param ullSize Number of bytes
+ * @return Number of bytes consumed, -1 on error
+ */
+long long llPullParallelReader(parallelReaderT* pCtx, unsigned char* pDest, unsigned long long ullSize) {
+    unsigned long long ullDone = 0;
+    unsigned char abScratch[CHUNK];
+
+    if (pCtx->bError) {
+        return -1;
+    }
+
+    while (ullDone < ullSize && !pCtx->bEnd) {
+        if (pCtx->bTail) {
+            unsigned long long ullWant = ullSize - ullDone;
+            if (!pDest && ullWant > sizeof(abScratch)) {
+                ullWant = sizeof(abScratch);
+            }
+            if (ullWant > 0x40000000) {
+                ullWant = 0x40000000;
+            }
+
+            pCtx->stTail.next_out = pDest ? pDest + ullDone : abScratch;
+            pCtx->stTail.avail_out = (uInt)ullWant;
+            int nRet = inflate(&pCtx->stTail, Z_NO_FLUSH);
+            ullDone += ullWant - pCtx->stTail.avail_out;
+
+            if (nRet == Z_STREAM_END) {
+                if (pCtx->stTail.avail_in >= 2 && pCtx->stTail.next_in[0] == 0x1f && pCtx->stTail.next_in[1] == 0x8b) {
+                    inflateReset(&pCtx->stTail);
+                }
+                else {
+                    pCtx->bEnd = true;
+                }
+            }
+            else if (nRet == Z_BUF_ERROR) {
+                break; // Truncated member
+            }
+            else if (nRet != Z_OK) {
+                pCtx->bError = true;
+                return -1;
+            }
+            continue;
+        }
+
+        if (pCtx->nCurChunk < 0 || pCtx->nCurPos == pCtx->pChunks[pCtx->nCurChunk].nOutSize) {
+            if (nAdvanceParallelReader(pCtx) < 0) {
+                pCtx->bError = true;
+                return -1;
+            }
+            continue;
+        }
+
+        parallelChunkT* pChunk = &pCtx->pChunks[pCtx->nCurChunk];
+        size_t nAvail = pChunk->nOutSize - pCtx->nCurPos;
+        if (nAvail > ullSize - ullDone) {
+            nAvail = (size_t)(ullSize - ullDone);
+        }
+
+        if (pDest) {
+            memcpy(pDest + ullDone, pChunk->pOut + pCtx->nCurPos, nAvail);
+        }
+        pCtx->nCurPos += nAvail;
+        ullDone += nAvail;
+    }
+
+    return (long long)ullDone;
+}
+
+/**
+ * Read callback for the parallel reader
+ * @param pReader Reader instance
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes to read
+ * @return Number of bytes read, -1 on error
+ */
+long long llParallelReaderRead(archiveReaderT* pReader, void* pBuffer, size_t nSize) {
+    return llPullParallelReader((parallelReaderT*)pReader->pContext, (unsigned char*)pBuffer, nSize);
+}
+
+/**
+ * Skip callback for the parallel reader
+ * @param pReader Reader instance
+ * @param ullSize Number of bytes to skip
+ * @return 0 on success, -1 on error
+ */
+int nParallelReaderSkip(archiveReaderT* pReader, unsigned long long ullSize) {
+    return llPullParallelReader((parallelReaderT*)pReader->pContext, NULL, ullSize) < 0 ? -1 : 0;
+}
+
+/**
+ * View callback for the parallel reader, exposes the current chunk's output
+ * @param pReader Reader instance
+ * @param nSize Number of bytes to consume
+ * @return Pointer to the bytes inside the chunk, NULL if they cross a chunk boundary
+ */
+const void* pParallelReaderView(archiveReaderT* pReader, size_t nSize) {
+    parallelReaderT* pCtx = (parallelReaderT*)pReader->pContext;
+
+    // Move on to the next chunk once the current one is used up
+    if (!pCtx->bError && !pCtx->bEnd && !pCtx->bTail &&
+        (pCtx->nCurChunk < 0 || pCtx->nCurPos == pCtx->pChunks[pCtx->nCurChunk].nOutSize)) {
+        if (nAdvanceParallelReader(pCtx) < 0) {
+            pCtx->bError = true;
+        }
+    }
+
+    if (pCtx->bError || pCtx->bEnd || pCtx->bTail ||
+        pCtx->pChunks[pCtx->nCurChunk].nOutSize - pCtx->nCurPos < nSize) {
+        return NULL;
+    }
+
+    const void* pData = pCtx->pChunks[pCtx->nCurChunk].pOut + pCtx->nCurPos;
+    pCtx->nCurPos += nSize;
+    return pData;
+}
+
+/**
+ * Close callback for the parallel reader
+ * @param pReader Reader instance
+ */
+void vParallelReaderClose(archiveReaderT* pReader) {
+    parallelReaderT* pCtx = (parallelReaderT*)pReader->pContext;
+
+    {
+        std::lock_guard<std::mutex> lock(pCtx->mtxState);
+        pCtx->bStop.store(true);
+        pCtx->cvWork.notify_all();
+    }
+    for (size_t i = 0; i < pCtx->vWorkers.size(); i++) {
+        pCtx->vWorkers[i].join();
+    }
+
+    for (int i = 0; i < pCtx->nChunks; i++) {
+        vFreeParallelChunk(&pCtx->pChunks[i]);
+    }
+    if (pCtx->bTail) {
+        inflateEnd(&pCtx->stTail);
+    }
+
+    free(pCtx->pChunks);
+    delete[] pCtx->pStartBits;
+    if (pCtx->hMapping) {
+        vUnmapFile(pCtx->pData, pCtx->hFile, pCtx->hMapping);
+    }
+    else {
+        free(pCtx->pData);
+    }
+    delete pCtx;
+    free(pReader);
+}
+
+/**
+ * Estimate how well a deflate stream compresses by inflating its first chunk
+ * The gzip trailer cannot tell, its size field wraps at 4 GiB.
+ * @param pData Compressed data
+ * @param nSize Size of the compressed data
+ * @param nDeflateStart Offset of the deflate stream
+ * @return Compressed size as a percentage of the uncompressed size, 100 if it cannot be told
+ */
+int nSampleCompressionPercent(const unsigned char* pData, size_t nSize, size_t nDeflateStart) {
+    z_stream stStream;
+    memset(&stStream, 0, sizeof(stStream));
+    if (inflateInit2(&stStream, -MAX_WBITS) != Z_OK) {
+        return 100;
+    }
+
+    size_t nSample = nSize - nDeflateStart < PARALLEL_CHUNK_SIZE ? nSize - nDeflateStart : PARALLEL_CHUNK_SIZE;
+    unsigned char abOut[DEFLATE_WINDOW_SIZE];
+    stStream.next_in = (Bytef*)(pData + nDeflateStart);
+    stStream.avail_in = (uInt)nSample;
+    int nResult = Z_OK;
+    while (nResult == Z_OK && stStream.avail_in > 0) {
+        stStream.next_out = abOut;
+        stStream.avail_out = sizeof(abOut);
+        nResult = inflate(&stStream, Z_NO_FLUSH);
+        if (nResult == Z_BUF_ERROR && stStream.avail_out == 0) {
+            nResult = Z_OK;
+        }
+    }
+
+    unsigned long long ullIn = stStream.total_in;
+    unsigned long long ullOut = stStream.total_out;
+    inflateEnd(&stStream);
+    if (ullOut == 0 || (nResult != Z_OK && nResult != Z_STREAM_END && nResult != Z_BUF_ERROR)) {
+        return 100;
+    }
+    return ullIn >= ullOut ? 100 : (int)(ullIn * 100 / ullOut);
+}
+
+/**
+ * Open a tar.gz file with the parallel reader
+ * The compressed file is mapped, so only the parts the workers get to are read. Where it cannot be mapped
+ * it is loaded into memory if it fits the memory budget. Poorly compressed data is left to the sequential
+ * readers, its blocks are too long to find starts in quickly and inflating it is cheap anyway.
+ * @param szTargzPath Path to the tar.gz file
+ * @param nThreads Number of decoding threads
+ * @param pIndex Index to record checkpoints into, NULL for none
+ * @param pOptions Extraction options, NULL for defaults
+ * @return Reader instance, NULL if the file cannot be decoded in parallel
+ */
+archiveReaderT* pOpenParallelReader(const char* szTargzPath, int nThreads, archiveIndexT* pIndex,
+    const extractOptionsT* pOptions) {
+    size_t nSize = 0;
+    HANDLE hFile = NULL;
+    HANDLE hMapping = NULL;
+    unsigned char* pData = pMapFile(szTargzPath, &nSize, &hFile, &hMapping);
+    if (!pData) {
+        unsigned long long ullArchiveSize;
+        unsigned char abTrailer[8];
+        if (!bReadArchiveIdentity(szTargzPath, &ullArchiveSize, abTrailer) ||
+            ullArchiveSize > ullResolveMemoryBudget(pOptions)) {
+            return NULL;
+        }
+        pData = pLoadFile(szTargzPath, &nSize);
+        if (!pData) {
+            return NULL;
+        }
+    }
+
+    size_t nDeflateStart = 0;
+    if (!bParseGzipHeader(pData, nSize, &nDeflateStart) ||
+        nSampleCompressionPercent(pData, nSize, nDeflateStart) > PARALLEL_MAX_PERCENT) {
+        if (hMapping) {
+            vUnmapFile(pData, hFile, hMapping);
+        }
+        else {
+            free(pData);
+        }
+        return NULL;
+    }
+
+    parallelReaderT* pCtx = new parallelReaderT();
+    archiveReaderT* pReader = (archiveReaderT*)calloc(1, sizeof(archiveReaderT));
+    pCtx->nChunks = (int)((nSize - nDeflateStart + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE);
+    pCtx->pChunks = (parallelChunkT*)calloc(pCtx->nChunks, sizeof(parallelChunkT));
+    pCtx->pStartBits = new std::atomic<long long>[pCtx->nChunks];
+    if (!pReader || !pCtx->pChunks) {
+        vLogMessage("Error: Memory allocation failed\n");
+        free(pReader);
+        free(pCtx->pChunks);
+        delete[] pCtx->pStartBits;
+        delete pCtx;
+        if (hMapping) {
+            vUnmapFile(pData, hFile, hMapping);
+        }
+        else {
+            free(pData);
+        }
+        return NULL;
+    }
+
+    pCtx->pData = pData;
+    pCtx->nDataSize = nSize;
+    pCtx->hFile = hFile;
+    pCtx->hMapping = hMapping;
+    pCtx->nDeflateStart = nDeflateStart;
+    for (int i = 0; i < pCtx->nChunks; i++) {
+        pCtx->pStartBits[i].store(i == 0 ? (long long)nDeflateStart * 8 : -1);
+    }
+    for (int i = 0; i < DEFLATE_WINDOW_SIZE; i++) {
+        pCtx->abDictA[i] = (unsigned char)(i & 0xff);
+        pCtx->abDictB[i] = bMarkerHigh(i);
+    }
+
+    pCtx->nNextTask = 0;
+    pCtx->nMaxAhead = nThreads + 1;
+    pCtx->nChainChunk.store(0);
+    pCtx->bStop.store(false);
+    pCtx->nCurChunk = -1;
+    pCtx->ulCrc = crc32(0L, Z_NULL, 0);
+    pCtx->pIndex = pIndex;
+
+    for (int i = 0; i < nThreads; i++) {
+        pCtx->vWorkers.push_back(std::thread(vParallelWorker, pCtx));
+    }
+
+    pReader->pfnRead = llParallelReaderRead;
+    pReader->pfnSkip = nParallelReaderSkip;
+    pReader->pfnView = pParallelReaderView;
+    pReader->pfnClose = vParallelReaderClose;
+    pReader->pContext = pCtx;
+    return pReader;
+}
+
+/**
+ * Get a gzip inflate state, the worker's warm one reset if it has one
+ * @param pBuffers Worker buffers, NULL to set up a new state
+ * @return Inflate state, NULL on error
+ */
+z_stream* pAcquireInflateState(workerBuffersT* pBuffers) {
+    // Resetting keeps the 32 KB window and the state allocated by the previous archive
+    if (pBuffers && pBuffers->pInflate) {
+        // Input the last archive left unconsumed, e.g. after an early stop, is not part of the next one
+        pBuffers->pInflate->next_in = NULL;
+        pBuffers->pInflate->avail_in = 0;
+        return inflateReset2(pBuffers->pInflate, 15 + 16) == Z_OK ? pBuffers->pInflate : NULL;
+    }
+
+    z_stream* pStream = (z_stream*)calloc(1, sizeof(z_stream));
+    if (!pStream || inflateInit2(pStream, 15 + 16) != Z_OK) {
+        free(pStream);
+        return NULL;
+    }
+    if (pBuffers) {
+        pBuffers->pInflate = pStream;
+    }
+    return pStream;
+}
+
+/**
+ * Release an inflate state from pAcquireInflateState
+ * @param pStream Inflate state, may be NULL
+ * @param bBorrowed The state belongs to a worker and stays warm
+ */
+void vReleaseInflateState(z_stream* pStream, bool bBorrowed) {
+    if (pStream && !bBorrowed) {
+        inflateEnd(pStream);
+        free(pStream);
+    }
+}
+
+/**
+ * Streaming inflate reader state, optionally records index checkpoints while it decodes
+ */
+typedef struct {
+    FILE* fp;                 // Archive file
+    z_stream* pStream;        // Inflate state, gzip wrapper
+    unsigned char* pInput;    // Compressed input buffer
+    unsigned char* pWindow;   // Output window for data viewed in place
+    unsigned char* pScratch;  // Output buffer for skipped data
+    size_t nWindowPos;        // Next unconsumed byte in the output window
+    size_t nWindowLen;        // Bytes decoded into the output window
+    unsigned long long ullInRead; // Archive bytes read into the input buffer so far
+    unsigned long long ullOut;    // Uncompressed bytes produced so far
+    archiveIndexT* pIndex;    // Index receiving checkpoints, may be NULL
+    unsigned long long ullLastCheckpoint; // Uncompressed offset of the last checkpoint
+    bool bBorrowed;           // pInput, pWindow and pScratch belong to a worker
+    bool bEnd;                // End of stream reached
+    bool bError;              // A decode error occurred, every later read fails
+} inflateReaderT;
+
+/**
+ * Run one inflate step of the inflate reader
+ * @param pCtx Inflate reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer, at most 1 GB
+ * @return Number of bytes produced, -1 on error
+ */
+long long llInflateReaderStep(inflateReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    z_stream* pStream = pCtx->pStream;
+    bool bNoInput = false;
+
+    if (pStream->avail_in == 0) {
+        size_t nRead = fread(pCtx->pInput, 1, INPUT_BUFFER_SIZE, pCtx->fp);
+        pStream->next_in = pCtx->pInput;
+        pStream->avail_in = (uInt)nRead;
+        pCtx->ullInRead += nRead;
+        bNoInput = nRead == 0;
+    }
+
+    // Only an index needs to stop at every block boundary
+    pStream->next_out = pOut;
+    pStream->avail_out = (uInt)nSize;
+    int nRet = inflate(pStream, pCtx->pIndex ? Z_BLOCK : Z_NO_FLUSH);
+    size_t nProduced = nSize - pStream->avail_out;
+    pCtx->ullOut += nProduced;
+
+    if (nRet == Z_STREAM_END) {
+        // Another gzip member may follow
+        if (pStream->avail_in == 0) {
+            size_t nRead = fread(pCtx->pInput, 1, INPUT_BUFFER_SIZE, pCtx->fp);
+            pStream->next_in = pCtx->pInput;
+            pStream->avail_in = (uInt)nRead;
+            pCtx->ullInRead += nRead;
+        }
+        if (pStream->avail_in > 0 && pStream->next_in[0] == 0x1f) {
+            inflateReset(pStream);
+        }
+        else {
+            pCtx->bEnd = true;
+        }
+        return (long long)nProduced;
+    }
+
+    if (nRet != Z_OK && nRet != Z_BUF_ERROR) {
+        vLogMessage("Error: Inflate failed: %s\n", pStream->msg ? pStream->msg : "unknown error");
+        pCtx->bError = true;
+        return -1;
+    }
+
+    // Inflate may still flush pending output without input, truncated archives end once it stops
+    if (bNoInput && nProduced == 0) {
+        pCtx->bEnd = true;
+        return 0;
+    }
+
+    // Block boundary, also right after a gzip header, but not after the last block
+    if (pCtx->pIndex && (pStream->data_type & 128) && !(pStream->data_type & 64) &&
+        (pCtx->pIndex->nCheckpoints == 0 || pCtx->ullOut - pCtx->ullLastCheckpoint >= INDEX_SPAN)) {
+        unsigned char abWindow[DEFLATE_WINDOW_SIZE];
+        uInt uWindowSize = sizeof(abWindow);
+        unsigned long long ullBit = (pCtx->ullInRead - pStream->avail_in) * 8 - (pStream->data_type & 7);
+
+        if (inflateGetDictionary(pStream, abWindow, &uWindowSize) != Z_OK ||
+            nAddIndexCheckpoint(pCtx->pIndex, ullBit, pCtx->ullOut, abWindow, uWindowSize) != 0) {
+            pCtx->bError = true;
+            return -1;
+        }
+        pCtx->ullLastCheckpoint = pCtx->ullOut;
+    }
+
+    return (long long)nProduced;
+}
+
+/**
+ * Copy or discard decoded bytes of the inflate reader
+ * @param pCtx Inflate reader
+ * @param pDest Destination buffer, NULL to discard
+ * @param ullSize Number of bytes
+ * @return Number of bytes consumed, -1 on error
+ */
+long long llPullInflateReader(inflateReaderT* pCtx, unsigned char* pDest, unsigned long long ullSize) {
+    unsigned long long ullDone = 0;
+
+    if (pCtx->bError) {
+        return -1;
+    }
+
+    // Bytes already decoded into the output window come first
+    size_t nBuffered = pCtx->nWindowLen - pCtx->nWindowPos;
+    if (nBuffered > 0) {
+        if (nBuffered > ullSize) {
+            nBuffered = (size_t)ullSize;
+        }
+        if (pDest) {
+            memcpy(pDest, pCtx->pWindow + pCtx->nWindowPos, nBuffered);
+        }
+        pCtx->nWindowPos += nBuffered;
+        ullDone = nBuffered;
+    }
+
+    // The rest is inflated straight into the destination, skipped data into a buffer large
+    // enough that zlib only has to keep the last 32 KB of it as its window
+    while (ullDone < ullSize && !pCtx->bEnd) {
+        unsigned long long ullWant = ullSize - ullDone;
+        if (!pDest && ullWant > INPUT_BUFFER_SIZE) {
+            ullWant = INPUT_BUFFER_SIZE;
+        }
+        if (ullWant > 0x40000000) {
+            ullWant = 0x40000000;
+        }
+
+        long long llProduced = llInflateReaderStep(pCtx, pDest ? pDest + ullDone : pCtx->pScratch, (size_t)ullWant);
+        if (llProduced < 0) {
+            return -1;
+        }
+        ullDone += llProduced;
+    }
+
+    return (long long)ullDone;
+}
+
+/**
+ * Read callback for the inflate reader
+ * @param pReader Reader instance
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes to read
+ * @return Number of bytes read, -1 on error
+ */
+long long llInflateReaderRead(archiveReaderT* pReader, void* pBuffer, size_t nSize) {
+    return llPullInflateReader((inflateReaderT*)pReader->pContext, (unsigned char*)pBuffer, nSize);
+}
+
+/**
+ * Skip callback for the inflate reader
+ * @param pReader Reader instance
+ * @param ullSize Number of bytes to skip
+ * @return 0 on success, -1 on error
+ */
+int nInflateReaderSkip(archiveReaderT* pReader, unsigned long long ullSize) {
+    return llPullInflateReader((inflateReaderT*)pReader->pContext, NULL, ullSize) < 0 ? -1 : 0;
+}
+
+/**
+ * View callback for the inflate reader, decodes into the output window
+ * @param pReader Reader instance
+ * @param nSize Number of bytes to consume, at most OUTPUT_WINDOW_SIZE
+ * @return Pointer to the bytes inside the output window, NULL if fewer are left
+ */
+const void* pInflateReaderView(archiveReaderT* pReader, size_t nSize) {
+    inflateReaderT* pCtx = (inflateReaderT*)pReader->pContext;
+
+    if (pCtx->nWindowLen - pCtx->nWindowPos < nSize) {
+        if (pCtx->bError || nSize > OUTPUT_WINDOW_SIZE) {
+            return NULL;
+        }
+
+        // Keep the unconsumed tail and decode only what is missing, later data goes straight to its reader
+        size_t nKeep = pCtx->nWindowLen - pCtx->nWindowPos;
+        memmove(pCtx->pWindow, pCtx->pWindow + pCtx->nWindowPos, nKeep);
+        pCtx->nWindowPos = 0;
+        pCtx->nWindowLen = nKeep;
+
+        while (pCtx->nWindowLen < nSize && !pCtx->bEnd) {
+            long long llProduced = llInflateReaderStep(pCtx, pCtx->pWindow + pCtx->nWindowLen,
+                nSize - pCtx->nWindowLen);
+            if (llProduced < 0) {
+                return NULL;
+            }
+            pCtx->nWindowLen += (size_t)llProduced;
+        }
+
+        if (pCtx->nWindowLen < nSize) {
+            return NULL;
+        }
+    }
+
+    const void* pData = pCtx->pWindow + pCtx->nWindowPos;
+    pCtx->nWindowPos += nSize;
+    return pData;
+}
+
+/**
+ * Close callback for the inflate reader
+ * @param pReader Reader instance
+ */
+void vInflateReaderClose(archiveReaderT* pReader) {
+    inflateReaderT* pCtx = (inflateReaderT*)pReader->pContext;
+    vReleaseInflateState(pCtx->pStream, pCtx->bBorrowed);
+    fclose(pCtx->fp);
+    if (!pCtx->bBorrowed) {
+        free(pCtx->pInput);
+        free(pCtx->pWindow);
+        free(pCtx->pScratch);
+    }
+    free(pCtx);
+    free(pReader);
+}
+
+/**
+ * Open a tar.gz file with a single threaded inflate reader
+ * @param szTargzPath Path to the tar.gz file
+ * @param pIndex Index to record checkpoints into, NULL for none
+ * @param pBuffers Worker buffers to use, NULL to allocate them
+ * @return Reader instance, NULL on error
+ */
+archiveReaderT* pOpenInflateReader(const char* szTargzPath, archiveIndexT* pIndex, workerBuffersT* pBuffers) {
+    FILE* fp = fopen(szTargzPath, "rb");
+    if (!fp) {
+        vLogMessage("Error: Cannot open %s\n", szTargzPath);
+        return NULL;
+    }
+
+    archiveReaderT* pReader = (archiveReaderT*)calloc(1, sizeof(archiveReaderT));
+    inflateReaderT* pCtx = (inflateReaderT*)calloc(1, sizeof(inflateReaderT));
+    unsigned char* pInput = pBuffers ? pBuffers->pInput : (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    unsigned char* pWindow = pBuffers ? pBuffers->pWindow : (unsigned char*)malloc(OUTPUT_WINDOW_SIZE);
+    unsigned char* pScratch = pBuffers ? pBuffers->pScratch : (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    z_stream* pStream = pReader && pCtx ? pAcquireInflateState(pBuffers) : NULL;
+    if (!pReader || !pCtx || !pInput || !pWindow || !pScratch || !pStream) {
+        vLogMessage("Error: Memory allocation failed\n");
+        vReleaseInflateState(pStream, pBuffers != NULL);
+        free(pReader);
+        free(pCtx);
+        if (!pBuffers) {
+            free(pInput);
+            free(pWindow);
+            free(pScratch);
+        }
+        fclose(fp);
+        return NULL;
+    }
+
+    pCtx->fp = fp;
+    pCtx->pStream = pStream;
+    pCtx->pInput = pInput;
+    pCtx->pWindow = pWindow;
+    pCtx->pScratch = pScratch;
+    pCtx->bBorrowed = pBuffers != NULL;
+    pCtx->pIndex = pIndex;
+
+    pReader->pfnRead = llInflateReaderRead;
+    pReader->pfnSkip = nInflateReaderSkip;
+    pReader->pfnView = pInflateReaderView;
+    pReader->pfnClose = vInflateReaderClose;
+    pReader->pContext = pCtx;
+    return pReader;
+}
+
+/**
+ * Reader state over a fully decompressed tar stream held in memory
+ */
+typedef struct {
+    unsigned char* pData;     // Uncompressed data, owned by the reader
+    size_t nSize;             // Size of the data
+    size_t nPos;              // Current read position
+    HANDLE hFile;             // File behind a mapped view, NULL for heap data
+    HANDLE hMapping;          // Mapping behind a mapped view, NULL for heap data
+    bool bBorrowed;           // pData belongs to the caller
+} memoryReaderT;
+
+/**
+ * Read callback for the memory reader
+ * @param pReader Reader instance
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes to read
+ * @return Number of bytes read
+ */
+long long llMemoryReaderRead(archiveReaderT* pReader, void* pBuffer, size_t nSize) {
+    memoryReaderT* pCtx = (memoryReaderT*)pReader->pContext;
+    size_t nAvailable = pCtx->nSize - pCtx->nPos;
+    if (nSize > nAvailable) {
+        nSize = nAvailable;
+    }
+
+    memcpy(pBuffer, pCtx->pData + pCtx->nPos, nSize);
+    pCtx->nPos += nSize;
+    return (long long)nSize;
+}
+
+/**
+ * Skip callback for the memory reader
+ * @param pReader Reader instance
+ * @param ullSize Number of bytes to skip
+ * @return 0 on success
+ */
+int nMemoryReaderSkip(archiveReaderT* pReader, unsigned long long ullSize) {
+    memoryReaderT* pCtx = (memoryReaderT*)pReader->pContext;
+    size_t nAvailable = pCtx->nSize - pCtx->nPos;
+    pCtx->nPos += ullSize > nAvailable ? nAvailable : (size_t)ullSize;
+    return 0;
+}
+
+/**
+ * View callback for the memory reader
+ * @param pReader Reader instance
+ * @param nSize Number of bytes to consume
+ * @return Pointer to the bytes, NULL if fewer are left
+ */
+const void* pMemoryReaderView(archiveReaderT* pReader, size_t nSize) {
+    memoryReaderT* pCtx = (memoryReaderT*)pReader->pContext;
+    if (pCtx->nSize - pCtx->nPos < nSize) {
+        return NULL;
+    }
+
+    const void* pData = pCtx->pData + pCtx->nPos;
+    pCtx->nPos += nSize;
+    return pData;
+}
+
+/**
+ * Close callback for the memory reader
+ * @param pReader Reader instance
+ */
+void vMemoryReaderClose(archiveReaderT* pReader) {
+    memoryReaderT* pCtx = (memoryReaderT*)pReader->pContext;
+    if (pCtx->hMapping) {
+        vUnmapFile(pCtx->pData, pCtx->hFile, pCtx->hMapping);
+    }
+    else if (!pCtx->bBorrowed) {
+        free(pCtx->pData);
+    }
+    free(pCtx);
+    free(pReader);
+}
+
+/**
+ * Wrap an uncompressed tar stream in a reader
+ * @param pData Uncompressed data, ownership passes to the reader on success
+ * @param nSize Size of the data
+ * @return Reader instance, NULL on error
+ */
+archiveReaderT* pOpenMemoryReader(unsigned char* pData, size_t nSize) {
+    archiveReaderT* pReader = (archiveReaderT*)calloc(1, sizeof(archiveReaderT));
+    memoryReaderT* pCtx = (memoryReaderT*)calloc(1, sizeof(memoryReaderT));
+    if (!pReader || !pCtx) {
+        vLogMessage("Error: Memory allocation failed\n");
+        free(pReader);
+        free(pCtx);
+        return NULL;
+    }
+
+    pCtx->pData = pData;
+    pCtx->nSize = nSize;
+
+    pReader->pfnRead = llMemoryReaderRead;
+    pReader->pfnSkip = nMemoryReaderSkip;
+    pReader->pfnView = pMemoryReaderView;
+    pReader->pfnClose = vMemoryReaderClose;
+    pReader->pContext = pCtx;
+    return pReader;
+}
+
+/**
+ * Map an uncompressed tar file into memory, no decompression involved
+ * @param szTarPath Path to the tar file
+ * @return Reader instance, NULL if the file cannot be mapped
+ */
+archiveReaderT* pOpenMappedReader(const char* szTarPath) {
+    size_t nSize = 0;
+    HANDLE hFile = NULL;
+    HANDLE hMapping = NULL;
+    unsigned char* pView = pMapFile(szTarPath, &nSize, &hFile, &hMapping);
+    if (!pView) {
+        return NULL;
+    }
+
+    archiveReaderT* pReader = pOpenMemoryReader(pView, nSize);
+    if (!pReader) {
+        vUnmapFile(pView, hFile, hMapping);
+        return NULL;
+    }
+
+    memoryReaderT* pCtx = (memoryReaderT*)pReader->pContext;
+    pCtx->hFile = hFile;
+    pCtx->hMapping = hMapping;
+    return pReader;
+}
+
+#ifdef BATTERYCYCLE_WITH_LIBDEFLATE
+/**
+ * Decompress a whole tar.gz file into memory with libdeflate
+ * @param szTargzPath Path to the tar.gz file
+ * @param pOptions Extraction options, ullMemoryBudget bounds the compressed plus uncompressed size
+ * @return Reader instance, NULL if the archive does not fit the budget or libdeflate rejects it
+ */
+archiveReaderT* pOpenLibdeflateReader(const char* szTargzPath, const extractOptionsT* pOptions) {
+    unsigned long long ullBudget = ullResolveMemoryBudget(pOptions);
+    unsigned long long ullArchiveSize;
+    unsigned char abTrailer[8];
+
+    // The last member's ISIZE is the whole tar size for the usual single member archive
+    if (!bReadArchiveIdentity(szTargzPath, &ullArchiveSize, abTrailer) || ullArchiveSize >= ullBudget) {
+        return NULL;
+    }
+    unsigned long long ullCapacity = (unsigned long long)abTrailer[4] | ((unsigned long long)abTrailer[5] << 8) |
+        ((unsigned long long)abTrailer[6] << 16) | ((unsigned long long)abTrailer[7] << 24);
+    if (ullCapacity < ullArchiveSize) {
+        ullCapacity = ullArchiveSize * 4;
+    }
+    if (ullArchiveSize + ullCapacity > ullBudget) {
+        ullCapacity = ullBudget - ullArchiveSize;
+    }
+
+    size_t nInSize = 0;
+    unsigned char* pIn = pLoadFile(szTargzPath, &nInSize);
+    unsigned char* pOut = (unsigned char*)malloc((size_t)ullCapacity);
+    struct libdeflate_decompressor* pDecompressor = libdeflate_alloc_decompressor();
+    if (!pIn || !pOut || !pDecompressor) {
+        free(pIn);
+        free(pOut);
+        if (pDecompressor) {
+            libdeflate_free_decompressor(pDecompressor);
+        }
+        return NULL;
+    }
+
+    // One call per gzip member, a member that runs out of space is decoded again into a larger buffer
+    size_t nInPos = 0, nOutPos = 0;
+    bool bOk = true;
+    while (bOk && nInPos + 2 <= nInSize && pIn[nInPos] == 0x1f && pIn[nInPos + 1] == 0x8b) {
+        size_t nUsedIn = 0, nUsedOut = 0;
+        enum libdeflate_result eResult = libdeflate_gzip_decompress_ex(pDecompressor,
+            pIn + nInPos, nInSize - nInPos, pOut + nOutPos, (size_t)ullCapacity - nOutPos, &nUsedIn, &nUsedOut);
+
+        if (eResult == LIBDEFLATE_SUCCESS) {
+            nInPos += nUsedIn;
+            nOutPos += nUsedOut;
+        }
+        else if (eResult == LIBDEFLATE_INSUFFICIENT_SPACE && nInSize + ullCapacity < ullBudget) {
+            unsigned long long ullGrown = ullCapacity * 2;
+            if (nInSize + ullGrown > ullBudget) {
+                ullGrown = ullBudget - nInSize;
+            }
+            unsigned char* pGrown = (unsigned char*)realloc(pOut, (size_t)ullGrown);
+            if (pGrown) {
+                pOut = pGrown;
+                ullCapacity = ullGrown;
+            }
+            else {
+                bOk = false;
+            }
+        }
+        else {
+            bOk = false;
+        }
+    }
+
+    libdeflate_free_decompressor(pDecompressor);
+    free(pIn);
+    archiveReaderT* pReader = bOk && nInPos > 0 ? pOpenMemoryReader(pOut, nOutPos) : NULL;
+    if (!pReader) {
+        free(pOut);
+    }
+    return pReader;
+}
+#endif
+
+/**
+ * Open a tar.gz file with the zlib streaming backend
+ * @param szTargzPath Path to the tar.gz file
+ * @param pOptions Extraction options, pBuffers is used if set
+ * @return Reader instance, NULL on error
+ */
+archiveReaderT* pOpenZlibBackend(const char* szTargzPath, const extractOptionsT* pOptions) {
+    unsigned char abMagic[2] = { 0, 0 };
+    FILE* fp = fopen(szTargzPath, "rb");
+    if (fp) {
+        if (fread(abMagic, 1, sizeof(abMagic), fp) != sizeof(abMagic)) {
+            abMagic[0] = 0;
+        }
+        fclose(fp);
+    }
+
+    // gzFile passes files that are not gzip compressed through unchanged
+    if (abMagic[0] != 0x1f || abMagic[1] != 0x8b) {
+        return pOpenGzReader(szTargzPath);
+    }
+    return pOpenInflateReader(szTargzPath, NULL, pOptions ? pOptions->pBuffers : NULL);
+}
+
+/**
+ * Inflate backend that can serve the uncompressed tar stream of an archive
+ */
+typedef struct {
+    const char* szName;       // Name used on the command line
+    // Open the archive, returns NULL if the backend cannot serve it
+    archiveReaderT* (*pfnOpen)(const char* szTargzPath, const extractOptionsT* pOptions);
+} inflateBackendT;
+
+/**
+ * Available inflate backends, the streaming backend first as the fallback for all others
+ */
+const inflateBackendT astInflateBackends[] = {
+#ifdef ZLIBNG_VERSION
+    { "zlib-ng", pOpenZlibBackend }, // zlib-ng built in zlib compatible mode
+#else
+    { "zlib", pOpenZlibBackend },
+#endif
+#ifdef BATTERYCYCLE_WITH_LIBDEFLATE
+    { "libdeflate", pOpenLibdeflateReader },
+#endif
+};
+#define INFLATE_BACKEND_COUNT (int)(sizeof(astInflateBackends) / sizeof(astInflateBackends[0]))
+
+/**
+ * Look up an inflate backend by name
+ * @param szName Backend name
+ * @return Backend, NULL if it is not available in this build
+ */
+const inflateBackendT* pFindInflateBackend(const char* szName) {
+    for (int i = 0; i < INFLATE_BACKEND_COUNT; i++) {
+        if (_stricmp(astInflateBackends[i].szName, szName) == 0) {
+            return &astInflateBackends[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Detect the format of an archive from its first bytes
+ * @param abMagic Start of the archive
+ * @param nMagic Number of bytes available, 6 are enough
+ * @return One of the INPUT_FORMAT_ constants other than INPUT_FORMAT_DIRECTORY and INPUT_FORMAT_UNKNOWN
+ */
+int nDetectBufferFormat(const unsigned char* abMagic, size_t nMagic) {
+    // Anything that is not compressed is walked as a tar, the header checks reject the rest
+    if (nMagic >= 2 && abMagic[0] == 0x1f && abMagic[1] == 0x8b) {
+        return INPUT_FORMAT_GZIP;
+    }
+    if (nMagic >= 4 && memcmp(abMagic, "\x28\xb5\x2f\xfd", 4) == 0) {
+        return INPUT_FORMAT_ZSTD;
+    }
+    if (nMagic >= 6 && memcmp(abMagic, "\xfd" "7zXZ\x00", 6) == 0) {
+        return INPUT_FORMAT_XZ;
+    }
+    if (nMagic >= 4 && memcmp(abMagic, "BZh", 3) == 0 && abMagic[3] >= '1' && abMagic[3] <= '9') {
+        return INPUT_FORMAT_BZIP2;
+    }
+    return INPUT_FORMAT_TAR;
+}
+
+/**
+ * Detect what kind of input a path refers to
+ * @param szPath Path given on the command line
+ * @return One of the INPUT_FORMAT_ constants
+ */
+int nDetectInputFormat(const char* szPath) {
+    DWORD dwAttributes = GetFileAttributesA(szPath);
+    if (dwAttributes == INVALID_FILE_ATTRIBUTES) {
+        return INPUT_FORMAT_UNKNOWN;
+    }
+    if (dwAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        return INPUT_FORMAT_DIRECTORY;
+    }
+
+    unsigned char abMagic[6] = { 0, 0, 0, 0, 0, 0 };
+    FILE* fp = fopen(szPath, "rb");
+    if (!fp) {
+        return INPUT_FORMAT_UNKNOWN;
+    }
+    size_t nMagic = fread(abMagic, 1, sizeof(abMagic), fp);
+    fclose(fp);
+
+    return nDetectBufferFormat(abMagic, nMagic);
+}
+
+/**
+ * Name of an input format for messages and reports
+ * @param nFormat One of the INPUT_FORMAT_ constants
+ * @return Format name
+ */
+const char* szInputFormatName(int nFormat) {
+    switch (nFormat) {
+    case INPUT_FORMAT_GZIP: return "gzip";
+    case INPUT_FORMAT_TAR: return "tar";
+    case INPUT_FORMAT_DIRECTORY: return "folder";
+    case INPUT_FORMAT_ZSTD: return "zstd";
+    case INPUT_FORMAT_XZ: return "xz";
+    case INPUT_FORMAT_BZIP2: return "bzip2";
+    default: return "unknown";
+    }
+}
+
+/**
+ * Bounded single producer, single consumer byte ring
+ * Both sides work on contiguous spans in place. Publishing and releasing is lock-free, the mutex
+ * is only taken by a side that has to sleep and by the other side to wake it.
+ */
+typedef struct spscRingT {
+    unsigned char* pData;     // Ring storage
+    size_t nCapacity;         // Size of the storage
+    std::atomic<unsigned long long> ullWritten; // Bytes published by the producer so far
+    std::atomic<unsigned long long> ullRead;    // Bytes released by the consumer so far
+    std::atomic<bool> bClosed;    // The producer published its last byte
+    std::atomic<bool> bCancelled; // The consumer is gone, the producer should stop
+    std::atomic<int> nSleepers;   // Sides waiting on cvWake
+    std::mutex mtxWake;
+    std::condition_variable cvWake; // Signalled on every publish, release, close and cancel
+} spscRingT;
+
+/**
+ * Check whether the consumer of a ring can continue
+ * @param pRing Ring
+ * @return true if bytes are readable or the producer is done
+ */
+bool bRingReadable(spscRingT* pRing) {
+    return pRing->ullWritten.load() != pRing->ullRead.load() || pRing->bClosed.load();
+}
+
+/**
+ * Check whether the producer of a ring can continue
+ * @param pRing Ring
+ * @return true if space is free or the consumer is gone
+ */
+bool bRingWritable(spscRingT* pRing) {
+    return pRing->ullWritten.load() - pRing->ullRead.load() < pRing->nCapacity || pRing->bCancelled.load();
+}
+
+/**
+ * Wait until one side of a ring can continue, spinning briefly before sleeping
+ * @param pRing Ring
+ * @param pfnReady bRingReadable or bRingWritable
+ */
+void vWaitRing(spscRingT* pRing, bool (*pfnReady)(spscRingT*)) {
+    for (int i = 0; i < RING_SPIN_COUNT; i++) {
+        if (pfnReady(pRing)) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(pRing->mtxWake);
+    pRing->nSleepers++;
+    while (!pfnReady(pRing)) {
+        pRing->cvWake.wait(lock);
+    }
+    pRing->nSleepers--;
+}
+
+/**
+ * Wake the other side of a ring if it sleeps
+ * @param pRing Ring
+ */
+void vWakeRing(spscRingT* pRing) {
+    if (pRing->nSleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(pRing->mtxWake);
+        pRing->cvWake.notify_all();
+    }
+}
+
+/**
+ * Wait for the next readable span of a ring, the bytes stay valid until they are released
+ * @param pRing Ring
+ * @param ppData Receives the start of the span
+ * @param nMax Maximum span size
+ * @return Size of the span, 0 once the producer is done and everything was read
+ */
+size_t nAcquireRingRead(spscRingT* pRing, unsigned char** ppData, size_t nMax) {
+    vWaitRing(pRing, bRingReadable);
+
+    unsigned long long ullRead = pRing->ullRead.load();
+    size_t nOffset = (size_t)(ullRead % pRing->nCapacity);
+    size_t nSpan = (size_t)(pRing->ullWritten.load() - ullRead);
+    if (nSpan > pRing->nCapacity - nOffset) {
+        nSpan = pRing->nCapacity - nOffset;
+    }
+    *ppData = pRing->pData + nOffset;
+    return nSpan < nMax ? nSpan : nMax;
+}
+
+/**
+ * Hand consumed bytes of a ring back to the producer
+ * @param pRing Ring
+ * @param nSize Number of bytes, from the start of the last acquired span
+ */
+void vReleaseRingRead(spscRingT* pRing, size_t nSize) {
+    if (nSize > 0) {
+        pRing->ullRead += nSize;
+        vWakeRing(pRing);
+    }
+}
+
+/**
+ * Wait for the next writable span of a ring
+ * @param pRing Ring
+ * @param ppData Receives the start of the span
+ * @param nMax Maximum span size
+ * @return Size of the span, 0 if the consumer is gone
+ */
+size_t nAcquireRingWrite(spscRingT* pRing, unsigned char** ppData, size_t nMax) {
+    vWaitRing(pRing, bRingWritable);
+    if (pRing->bCancelled.load()) {
+        return 0;
+    }
+
+    unsigned long long ullWritten = pRing->ullWritten.load();
+    size_t nOffset = (size_t)(ullWritten % pRing->nCapacity);
+    size_t nSpan = pRing->nCapacity - (size_t)(ullWritten - pRing->ullRead.load());
+    if (nSpan > pRing->nCapacity - nOffset) {
+        nSpan = pRing->nCapacity - nOffset;
+    }
+    *ppData = pRing->pData + nOffset;
+    return nSpan < nMax ? nSpan : nMax;
+}
+
+/**
+ * Make written bytes of a ring visible to the consumer
+ * @param pRing Ring
+ * @param nSize Number of bytes, from the start of the last acquired span
+ */
+void vPublishRingWrite(spscRingT* pRing, size_t nSize) {
+    if (nSize > 0) {
+        pRing->ullWritten += nSize;
+        vWakeRing(pRing);
+    }
+}
+
+/**
+ * Producer side: no more bytes will be published
+ * @param pRing Ring
+ */
+void vCloseRing(spscRingT* pRing) {
+    pRing->bClosed = true;
+    vWakeRing(pRing);
+}
+
+/**
+ * Consumer side: no more bytes will be read
+ * @param pRing Ring
+ */
+void vCancelRing(spscRingT* pRing) {
+    pRing->bCancelled = true;
+    vWakeRing(pRing);
+}
+
+/**
+ * Streaming decoder reader state, one per archive for gzip, zstd, xz and bzip2
+ */
+typedef struct decoderReaderT {
+    FILE* fp;                 // Archive file or stream, NULL when pInputRing or pMemoryInput supplies the input
+    spscRingT* pInputRing;    // Compressed input read ahead by another thread, NULL to read fp
+    const unsigned char* pMemoryInput; // Rest of an archive held in memory, NULL to read fp
+    size_t nMemoryLeft;       // Bytes left at pMemoryInput
+    unsigned char* pInput;    // Compressed input buffer, or the current span of pInputRing
+    size_t nInputPos;         // Next unconsumed input byte
+    size_t nInputLen;         // Valid bytes in the input buffer
+    bool bInputEof;           // The archive file is exhausted
+    unsigned char* pWindow;   // Output window for data viewed in place
+    size_t nWindowPos;        // Next unconsumed byte in the output window
+    size_t nWindowLen;        // Bytes decoded into the output window
+    unsigned char* pScratch;  // Output buffer for skipped data
+    void* pState;             // Format specific decoder state
+    // Decode from the input buffer into pOut, returns the bytes produced or -1 on error, sets bEnd at the end
+    long long (*pfnDecode)(struct decoderReaderT* pCtx, unsigned char* pOut, size_t nSize);
+    // Release pState
+    void (*pfnFree)(struct decoderReaderT* pCtx);
+    bool bStreamEnd;          // A gzip member or bzip2 stream ended, another one may follow
+    bool bBorrowed;           // pInput, pWindow and pScratch belong to a worker
+    bool bOwnsFile;           // fp was opened for the reader and is closed with it
+    bool bEnd;                // End of stream reached
+    bool bError;              // A decode error occurred, every later read fails
+} decoderReaderT;
+
+/**
+ * Decode step for uncompressed tars read from a stream, copies the input through
+ * @param pCtx Decoder reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer
+ * @return Number of bytes produced
+ */
+long long llDecodeStored(decoderReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    size_t nCopy = pCtx->nInputLen - pCtx->nInputPos;
+    if (nCopy > nSize) {
+        nCopy = nSize;
+    }
+    memcpy(pOut, pCtx->pInput + pCtx->nInputPos, nCopy);
+    pCtx->nInputPos += nCopy;
+    return (long long)nCopy;
+}
+
+/**
+ * Decode step for gzip, members that follow each other are decoded as one stream
+ * @param pCtx Decoder reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer, at most 1 GB
+ * @return Number of bytes produced, -1 on error
+ */
+long long llDecodeGzip(decoderReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    z_stream* pStream = (z_stream*)pCtx->pState;
+
+    if (pCtx->bStreamEnd) {
+        // Anything but another gzip member ends the archive
+        if (pCtx->nInputPos == pCtx->nInputLen || pCtx->pInput[pCtx->nInputPos] != 0x1f) {
+            pCtx->bEnd = true;
+            return 0;
+        }
+        inflateReset(pStream);
+        pCtx->bStreamEnd = false;
+    }
+
+    pStream->next_in = pCtx->pInput + pCtx->nInputPos;
+    pStream->avail_in = (uInt)(pCtx->nInputLen - pCtx->nInputPos);
+    pStream->next_out = pOut;
+    pStream->avail_out = (uInt)nSize;
+
+    int nRet = inflate(pStream, Z_NO_FLUSH);
+    pCtx->nInputPos = pCtx->nInputLen - pStream->avail_in;
+
+    if (nRet == Z_STREAM_END) {
+        pCtx->bStreamEnd = true;
+    }
+    else if (nRet != Z_OK && nRet != Z_BUF_ERROR) {
+        vLogMessage("Error: Inflate failed: %s\n", pStream->msg ? pStream->msg : "unknown error");
+        return -1;
+    }
+
+    return (long long)(nSize - pStream->avail_out);
+}
+
+/**
+ * Release the gzip decoder
+ * @param pCtx Decoder reader
+ */
+void vFreeGzip(decoderReaderT* pCtx) {
+    vReleaseInflateState((z_stream*)pCtx->pState, pCtx->bBorrowed);
+}
+
+#ifdef BATTERYCYCLE_WITH_ZSTD
+/**
+ * Decode step for zstd, frames that follow each other are decoded as one stream
+ * @param pCtx Decoder reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer
+ * @return Number of bytes produced, -1 on error
+ */
+long long llDecodeZstd(decoderReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    ZSTD_inBuffer stIn = { pCtx->pInput + pCtx->nInputPos, pCtx->nInputLen - pCtx->nInputPos, 0 };
+    ZSTD_outBuffer stOut = { pOut, nSize, 0 };
+
+    size_t nRet = ZSTD_decompressStream((ZSTD_DStream*)pCtx->pState, &stOut, &stIn);
+    pCtx->nInputPos += stIn.pos;
+    if (ZSTD_isError(nRet)) {
+        vLogMessage("Error: zstd decoding failed: %s\n", ZSTD_getErrorName(nRet));
+        return -1;
+    }
+
+    return (long long)stOut.pos;
+}
+
+/**
+ * Release the zstd decoder
+ * @param pCtx Decoder reader
+ */
+void vFreeZstd(decoderReaderT* pCtx) {
+    ZSTD_freeDStream((ZSTD_DStream*)pCtx->pState);
+}
+#endif
+
+#ifdef BATTERYCYCLE_WITH_XZ
+/**
+ * Decode step for xz, concatenated streams are decoded as one
+ * @param pCtx Decoder reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer
+ * @return Number of bytes produced, -1 on error
+ */
+long long llDecodeXz(decoderReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    lzma_stream* pStream = (lzma_stream*)pCtx->pState;
+    pStream->next_in = pCtx->pInput + pCtx->nInputPos;
+    pStream->avail_in = pCtx->nInputLen - pCtx->nInputPos;
+    pStream->next_out = pOut;
+    pStream->avail_out = nSize;
+
+    // LZMA_CONCATENATED needs LZMA_FINISH to know no further stream follows
+    lzma_ret eRet = lzma_code(pStream, pCtx->bInputEof ? LZMA_FINISH : LZMA_RUN);
+    pCtx->nInputPos = pCtx->nInputLen - pStream->avail_in;
+
+    if (eRet == LZMA_STREAM_END) {
+        pCtx->bEnd = true;
+    }
+    else if (eRet != LZMA_OK && !(eRet == LZMA_BUF_ERROR && pCtx->bInputEof)) {
+        vLogMessage("Error: xz decoding failed (%d)\n", (int)eRet);
+        return -1;
+    }
+
+    return (long long)(nSize - pStream->avail_out);
+}
+
+/**
+ * Release the xz decoder
+ * @param pCtx Decoder reader
+ */
+void vFreeXz(decoderReaderT* pCtx) {
+    lzma_end((lzma_stream*)pCtx->pState);
+    free(pCtx->pState);
+}
+#endif
+
+#ifdef BATTERYCYCLE_WITH_BZIP2
+/**
+ * Decode step for bzip2, further streams as written by parallel compressors are decoded as one
+ * @param pCtx Decoder reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer, at most 1 GB
+ * @return Number of bytes produced, -1 on error
+ */
+long long llDecodeBzip2(decoderReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    bz_stream* pStream = (bz_stream*)pCtx->pState;
+
+    if (pCtx->bStreamEnd) {
+        // Anything but another bzip2 stream ends the archive
+        if (pCtx->nInputPos == pCtx->nInputLen || pCtx->pInput[pCtx->nInputPos] != 'B') {
+            pCtx->bEnd = true;
+            return 0;
+        }
+        BZ2_bzDecompressEnd(pStream);
+        memset(pStream, 0, sizeof(bz_stream));
+        if (BZ2_bzDecompressInit(pStream, 0, 0) != BZ_OK) {
+            vLogMessage("Error: Memory allocation failed\n");
+            return -1;
+        }
+        pCtx->bStreamEnd = false;
+    }
+
+    pStream->next_in = (char*)pCtx->pInput + pCtx->nInputPos;
+    pStream->avail_in = (unsigned int)(pCtx->nInputLen - pCtx->nInputPos);
+    pStream->next_out = (char*)pOut;
+    pStream->avail_out = (unsigned int)nSize;
+
+    int nRet = BZ2_bzDecompress(pStream);
+    pCtx->nInputPos = pCtx->nInputLen - pStream->avail_in;
+
+    if (nRet == BZ_STREAM_END) {
+        pCtx->bStreamEnd = true;
+    }
+    else if (nRet != BZ_OK) {
+        vLogMessage("Error: bzip2 decoding failed (%d)\n", nRet);
+        return -1;
+    }
+
+    return (long long)(nSize - pStream->avail_out);
+}
+
+/**
+ * Release the bzip2 decoder
+ * @param pCtx Decoder reader
+ */
+void vFreeBzip2(decoderReaderT* pCtx) {
+    BZ2_bzDecompressEnd((bz_stream*)pCtx->pState);
+    free(pCtx->pState);
+}
+#endif
+
+/**
+ * Set up the format specific decoder of a decoder reader
+ * @param pCtx Decoder reader
+ * @param nFormat One of INPUT_FORMAT_GZIP, INPUT_FORMAT_ZSTD, INPUT_FORMAT_XZ and INPUT_FORMAT_BZIP2,
+ *                or INPUT_FORMAT_TAR for a stream that cannot be mapped
+ * @param pBuffers Worker buffers whose warm gzip state to use, NULL to set up a new one
+ * @return 0 on success, -1 on error or if the format is not built in
+ */
+int nInitDecoder(decoderReaderT* pCtx, int nFormat, workerBuffersT* pBuffers) {
+    if (nFormat == INPUT_FORMAT_TAR) {
+        pCtx->pfnDecode = llDecodeStored;
+        return 0;
+    }
+    if (nFormat == INPUT_FORMAT_GZIP) {
+        z_stream* pStream = pAcquireInflateState(pBuffers);
+        if (!pStream) {
+            vLogMessage("Error: Memory allocation failed\n");
+            return -1;
+        }
+        pCtx->pState = pStream;
+        pCtx->pfnDecode = llDecodeGzip;
+        pCtx->pfnFree = vFreeGzip;
+        return 0;
+    }
+#ifdef BATTERYCYCLE_WITH_ZSTD
+    if (nFormat == INPUT_FORMAT_ZSTD) {
+        ZSTD_DStream* pDStream = ZSTD_createDStream();
+        if (!pDStream || ZSTD_isError(ZSTD_initDStream(pDStream))) {
+            vLogMessage("Error: Memory allocation failed\n");
+            ZSTD_freeDStream(pDStream);
+            return -1;
+        }
+        pCtx->pState = pDStream;
+        pCtx->pfnDecode = llDecodeZstd;
+        pCtx->pfnFree = vFreeZstd;
+        return 0;
+    }
+#endif
+#ifdef BATTERYCYCLE_WITH_XZ
+    if (nFormat == INPUT_FORMAT_XZ) {
+        lzma_stream* pStream = (lzma_stream*)calloc(1, sizeof(lzma_stream));
+        if (!pStream || lzma_stream_decoder(pStream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+            vLogMessage("Error: Memory allocation failed\n");
+            free(pStream);
+            return -1;
+        }
+        pCtx->pState = pStream;
+        pCtx->pfnDecode = llDecodeXz;
+        pCtx->pfnFree = vFreeXz;
+        return 0;
+    }
+#endif
+#ifdef BATTERYCYCLE_WITH_BZIP2
+    if (nFormat == INPUT_FORMAT_BZIP2) {
+        bz_stream* pStream = (bz_stream*)calloc(1, sizeof(bz_stream));
+        if (!pStream || BZ2_bzDecompressInit(pStream, 0, 0) != BZ_OK) {
+            vLogMessage("Error: Memory allocation failed\n");
+            free(pStream);
+            return -1;
+        }
+        pCtx->pState = pStream;
+        pCtx->pfnDecode = llDecodeBzip2;
+        pCtx->pfnFree = vFreeBzip2;
+        return 0;
+    }
+#endif
+
+    vLogMessage("Error: %s archives are not supported by this build\n", szInputFormatName(nFormat));
+    return -1;
+}
+
+/**
+ * Refill the input of a decoder reader once it is consumed
+ * @param pCtx Decoder reader
+ */
+void vRefillDecoderInput(decoderReaderT* pCtx) {
+    if (pCtx->pInputRing) {
+        // The consumed span goes back to the I/O thread
+        vReleaseRingRead(pCtx->pInputRing, pCtx->nInputLen);
+        pCtx->nInputLen = nAcquireRingRead(pCtx->pInputRing, &pCtx->pInput, INPUT_BUFFER_SIZE);
+    }
+    else if (pCtx->pMemoryInput) {
+        // Decoders take the buffer in place, in pieces their 32-bit counters can hold
+        pCtx->pInput = (unsigned char*)pCtx->pMemoryInput;
+        pCtx->nInputLen = pCtx->nMemoryLeft < 0x40000000 ? pCtx->nMemoryLeft : 0x40000000;
+        pCtx->pMemoryInput += pCtx->nInputLen;
+        pCtx->nMemoryLeft -= pCtx->nInputLen;
+    }
+    else {
+        pCtx->nInputLen = fread(pCtx->pInput, 1, INPUT_BUFFER_SIZE, pCtx->fp);
+        if (pCtx->nInputLen == 0 && ferror(pCtx->fp)) {
+            vLogMessage("Error: Reading the archive failed\n");
+        }
+    }
+    pCtx->nInputPos = 0;
+    pCtx->bInputEof = pCtx->nInputLen == 0;
+}
+
+/**
+ * Run one decode step of the decoder reader
+ * @param pCtx Decoder reader
+ * @param pOut Destination buffer
+ * @param nSize Size of the destination buffer, at most 1 GB
+ * @return Number of bytes produced, -1 on error
+ */
+long long llDecoderReaderStep(decoderReaderT* pCtx, unsigned char* pOut, size_t nSize) {
+    if (pCtx->nInputPos == pCtx->nInputLen && !pCtx->bInputEof) {
+        vRefillDecoderInput(pCtx);
+    }
+
+    long long llProduced = pCtx->pfnDecode(pCtx, pOut, nSize);
+    if (llProduced < 0) {
+        pCtx->bError = true;
+        return -1;
+    }
+
+    // Decoders may still flush output without input, truncated archives end once they stop
+    if (llProduced == 0 && pCtx->bInputEof && pCtx->nInputPos == pCtx->nInputLen) {
+        pCtx->bEnd = true;
+    }
+    return llProduced;
+}
+
+/**
+ * Copy or discard decoded bytes of the decoder reader
+ * @param pCtx Decoder reader
+ * @param pDest Destination buffer, NULL to discard
+ * @param ullSize Number of bytes
+ * @return Number of bytes consumed, -1 on error
+ */
+long long llPullDecoderReader(decoderReaderT* pCtx, unsigned char* pDest, unsigned long long ullSize) {
+    unsigned long long ullDone = 0;
+
+    if (pCtx->bError) {
+        return -1;
+    }
+
+    // Bytes already decoded into the output window come first
+    size_t nBuffered = pCtx->nWindowLen - pCtx->nWindowPos;
+    if (nBuffered > 0) {
+        if (nBuffered > ullSize) {
+            nBuffered = (size_t)ullSize;
+        }
+        if (pDest) {
+            memcpy(pDest, pCtx->pWindow + pCtx->nWindowPos, nBuffered);
+        }
+        pCtx->nWindowPos += nBuffered;
+        ullDone = nBuffered;
+    }
+
+    // The rest is decoded straight into the destination
+    while (ullDone < ullSize && !pCtx->bEnd) {
+        unsigned long long ullWant = ullSize - ullDone;
+        if (!pDest && ullWant > INPUT_BUFFER_SIZE) {
+            ullWant = INPUT_BUFFER_SIZE;
+        }
+        if (ullWant > 0x40000000) {
+            ullWant = 0x40000000;
+        }
+
+        long long llProduced = llDecoderReaderStep(pCtx, pDest ? pDest + ullDone : pCtx->pScratch, (size_t)ullWant);
+        if (llProduced < 0) {
+            return -1;
+        }
+        ullDone += llProduced;
+    }
+
+    return (long long)ullDone;
+}
+
+/**
+ * Read callback for the decoder reader
+ * @param pReader Reader instance
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes to read
+ * @return Number of bytes read, -1 on error
+ */
+long long llDecoderReaderRead(archiveReaderT* pReader, void* pBuffer, size_t nSize) {
+    return llPullDecoderReader((decoderReaderT*)pReader->pContext, (unsigned char*)pBuffer, nSize);
+}
+
+/**
+ * Skip callback for the decoder reader
+ * @param pReader Reader instance
+ * @param ullSize Number of bytes to skip
+ * @return 0 on success, -1 on error
+ */
+int nDecoderReaderSkip(archiveReaderT* pReader, unsigned long long ullSize) {
+    return llPullDecoderReader((decoderReaderT*)pReader->pContext, NULL, ullSize) < 0 ? -1 : 0;
+}
+
+/**
+ * View callback for the decoder reader, decodes into the output window
+ * @param pReader Reader instance
+ * @param nSize Number of bytes to consume, at most OUTPUT_WINDOW_SIZE
+ * @return Pointer to the bytes inside the output window, NULL if fewer are left
+ */
+const void* pDecoderReaderView(archiveReaderT* pReader, size_t nSize) {
+    decoderReaderT* pCtx = (decoderReaderT*)pReader->pContext;
+
+    if (pCtx->nWindowLen - pCtx->nWindowPos < nSize) {
+        if (pCtx->bError || nSize > OUTPUT_WINDOW_SIZE) {
+            return NULL;
+        }
+
+        // Keep the unconsumed tail and decode only what is missing
+        size_t nKeep = pCtx->nWindowLen - pCtx->nWindowPos;
+        memmove(pCtx->pWindow, pCtx->pWindow + pCtx->nWindowPos, nKeep);
+        pCtx->nWindowPos = 0;
+        pCtx->nWindowLen = nKeep;
+
+        while (pCtx->nWindowLen < nSize && !pCtx->bEnd) {
+            long long llProduced = llDecoderReaderStep(pCtx, pCtx->pWindow + pCtx->nWindowLen,
+                nSize - pCtx->nWindowLen);
+            if (llProduced < 0) {
+                return NULL;
+            }
+            pCtx->nWindowLen += (size_t)llProduced;
+        }
+
+        if (pCtx->nWindowLen < nSize) {
+            return NULL;
+        }
+    }
+
+    const void* pData = pCtx->pWindow + pCtx->nWindowPos;
+    pCtx->nWindowPos += nSize;
+    return pData;
+}
+
+/**
+ * Close callback for the decoder reader
+ * @param pReader Reader instance
+ */
+void vDecoderReaderClose(archiveReaderT* pReader) {
+    decoderReaderT* pCtx = (decoderReaderT*)pReader->pContext;
+    if (pCtx->pfnFree) {
+        pCtx->pfnFree(pCtx);
+    }
+    if (pCtx->bOwnsFile) {
+        fclose(pCtx->fp);
+    }
+    if (!pCtx->bBorrowed) {
+        if (pCtx->fp) {
+            free(pCtx->pInput);
+        }
+        free(pCtx->pWindow);
+        free(pCtx->pScratch);
+    }
+    free(pCtx);
+    free(pReader);
+}
+
+/**
+ * Create a single threaded streaming decoder over a file or stream, or over an archive in memory
+ * The reader only ever reads fp forward, so pipes and sockets work as well as files.
+ * @param fp Archive file or stream, left open by the reader, NULL to decode pData
+ * @param pData With fp, bytes already read from it that come first, at most INPUT_BUFFER_SIZE.
+ *              Otherwise an archive held in memory, decoded in place and not owned by the reader
+ * @param nSize Size of pData
+ * @param nFormat One of INPUT_FORMAT_GZIP, INPUT_FORMAT_ZSTD, INPUT_FORMAT_XZ and INPUT_FORMAT_BZIP2,
+ *                or INPUT_FORMAT_TAR for a stream that cannot be mapped
+ * @param pBuffers Worker buffers to use, NULL to allocate them
+ * @return Reader instance, NULL on error or if the format is not built in
+ */
+archiveReaderT* pCreateDecoderReader(FILE* fp, const unsigned char* pData, size_t nSize, int nFormat,
+    workerBuffersT* pBuffers) {
+    archiveReaderT* pReader = (archiveReaderT*)calloc(1, sizeof(archiveReaderT));
+    decoderReaderT* pCtx = (decoderReaderT*)calloc(1, sizeof(decoderReaderT));
+    unsigned char* pInput = !fp ? NULL : pBuffers ? pBuffers->pInput : (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    unsigned char* pWindow = pBuffers ? pBuffers->pWindow : (unsigned char*)malloc(OUTPUT_WINDOW_SIZE);
+    unsigned char* pScratch = pBuffers ? pBuffers->pScratch : (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    if (!pReader || !pCtx || (fp && !pInput) || !pWindow || !pScratch) {
+        vLogMessage("Error: Memory allocation failed\n");
+    }
+    if (!pReader || !pCtx || (fp && !pInput) || !pWindow || !pScratch || nInitDecoder(pCtx, nFormat, pBuffers) != 0) {
+        free(pReader);
+        free(pCtx);
+        if (!pBuffers) {
+            free(pInput);
+            free(pWindow);
+            free(pScratch);
+        }
+        return NULL;
+    }
+
+    pCtx->fp = fp;
+    pCtx->pMemoryInput = fp ? NULL : pData;
+    pCtx->nMemoryLeft = fp ? 0 : nSize;
+    pCtx->pInput = pInput;
+    if (fp && nSize > 0) {
+        // Bytes the caller peeked at, e.g. to detect the format of a pipe, are decoded first
+        memcpy(pInput, pData, nSize);
+        pCtx->nInputLen = nSize;
+    }
+    pCtx->pWindow = pWindow;
+    pCtx->pScratch = pScratch;
+    pCtx->bBorrowed = pBuffers != NULL;
+
+    pReader->pfnRead = llDecoderReaderRead;
+    pReader->pfnSkip = nDecoderReaderSkip;
+    pReader->pfnView = pDecoderReaderView;
+    pReader->pfnClose = vDecoderReaderClose;
+    pReader->pContext = pCtx;
+    return pReader;
+}
+
+/**
+ * Open a compressed tar with a single threaded streaming decoder
+ * @param szArchivePath Path to the archive
+ * @param nFormat One of INPUT_FORMAT_GZIP, INPUT_FORMAT_ZSTD, INPUT_FORMAT_XZ and INPUT_FORMAT_BZIP2
+ * @param pBuffers Worker buffers to use, NULL to allocate them
+ * @return Reader instance, NULL on error or if the format is not built in
+ */
+archiveReaderT* pOpenDecoderReader(const char* szArchivePath, int nFormat, workerBuffersT* pBuffers) {
+    FILE* fp = fopen(szArchivePath, "rb");
+    if (!fp) {
+        vLogMessage("Error: Cannot open %s\n", szArchivePath);
+        return NULL;
+    }
+
+    archiveReaderT* pReader = pCreateDecoderReader(fp, NULL, 0, nFormat, pBuffers);
+    if (!pReader) {
+        fclose(fp);
+        return NULL;
+    }
+    ((decoderReaderT*)pReader->pContext)->bOwnsFile = true;
+    return pReader;
+}
+
+/**
+ * Pipelined reader state
+ * An I/O thread reads the archive ahead into one ring, a decode thread turns it into the tar
+ * stream in a second ring, and the tar parser consumes that on the calling thread.
+ */
+typedef struct pipelineReaderT {
+    FILE* fp;                 // Archive file or stream, read by the I/O thread only
+    bool bOwnsFile;           // fp was opened for the reader and is closed with it
+    spscRingT stInput;        // Compressed bytes from the I/O thread to the decode thread
+    spscRingT stOutput;       // Tar stream from the decode thread to the parser
+    decoderReaderT stDecoder; // Decoder state, used by the decode thread only
+    std::thread thIo;
+    std::thread thDecode;
+    std::atomic<bool> bFailed; // A stage failed, the tar stream ends with an error
+    logSinkT* pLogSink;       // Log sink of the opening thread, the stages report to it as well
+
+    unsigned char* pSpan;     // Output span the parser is reading, released when it moves on
+    size_t nSpanPos;          // Next unconsumed byte in the span
+    size_t nSpanLen;          // Size of the span
+    unsigned char abWindow[OUTPUT_WINDOW_SIZE]; // Views that straddle two spans are gathered here
+    size_t nWindowPos;        // Next unconsumed byte in abWindow
+    size_t nWindowLen;        // Bytes gathered into abWindow
+} pipelineReaderT;
+
+/**
+ * I/O thread of the pipelined reader, keeps the input ring filled
+ * @param pCtx Pipelined reader
+ */
+void vPipelineIoStage(pipelineReaderT* pCtx) {
+    g_pLogSink = pCtx->pLogSink;
+    while (true) {
+        unsigned char* pSpan;
+        size_t nSpan = nAcquireRingWrite(&pCtx->stInput, &pSpan, INPUT_BUFFER_SIZE);
+        if (nSpan == 0) {
+            break;
+        }
+
+        size_t nRead = fread(pSpan, 1, nSpan, pCtx->fp);
+        vPublishRingWrite(&pCtx->stInput, nRead);
+        if (nRead < nSpan) {
+            if (ferror(pCtx->fp)) {
+                vLogMessage("Error: Reading the archive failed\n");
+                pCtx->bFailed = true;
+            }
+            break;
+        }
+    }
+    vCloseRing(&pCtx->stInput);
+}
+
+/**
+ * Decode thread of the pipelined reader, keeps the output ring filled
+ * @param pCtx Pipelined reader
+ */
+void vPipelineDecodeStage(pipelineReaderT* pCtx) {
+    g_pLogSink = pCtx->pLogSink;
+    while (!pCtx->stDecoder.bEnd) {
+        unsigned char* pSpan;
+        size_t nSpan = nAcquireRingWrite(&pCtx->stOutput, &pSpan, INPUT_BUFFER_SIZE);
+        if (nSpan == 0) {
+            break;
+        }
+
+        long long llProduced = llDecoderReaderStep(&pCtx->stDecoder, pSpan, nSpan);
+        if (llProduced < 0) {
+            pCtx->bFailed = true;
+            break;
+        }
+        vPublishRingWrite(&pCtx->stOutput, (size_t)llProduced);
+    }
+
+    // The I/O thread may stop reading as well, e.g. after an early stop or an error
+    vCancelRing(&pCtx->stInput);
+    vCloseRing(&pCtx->stOutput);
+}
+
+/**
+ * Copy or discard tar stream bytes from the output ring of the pipelined reader
+ * @param pCtx Pipelined reader
+ * @param pDest Destination buffer, NULL to discard
+ * @param ullSize Number of bytes
+ * @return Number of bytes consumed, -1 on error
+ */
+long long llPullPipelineSpans(pipelineReaderT* pCtx, unsigned char* pDest, unsigned long long ullSize) {
+    unsigned long long ullDone = 0;
+
+    while (ullDone < ullSize) {
+        if (pCtx->nSpanPos == pCtx->nSpanLen) {
+            vReleaseRingRead(&pCtx->stOutput, pCtx->nSpanLen);
+            pCtx->nSpanPos = 0;
+            pCtx->nSpanLen = nAcquireRingRead(&pCtx->stOutput, &pCtx->pSpan, INPUT_BUFFER_SIZE);
+            if (pCtx->nSpanLen == 0) {
+                return pCtx->bFailed.load() ? -1 : (long long)ullDone;
+            }
+        }
+
+        size_t nCopy = pCtx->nSpanLen - pCtx->nSpanPos;
+        if (nCopy > ullSize - ullDone) {
+            nCopy = (size_t)(ullSize - ullDone);
+        }
+        if (pDest) {
+            memcpy(pDest + ullDone, pCtx->pSpan + pCtx->nSpanPos, nCopy);
+        }
+        pCtx->nSpanPos += nCopy;
+        ullDone += nCopy;
+    }
+
+    return (long long)ullDone;
+}
+
+/**
+ * Copy or discard tar stream bytes of the pipelined reader
+ * @param pCtx Pipelined reader
+ * @param pDest Destination buffer, NULL to discard
+ * @param ullSize Number of bytes
+ * @return Number of bytes consumed, -1 on error
+ */
+long long llPullPipelineReader(pipelineReaderT* pCtx, unsigned char* pDest, unsigned long long ullSize) {
+    // Bytes gathered into the window by a failed view come first
+    size_t nBuffered = pCtx->nWindowLen - pCtx->nWindowPos;
+    if (nBuffered > ullSize) {
+        nBuffered = (size_t)ullSize;
+    }
+    if (pDest) {
+        memcpy(pDest, pCtx->abWindow + pCtx->nWindowPos, nBuffered);
+    }
+    pCtx->nWindowPos += nBuffered;
+
+    long long llRest = llPullPipelineSpans(pCtx, pDest ? pDest + nBuffered : NULL, ullSize - nBuffered);
+    return llRest < 0 ? -1 : (long long)nBuffered + llRest;
+}
+
+/**
+ * Read callback for the pipelined reader
+ * @param pReader Reader instance
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes to read
+ * @return Number of bytes read, -1 on error
+ */
+long long llPipelineReaderRead(archiveReaderT* pReader, void* pBuffer, size_t nSize) {
+    return llPullPipelineReader((pipelineReaderT*)pReader->pContext, (unsigned char*)pBuffer, nSize);
+}
+
+/**
+ * Skip callback for the pipelined reader
+ * @param pReader Reader instance
+ * @param ullSize Number of bytes to skip
+ * @return 0 on success, -1 on error
+ */
+int nPipelineReaderSkip(archiveReaderT* pReader, unsigned long long ullSize) {
+    return llPullPipelineReader((pipelineReaderT*)pReader->pContext, NULL, ullSize) < 0 ? -1 : 0;
+}
+
+/**
+ * View callback for the pipelined reader, points into the output ring where possible
+ * @param pReader Reader instance
+ * @param nSize Number of bytes to consume, at most OUTPUT_WINDOW_SIZE
+ * @return Pointer to the bytes, NULL if fewer are left
+ */
+const void* pPipelineReaderView(archiveReaderT* pReader, size_t nSize) {
+    pipelineReaderT* pCtx = (pipelineReaderT*)pReader->pContext;
+
+    // The span stays acquired until the parser moves past it, so the bytes cannot be overwritten
+    if (pCtx->nWindowPos == pCtx->nWindowLen && pCtx->nSpanLen - pCtx->nSpanPos >= nSize) {
+        const void* pData = pCtx->pSpan + pCtx->nSpanPos;
+        pCtx->nSpanPos += nSize;
+        return pData;
+    }
+    if (nSize > OUTPUT_WINDOW_SIZE) {
+        return NULL;
+    }
+
+    // Gather the bytes, if the stream ends short they stay in the window for the next read
+    size_t nKeep = pCtx->nWindowLen - pCtx->nWindowPos;
+    memmove(pCtx->abWindow, pCtx->abWindow + pCtx->nWindowPos, nKeep);
+    pCtx->nWindowPos = 0;
+    pCtx->nWindowLen = nKeep;
+    if (nKeep < nSize) {
+        long long llGathered = llPullPipelineSpans(pCtx, pCtx->abWindow + nKeep, nSize - nKeep);
+        if (llGathered > 0) {
+            pCtx->nWindowLen += (size_t)llGathered;
+        }
+    }
+
+    if (pCtx->nWindowLen < nSize) {
+        return NULL;
+    }
+    pCtx->nWindowPos = nSize;
+    return pCtx->abWindow;
+}
+
+/**
+ * Close callback for the pipelined reader, stops both threads
+ * @param pReader Reader instance
+ */
+void vPipelineReaderClose(archiveReaderT* pReader) {
+    pipelineReaderT* pCtx = (pipelineReaderT*)pReader->pContext;
+
+    vCancelRing(&pCtx->stOutput);
+    if (pCtx->thDecode.joinable()) {
+        pCtx->thDecode.join();
+    }
+    vCancelRing(&pCtx->stInput);
+    if (pCtx->thIo.joinable()) {
+        pCtx->thIo.join();
+    }
+
+    if (pCtx->stDecoder.pfnFree) {
+        pCtx->stDecoder.pfnFree(&pCtx->stDecoder);
+    }
+    if (pCtx->bOwnsFile) {
+        fclose(pCtx->fp);
+    }
+    free(pCtx->stInput.pData);
+    free(pCtx->stOutput.pData);
+    delete pCtx;
+    free(pReader);
+}
+
+/**
+ * Resolve how far the I/O thread of the pipelined reader may read ahead
+ * @param pOptions Extraction options, NULL for defaults
+ * @return Read-ahead in bytes, at least two input buffers
+ */
+unsigned long long ullResolveReadAhead(const extractOptionsT* pOptions) {
+    unsigned long long ullReadAhead = pOptions && pOptions->ullReadAhead ? pOptions->ullReadAhead : DEFAULT_READ_AHEAD;
+    return ullReadAhead > 2 * INPUT_BUFFER_SIZE ? ullReadAhead : 2 * INPUT_BUFFER_SIZE;
+}
+
+/**
+ * Create a reader that reads, decodes and parses a compressed tar on three threads
+ * @param fp Archive file or stream, left open by the reader
+ * @param pPrefix Bytes already read from fp that come first, at most INPUT_BUFFER_SIZE
+ * @param nPrefix Size of pPrefix
+ * @param nFormat One of INPUT_FORMAT_GZIP, INPUT_FORMAT_ZSTD, INPUT_FORMAT_XZ and INPUT_FORMAT_BZIP2,
+ *                or INPUT_FORMAT_TAR for a stream that cannot be mapped
+ * @param pOptions Extraction options, ullReadAhead sizes the input ring
+ * @return Reader instance, NULL on error or if the format is not built in
+ */
+archiveReaderT* pCreatePipelineReader(FILE* fp, const unsigned char* pPrefix, size_t nPrefix, int nFormat,
+    const extractOptionsT* pOptions) {
+    archiveReaderT* pReader = (archiveReaderT*)calloc(1, sizeof(archiveReaderT));
+    pipelineReaderT* pCtx = new pipelineReaderT();
+    pCtx->fp = fp;
+    pCtx->stInput.nCapacity = (size_t)ullResolveReadAhead(pOptions);
+    pCtx->stInput.pData = (unsigned char*)malloc(pCtx->stInput.nCapacity);
+    pCtx->stOutput.nCapacity = PIPELINE_OUTPUT_SIZE;
+    pCtx->stOutput.pData = (unsigned char*)malloc(pCtx->stOutput.nCapacity);
+    if (!pReader || !pCtx->stInput.pData || !pCtx->stOutput.pData) {
+        vLogMessage("Error: Memory allocation failed\n");
+    }
+    if (!pReader || !pCtx->stInput.pData || !pCtx->stOutput.pData || nInitDecoder(&pCtx->stDecoder, nFormat, NULL) != 0) {
+        free(pCtx->stInput.pData);
+        free(pCtx->stOutput.pData);
+        delete pCtx;
+        free(pReader);
+        return NULL;
+    }
+    pCtx->stDecoder.pInputRing = &pCtx->stInput;
+    pCtx->pLogSink = g_pLogSink;
+
+    // The ring is still empty, so the peeked bytes fit in one span
+    if (nPrefix > 0) {
+        unsigned char* pSpan;
+        nAcquireRingWrite(&pCtx->stInput, &pSpan, nPrefix);
+        memcpy(pSpan, pPrefix, nPrefix);
+        vPublishRingWrite(&pCtx->stInput, nPrefix);
+    }
+
+    pReader->pfnRead = llPipelineReaderRead;
+    pReader->pfnSkip = nPipelineReaderSkip;
+    pReader->pfnView = pPipelineReaderView;
+    pReader->pfnClose = vPipelineReaderClose;
+    pReader->pContext = pCtx;
+
+    pCtx->thIo = std::thread(vPipelineIoStage, pCtx);
+    pCtx->thDecode = std::thread(vPipelineDecodeStage, pCtx);
+    return pReader;
+}
+
+/**
+ * Open a compressed tar with reading, decoding and tar parsing on three threads
+ * @param szArchivePath Path to the archive
+ * @param nFormat One of INPUT_FORMAT_GZIP, INPUT_FORMAT_ZSTD, INPUT_FORMAT_XZ and INPUT_FORMAT_BZIP2
+ * @param pOptions Extraction options, ullReadAhead sizes the input ring
+ * @return Reader instance, NULL on error or if the format is not built in
+ */
+archiveReaderT* pOpenPipelineReader(const char* szArchivePath, int nFormat, const extractOptionsT* pOptions) {
+    FILE* fp = fopen(szArchivePath, "rb");
+    if (!fp) {
+        vLogMessage("Error: Cannot open %s\n", szArchivePath);
+        return NULL;
+    }
+
+    archiveReaderT* pReader = pCreatePipelineReader(fp, NULL, 0, nFormat, pOptions);
+    if (!pReader) {
+        fclose(fp);
+        return NULL;
+    }
+    ((pipelineReaderT*)pReader->pContext)->bOwnsFile = true;
+    return pReader;
+}
+
+/**
+ * Resolve the number of decompression threads to use
+ * @param pOptions Extraction options, NULL for defaults
+ * @return Number of threads, at least 1
+ */
+int nResolveThreadCount(const extractOptionsT* pOptions) {
+    int nThreads = pOptions ? pOptions->nThreads : 0;
+    if (nThreads <= 0) {
+        nThreads = (int)std::thread::hardware_concurrency();
+    }
+    return nThreads > 0 ? nThreads : 1;
+}
+
+/**
+ * Open a reader over the uncompressed tar stream of a tar.gz file
+ * @param szTargzPath Path to the tar.gz file
+ * @param pOptions Extraction options, NULL for defaults
+ * @param pIndex Index to record checkpoints into, NULL for none
+ * @return Reader instance, NULL on error
+ */
+archiveReaderT* pOpenArchiveReader(const char* szTargzPath, const extractOptionsT* pOptions, archiveIndexT* pIndex) {
+    // Uncompressed tars are walked straight from the page cache
+    int nFormat = nDetectInputFormat(szTargzPath);
+    if (nFormat == INPUT_FORMAT_TAR) {
+        archiveReaderT* pReader = pOpenMappedReader(szTargzPath);
+        if (pReader) {
+            return pReader;
+        }
+    }
+
+    // Other compressors have a single streaming decoder each, the options below are gzip only
+    int nThreads = nResolveThreadCount(pOptions);
+    if (nFormat == INPUT_FORMAT_ZSTD || nFormat == INPUT_FORMAT_XZ || nFormat == INPUT_FORMAT_BZIP2) {
+        return nThreads > 1 ? pOpenPipelineReader(szTargzPath, nFormat, pOptions)
+            : pOpenDecoderReader(szTargzPath, nFormat, pOptions ? pOptions->pBuffers : NULL);
+    }
+
+    const char* szBackend = pOptions ? pOptions->szBackend : NULL;
+    bool bAuto = !szBackend || _stricmp(szBackend, "auto") == 0;
+    const inflateBackendT* pBackend = bAuto ? NULL : pFindInflateBackend(szBackend);
+
+    // Archives smaller than two chunks gain nothing from the thread pool, which decodes with zlib
+    if (nThreads > 1 && (bAuto || pIndex || pBackend == &astInflateBackends[0])) {
+        FILE* fp = fopen(szTargzPath, "rb");
+        long long llSize = -1;
+        if (fp) {
+            if (_fseeki64(fp, 0, SEEK_END) == 0) {
+                llSize = _ftelli64(fp);
+            }
+            fclose(fp);
+        }
+
+        if (llSize >= 2LL * PARALLEL_CHUNK_SIZE) {
+            archiveReaderT* pReader = pOpenParallelReader(szTargzPath, nThreads, pIndex, pOptions);
+            if (pReader) {
+                return pReader;
+            }
+        }
+    }
+
+    // gzFile hides block boundaries, building an index needs the raw inflate state
+    if (pIndex) {
+        return pOpenInflateReader(szTargzPath, pIndex, pOptions ? pOptions->pBuffers : NULL);
+    }
+
+    // Faster backends that cannot serve this archive fall back to streaming with zlib
+    for (int i = INFLATE_BACKEND_COUNT - 1; i > 0; i--) {
+        if (bAuto || pBackend == &astInflateBackends[i]) {
+            archiveReaderT* pReader = astInflateBackends[i].pfnOpen(szTargzPath, pOptions);
+            if (pReader) {
+                return pReader;
+            }
+        }
+    }
+
+    // Streaming zlib still overlaps reading, inflating and tar parsing if it may use threads
+    if (nThreads > 1 && nFormat == INPUT_FORMAT_GZIP) {
+        return pOpenPipelineReader(szTargzPath, nFormat, pOptions);
+    }
+    return pOpenZlibBackend(szTargzPath, pOptions);
+}
+
+/**
+ * Random access position in an indexed archive
+ */
+typedef struct {
+    FILE* fp;                 // Archive file
+    z_stream stStream;        // Raw inflate state
+    unsigned char* pInput;    // Compressed input buffer
+    unsigned long long ullOut; // Uncompressed offset of the stream position
+    bool bActive;             // The stream is positioned and can continue forward
+    bool bEnd;                // End of the deflate data reached
+} indexCursorT;
+
+/**
+ * Move unread input to the front of the cursor's buffer and top it up from the archive
+ * @param pCursor Index cursor
+ * @return Number of bytes available
+ */
+size_t nFillCursorInput(indexCursorT* pCursor) {
+    z_stream* pStream = &pCursor->stStream;
+    if (pStream->avail_in > 0 && pStream->next_in != pCursor->pInput) {
+        memmove(pCursor->pInput, pStream->next_in, pStream->avail_in);
+    }
+    pStream->next_in = pCursor->pInput;
+    pStream->avail_in += (uInt)fread(pCursor->pInput + pStream->avail_in, 1,
+        INPUT_BUFFER_SIZE - pStream->avail_in, pCursor->fp);
+    return pStream->avail_in;
+}
+
+/**
+ * Copy or discard decoded bytes at the cursor position
+ * @param pCursor Index cursor
+ * @param pDest Destination buffer, NULL to discard
+ * @param ullSize Number of bytes
+ * @return Number of bytes consumed, -1 on error
+ */
+long long llReadIndexCursor(indexCursorT* pCursor, unsigned char* pDest, unsigned long long ullSize) {
+    unsigned long long ullDone = 0;
+    unsigned char abScratch[CHUNK];
+    z_stream* pStream = &pCursor->stStream;
+
+    while (ullDone < ullSize && !pCursor->bEnd) {
+        bool bNoInput = pStream->avail_in == 0 && nFillCursorInput(pCursor) == 0;
+
+        unsigned long long ullWant = ullSize - ullDone;
+        if (!pDest && ullWant > sizeof(abScratch)) {
+            ullWant = sizeof(abScratch);
+        }
+        if (ullWant > 0x40000000) {
+            ullWant = 0x40000000;
+        }
+
+        pStream->next_out = pDest ? pDest + ullDone : abScratch;
+        pStream->avail_out = (uInt)ullWant;
+        int nRet = inflate(pStream, Z_NO_FLUSH);
+        ullDone += ullWant - pStream->avail_out;
+        pCursor->ullOut += ullWant - pStream->avail_out;
+
+        if (bNoInput && pStream->avail_out == ullWant) {
+            pCursor->bEnd = true; // Nothing left to flush
+        }
+        else if (nRet == Z_STREAM_END) {
+            // Member boundary, skip the trailer and the next member's header
+            size_t nDeflateStart = 0;
+            nFillCursorInput(pCursor);
+            if (pStream->avail_in > 8 &&
+                bParseGzipHeader(pStream->next_in + 8, pStream->avail_in - 8, &nDeflateStart)) {
+                pStream->next_in += 8 + nDeflateStart;
+                pStream->avail_in -= (uInt)(8 + nDeflateStart);
+                inflateReset(pStream);
+            }
+            else {
+                pCursor->bEnd = true;
+            }
+        }
+        else if (nRet != Z_OK && nRet != Z_BUF_ERROR) {
+            vLogMessage("Error: Inflate failed: %s\n", pStream->msg ? pStream->msg : "unknown error");
+            pCursor->bActive = false;
+            return -1;
+        }
+    }
+
+    return (long long)ullDone;
+}
+
+/**
+ * Position the cursor at an uncompressed offset, from the nearest checkpoint if needed
+ * @param pCursor Index cursor
+ * @param pIndex Archive index
+ * @param ullTarget Uncompressed offset to move to
+ * @return 0 on success, -1 on error
+ */
+int nSeekIndexCursor(indexCursorT* pCursor, const archiveIndexT* pIndex, unsigned long long ullTarget) {
+    // Members close behind the current position are cheaper to reach by decoding forward
+    if (!pCursor->bActive || ullTarget < pCursor->ullOut || ullTarget - pCursor->ullOut >= INDEX_SPAN) {
+        int nLow = 0, nHigh = pIndex->nCheckpoints - 1;
+        while (nLow < nHigh) {
+            int nMid = (nLow + nHigh + 1) / 2;
+            if (pIndex->pCheckpoints[nMid].ullOut <= ullTarget) {
+                nLow = nMid;
+            }
+            else {
+                nHigh = nMid - 1;
+            }
+        }
+
+        const indexCheckpointT* pCheckpoint = &pIndex->pCheckpoints[nLow];
+        unsigned char abWindow[DEFLATE_WINDOW_SIZE];
+        uLongf ulWindowSize = sizeof(abWindow);
+        if (uncompress(abWindow, &ulWindowSize, pCheckpoint->pWindow, pCheckpoint->uPackedSize) != Z_OK ||
+            ulWindowSize != pCheckpoint->uWindowSize) {
+            vLogMessage("Error: Corrupt index window\n");
+            return -1;
+        }
+
+        z_stream* pStream = &pCursor->stStream;
+        inflateReset(pStream);
+        pStream->avail_in = 0;
+        if (_fseeki64(pCursor->fp, (long long)(pCheckpoint->ullBit >> 3), SEEK_SET) != 0 ||
+            nFillCursorInput(pCursor) == 0) {
+            return -1;
+        }
+
+        int nBit = (int)(pCheckpoint->ullBit & 7);
+        if (nBit) {
+            inflatePrime(pStream, 8 - nBit, pStream->next_in[0] >> nBit);
+            pStream->next_in++;
+            pStream->avail_in--;
+        }
+        if (ulWindowSize > 0) {
+            inflateSetDictionary(pStream, abWindow, (uInt)ulWindowSize);
+        }
+
+        pCursor->ullOut = pCheckpoint->ullOut;
+        pCursor->bActive = true;
+        pCursor->bEnd = false;
+    }
+
+    unsigned long long ullSkip = ullTarget - pCursor->ullOut;
+    return llReadIndexCursor(pCursor, NULL, ullSkip) == (long long)ullSkip ? 0 : -1;
+}
+
+/**
+ * Extract matching files using an archive index instead of scanning the whole archive
+ * @param pIndex Archive index
+ * @param szTargzPath Path to the tar.gz file
+ * @param szTargetDir Target directory to extract from
+ * @param pfnMatcher Callback function for file matching
+ * @param pfnContent Callback function receiving the content of extracted files
+ * @param pUserData User data for callback
+ * @return 0 on success, non-zero on error
+ */
+int nExtractWithIndex(
+    const archiveIndexT* pIndex,
+    const char* szTargzPath,
+    const char* szTargetDir,
+    pfnFileMatcherCallback pfnMatcher,
+    pfnFileContentCallback pfnContent,
+    void* pUserData
+) {
+    indexCursorT stCursor;
+    memset(&stCursor, 0, sizeof(indexCursorT));
+
+    stCursor.fp = fopen(szTargzPath, "rb");
+    if (!stCursor.fp) {
+        vLogMessage("Error: Cannot open %s\n", szTargzPath);
+        return -1;
+    }
+
+    stCursor.pInput = (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    if (!stCursor.pInput || inflateInit2(&stCursor.stStream, -15) != Z_OK) {
+        vLogMessage("Error: Memory allocation failed\n");
+        free(stCursor.pInput);
+        fclose(stCursor.fp);
+        return -2;
+    }
+
+    unsigned char abPiece[CHUNK];
+    int nRet = 0;
+    for (int i = 0; i < pIndex->nMembers; i++) {
+        const indexMemberT* pMember = &pIndex->pMembers[i];
+
+        // Same filtering as the sequential scan
+        if (strstr(pMember->szName, "../") || strstr(pMember->szName, "..\\")) {
+            vLogMessage("Warning: Skipping potentially unsafe path: %s\n", pMember->szName);
+            continue;
+        }
+
+        const char* szFilename = szGetTargetFileName(pMember->szName, pMember->cTypeflag, szTargetDir);
+        if (!szFilename || (pfnMatcher && !pfnMatcher(szFilename, pUserData))) {
+            continue;
+        }
+
+        if (nSeekIndexCursor(&stCursor, pIndex, pMember->ullOffset) != 0) {
+            vLogMessage("Error: Failed to read %s through the index\n", pMember->szName);
+            nRet = -1;
+            break;
+        }
+
+        // Hand the content over in pieces, followed by the end of the file
+        unsigned long long ullDone = 0;
+        int nContentRet = 0;
+        while (nContentRet == 0) {
+            size_t nPiece = pMember->ullSize - ullDone < sizeof(abPiece) ? (size_t)(pMember->ullSize - ullDone) : sizeof(abPiece);
+            if (nPiece > 0 && llReadIndexCursor(&stCursor, abPiece, nPiece) != (long long)nPiece) {
+                vLogMessage("Error: Failed to read %s through the index\n", pMember->szName);
+                nContentRet = -1;
+                break;
+            }
+            if (pfnContent) {
+                nContentRet = pfnContent(szFilename, (const char*)abPiece, nPiece, ullDone, pUserData);
+            }
+            ullDone += nPiece;
+            if (nPiece == 0) {
+                break;
+            }
+        }
+        if (nContentRet < 0) {
+            nRet = nContentRet;
+            break;
+        }
+        if (nContentRet > 0) {
+            break; // Callback asked us to stop
+        }
+    }
+
+    inflateEnd(&stCursor.stStream);
+    free(stCursor.pInput);
+    fclose(stCursor.fp);
+    return nRet;
+}
+
+/**
+ * Find the target directory inside an extracted sysdiagnose folder
+ * @param szRootDir Folder given on the command line
+ * @param szTargetDir Target directory relative to the archive root, e.g. "logs/BatteryBDC/"
+ * @param szFoundDir Receives the path of the target directory
+ * @param nBufSize Size of szFoundDir
+ * @return 1 if found, 0 otherwise
+ */
+int bFindExtractedDirectory(const char* szRootDir, const char* szTargetDir, char* szFoundDir, size_t nBufSize) {
+    // Either the folder itself is the archive root or it holds the extracted top level folder
+    snprintf(szFoundDir, nBufSize, "%s/%s", szRootDir, szTargetDir);
+    DWORD dwAttributes = GetFileAttributesA(szFoundDir);
+    if (dwAttributes != INVALID_FILE_ATTRIBUTES && (dwAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return 1;
+    }
+
+    char szPattern[MAX_PATH_LENGTH * 2];
+    snprintf(szPattern, sizeof(szPattern), "%s/*", szRootDir);
+    WIN32_FIND_DATAA stFind;
+    HANDLE hFind = FindFirstFileA(szPattern, &stFind);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    int bFound = 0;
+    do {
+        if (!(stFind.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+            strcmp(stFind.cFileName, ".") == 0 || strcmp(stFind.cFileName, "..") == 0) {
+            continue;
+        }
+
+        snprintf(szFoundDir, nBufSize, "%s/%s/%s", szRootDir, stFind.cFileName, szTargetDir);
+        dwAttributes = GetFileAttributesA(szFoundDir);
+        bFound = dwAttributes != INVALID_FILE_ATTRIBUTES && (dwAttributes & FILE_ATTRIBUTE_DIRECTORY);
+    } while (!bFound && FindNextFileA(hFind, &stFind));
+
+    FindClose(hFind);
+    return bFound;
+}
+
+/**
+ * Extract matching files from a sysdiagnose folder that was already extracted
+ * @param szRootDir Folder given on the command line
+ * @param szTargetDir Target directory to extract from
+ * @param pfnMatcher Callback function for file matching
+ * @param pfnContent Callback function receiving the content of extracted files
+ * @param pUserData User data for callback
+ * @return 0 on success, non-zero on error
+ */
+int nExtractFromDirectory(
+    const char* szRootDir,
+    const char* szTargetDir,
+    pfnFileMatcherCallback pfnMatcher,
+    pfnFileContentCallback pfnContent,
+    void* pUserData
+) {
+    char szDir[MAX_PATH_LENGTH * 2];
+    if (!bFindExtractedDirectory(szRootDir, szTargetDir, szDir, sizeof(szDir))) {
+        vLogMessage("Error: %s not found in %s\n", szTargetDir, szRootDir);
+        return -1;
+    }
+
+    char szPattern[MAX_PATH_LENGTH * 3];
+    snprintf(szPattern, sizeof(szPattern), "%s/*", szDir);
+    WIN32_FIND_DATAA stFind;
+    HANDLE hFind = FindFirstFileA(szPattern, &stFind);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return 0; // Empty directory
+    }
+
+    int nRet = 0;
+    do {
+        // Only files directly inside the target directory, the same as in an archive
+        if (stFind.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+        if (pfnMatcher && !pfnMatcher(stFind.cFileName, pUserData)) {
+            continue;
+        }
+
+        char szFilePath[MAX_PATH_LENGTH * 4];
+        snprintf(szFilePath, sizeof(szFilePath), "%s/%s", szDir, stFind.cFileName);
+        FILE* fp = fopen(szFilePath, "rb");
+        if (!fp) {
+            vLogMessage("Error: Cannot read %s\n", szFilePath);
+            nRet = -1;
+            break;
+        }
+
+        // Hand the content over in pieces, followed by the end of the file
+        char abPiece[CHUNK];
+        unsigned long long ullDone = 0;
+        int nContentRet = 0;
+        while (nContentRet == 0) {
+            size_t nPiece = fread(abPiece, 1, sizeof(abPiece), fp);
+            if (nPiece == 0 && ferror(fp)) {
+                vLogMessage("Error: Cannot read %s\n", szFilePath);
+                nContentRet = -1;
+                break;
+            }
+            if (pfnContent) {
+                nContentRet = pfnContent(stFind.cFileName, abPiece, nPiece, ullDone, pUserData);
+            }
+            ullDone += nPiece;
+            if (nPiece == 0) {
+                break;
+            }
+        }
+        fclose(fp);
+        if (nContentRet < 0) {
+            nRet = nContentRet;
+            break;
+        }
+        if (nContentRet > 0) {
+            break; // Callback asked us to stop
+        }
+    } while (FindNextFileA(hFind, &stFind));
+
+    FindClose(hFind);
+    return nRet;
+}
+
+/**
+ * Estimate the uncompressed size of an archive from its size and last 8 bytes
+ * @param nFormat One of the INPUT_FORMAT_ constants
+ * @param ullArchiveSize Size of the archive
+ * @param abTrailer Last 8 bytes of the archive
+ * @param ullAtLeast Uncompressed bytes known to exist
+ * @return Size from the gzip trailer, modulo 4 GB and of the last member only, or the size of
+ *         an uncompressed tar, 0 for other formats or if inconsistent with ullAtLeast
+ */
+unsigned long long ullEstimateTarSizeFromTrailer(int nFormat, unsigned long long ullArchiveSize,
+    const unsigned char abTrailer[8], unsigned long long ullAtLeast) {
+    unsigned long long ullSize = 0;
+
+    if (nFormat == INPUT_FORMAT_GZIP) {
+        ullSize = (unsigned long long)abTrailer[4] | ((unsigned long long)abTrailer[5] << 8) |
+            ((unsigned long long)abTrailer[6] << 16) | ((unsigned long long)abTrailer[7] << 24);
+    }
+    else if (nFormat == INPUT_FORMAT_TAR) {
+        ullSize = ullArchiveSize;
+    }
+
+    return ullSize >= ullAtLeast ? ullSize : 0;
+}
+
+/**
+ * Estimate the uncompressed size of an archive without decompressing it
+ * @param szTargzPath Path to the tar.gz file
+ * @param ullAtLeast Uncompressed bytes known to exist
+ * @return See ullEstimateTarSizeFromTrailer, 0 if the archive cannot be read
+ */
+unsigned long long ullEstimateTarSize(const char* szTargzPath, unsigned long long ullAtLeast) {
+    unsigned char abTrailer[8];
+    unsigned long long ullArchiveSize = 0;
+
+    int nFormat = nDetectInputFormat(szTargzPath);
+    if ((nFormat != INPUT_FORMAT_GZIP && nFormat != INPUT_FORMAT_TAR) ||
+        !bReadArchiveIdentity(szTargzPath, &ullArchiveSize, abTrailer)) {
+        return 0;
+    }
+    return ullEstimateTarSizeFromTrailer(nFormat, ullArchiveSize, abTrailer, ullAtLeast);
+}
+
+/**
+ * Walk a tar stream and pass the files of the target directory to the callbacks
+ * @param pReader Reader over the tar stream
+ * @param szTargetDir Target directory to extract from
+ * @param pfnMatcher Callback function for file matching
+ * @param pfnContent Callback function receiving the content of extracted files
+ * @param pUserData User data for callback
+ * @param pOptions Extraction options, NULL for defaults
+ * @param ppIndex Index to add every member to, set to NULL if it had to be dropped, may point to NULL
+ * @param pStats Receives the bytes scanned and whether the scan stopped early, ullTotal is left alone
+ * @param pbReachedEnd Receives whether the end of archive block was found
+ * @return 0 on success, non-zero on error
+ */
+int nWalkTarStream(
+    archiveReaderT* pReader,
+    const char* szTargetDir,
+    pfnFileMatcherCallback pfnMatcher,
+    pfnFileContentCallback pfnContent,
+    void* pUserData,
+    const extractOptionsT* pOptions,
+    archiveIndexT** ppIndex,
+    extractStatsT* pStats,
+    int* pbReachedEnd
+) {
+    tarHeaderT stHeader;
+    const tarHeaderT* pHeader;
+    char szMemberName[sizeof(stHeader.szName) + 1];
+    char abPiece[CHUNK];
+    unsigned long ulFileSize;
+    unsigned long long ullMemberOffset = 0;
+    archiveIndexT* pIndex = *ppIndex;
+    int bReachedEnd = 0;
+    int bSeenTargetDir = 0;
+    int bStoppedEarly = 0;
+    int nRet = 0;
+
+    // Main extraction loop
+    while (1) {
+        // Parse the tar header in place if the reader can expose it, copy it otherwise
+        pHeader = pReader->pfnView ? (const tarHeaderT*)pReader->pfnView(pReader, TAR_BLOCK_SIZE) : NULL;
+        if (!pHeader) {
+            // Short skips stop at the end of the stream, so a truncated member also ends up here
+            if (pReader->pfnRead(pReader, &stHeader, TAR_BLOCK_SIZE) != TAR_BLOCK_SIZE) {
+                vLogMessage("Error: Unexpected end of archive, it is truncated or corrupt\n");
+                nRet = -1;
+                break;
+            }
+            pHeader = &stHeader;
+        }
+
+        // Check for end of archive (empty block)
+        if (pHeader->szName[0] == '\0') {
+            // Skip one more block to validate end of archive
+            if (pReader->pfnSkip(pReader, TAR_BLOCK_SIZE) != 0) {
+                vLogMessage("Error: Failed to skip data\n");
+                nRet = -1;
+                break;
+            }
+            bReachedEnd = 1;
+            break;
+        }
+
+        // Sysdiagnose archives keep a directory's members together, so nothing of interest follows
+        // once the scan has left the target directory; an index being built needs the whole archive
+        int bInTargetDir = bIsInDirectory(pHeader->szName, szTargetDir);
+        if (pOptions && pOptions->bStopAfterDirectory && !pIndex && bSeenTargetDir && !bInTargetDir) {
+            bStoppedEarly = 1;
+            break;
+        }
+        bSeenTargetDir |= bInTargetDir;
+
+        // Get file size
+        ulFileSize = ulParseOctal(pHeader->szSize, sizeof(pHeader->szSize));
+
+        // Calculate number of blocks for this file and padding
+        size_t nBlocks = (ulFileSize + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
+
+        // Remember where every member's data starts
+        if (pIndex && nAddIndexMember(pIndex, pHeader, ullMemberOffset + TAR_BLOCK_SIZE) != 0) {
+            vFreeArchiveIndex(pIndex);
+            pIndex = NULL;
+            *ppIndex = NULL;
+        }
+        ullMemberOffset += TAR_BLOCK_SIZE + nBlocks * TAR_BLOCK_SIZE;
+
+        // Validate file path for safety - prevent path traversal attacks
+        if (strstr(pHeader->szName, "../") || strstr(pHeader->szName, "..\\")) {
+            vLogMessage("Warning: Skipping potentially unsafe path: %s\n", pHeader->szName);
+            // Skip this file's content
+            if (pReader->pfnSkip(pReader, nBlocks * TAR_BLOCK_SIZE) != 0) {
+                vLogMessage("Error: Failed to skip data\n");
+                nRet = -1;
+                break;
+            }
+            continue;
+        }
+
+        // Check if it's a file and if it's in our target directory
+        const char* szFilename = szGetTargetFileName(pHeader->szName, pHeader->cTypeflag, szTargetDir);
+        if (szFilename) {
+            // Call the matcher callback to see if we should extract this file
+            if (pfnMatcher && !pfnMatcher(szFilename, pUserData)) {
+                // Matcher says skip this file
+                if (pReader->pfnSkip(pReader, nBlocks * TAR_BLOCK_SIZE) != 0) {
+                    vLogMessage("Error: Failed to skip data\n");
+                    nRet = -1;
+                    break;
+                }
+                continue;
+            }
+
+            // A header viewed in place is gone once the data is read, keep the name
+            if (pHeader != &stHeader) {
+                memcpy(szMemberName, pHeader->szName, sizeof(pHeader->szName));
+                szMemberName[sizeof(pHeader->szName)] = '\0';
+                szFilename = szMemberName + (szFilename - pHeader->szName);
+            }
+
+            // Hand the content over in pieces, a corrupt size field cannot make us allocate it
+            unsigned long ulDone = 0;
+            int nContentRet = 0;
+            while (nContentRet == 0) {
+                size_t nPiece = ulFileSize - ulDone < sizeof(abPiece) ? ulFileSize - ulDone : sizeof(abPiece);
+                long long llBytesRead = nPiece > 0 ? pReader->pfnRead(pReader, abPiece, nPiece) : 0;
+                if (llBytesRead != (long long)nPiece) {
+                    vLogMessage("Error: Failed to read data (expected %lu, got %lu)\n",
+                        ulFileSize, ulDone + (llBytesRead > 0 ? (unsigned long)llBytesRead : 0UL));
+                    nContentRet = -1;
+                    break;
+                }
+                if (pfnContent) {
+                    nContentRet = pfnContent(szFilename, abPiece, nPiece, ulDone, pUserData);
+                }
+                ulDone += (unsigned long)nPiece;
+                if (nPiece == 0) {
+                    break; // The end of the file was reported
+                }
+            }
+            if (nContentRet < 0) {
+                nRet = nContentRet;
+                break;
+            }
+            if (nContentRet > 0) {
+                break; // Callback asked us to stop scanning
+            }
+
+            // Skip the padding up to the next block boundary
+            size_t nPadding = nBlocks * TAR_BLOCK_SIZE - ulFileSize;
+            if (nPadding > 0 && pReader->pfnSkip(pReader, nPadding) != 0) {
+                vLogMessage("Error: Failed to skip data\n");
+                nRet = -1;
+                break;
+            }
+        }
+        else if (pReader->pfnSkip(pReader, nBlocks * TAR_BLOCK_SIZE) != 0) {
+            // Skip this file's data blocks
+            vLogMessage("Error: Failed to skip data\n");
+            nRet = -1;
+            break;
+        }
+    }
+
+    pStats->ullScanned = ullMemberOffset;
+    pStats->bStoppedEarly = bStoppedEarly;
+    *pbReachedEnd = bReachedEnd;
+    return nRet;
+}
+
+/**
+ * Extract files from a tar.gz file that match the target directory and pass matcher callback
+ * @param szTargzPath Path to the tar.gz file, an uncompressed tar or an extracted folder
+ * @param szTargetDir Target directory to extract from
+ * @param pfnMatcher Callback function for file matching
+ * @param pfnContent Callback function receiving the content of extracted files
+ * @param pUserData User data for callback
+ * @param pOptions Extraction options, NULL for defaults
+ * @return 0 on success, non-zero on error
+ */
+int nExtractFromTargzWithCallback(
+    const char* szTargzPath,
+    const char* szTargetDir,
+    pfnFileMatcherCallback pfnMatcher,
+    pfnFileContentCallback pfnContent,
+    void* pUserData,
+    const extractOptionsT* pOptions
+) {
+    archiveReaderT* pReader;
+    archiveIndexT* pIndex = NULL;
+    char szIndexPath[MAX_PATH_LENGTH * 2];
+    int bReachedEnd = 0;
+    int nRet = 0;
+
+    // Extracted folders need no archive at all
+    int nFormat = nDetectInputFormat(szTargzPath);
+    if (nFormat == INPUT_FORMAT_DIRECTORY) {
+        return nExtractFromDirectory(szTargzPath, szTargetDir, pfnMatcher, pfnContent, pUserData);
+    }
+
+    // A matching index lets us inflate only the members we need, plain tars are cheap to walk anyway
+    if (pOptions && pOptions->bUseIndex && nFormat == INPUT_FORMAT_GZIP &&
+        bGetIndexPath(szTargzPath, pOptions->szIndexDir, szIndexPath, sizeof(szIndexPath))) {
+        pIndex = pLoadArchiveIndex(szIndexPath, szTargzPath);
+        if (pIndex) {
+            nRet = nExtractWithIndex(pIndex, szTargzPath, szTargetDir, pfnMatcher, pfnContent, pUserData);
+            vFreeArchiveIndex(pIndex);
+            return nRet;
+        }
+
+        // No usable index yet, build one during this scan
+        pIndex = pCreateArchiveIndex(szTargzPath);
+    }
+
+    // Open tar.gz file
+    pReader = pOpenArchiveReader(szTargzPath, pOptions, pIndex);
+    if (!pReader) {
+        vFreeArchiveIndex(pIndex);
+        return -1;
+    }
+
+    extractStatsT stStats;
+    memset(&stStats, 0, sizeof(extractStatsT));
+    nRet = nWalkTarStream(pReader, szTargetDir, pfnMatcher, pfnContent, pUserData, pOptions,
+        &pIndex, &stStats, &bReachedEnd);
+    pReader->pfnClose(pReader);
+
+    if (pOptions && pOptions->pStats) {
+        stStats.ullTotal = stStats.bStoppedEarly ? ullEstimateTarSize(szTargzPath, stStats.ullScanned) : stStats.ullScanned;
+        *pOptions->pStats = stStats;
+    }
+
+    // Only an index covering the whole archive can answer later queries
+    if (pIndex) {
+        if (nRet == 0 && bReachedEnd) {
+            nSaveArchiveIndex(pIndex, szIndexPath);
+        }
+        vFreeArchiveIndex(pIndex);
+    }
+
+    return nRet;
+}
+
+/**
+ * Extract files of the target directory from an archive held in memory, see nExtractFromTargzWithCallback
+ * @param pData Compressed or uncompressed tar, decoded in place on the calling thread
+ * @param nSize Size of the data
+ * @param szTargetDir Target directory to extract from
+ * @param pfnMatcher Callback function for file matching
+ * @param pfnContent Callback function receiving the content of extracted files
+ * @param pUserData User data for callback
+ * @param pOptions Extraction options, NULL for defaults, the index does not apply
+ * @return 0 on success, non-zero on error
+ */
+int nExtractFromBufferWithCallback(
+    const unsigned char* pData,
+    size_t nSize,
+    const char* szTargetDir,
+    pfnFileMatcherCallback pfnMatcher,
+    pfnFileContentCallback pfnContent,
+    void* pUserData,
+    const extractOptionsT* pOptions
+) {
+    archiveReaderT* pReader;
+    int nFormat = nDetectBufferFormat(pData, nSize);
+    if (nFormat == INPUT_FORMAT_TAR) {
+        pReader = pOpenMemoryReader((unsigned char*)pData, nSize);
+        if (pReader) {
+            ((memoryReaderT*)pReader->pContext)->bBorrowed = true;
+        }
+    }
+    else {
+        pReader = pCreateDecoderReader(NULL, pData, nSize, nFormat, pOptions ? pOptions->pBuffers : NULL);
+    }
+    if (!pReader) {
+        return -1;
+    }
+
+    archiveIndexT* pIndex = NULL;
+    extractStatsT stStats;
+    memset(&stStats, 0, sizeof(extractStatsT));
+    int bReachedEnd = 0;
+    int nRet = nWalkTarStream(pReader, szTargetDir, pfnMatcher, pfnContent, pUserData, pOptions,
+        &pIndex, &stStats, &bReachedEnd);
+    pReader->pfnClose(pReader);
+
+    if (pOptions && pOptions->pStats) {
+        stStats.ullTotal = stStats.ullScanned;
+        if (stStats.bStoppedEarly) {
+            stStats.ullTotal = nSize >= 8 ? ullEstimateTarSizeFromTrailer(nFormat, nSize, pData + nSize - 8, stStats.ullScanned) : 0;
+        }
+        *pOptions->pStats = stStats;
+    }
+    return nRet;
+}
+
+/**
+ * Extract files of the target directory from an archive read front to back from a stream,
+ * see nExtractFromTargzWithCallback
+ * Nothing is seeked, so stdin, pipes and sockets work, and memory use does not grow with the archive.
+ * @param fp Compressed or uncompressed tar, read up to where the scan ends and left open
+ * @param szTargetDir Target directory to extract from
+ * @param pfnMatcher Callback function for file matching
+ * @param pfnContent Callback function receiving the content of extracted files
+ * @param pUserData User data for callback
+ * @param pOptions Extraction options, NULL for defaults, the index and the backends do not apply
+ * @return 0 on success, non-zero on error
+ */
+int nExtractFromStreamWithCallback(
+    FILE* fp,
+    const char* szTargetDir,
+    pfnFileMatcherCallback pfnMatcher,
+    pfnFileContentCallback pfnContent,
+    void* pUserData,
+    const extractOptionsT* pOptions
+) {
+    // The magic bytes cannot be read again, the reader decodes them before the rest of the stream
+    unsigned char abMagic[6];
+    size_t nMagic = 0;
+    while (nMagic < sizeof(abMagic)) {
+        size_t nRead = fread(abMagic + nMagic, 1, sizeof(abMagic) - nMagic, fp);
+        if (nRead == 0) {
+            break;
+        }
+        nMagic += nRead;
+    }
+    if (nMagic < sizeof(abMagic) && ferror(fp)) {
+        vLogMessage("Error: Reading the archive failed\n");
+        return -1;
+    }
+
+    int nFormat = nDetectBufferFormat(abMagic, nMagic);
+    archiveReaderT* pReader = nResolveThreadCount(pOptions) > 1 ?
+        pCreatePipelineReader(fp, abMagic, nMagic, nFormat, pOptions) :
+        pCreateDecoderReader(fp, abMagic, nMagic, nFormat, pOptions ? pOptions->pBuffers : NULL);
+    if (!pReader) {
+        return -1;
+    }
+
+    archiveIndexT* pIndex = NULL;
+    extractStatsT stStats;
+    memset(&stStats, 0, sizeof(extractStatsT));
+    int bReachedEnd = 0;
+    int nRet = nWalkTarStream(pReader, szTargetDir, pfnMatcher, pfnContent, pUserData, pOptions,
+        &pIndex, &stStats, &bReachedEnd);
+    pReader->pfnClose(pReader);
+
+    // The size of a stream that was not read to its end is unknown
+    if (pOptions && pOptions->pStats) {
+        stStats.ullTotal = stStats.bStoppedEarly ? 0 : stStats.ullScanned;
+        *pOptions->pStats = stStats;
+    }
+    return nRet;
+}
+
+/**
+ * File matcher that accepts files with specific extension
+ * @param szFilename Filename to check
+ * @param pUserData Pointer to extension string
+ * @return 1 if matches, 0 otherwise
+ */
+int bFileExtensionMatcher(const char* szFilename, void* pUserData) {
+    const char* szExtension = (const char*)pUserData;
+    const char* szFileExt = strrchr(szFilename, '.');
+
+    if (!szFileExt) return 0; // No extension
+
+    return _stricmp(szFileExt, szExtension) == 0;
+}
+
+/**
+ * File matcher that uses a wildcard pattern (basic implementation)
+ * @param szFilename Filename to check
+ * @param pUserData Pointer to pattern string
+ * @return 1 if matches, 0 otherwise
+ */
+int bWildcardMatcher(const char* szFilename, void* pUserData) {
+    const char* szPattern = (const char*)pUserData;
+
+    // Simple wildcard matching for "*.ext" patterns
+    if (szPattern[0] == '*' && szPattern[1] == '.') {
+        const char* szFileExt = strrchr(szFilename, '.');
+        if (!szFileExt) return 0;
+        return _stricmp(szFileExt, szPattern + 1) == 0;
+    }
+
+    // Exact match
+    return strcmp(szFilename, szPattern) == 0;
+}/**
+ * Parse date in format YYYY-MM-DD_HH:MM:SS
+ * The timestamp is the time as written, on the same scale as the timestamps in the logs,
+ * so it does not depend on the time zone and needs no mktime.
+ * @param szDateStr Date string to parse
+ * @param pDate Pointer to date structure to fill
+ * @return 1 if successful, 0 if failed
+ */
+int bParseDate(const char* szDateStr, fileDateT* pDate) {
+    if (!szDateStr || !pDate) {
+        return 0; // Invalid parameters
+    }
+
+    // Using sscanf_s which is the secure version of sscanf
+    int nResult = sscanf_s(szDateStr, "%d-%d-%d_%d:%d:%d",
+        &pDate->nYear, &pDate->nMonth, &pDate->nDay,
+        &pDate->nHour, &pDate->nMinute, &pDate->nSecond);
+
+    if (nResult != 6) {
+        vLogMessage("Error: Date parsing failed for %s\n", szDateStr);
+        return 0; // Failed to parse all date components
+    }
+
+    // Validate date components
+    if (pDate->nYear < 1970 || pDate->nYear > 2100 ||
+        pDate->nMonth < 1 || pDate->nMonth > 12 ||
+        pDate->nDay < 1 || pDate->nDay > 31 ||
+        pDate->nHour < 0 || pDate->nHour > 23 ||
+        pDate->nMinute < 0 || pDate->nMinute > 59 ||
+        pDate->nSecond < 0 || pDate->nSecond > 59) {
+        vLogMessage("Error: Invalid date components in %s\n", szDateStr);
+        return 0; // Invalid date components
+    }
+
+    // Convert to timestamp for easy comparison
+    long long llDays = llDaysFromCivil(pDate->nYear, pDate->nMonth, pDate->nDay);
+    pDate->tTimestamp = (time_t)(llDays * 86400 + pDate->nHour * 3600 + pDate->nMinute * 60 + pDate->nSecond);
+
+    return 1; // Successfully parsed
+}
+
+/**
+ * Check that a file name starts with a prefix and read the date that follows it
+ * @param szFilename Filename to check, e.g. BDC_Daily_version_2025-05-14_20:30:45.csv
+ * @param szPrefix Prefix to match (e.g., "BDC_Daily_version")
+ * @param pDate Receives the filename and its date
+ * @return 1 if the name matches and has a valid date, 0 otherwise
+ */
+int bParseBdcDailyName(const char* szFilename, const char* szPrefix, fileDateT* pDate) {
+    // Check if file starts with the prefix
+    if (strncmp(szFilename, szPrefix, strlen(szPrefix)) != 0) {
+        return 0; // Not a BDC_Daily_ file
+    }
+
+    // Get the date part (after the prefix)
+    const char* szDatePart = szFilename + strlen(szPrefix);
+
+    szDatePart = strchr(szDatePart, '_');
+
+    if (szDatePart == 0) {
+        return 0;
+    }
+
+    szDatePart++;
+
+    // Parse the date
+    memset(pDate, 0, sizeof(fileDateT));
+
+    if (strncpy_s(pDate->szFilename, sizeof(pDate->szFilename),
+        szFilename, _TRUNCATE) != 0) {
+        vLogMessage("Error: Failed to copy filename\n");
+        return 0;
+    }
+
+    if (!bParseDate(szDatePart, pDate)) {
+        vLogMessage("Error: Invalid date format\n");
+        return 0; // Invalid date format
+    }
+
+    return 1;
+}
+
+/**
+ * Callback function to find the latest BDC_Daily_ file
+ * @param szFilename Filename to check
+ * @param pUserData User data (matcherDataT)
+ * @return 1 if the file is the newest seen so far and should be extracted, 0 otherwise
+ */
+int bLatestBdcDailyMatcher(const char* szFilename, void* pUserData) {
+    matcherDataT* pData = (matcherDataT*)pUserData;
+    if (!pData || !szFilename) {
+        return 0;
+    }
+
+    fileDateT stCurrentFile;
+    if (!bParseBdcDailyName(szFilename, pData->szPrefix, &stCurrentFile)) {
+        return 0;
+    }
+
+    // First match or newer than previous match
+    if (!pData->bFoundMatch || stCurrentFile.tTimestamp > pData->stLatestFile.tTimestamp) {
+        pData->stLatestFile = stCurrentFile;
+        pData->bFoundMatch = 1;
+        return 1; // Extract it, it replaces the previously buffered candidate
+    }
+
+    // Older than what we already have
+    return 0;
+}
+
+/**
+ * Append bytes to a line of the CSV tail, cutting it off once it is full
+ * @param szLine Line buffer, CSV_TAIL_LINE_SIZE bytes
+ * @param pnLen Bytes in the line
+ * @param pbTooLong Set once the line was cut off
+ * @param pData Bytes to append
+ * @param nSize Number of bytes
+ */
+void vAppendCsvTailLine(char* szLine, size_t* pnLen, bool* pbTooLong, const char* pData, size_t nSize) {
+    if (nSize > CSV_TAIL_LINE_SIZE - 1 - *pnLen) {
+        nSize = CSV_TAIL_LINE_SIZE - 1 - *pnLen;
+        *pbTooLong = true;
+    }
+    memcpy(szLine + *pnLen, pData, nSize);
+    *pnLen += nSize;
+    szLine[*pnLen] = '\0';
+}
+
+/**
+ * Finish the row being received by a CSV tail, a row that is not blank becomes the last row
+ * @param pTail CSV tail
+ */
+void vEndCsvTailRow(csvTailT* pTail) {
+    int nRow = pTail->nCurrentRow;
+    if (!bIsBlankCSVLine(pTail->aszRows[nRow], pTail->aszRows[nRow] + pTail->anRowLen[nRow])) {
+        // The older buffer takes the next row
+        pTail->bHasRow = true;
+        nRow ^= 1;
+        pTail->nCurrentRow = nRow;
+    }
+    pTail->anRowLen[nRow] = 0;
+    pTail->abRowTooLong[nRow] = false;
+    pTail->aszRows[nRow][0] = '\0';
+}
+
+/**
+ * Feed the next piece of a CSV file into its tail, keeping the header and the last row
+ * Blank lines do not count as rows, the same as for the last row in nGetCSVDataByColNames.
+ * @param pTail CSV tail
+ * @param pData Next piece of the file
+ * @param nSize Size of the piece
+ */
+void vFeedCsvTail(csvTailT* pTail, const char* pData, size_t nSize) {
+    const char* pEnd = pData + nSize;
+    while (pData < pEnd) {
+        const char* pNewline = (const char*)memchr(pData, '\n', pEnd - pData);
+        const char* pLineEnd = pNewline ? pNewline : pEnd;
+
+        if (!pTail->bHeaderDone) {
+            vAppendCsvTailLine(pTail->szHeader, &pTail->nHeaderLen, &pTail->bHeaderTooLong, pData, pLineEnd - pData);
+            pTail->bHeaderDone = pNewline != NULL;
+        }
+        else {
+            int nRow = pTail->nCurrentRow;
+            vAppendCsvTailLine(pTail->aszRows[nRow], &pTail->anRowLen[nRow], &pTail->abRowTooLong[nRow],
+                pData, pLineEnd - pData);
+            if (pNewline) {
+                vEndCsvTailRow(pTail);
+            }
+        }
+        pData = pNewline ? pNewline + 1 : pEnd;
+    }
+}
+
+/**
+ * Content callback that keeps the header and last row of the latest BDC_Daily_ file
+ * @param szFilename Filename that was extracted
+ * @param pPiece Next piece of the file
+ * @param nSize Size of the piece, 0 at the end of the file
+ * @param ullOffset Offset of the piece, 0 for a new file
+ * @param pUserData User data (matcherDataT)
+ * @return 0 to continue scanning
+ */
+int nKeepLatestTailCallback(const char* szFilename, const char* pPiece, size_t nSize,
+    unsigned long long ullOffset, void* pUserData) {
+    (void)szFilename;
+    matcherDataT* pData = (matcherDataT*)pUserData;
+    if (!pData) {
+        return -1;
+    }
+    csvTailT* pTail = &pData->stLatestTail;
+
+    // The matcher only lets newer files through, so this one replaces the old candidate
+    if (ullOffset == 0) {
+        memset(pTail, 0, sizeof(csvTailT));
+    }
+    vFeedCsvTail(pTail, pPiece, nSize);
+    if (nSize == 0) {
+        // A last row without newline counts as well, without any newline the whole file is the header
+        if (pTail->bHeaderDone) {
+            vEndCsvTailRow(pTail);
+        }
+        pTail->bHeaderDone = true;
+        pTail->bComplete = true;
+    }
+    return 0;
+}
+
+/**
+ * Read battery cycle count and last charging date from BDC CSV data
+ * @param pCsvData CSV data
+ * @param nCsvLen Size of the CSV data
+ * @param pInfo Receives the values, szFilename is left alone
+ * @return 0 on success, non-zero on error
+ */
+int nReadBatteryInfo(const char* pCsvData, size_t nCsvLen, batteryInfoT* pInfo) {
+    // Both values come from the last row, one pass finds them together
+    csvColumnRequestT astColumns[2] = {
+        { "TimeStamp", pInfo->szTimeStamp, sizeof(pInfo->szTimeStamp), 0, CSV_VALUE_TEXT, 0, 0, { NULL, 0 } },
+        { "CycleCount", pInfo->szCycleCount, sizeof(pInfo->szCycleCount), 0, CSV_VALUE_TEXT, 0, 0, { NULL, 0 } },
+    };
+    nGetCSVDataByColNames(pCsvData, nCsvLen, -1, astColumns, 2);
+
+    if (astColumns[0].nStatus != 0) {
+        vLogMessage("Error: Failed to parse timestamp\n");
+        return -1;
+    }
+
+    if (astColumns[1].nStatus != 0) {
+        vLogMessage("Error: Failed to parse CycleCount\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read battery cycle count and last charging date from the tail of a BDC CSV file
+ * @param pTail Header and last row of the file
+ * @param pInfo Receives the values, szFilename is left alone
+ * @return 0 on success, non-zero on error
+ */
+int nReadBatteryInfoFromTail(const csvTailT* pTail, batteryInfoT* pInfo) {
+    int nLastRow = pTail->nCurrentRow ^ 1;
+    if (pTail->bHeaderTooLong || (pTail->bHasRow && pTail->abRowTooLong[nLastRow])) {
+        vLogMessage("Error: CSV line longer than %d bytes\n", CSV_TAIL_LINE_SIZE - 1);
+        return -1;
+    }
+
+    // The header and the last row make up a CSV of their own
+    char szCsv[2 * CSV_TAIL_LINE_SIZE];
+    size_t nLen = pTail->nHeaderLen;
+    memcpy(szCsv, pTail->szHeader, nLen);
+    szCsv[nLen++] = '\n';
+    if (pTail->bHasRow) {
+        memcpy(szCsv + nLen, pTail->aszRows[nLastRow], pTail->anRowLen[nLastRow]);
+        nLen += pTail->anRowLen[nLastRow];
+        szCsv[nLen++] = '\n';
+    }
+    return nReadBatteryInfo(szCsv, nLen, pInfo);
+}
+
+/**
+ * Callback function that lets every BDC_Daily_ file through, for loading all of their rows
+ * @param szFilename Filename to check
+ * @param pUserData User data (bdcHistoryLoaderT)
+ * @return 1 if the file is a BDC_Daily_ file with a valid date, 0 otherwise
+ */
+int bAllBdcDailyMatcher(const char* szFilename, void* pUserData) {
+    bdcHistoryLoaderT* pLoader = (bdcHistoryLoaderT*)pUserData;
+    if (!pLoader || !szFilename) {
+        return 0;
+    }
+
+    fileDateT stDate;
+    return bParseBdcDailyName(szFilename, pLoader->szPrefix, &stDate);
+}
+
+/**
+ * Find the type of a CSV value and parse it
+ * @param pValue Value without blanks and quotes around it, need not be NUL-terminated
+ * @param nLen Length of the value
+ * @param pllValue Receives integers and timestamps
+ * @param pdValue Receives reals
+ * @return One of the BDC_COLUMN_ constants, -1 for an empty value
+ */
+int nParseBdcValue(const char* pValue, size_t nLen, long long* pllValue, double* pdValue) {
+    if (nLen == 0) {
+        return -1;
+    }
+    if (bParseCSVTimeStamp(pValue, nLen, pllValue)) {
+        return BDC_COLUMN_TIMESTAMP;
+    }
+
+    // Numbers start with a digit, a sign or a decimal point and are short
+    char c = pValue[0];
+    if (nLen >= 64 || !((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.')) {
+        return BDC_COLUMN_TEXT;
+    }
+    if (bParseCSVInteger(pValue, nLen, pllValue)) {
+        return BDC_COLUMN_INTEGER;
+    }
+    if (bParseCSVReal(pValue, nLen, pdValue)) {
+        return BDC_COLUMN_REAL;
+    }
+    return BDC_COLUMN_TEXT;
+}
+
+/**
+ * Get the number of values in a history column
+ * @param pColumn Column
+ * @return Number of values
+ */
+size_t nBdcColumnSize(const bdcColumnT* pColumn) {
+    if (pColumn->nType == BDC_COLUMN_REAL) {
+        return pColumn->vecReals.size();
+    }
+    if (pColumn->nType == BDC_COLUMN_TEXT) {
+        return pColumn->vecTexts.size();
+    }
+    return pColumn->vecIntegers.size();
+}
+
+/**
+ * Append an empty value to a history column
+ * @param pColumn Column
+ */
+void vAppendBdcMissing(bdcColumnT* pColumn) {
+    if (pColumn->nType == BDC_COLUMN_REAL) {
+        pColumn->vecReals.push_back(NAN);
+    }
+    else if (pColumn->nType == BDC_COLUMN_TEXT) {
+        pColumn->vecTexts.push_back(std::string());
+    }
+    else {
+        pColumn->vecIntegers.push_back(BDC_MISSING_INTEGER);
+    }
+}
+
+/**
+ * Change the type of a history column, converting the values it already has
+ * Only integer columns are converted: all empty ones to any type, the others to real.
+ * @param pColumn Column
+ * @param nType New type
+ */
+void vSetBdcColumnType(bdcColumnT* pColumn, int nType) {
+    if (nType == BDC_COLUMN_REAL) {
+        pColumn->vecReals.reserve(pColumn->vecIntegers.size());
+        for (size_t i = 0; i < pColumn->vecIntegers.size(); i++) {
+            long long llValue = pColumn->vecIntegers[i];
+            pColumn->vecReals.push_back(llValue == BDC_MISSING_INTEGER ? NAN : (double)llValue);
+        }
+    }
+    else if (nType == BDC_COLUMN_TEXT) {
+        pColumn->vecTexts.resize(pColumn->vecIntegers.size());
+    }
+    if (nType == BDC_COLUMN_REAL || nType == BDC_COLUMN_TEXT) {
+        std::vector<long long>().swap(pColumn->vecIntegers);
+    }
+    pColumn->nType = nType;
+    pColumn->bTyped = true;
+}
+
+/**
+ * Append a value to a history column
+ * @param pColumn Column
+ * @param pField Value in the file data
+ */
+void vAppendBdcValue(bdcColumnT* pColumn, const csvFieldT* pField) {
+    long long llValue = 0;
+    double dValue = 0;
+    int nType = nParseBdcValue(pField->pData, pField->nLen, &llValue, &dValue);
+    if (nType < 0) {
+        vAppendBdcMissing(pColumn);
+        return;
+    }
+
+    // The first value sets the type, a fraction turns integers into reals
+    if (!pColumn->bTyped) {
+        vSetBdcColumnType(pColumn, nType);
+    }
+    else if (pColumn->nType == BDC_COLUMN_INTEGER && nType == BDC_COLUMN_REAL) {
+        vSetBdcColumnType(pColumn, BDC_COLUMN_REAL);
+    }
+
+    if (pColumn->nType == BDC_COLUMN_TEXT) {
+        // Only text is copied out of the file data, with doubled quotes undone
+        pColumn->vecTexts.push_back(std::string());
+        std::string& strText = pColumn->vecTexts.back();
+        size_t nCopied = 0;
+        strText.resize(pField->nLen + 1);
+        bCopyCSVField(pField, &strText[0], strText.size(), &nCopied);
+        strText.resize(nCopied);
+    }
+    else if (pColumn->nType == BDC_COLUMN_REAL) {
+        pColumn->vecReals.push_back(nType == BDC_COLUMN_REAL ? dValue : nType == BDC_COLUMN_INTEGER ? (double)llValue : NAN);
+    }
+    else {
+        pColumn->vecIntegers.push_back(nType == pColumn->nType ? llValue : BDC_MISSING_INTEGER);
+    }
+}
+
+/**
+ * Read the header of a BDC_Daily_ file into the table columns its fields go to
+ * Files with the same header as the previous one reuse its mapping without looking at a single name.
+ * @param pLoader Loader, the header line is the current file's first
+ * @param pLine Header line, without its newline
+ * @param nLen Length of the line
+ */
+void vReadBdcHeader(bdcHistoryLoaderT* pLoader, const char* pLine, size_t nLen) {
+    pLoader->bHeaderDone = true;
+    const csvSchemaT* pSchema = pGetCSVSchema(pLine, nLen, &pLoader->stLocalSchema);
+    if (pSchema == pLoader->pFieldSchema) {
+        return;
+    }
+    pLoader->pFieldSchema = pSchema != &pLoader->stLocalSchema ? pSchema : NULL;
+
+    bdcTableT* pTable = pLoader->pTable;
+    pLoader->vecFieldColumns.assign(pSchema->vecNames.size(), -1);
+    for (size_t i = 0; i < pSchema->vecNames.size(); i++) {
+        // A column named twice in one header keeps its first field
+        const std::string& strName = pSchema->vecNames[i];
+        if (nFindCSVSchemaColumn(pSchema, strName.data(), strName.size()) != (int)i) {
+            continue;
+        }
+
+        // Columns of earlier files are reused, new ones start out empty for the rows before
+        size_t nColumn = 0;
+        while (nColumn < pTable->vecColumns.size() && pTable->vecColumns[nColumn].strName != strName) {
+            nColumn++;
+        }
+        if (nColumn == pTable->vecColumns.size()) {
+            pTable->vecColumns.push_back(bdcColumnT());
+            bdcColumnT* pColumn = &pTable->vecColumns.back();
+            pColumn->strName = strName;
+            pColumn->nType = BDC_COLUMN_INTEGER;
+            pColumn->bTyped = false;
+            pColumn->vecIntegers.assign(pTable->nRows, BDC_MISSING_INTEGER);
+        }
+        pLoader->vecFieldColumns[i] = (int)nColumn;
+    }
+}
+
+/**
+ * Add complete lines of the current BDC_Daily_ file to the table, the first one of a file is its header
+ * Blank lines are skipped, fields past the header are ignored and missing fields are empty.
+ * @param pLoader Loader
+ * @param pData Lines, each ending with a newline except possibly the last line of the file
+ * @param nSize Size of the lines
+ * @return 0 on success, non-zero on error
+ */
+int nAddBdcLines(bdcHistoryLoaderT* pLoader, const char* pData, size_t nSize) {
+    if (nTokenizeCSV(pData, nSize, NULL, &pLoader->vecFieldEnds) != 0) {
+        return -1;
+    }
+
+    bdcTableT* pTable = pLoader->pTable;
+    const unsigned int* pFieldEnds = pLoader->vecFieldEnds.data();
+    size_t nFieldEnds = pLoader->vecFieldEnds.size();
+    size_t nLineField = 0;
+    unsigned int uLineStart = 0;
+    for (size_t i = 0; i < nFieldEnds; i++) {
+        // Collect the fields up to the end of the line
+        if (pFieldEnds[i] < nSize && pData[pFieldEnds[i]] != '\n') {
+            continue;
+        }
+        const char* pLine = pData + uLineStart;
+        unsigned int uLineEnd = pFieldEnds[i];
+        const unsigned int* pLineFields = pFieldEnds + nLineField;
+        size_t nFields = i + 1 - nLineField;
+        nLineField = i + 1;
+        uLineStart = uLineEnd + 1;
+
+        // The first line is the header, as for nGetCSVDataByColNames
+        if (!pLoader->bHeaderDone) {
+            vReadBdcHeader(pLoader, pLine, pData + uLineEnd - pLine);
+            continue;
+        }
+        if (bIsBlankCSVLine(pLine, pData + uLineEnd)) {
+            continue;
+        }
+
+        size_t nMapped = pLoader->vecFieldColumns.size();
+        const char* pField = pLine;
+        for (size_t j = 0; j < nFields && j < nMapped; j++) {
+            const char* pFieldEnd = pData + pLineFields[j];
+            int nColumn = pLoader->vecFieldColumns[j];
+            if (nColumn >= 0) {
+                const char* pValueEnd = pFieldEnd;
+                csvFieldT stValue = { pField, 0 };
+                vTrimCSVField(&stValue.pData, &pValueEnd);
+                stValue.nLen = pValueEnd - stValue.pData;
+                vAppendBdcValue(&pTable->vecColumns[nColumn], &stValue);
+            }
+            pField = pFieldEnd + 1;
+        }
+
+        // Every column gets exactly one value per row
+        pTable->nRows++;
+        for (size_t j = 0; j < pTable->vecColumns.size(); j++) {
+            if (nBdcColumnSize(&pTable->vecColumns[j]) < pTable->nRows) {
+                vAppendBdcMissing(&pTable->vecColumns[j]);
+            }
+        }
+        pTable->vecMembers.back().nRows++;
+    }
+    return 0;
+}
+
+/**
+ * Content callback that adds every row of every BDC_Daily_ file to a history table
+ * @param szFilename Filename that was extracted
+ * @param pPiece Next piece of the file
+ * @param nSize Size of the piece, 0 at the end of the file
+ * @param ullOffset Offset of the piece, 0 for a new file
+ * @param pUserData User data (bdcHistoryLoaderT)
+ * @return 0 to continue scanning, negative number on error
+ */
+int nLoadBdcHistoryCallback(const char* szFilename, const char* pPiece, size_t nSize,
+    unsigned long long ullOffset, void* pUserData) {
+    bdcHistoryLoaderT* pLoader = (bdcHistoryLoaderT*)pUserData;
+    if (!pLoader) {
+        return -1;
+    }
+
+    if (ullOffset == 0) {
+        bdcMemberT stMember;
+        if (!bParseBdcDailyName(szFilename, pLoader->szPrefix, &stMember.stDate)) {
+            return -1;
+        }
+        stMember.nFirstRow = pLoader->pTable->nRows;
+        stMember.nRows = 0;
+        pLoader->pTable->vecMembers.push_back(stMember);
+        pLoader->strPartialLine.clear();
+        pLoader->bHeaderDone = false;
+    }
+
+    // The last line of the file needs no newline
+    if (nSize == 0) {
+        int nRet = nAddBdcLines(pLoader, pLoader->strPartialLine.data(), pLoader->strPartialLine.size());
+        pLoader->strPartialLine.clear();
+        return nRet;
+    }
+
+    // Lines are added as soon as their newline has arrived, a line split across pieces is put together first
+    const char* pEnd = pPiece + nSize;
+    const char* pLastNewline = pFindLastByte(pPiece, '\n', nSize);
+    if (!pLastNewline) {
+        pLoader->strPartialLine.append(pPiece, nSize);
+        return 0;
+    }
+    if (!pLoader->strPartialLine.empty()) {
+        const char* pFirstNewline = (const char*)memchr(pPiece, '\n', nSize);
+        pLoader->strPartialLine.append(pPiece, pFirstNewline + 1 - pPiece);
+        if (nAddBdcLines(pLoader, pLoader->strPartialLine.data(), pLoader->strPartialLine.size()) != 0) {
+            return -1;
+        }
+        pLoader->strPartialLine.clear();
+        pPiece = pFirstNewline + 1;
+    }
+    if (pPiece <= pLastNewline && nAddBdcLines(pLoader, pPiece, pLastNewline + 1 - pPiece) != 0) {
+        return -1;
+    }
+    pLoader->strPartialLine.assign(pLastNewline + 1, pEnd - (pLastNewline + 1));
+    return 0;
+}
+
+/**
+ * Compare history table files by the date in their names
+ * @param stA First file
+ * @param stB Second file
+ * @return true if stA is older than stB
+ */
+bool bBdcMemberEarlier(const bdcMemberT& stA, const bdcMemberT& stB) {
+    return stA.stDate.tTimestamp < stB.stDate.tTimestamp;
+}
+
+/**
+ * Order the files of a history table and their rows by the date in the file names
+ * Archives usually list the files in date order already, then nothing is moved.
+ * @param pTable Table
+ */
+void vSortBdcTableByDate(bdcTableT* pTable) {
+    std::vector<bdcMemberT>& vecMembers = pTable->vecMembers;
+    bool bSorted = true;
+    for (size_t i = 1; i < vecMembers.size(); i++) {
+        bSorted = bSorted && vecMembers[i - 1].stDate.tTimestamp <= vecMembers[i].stDate.tTimestamp;
+    }
+    if (bSorted) {
+        return;
+    }
+
+    std::stable_sort(vecMembers.begin(), vecMembers.end(), bBdcMemberEarlier);
+
+    // New position to old position of every row
+    std::vector<size_t> vecOrder;
+    vecOrder.reserve(pTable->nRows);
+    for (size_t i = 0; i < vecMembers.size(); i++) {
+        for (size_t j = 0; j < vecMembers[i].nRows; j++) {
+            vecOrder.push_back(vecMembers[i].nFirstRow + j);
+        }
+        vecMembers[i].nFirstRow = vecOrder.size() - vecMembers[i].nRows;
+    }
+
+    for (size_t i = 0; i < pTable->vecColumns.size(); i++) {
+        bdcColumnT* pColumn = &pTable->vecColumns[i];
+        if (pColumn->nType == BDC_COLUMN_REAL) {
+            std::vector<double> vecReals(pTable->nRows);
+            for (size_t j = 0; j < pTable->nRows; j++) {
+                vecReals[j] = pColumn->vecReals[vecOrder[j]];
+            }
+            pColumn->vecReals.swap(vecReals);
+        }
+        else if (pColumn->nType == BDC_COLUMN_TEXT) {
+            std::vector<std::string> vecTexts(pTable->nRows);
+            for (size_t j = 0; j < pTable->nRows; j++) {
+                vecTexts[j].swap(pColumn->vecTexts[vecOrder[j]]);
+            }
+            pColumn->vecTexts.swap(vecTexts);
+        }
+        else {
+            std::vector<long long> vecIntegers(pTable->nRows);
+            for (size_t j = 0; j < pTable->nRows; j++) {
+                vecIntegers[j] = pColumn->vecIntegers[vecOrder[j]];
+            }
+            pColumn->vecIntegers.swap(vecIntegers);
+        }
+    }
+}
+
+/**
+ * Find a column of a history table by name
+ * @param pTable Table
+ * @param strName Column name
+ * @return Column, NULL if the table does not have it
+ */
+bdcColumnT* pFindBdcColumn(bdcTableT* pTable, const std::string& strName) {
+    for (size_t i = 0; i < pTable->vecColumns.size(); i++) {
+        if (pTable->vecColumns[i].strName == strName) {
+            return &pTable->vecColumns[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Check whether a value is NaN, for the standard algorithms
+ * @param dValue Value
+ * @return true if it is NaN
+ */
+bool bIsNaN(double dValue) {
+    return dValue != dValue;
+}
+
+/**
+ * Start the lanes of a column reduction
+ * @param pSums Lanes
+ */
+void vInitBdcSums(bdcSumsT* pSums) {
+    for (int i = 0; i < 4; i++) {
+        pSums->adCount[i] = 0;
+        pSums->adSum[i] = 0;
+        pSums->adSquares[i] = 0;
+        pSums->adMin[i] = INFINITY;
+        pSums->adMax[i] = -INFINITY;
+    }
+}
+
+/**
+ * Reduce values one at a time into their lanes, also the tail of the vector kernels
+ * @param pValues Values, NaN for empty ones
+ * @param nStart Index of the first value, which decides its lane
+ * @param nEnd Index after the last value
+ * @param dShift Subtracted from every value before summing, keeps the squares precise
+ * @param pSums Lanes
+ */
+void vReduceBdcValues(const double* pValues, size_t nStart, size_t nEnd, double dShift, bdcSumsT* pSums) {
+    for (size_t i = nStart; i < nEnd; i++) {
+        double dValue = pValues[i];
+        if (dValue != dValue) {
+            continue;
+        }
+        int nLane = (int)(i & 3);
+        double dDelta = dValue - dShift;
+        pSums->adCount[nLane] += 1;
+        pSums->adSum[nLane] += dDelta;
+        pSums->adSquares[nLane] += dDelta * dDelta;
+        pSums->adMin[nLane] = pSums->adMin[nLane] < dValue ? pSums->adMin[nLane] : dValue;
+        pSums->adMax[nLane] = pSums->adMax[nLane] > dValue ? pSums->adMax[nLane] : dValue;
+    }
+}
+
+/**
+ * Reduce a column one value at a time
+ * @param pValues Values, NaN for empty ones
+ * @param nCount Number of values
+ * @param dShift Subtracted from every value before summing
+ * @param pSums Lanes, added to
+ */
+void vReduceBdcScalar(const double* pValues, size_t nCount, double dShift, bdcSumsT* pSums) {
+    vReduceBdcValues(pValues, 0, nCount, dShift, pSums);
+}
+
+#ifdef BATTERYCYCLE_X86
+/**
+ * Reduce a column four values at a time in two SSE2 registers per sum
+ * @param pValues Values, NaN for empty ones
+ * @param nCount Number of values
+ * @param dShift Subtracted from every value before summing
+ * @param pSums Lanes, added to
+ */
+CSV_TARGET("sse2")
+void vReduceBdcSse2(const double* pValues, size_t nCount, double dShift, bdcSumsT* pSums) {
+    const __m128d xShift = _mm_set1_pd(dShift);
+    const __m128d xOne = _mm_set1_pd(1.0);
+    const __m128d xInf = _mm_set1_pd(INFINITY);
+    const __m128d xNegInf = _mm_set1_pd(-INFINITY);
+    __m128d axCount[2], axSum[2], axSquares[2], axMin[2], axMax[2];
+    for (int j = 0; j < 2; j++) {
+        axCount[j] = _mm_loadu_pd(pSums->adCount + 2 * j);
+        axSum[j] = _mm_loadu_pd(pSums->adSum + 2 * j);
+        axSquares[j] = _mm_loadu_pd(pSums->adSquares + 2 * j);
+        axMin[j] = _mm_loadu_pd(pSums->adMin + 2 * j);
+        axMax[j] = _mm_loadu_pd(pSums->adMax + 2 * j);
+    }
+
+    // Empty values add zeros and compare as infinities
+    size_t nBlocks = nCount & ~(size_t)3;
+    for (size_t i = 0; i < nBlocks; i += 4) {
+        for (int j = 0; j < 2; j++) {
+            __m128d xValue = _mm_loadu_pd(pValues + i + 2 * j);
+            __m128d xSet = _mm_cmpord_pd(xValue, xValue);
+            __m128d xDelta = _mm_and_pd(_mm_sub_pd(xValue, xShift), xSet);
+            axCount[j] = _mm_add_pd(axCount[j], _mm_and_pd(xOne, xSet));
+            axSum[j] = _mm_add_pd(axSum[j], xDelta);
+            axSquares[j] = _mm_add_pd(axSquares[j], _mm_mul_pd(xDelta, xDelta));
+            axMin[j] = _mm_min_pd(axMin[j], _mm_or_pd(_mm_and_pd(xSet, xValue), _mm_andnot_pd(xSet, xInf)));
+            axMax[j] = _mm_max_pd(axMax[j], _mm_or_pd(_mm_and_pd(xSet, xValue), _mm_andnot_pd(xSet, xNegInf)));
+        }
+    }
+
+    for (int j = 0; j < 2; j++) {
+        _mm_storeu_pd(pSums->adCount + 2 * j, axCount[j]);
+        _mm_storeu_pd(pSums->adSum + 2 * j, axSum[j]);
+        _mm_storeu_pd(pSums->adSquares + 2 * j, axSquares[j]);
+        _mm_storeu_pd(pSums->adMin + 2 * j, axMin[j]);
+        _mm_storeu_pd(pSums->adMax + 2 * j, axMax[j]);
+    }
+    vReduceBdcValues(pValues, nBlocks, nCount, dShift, pSums);
+}
+
+/**
+ * Reduce a column four values at a time in one AVX2 register per sum
+ * @param pValues Values, NaN for empty ones
+ * @param nCount Number of values
+ * @param dShift Subtracted from every value before summing
+ * @param pSums Lanes, added to
+ */
+CSV_TARGET("avx2")
+void vReduceBdcAvx2(const double* pValues, size_t nCount, double dShift, bdcSumsT* pSums) {
+    const __m256d yShift = _mm256_set1_pd(dShift);
+    const __m256d yOne = _mm256_set1_pd(1.0);
+    const __m256d yInf = _mm256_set1_pd(INFINITY);
+    const __m256d yNegInf = _mm256_set1_pd(-INFINITY);
+    __m256d yCount = _mm256_loadu_pd(pSums->adCount);
+    __m256d ySum = _mm256_loadu_pd(pSums->adSum);
+    __m256d ySquares = _mm256_loadu_pd(pSums->adSquares);
+    __m256d yMin = _mm256_loadu_pd(pSums->adMin);
+    __m256d yMax = _mm256_loadu_pd(pSums->adMax);
+
+    // Empty values add zeros and compare as infinities
+    size_t nBlocks = nCount & ~(size_t)3;
+    for (size_t i = 0; i < nBlocks; i += 4) {
+        __m256d yValue = _mm256_loadu_pd(pValues + i);
+        __m256d ySet = _mm256_cmp_pd(yValue, yValue, _CMP_ORD_Q);
+        __m256d yDelta = _mm256_and_pd(_mm256_sub_pd(yValue, yShift), ySet);
+        yCount = _mm256_add_pd(yCount, _mm256_and_pd(yOne, ySet));
+        ySum = _mm256_add_pd(ySum, yDelta);
+        ySquares = _mm256_add_pd(ySquares, _mm256_mul_pd(yDelta, yDelta));
+        yMin = _mm256_min_pd(yMin, _mm256_blendv_pd(yInf, yValue, ySet));
+        yMax = _mm256_max_pd(yMax, _mm256_blendv_pd(yNegInf, yValue, ySet));
+    }
+
+    _mm256_storeu_pd(pSums->adCount, yCount);
+    _mm256_storeu_pd(pSums->adSum, ySum);
+    _mm256_storeu_pd(pSums->adSquares, ySquares);
+    _mm256_storeu_pd(pSums->adMin, yMin);
+    _mm256_storeu_pd(pSums->adMax, yMax);
+    vReduceBdcValues(pValues, nBlocks, nCount, dShift, pSums);
+}
+#endif
+
+/**
+ * Available reduction kernels, each one faster than the one before it, all with the same results
+ */
+const bdcReduceKernelT astBdcReduceKernels[] = {
+    { "scalar", vReduceBdcScalar, bCpuHasScalar },
+#ifdef BATTERYCYCLE_X86
+    { "sse2", vReduceBdcSse2, bCpuHasSse2 },
+    { "avx2", vReduceBdcAvx2, bCpuHasAvx2 },
+#endif
+};
+#define BDC_REDUCE_KERNEL_COUNT (int)(sizeof(astBdcReduceKernels) / sizeof(astBdcReduceKernels[0]))
+
+/**
+ * Pick the fastest reduction kernel the CPU supports
+ * @return Kernel
+ */
+const bdcReduceKernelT* pSelectBdcReduceKernel(void) {
+    for (int i = BDC_REDUCE_KERNEL_COUNT - 1; i > 0; i--) {
+        if (astBdcReduceKernels[i].pfnSupported()) {
+            return &astBdcReduceKernels[i];
+        }
+    }
+    return &astBdcReduceKernels[0];
+}
+
+/**
+ * Get the reduction kernel chosen for this CPU, the choice is made on the first call
+ * @return Kernel
+ */
+const bdcReduceKernelT* pGetBdcReduceKernel(void) {
+    static const bdcReduceKernelT* pKernel = pSelectBdcReduceKernel();
+    return pKernel;
+}
+
+/**
+ * Get a percentile of values, interpolating between the two closest ones
+ * @param pvecValues Values without empty ones, reordered
+ * @param dFraction Percentile as a fraction, 0.5 for the median
+ * @return Percentile
+ */
+double dBdcPercentile(std::vector<double>* pvecValues, double dFraction) {
+    double dPosition = dFraction * (pvecValues->size() - 1);
+    size_t nLow = (size_t)dPosition;
+    std::nth_element(pvecValues->begin(), pvecValues->begin() + nLow, pvecValues->end());
+    double dLow = (*pvecValues)[nLow];
+    if (nLow + 1 >= pvecValues->size()) {
+        return dLow;
+    }
+
+    // The next value is the smallest of the ones after the selected one
+    double dHigh = *std::min_element(pvecValues->begin() + nLow + 1, pvecValues->end());
+    return dLow + (dHigh - dLow) * (dPosition - nLow);
+}
+
+/**
+ * Copy a range of a numeric history column as reals, NaN for empty values
+ * @param pColumn Column, not text
+ * @param nFirst First row
+ * @param nEnd Row after the last one
+ * @param pvecValues Receives the values
+ */
+void vGetBdcColumnReals(const bdcColumnT* pColumn, size_t nFirst, size_t nEnd, std::vector<double>* pvecValues) {
+    if (pColumn->nType == BDC_COLUMN_REAL) {
+        pvecValues->assign(pColumn->vecReals.begin() + nFirst, pColumn->vecReals.begin() + nEnd);
+        return;
+    }
+    pvecValues->resize(nEnd - nFirst);
+    const long long* pIntegers = pColumn->vecIntegers.data() + nFirst;
+    double* pValues = pvecValues->data();
+    for (size_t i = 0; i < nEnd - nFirst; i++) {
+        pValues[i] = pIntegers[i] == BDC_MISSING_INTEGER ? NAN : (double)pIntegers[i];
+    }
+}
+
+/**
+ * Compute every statistic of a range of a history column, the sums in a single pass over the values
+ * Timestamps count as seconds since 1970, text columns only get their count.
+ * @param pColumn Column
+ * @param nFirst First row
+ * @param nEnd Row after the last one
+ * @param pStats Receives the statistics
+ */
+void vAggregateBdcColumn(const bdcColumnT* pColumn, size_t nFirst, size_t nEnd, bdcStatsT* pStats) {
+    pStats->ullCount = 0;
+    pStats->dMin = pStats->dMax = pStats->dMean = pStats->dStdDev = NAN;
+    pStats->dP50 = pStats->dP90 = pStats->dP99 = NAN;
+    if (pColumn->nType == BDC_COLUMN_TEXT) {
+        for (size_t i = nFirst; i < nEnd; i++) {
+            pStats->ullCount += !pColumn->vecTexts[i].empty();
+        }
+        return;
+    }
+
+    std::vector<double> vecValues;
+    vGetBdcColumnReals(pColumn, nFirst, nEnd, &vecValues);
+    double dShift = 0;
+    for (size_t i = 0; i < vecValues.size(); i++) {
+        if (vecValues[i] == vecValues[i]) {
+            dShift = vecValues[i];
+            break;
+        }
+    }
+
+    bdcSumsT stSums;
+    vInitBdcSums(&stSums);
+    pGetBdcReduceKernel()->pfnReduce(vecValues.data(), vecValues.size(), dShift, &stSums);
+
+    // Lanes are combined pairwise in a fixed order
+    double dCount = (stSums.adCount[0] + stSums.adCount[1]) + (stSums.adCount[2] + stSums.adCount[3]);
+    if (dCount == 0) {
+        return;
+    }
+    double dSum = (stSums.adSum[0] + stSums.adSum[1]) + (stSums.adSum[2] + stSums.adSum[3]);
+    double dSquares = (stSums.adSquares[0] + stSums.adSquares[1]) + (stSums.adSquares[2] + stSums.adSquares[3]);
+    double dMin01 = stSums.adMin[0] < stSums.adMin[1] ? stSums.adMin[0] : stSums.adMin[1];
+    double dMin23 = stSums.adMin[2] < stSums.adMin[3] ? stSums.adMin[2] : stSums.adMin[3];
+    double dMax01 = stSums.adMax[0] > stSums.adMax[1] ? stSums.adMax[0] : stSums.adMax[1];
+    double dMax23 = stSums.adMax[2] > stSums.adMax[3] ? stSums.adMax[2] : stSums.adMax[3];
+    double dVariance = (dSquares - dSum * dSum / dCount) / dCount;
+    pStats->ullCount = (unsigned long long)dCount;
+    pStats->dMin = dMin01 < dMin23 ? dMin01 : dMin23;
+    pStats->dMax = dMax01 > dMax23 ? dMax01 : dMax23;
+    pStats->dMean = dShift + dSum / dCount;
+    pStats->dStdDev = sqrt(dVariance > 0 ? dVariance : 0);
+
+    // Percentiles need the values themselves, empty ones are dropped first
+    vecValues.erase(std::remove_if(vecValues.begin(), vecValues.end(), bIsNaN), vecValues.end());
+    pStats->dP50 = dBdcPercentile(&vecValues, 0.5);
+    pStats->dP90 = dBdcPercentile(&vecValues, 0.9);
+    pStats->dP99 = dBdcPercentile(&vecValues, 0.99);
+}
+
+/**
+ * Add derived ratio columns named "A/B" to a history table, e.g. "NominalChargeCapacity/DesignCapacity"
+ * Every row gets A divided by B, empty if either is empty, B is zero or one of them is text.
+ * @param pTable Table
+ * @param vecNames Column names, those with a slash that the table does not have yet are derived
+ */
+void vDeriveBdcColumns(bdcTableT* pTable, const std::vector<std::string>& vecNames) {
+    for (size_t i = 0; i < vecNames.size(); i++) {
+        size_t nSlash = vecNames[i].find('/');
+        if (nSlash == std::string::npos || pFindBdcColumn(pTable, vecNames[i])) {
+            continue;
+        }
+        const bdcColumnT* pNumerator = pFindBdcColumn(pTable, vecNames[i].substr(0, nSlash));
+        const bdcColumnT* pDenominator = pFindBdcColumn(pTable, vecNames[i].substr(nSlash + 1));
+        if (!pNumerator || !pDenominator || pNumerator->nType == BDC_COLUMN_TEXT ||
+            pDenominator->nType == BDC_COLUMN_TEXT) {
+            continue;
+        }
+
+        std::vector<double> vecNumerators;
+        std::vector<double> vecDenominators;
+        vGetBdcColumnReals(pNumerator, 0, pTable->nRows, &vecNumerators);
+        vGetBdcColumnReals(pDenominator, 0, pTable->nRows, &vecDenominators);
+        bdcColumnT stRatio;
+        stRatio.strName = vecNames[i];
+        stRatio.nType = BDC_COLUMN_REAL;
+        stRatio.bTyped = true;
+        stRatio.vecReals.resize(pTable->nRows);
+        for (size_t j = 0; j < pTable->nRows; j++) {
+            stRatio.vecReals[j] = vecDenominators[j] != 0 ? vecNumerators[j] / vecDenominators[j] : NAN;
+        }
+        pTable->vecColumns.push_back(stRatio);
+    }
+}
+
+/**
+ * Start the trends of a report
+ * @param pTrend Trends, vecColumns names the columns
+ */
+void vInitBdcTrends(bdcTrendSetT* pTrend) {
+    bdcTrendT stEmpty;
+    memset(&stEmpty, 0, sizeof(stEmpty));
+    pTrend->vecTrends.assign(pTrend->vecColumns.size(), stEmpty);
+    pTrend->ullFiles = 0;
+}
+
+/**
+ * Add a value to a trend
+ * Welford's update: the means move first and the co-moments grow by products of deviations from
+ * the old and the new means, which keeps them accurate over years of rows.
+ * @param pTrend Trend
+ * @param llSeconds Time of the value, seconds since 1970
+ * @param dValue Value
+ */
+void vAddBdcTrendValue(bdcTrendT* pTrend, long long llSeconds, double dValue) {
+    if (pTrend->ullCount == 0) {
+        pTrend->llOrigin = pTrend->llFirst = pTrend->llLast = llSeconds;
+    }
+    pTrend->llFirst = std::min(pTrend->llFirst, llSeconds);
+    pTrend->llLast = std::max(pTrend->llLast, llSeconds);
+
+    double dX = (double)(llSeconds - pTrend->llOrigin) / 86400;
+    pTrend->ullCount++;
+    double dDeltaX = dX - pTrend->dMeanX;
+    double dDeltaY = dValue - pTrend->dMeanY;
+    pTrend->dMeanX += dDeltaX / (double)pTrend->ullCount;
+    pTrend->dMeanY += dDeltaY / (double)pTrend->ullCount;
+    pTrend->dSxx += dDeltaX * (dX - pTrend->dMeanX);
+    pTrend->dSxy += dDeltaX * (dValue - pTrend->dMeanY);
+    pTrend->dSyy += dDeltaY * (dValue - pTrend->dMeanY);
+}
+
+/**
+ * Remember the last value of a file if the file is one of the two newest of a trend
+ * Files may come in any order, their dates decide.
+ * @param pTrend Trend
+ * @param tFile Date of the file
+ * @param llSeconds Time of its last value
+ * @param dValue Its last value
+ */
+void vAddBdcTrendFileEnd(bdcTrendT* pTrend, time_t tFile, long long llSeconds, double dValue) {
+    double dX = (double)(llSeconds - pTrend->llOrigin) / 86400;
+    int nSlot;
+    if (pTrend->nFiles == 0 || tFile >= pTrend->atFiles[0]) {
+        pTrend->atFiles[1] = pTrend->atFiles[0];
+        pTrend->adFileX[1] = pTrend->adFileX[0];
+        pTrend->adFileY[1] = pTrend->adFileY[0];
+        nSlot = 0;
+    }
+    else if (pTrend->nFiles == 1 || tFile >= pTrend->atFiles[1]) {
+        nSlot = 1;
+    }
+    else {
+        return;
+    }
+    pTrend->atFiles[nSlot] = tFile;
+    pTrend->adFileX[nSlot] = dX;
+    pTrend->adFileY[nSlot] = dValue;
+    pTrend->nFiles = std::min(pTrend->nFiles + 1, 2);
+}
+
+/**
+ * Add the rows of one complete BDC_Daily_ file to the trends of a report and drop them from the table
+ * Rows are timed by their TimeStamp column, rows without one by the date of the file.
+ * The columns stay in the table with their types, ready for the next file.
+ * @param pTrend Trends
+ * @param pTable Table holding the rows of this file only
+ * @param tFile Date of the file
+ */
+void vAddBdcTrendFile(bdcTrendSetT* pTrend, bdcTableT* pTable, time_t tFile) {
+    pTrend->ullFiles++;
+    size_t nHeaderColumns = pTable->vecColumns.size();
+    vDeriveBdcColumns(pTable, pTrend->vecColumns);
+
+    const bdcColumnT* pTime = pFindBdcColumn(pTable, "TimeStamp");
+    if (pTime && pTime->nType != BDC_COLUMN_TIMESTAMP) {
+        pTime = NULL;
+    }
+    std::vector<double> vecValues;
+    for (size_t i = 0; i < pTrend->vecColumns.size(); i++) {
+        const bdcColumnT* pColumn = pFindBdcColumn(pTable, pTrend->vecColumns[i]);
+        if (!pColumn || pColumn->nType == BDC_COLUMN_TEXT) {
+            continue;
+        }
+        vGetBdcColumnReals(pColumn, 0, pTable->nRows, &vecValues);
+        bdcTrendT* pColumnTrend = &pTrend->vecTrends[i];
+        bool bAny = false;
+        long long llSeconds = 0;
+        double dValue = 0;
+        for (size_t j = 0; j < pTable->nRows; j++) {
+            if (bIsNaN(vecValues[j])) {
+                continue;
+            }
+            bool bTimed = pTime && pTime->vecIntegers[j] != BDC_MISSING_INTEGER;
+            llSeconds = bTimed ? pTime->vecIntegers[j] : (long long)tFile;
+            dValue = vecValues[j];
+            vAddBdcTrendValue(pColumnTrend, llSeconds, dValue);
+            bAny = true;
+        }
+        if (bAny) {
+            vAddBdcTrendFileEnd(pColumnTrend, tFile, llSeconds, dValue);
+        }
+    }
+
+    pTable->vecColumns.resize(nHeaderColumns);
+    for (size_t i = 0; i < nHeaderColumns; i++) {
+        pTable->vecColumns[i].vecIntegers.clear();
+        pTable->vecColumns[i].vecReals.clear();
+        pTable->vecColumns[i].vecTexts.clear();
+    }
+    pTable->vecMembers.clear();
+    pTable->nRows = 0;
+}
+
+/**
+ * Get the fitted line and the rates of change of a trend
+ * @param pTrend Trend
+ * @param pLine Receives the line
+ */
+void vGetBdcTrendLine(const bdcTrendT* pTrend, bdcTrendLineT* pLine) {
+    pLine->dPerDay = pLine->dStart = pLine->dEnd = pLine->dR2 = pLine->dRecentPerDay = NAN;
+    if (pTrend->ullCount >= 2 && pTrend->dSxx > 0) {
+        pLine->dPerDay = pTrend->dSxy / pTrend->dSxx;
+        double dFirstX = (double)(pTrend->llFirst - pTrend->llOrigin) / 86400;
+        double dLastX = (double)(pTrend->llLast - pTrend->llOrigin) / 86400;
+        pLine->dStart = pTrend->dMeanY + pLine->dPerDay * (dFirstX - pTrend->dMeanX);
+        pLine->dEnd = pTrend->dMeanY + pLine->dPerDay * (dLastX - pTrend->dMeanX);
+        if (pTrend->dSyy > 0) {
+            pLine->dR2 = pTrend->dSxy * pTrend->dSxy / (pTrend->dSxx * pTrend->dSyy);
+        }
+    }
+    if (pTrend->nFiles == 2 && pTrend->adFileX[0] != pTrend->adFileX[1]) {
+        pLine->dRecentPerDay = (pTrend->adFileY[0] - pTrend->adFileY[1]) / (pTrend->adFileX[0] - pTrend->adFileX[1]);
+    }
+}
+
+/**
+ * Content callback that adds every BDC_Daily_ file to the trends of a report once it is complete
+ * Rows go through nLoadBdcHistoryCallback, only those of the current file are held at a time.
+ * @param szFilename Filename that was extracted
+ * @param pPiece Next piece of the file
+ * @param nSize Size of the piece, 0 at the end of the file
+ * @param ullOffset Offset of the piece, 0 for a new file
+ * @param pUserData User data (bdcHistoryLoaderT with pTrend set)
+ * @return 0 to continue scanning, negative number on error
+ */
+int nTrackBdcTrendCallback(const char* szFilename, const char* pPiece, size_t nSize,
+    unsigned long long ullOffset, void* pUserData) {
+    bdcHistoryLoaderT* pLoader = (bdcHistoryLoaderT*)pUserData;
+    if (!pLoader || !pLoader->pTrend) {
+        return -1;
+    }
+
+    int nRet = nLoadBdcHistoryCallback(szFilename, pPiece, nSize, ullOffset, pUserData);
+    if (nRet == 0 && nSize == 0) {
+        vAddBdcTrendFile(pLoader->pTrend, pLoader->pTable, pLoader->pTable->vecMembers.back().stDate.tTimestamp);
+    }
+    return nRet;
+}
+
+/**
+ * Allocate the buffers a worker reuses across archives
+ * @param pBuffers Receives the buffers, release them with vFreeWorkerBuffers in any case
+ * @return true on success, false if an allocation failed
+ */
+bool bAllocWorkerBuffers(workerBuffersT* pBuffers) {
+    pBuffers->pInput = (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    pBuffers->pWindow = (unsigned char*)malloc(OUTPUT_WINDOW_SIZE);
+    pBuffers->pScratch = (unsigned char*)malloc(INPUT_BUFFER_SIZE);
+    pBuffers->pFingerprint = (unsigned char*)malloc(FINGERPRINT_SPAN);
+    pBuffers->pInflate = NULL;
+    return pBuffers->pInput && pBuffers->pWindow && pBuffers->pScratch && pBuffers->pFingerprint;
+}
+
+/**
+ * Release the buffers and warm decoder state of a worker
+ * @param pBuffers Worker buffers
+ */
+void vFreeWorkerBuffers(workerBuffersT* pBuffers) {
+    free(pBuffers->pInput);
+    free(pBuffers->pWindow);
+    free(pBuffers->pScratch);
+    free(pBuffers->pFingerprint);
+    vReleaseInflateState(pBuffers->pInflate, false);
+}
+
+/**
+ * Fingerprint an archive from its size, its last 8 bytes and CRC32s of its first and last MB
+ * @param szTargzPath Path to the archive
+ * @param pFingerprint Receives the fingerprint
+ * @param pBuffers Worker buffers to use, NULL to allocate them
+ * @return 1 on success, 0 if the archive cannot be read
+ */
+int bFingerprintArchive(const char* szTargzPath, archiveFingerprintT* pFingerprint, workerBuffersT* pBuffers) {
+    memset(pFingerprint, 0, sizeof(archiveFingerprintT));
+    unsigned char* pBuffer = pBuffers ? pBuffers->pFingerprint : (unsigned char*)malloc(FINGERPRINT_SPAN);
+    FILE* fp = fopen(szTargzPath, "rb");
+    if (!pBuffer || !fp) {
+        if (!pBuffers) {
+            free(pBuffer);
+        }
+        if (fp) {
+            fclose(fp);
+        }
+        return 0;
+    }
+
+    long long llSize = -1;
+    if (_fseeki64(fp, 0, SEEK_END) == 0) {
+        llSize = _ftelli64(fp);
+    }
+
+    int bOk = llSize >= 8;
+    if (bOk) {
+        pFingerprint->ullSize = (unsigned long long)llSize;
+        size_t nSpan = llSize < FINGERPRINT_SPAN ? (size_t)llSize : FINGERPRINT_SPAN;
+
+        bOk = _fseeki64(fp, 0, SEEK_SET) == 0 && fread(pBuffer, 1, nSpan, fp) == nSpan;
+        if (bOk) {
+            pFingerprint->ulHeadCrc = crc32(0L, pBuffer, (uInt)nSpan);
+            bOk = _fseeki64(fp, llSize - (long long)nSpan, SEEK_SET) == 0 && fread(pBuffer, 1, nSpan, fp) == nSpan;
+        }
+        if (bOk) {
+            pFingerprint->ulTailCrc = crc32(0L, pBuffer, (uInt)nSpan);
+            memcpy(pFingerprint->abTrailer, pBuffer + nSpan - 8, 8);
+        }
+    }
+
+    fclose(fp);
+    if (!pBuffers) {
+        free(pBuffer);
+    }
+    return bOk;
+}
+
+/**
+ * Fingerprint an archive held in memory, the result equals bFingerprintArchive on the same bytes
+ * @param pData Archive data
+ * @param nSize Size of the data
+ * @param pFingerprint Receives the fingerprint
+ * @return 1 on success, 0 if the archive is too small
+ */
+int bFingerprintBuffer(const unsigned char* pData, size_t nSize, archiveFingerprintT* pFingerprint) {
+    memset(pFingerprint, 0, sizeof(archiveFingerprintT));
+    if (nSize < 8) {
+        return 0;
+    }
+
+    size_t nSpan = nSize < FINGERPRINT_SPAN ? nSize : FINGERPRINT_SPAN;
+    pFingerprint->ullSize = nSize;
+    pFingerprint->ulHeadCrc = crc32(0L, pData, (uInt)nSpan);
+    pFingerprint->ulTailCrc = crc32(0L, pData + nSize - nSpan, (uInt)nSpan);
+    memcpy(pFingerprint->abTrailer, pData + nSize - 8, 8);
+    return 1;
+}
+
+/**
+ * Build the result cache file path for an archive fingerprint
+ * @param pFingerprint Archive fingerprint
+ * @param szCacheDir Cache directory
+ * @param szCachePath Buffer receiving the cache path
+ * @param nBufSize Size of the buffer
+ * @return 1 on success, 0 if the path does not fit
+ */
+int bGetResultCachePath(const archiveFingerprintT* pFingerprint, const char* szCacheDir,
+    char* szCachePath, size_t nBufSize) {
+    char szTrailer[17];
+    for (int i = 0; i < 8; i++) {
+        snprintf(szTrailer + i * 2, 3, "%02x", pFingerprint->abTrailer[i]);
+    }
+
+    int nLen = snprintf(szCachePath, nBufSize, "%s/%016llx-%s-%08lx-%08lx%s", szCacheDir, pFingerprint->ullSize,
+        szTrailer, pFingerprint->ulHeadCrc, pFingerprint->ulTailCrc, RESULT_CACHE_EXTENSION);
+    return nLen > 0 && (size_t)nLen < nBufSize;
+}
+
+/**
+ * Read one length prefixed string of a result cache file
+ * @param fp Cache file
+ * @param szBuffer Buffer receiving the NUL-terminated string
+ * @param nBufSize Size of the buffer
+ * @return 1 on success, 0 if the file is damaged
+ */
+int bReadCachedString(FILE* fp, char* szBuffer, size_t nBufSize) {
+    unsigned int uLen = 0;
+    if (fread(&uLen, sizeof(uLen), 1, fp) != 1 || uLen >= nBufSize || fread(szBuffer, 1, uLen, fp) != uLen) {
+        return 0;
+    }
+    szBuffer[uLen] = '\0';
+    return 1;
+}
+
+/**
+ * Write one length prefixed string of a result cache file
+ * @param fp Cache file
+ * @param szValue String to write
+ * @return 1 on success, 0 on error
+ */
+int bWriteCachedString(FILE* fp, const char* szValue) {
+    unsigned int uLen = (unsigned int)strlen(szValue);
+    return fwrite(&uLen, sizeof(uLen), 1, fp) == 1 && fwrite(szValue, 1, uLen, fp) == uLen;
+}
+
+/**
+ * Look up the cached result of an archive
+ * @param pFingerprint Archive fingerprint
+ * @param szCacheDir Cache directory
+ * @param pInfo Receives the cached battery information
+ * @return 0 on a hit, -1 otherwise
+ */
+int nLoadCachedResult(const archiveFingerprintT* pFingerprint, const char* szCacheDir, batteryInfoT* pInfo) {
+    char szCachePath[MAX_PATH_LENGTH * 2];
+    if (!bGetResultCachePath(pFingerprint, szCacheDir, szCachePath, sizeof(szCachePath))) {
+        return -1;
+    }
+
+    FILE* fp = fopen(szCachePath, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    // The file name already is the key, the stored copy guards against name collisions
+    archiveFingerprintT stStored;
+    char szMagic[8];
+    int bOk = fread(szMagic, 1, 8, fp) == 8 && memcmp(szMagic, RESULT_CACHE_MAGIC, 8) == 0 &&
+        fread(&stStored, sizeof(stStored), 1, fp) == 1 &&
+        memcmp(&stStored, pFingerprint, sizeof(stStored)) == 0 &&
+        bReadCachedString(fp, pInfo->szFilename, sizeof(pInfo->szFilename)) &&
+        bReadCachedString(fp, pInfo->szCycleCount, sizeof(pInfo->szCycleCount)) &&
+        bReadCachedString(fp, pInfo->szTimeStamp, sizeof(pInfo->szTimeStamp));
+
+    fclose(fp);
+    return bOk ? 0 : -1;
+}
+
+/**
+ * Store the result of an archive in the cache, replacing an older entry
+ * @param pFingerprint Archive fingerprint
+ * @param szCacheDir Cache directory
+ * @param pInfo Battery information to store
+ * @return 0 on success, -1 on error
+ */
+int nSaveCachedResult(const archiveFingerprintT* pFingerprint, const char* szCacheDir, const batteryInfoT* pInfo) {
+    char szCachePath[MAX_PATH_LENGTH * 2];
+    char szTempPath[MAX_PATH_LENGTH * 2 + 4];
+    if (!bGetResultCachePath(pFingerprint, szCacheDir, szCachePath, sizeof(szCachePath)) ||
+        snprintf(szTempPath, sizeof(szTempPath), "%s.tmp", szCachePath) >= (int)sizeof(szTempPath)) {
+        return -1;
+    }
+
+    FILE* fp = fopen(szTempPath, "wb");
+    if (!fp) {
+        vLogMessage("Warning: Cannot write result cache %s\n", szTempPath);
+        return -1;
+    }
+
+    // Like the index, the cache is local and written in native layout
+    int bOk = fwrite(RESULT_CACHE_MAGIC, 1, 8, fp) == 8 &&
+        fwrite(pFingerprint, sizeof(archiveFingerprintT), 1, fp) == 1 &&
+        bWriteCachedString(fp, pInfo->szFilename) &&
+        bWriteCachedString(fp, pInfo->szCycleCount) &&
+        bWriteCachedString(fp, pInfo->szTimeStamp);
+
+    if (fclose(fp) != 0) {
+        bOk = 0;
+    }
+
+    if (!bOk) {
+        vLogMessage("Warning: Failed to write result cache %s\n", szTempPath);
+        remove(szTempPath);
+        return -1;
+    }
+
+    remove(szCachePath);
+    if (rename(szTempPath, szCachePath) != 0) {
+        remove(szTempPath);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Milliseconds elapsed since a point in time
+ * @param tStart Start time
+ * @return Elapsed milliseconds
+ */
+double dElapsedMs(std::chrono::steady_clock::time_point tStart) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+}
+
+/**
+ * Where a report is read from, set exactly one of szPath, pData and fp
+ */
+typedef struct {
+    const char* szPath;       // Archive or extracted folder on disk
+    const unsigned char* pData; // Archive held in memory
+    size_t nSize;             // Size of pData
+    FILE* fp;                 // Archive read once front to back from a file, pipe or socket
+} reportSourceT;
+
+/**
+ * Find the latest BDC_Daily_ file of a report and read its battery information, printing nothing
+ * @param pSource Report to analyze
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options, NULL for defaults, pStats receives the scan statistics
+ * @param pInfo Receives the battery information
+ * @param pbFromCache Receives whether the result came from the result cache, may be NULL
+ * @param pTimings Receives the time spent per stage, may be NULL
+ * @return 0 on success, non-zero on error
+ */
+int nAnalyzeReport(
+    const reportSourceT* pSource,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions,
+    batteryInfoT* pInfo,
+    bool* pbFromCache,
+    reportTimingsT* pTimings
+) {
+    if (!pSource || (!pSource->szPath && !pSource->pData && !pSource->fp) || !szTargetDir || !pInfo) {
+        vLogMessage("Error: Invalid parameters\n");
+        return -1;
+    }
+    memset(pInfo, 0, sizeof(batteryInfoT));
+    if (pbFromCache) {
+        *pbFromCache = false;
+    }
+    reportTimingsT stTimings;
+    memset(&stTimings, 0, sizeof(reportTimingsT));
+    if (!pTimings) {
+        pTimings = &stTimings;
+    }
+    memset(pTimings, 0, sizeof(reportTimingsT));
+    std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+
+    // A report seen before is answered from the result cache without decompressing anything,
+    // streams cannot be fingerprinted without reading them twice
+    archiveFingerprintT stFingerprint;
+    bool bCacheable = false;
+    if (pOptions && pOptions->szCacheDir) {
+        if (pSource->szPath) {
+            bCacheable = nDetectInputFormat(pSource->szPath) != INPUT_FORMAT_DIRECTORY &&
+                bFingerprintArchive(pSource->szPath, &stFingerprint, pOptions->pBuffers);
+        }
+        else if (pSource->pData) {
+            bCacheable = bFingerprintBuffer(pSource->pData, pSource->nSize, &stFingerprint);
+        }
+    }
+    if (bCacheable && nLoadCachedResult(&stFingerprint, pOptions->szCacheDir, pInfo) == 0) {
+        if (pbFromCache) {
+            *pbFromCache = true;
+        }
+        pTimings->dLookupMs = pTimings->dTotalMs = dElapsedMs(tStart);
+        return 0;
+    }
+    pTimings->dLookupMs = dElapsedMs(tStart);
+
+    // Setup matcher data
+    matcherDataT stData;
+    memset(&stData, 0, sizeof(matcherDataT));
+    stData.szPrefix = "BDC_Daily_version";
+    stData.bFoundMatch = 0;
+
+    // Single pass: every newer candidate replaces the buffered one, the archive is inflated once
+    std::chrono::steady_clock::time_point tScan = std::chrono::steady_clock::now();
+    int nResult;
+    if (pSource->szPath) {
+        nResult = nExtractFromTargzWithCallback(pSource->szPath, szTargetDir,
+            bLatestBdcDailyMatcher, nKeepLatestTailCallback, &stData, pOptions);
+    }
+    else if (pSource->pData) {
+        nResult = nExtractFromBufferWithCallback(pSource->pData, pSource->nSize, szTargetDir,
+            bLatestBdcDailyMatcher, nKeepLatestTailCallback, &stData, pOptions);
+    }
+    else {
+        nResult = nExtractFromStreamWithCallback(pSource->fp, szTargetDir,
+            bLatestBdcDailyMatcher, nKeepLatestTailCallback, &stData, pOptions);
+    }
+    pTimings->dScanMs = dElapsedMs(tScan);
+    if (nResult != 0 || !stData.bFoundMatch || !stData.stLatestTail.bComplete) {
+        if (nResult != 0) {
+            vLogMessage("Error: Failed to analyze archive\n");
+        }
+        else {
+            vLogMessage("Error: No matching BDC_Daily_ files found\n");
+            nResult = -1;
+        }
+        pTimings->dTotalMs = dElapsedMs(tStart);
+        return nResult;
+    }
+
+    // Parse the kept header and last row of the latest file
+    std::chrono::steady_clock::time_point tParse = std::chrono::steady_clock::now();
+    strncpy_s(pInfo->szFilename, sizeof(pInfo->szFilename), stData.stLatestFile.szFilename, _TRUNCATE);
+    nResult = nReadBatteryInfoFromTail(&stData.stLatestTail, pInfo);
+    pTimings->dParseMs = dElapsedMs(tParse);
+    if (nResult == 0 && bCacheable) {
+        nSaveCachedResult(&stFingerprint, pOptions->szCacheDir, pInfo);
+    }
+    pTimings->dTotalMs = dElapsedMs(tStart);
+    return nResult;
+}
+
+/**
+ * Scan a report once and hand every BDC_Daily_ file to a content callback of a history loader
+ * @param pSource Report to scan
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options, NULL for defaults
+ * @param pfnContent nLoadBdcHistoryCallback or nTrackBdcTrendCallback
+ * @param pLoader Loader passed to the callback
+ * @return 0 on success, non-zero on error
+ */
+int nScanBdcDailyFiles(
+    const reportSourceT* pSource,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions,
+    pfnFileContentCallback pfnContent,
+    bdcHistoryLoaderT* pLoader
+) {
+    int nResult;
+    if (pSource->szPath) {
+        nResult = nExtractFromTargzWithCallback(pSource->szPath, szTargetDir,
+            bAllBdcDailyMatcher, pfnContent, pLoader, pOptions);
+    }
+    else if (pSource->pData) {
+        nResult = nExtractFromBufferWithCallback(pSource->pData, pSource->nSize, szTargetDir,
+            bAllBdcDailyMatcher, pfnContent, pLoader, pOptions);
+    }
+    else {
+        nResult = nExtractFromStreamWithCallback(pSource->fp, szTargetDir,
+            bAllBdcDailyMatcher, pfnContent, pLoader, pOptions);
+    }
+    if (nResult != 0) {
+        vLogMessage("Error: Failed to analyze archive\n");
+    }
+    return nResult;
+}
+
+/**
+ * Load every row of every BDC_Daily_ file of a report into a history table, printing nothing
+ * The archive is scanned once like for nAnalyzeReport, but the result cache does not apply.
+ * @param pSource Report to load
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options, NULL for defaults, pStats receives the scan statistics
+ * @param pTable Receives the rows in date order
+ * @return 0 on success, non-zero on error
+ */
+int nLoadBdcHistory(
+    const reportSourceT* pSource,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions,
+    bdcTableT* pTable
+) {
+    if (!pSource || (!pSource->szPath && !pSource->pData && !pSource->fp) || !szTargetDir || !pTable) {
+        vLogMessage("Error: Invalid parameters\n");
+        return -1;
+    }
+    pTable->vecColumns.clear();
+    pTable->vecMembers.clear();
+    pTable->nRows = 0;
+
+    bdcHistoryLoaderT stLoader;
+    stLoader.szPrefix = "BDC_Daily_version";
+    stLoader.pTable = pTable;
+    stLoader.bHeaderDone = false;
+    stLoader.pFieldSchema = NULL;
+    stLoader.pTrend = NULL;
+
+    int nResult = nScanBdcDailyFiles(pSource, szTargetDir, pOptions, nLoadBdcHistoryCallback, &stLoader);
+    if (nResult != 0) {
+        return nResult;
+    }
+    if (pTable->vecMembers.empty()) {
+        vLogMessage("Error: No matching BDC_Daily_ files found\n");
+        return -1;
+    }
+
+    vSortBdcTableByDate(pTable);
+    return 0;
+}
+
+/**
+ * Fit the trends of columns of a report over time while its BDC_Daily_ files stream past, printing nothing
+ * Files are added in archive order as each one completes, memory use does not grow with the history.
+ * @param pSource Report to scan
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options, NULL for defaults
+ * @param pTrend Trends, vecColumns names the columns, receives the fits
+ * @return 0 on success, non-zero on error
+ */
+int nTrackBdcTrend(
+    const reportSourceT* pSource,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions,
+    bdcTrendSetT* pTrend
+) {
+    if (!pSource || (!pSource->szPath && !pSource->pData && !pSource->fp) || !szTargetDir || !pTrend) {
+        vLogMessage("Error: Invalid parameters\n");
+        return -1;
+    }
+    vInitBdcTrends(pTrend);
+
+    bdcTableT stTable;
+    stTable.nRows = 0;
+    bdcHistoryLoaderT stLoader;
+    stLoader.szPrefix = "BDC_Daily_version";
+    stLoader.pTable = &stTable;
+    stLoader.bHeaderDone = false;
+    stLoader.pFieldSchema = NULL;
+    stLoader.pTrend = pTrend;
+
+    int nResult = nScanBdcDailyFiles(pSource, szTargetDir, pOptions, nTrackBdcTrendCallback, &stLoader);
+    if (nResult != 0) {
+        return nResult;
+    }
+    if (pTrend->ullFiles == 0) {
+        vLogMessage("Error: No matching BDC_Daily_ files found\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Convert library options into extraction options
+ * @param pOptions Library options, NULL for defaults
+ * @param pExtract Receives the extraction options
+ */
+void vGetExtractOptions(const batteryCycleOptionsT* pOptions, extractOptionsT* pExtract) {
+    memset(pExtract, 0, sizeof(extractOptionsT));
+    if (pOptions) {
+        pExtract->nThreads = pOptions->nThreads;
+        pExtract->bUseIndex = pOptions->bUseIndex;
+        pExtract->szIndexDir = pOptions->szIndexDir;
+        pExtract->szCacheDir = pOptions->szCacheDir;
+        pExtract->szBackend = pOptions->szBackend;
+        pExtract->ullMemoryBudget = pOptions->ullMemoryBudget;
+        pExtract->bStopAfterDirectory = pOptions->bStopAfterDirectory;
+        pExtract->ullReadAhead = pOptions->ullReadAhead;
+    }
+}
+
+/**
+ * Analyze a report into a library result, reporting messages to a log callback instead of stderr
+ * @param pSource Report to analyze
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options, pStats is replaced
+ * @param pfnLog Receives errors and warnings, NULL to only keep the first error
+ * @param pLogUserData User data for pfnLog
+ * @param pResult Receives the result
+ * @return 0 on success, non-zero on error
+ */
+int nAnalyzeIntoResult(const reportSourceT* pSource, const char* szTargetDir, const extractOptionsT* pOptions,
+    pfnBatteryCycleLogCallback pfnLog, void* pLogUserData, batteryCycleResultT* pResult) {
+    if (!pResult) {
+        return -1;
+    }
+    memset(pResult, 0, sizeof(batteryCycleResultT));
+    pResult->llCycleCount = -1;
+
+    // Messages of this call and of the threads it starts go to the sink, nested calls keep theirs
+    logSinkT stSink;
+    stSink.pfnLog = pfnLog;
+    stSink.pUserData = pLogUserData;
+    stSink.szFirstError = pResult->szError;
+    logSinkT* pOuterSink = g_pLogSink;
+    g_pLogSink = &stSink;
+
+    extractOptionsT stOptions = *pOptions;
+    extractStatsT stStats;
+    memset(&stStats, 0, sizeof(extractStatsT));
+    stOptions.pStats = &stStats;
+
+    batteryInfoT stInfo;
+    bool bFromCache = false;
+    reportTimingsT stTimings;
+    int nResult = nAnalyzeReport(pSource, szTargetDir, &stOptions, &stInfo, &bFromCache, &stTimings);
+    g_pLogSink = pOuterSink;
+
+    pResult->bFromCache = bFromCache;
+    pResult->bStoppedEarly = stStats.bStoppedEarly && !bFromCache;
+    pResult->ullScanned = stStats.ullScanned;
+    pResult->ullTotal = stStats.ullTotal;
+    pResult->dLookupMs = stTimings.dLookupMs;
+    pResult->dScanMs = stTimings.dScanMs;
+    pResult->dParseMs = stTimings.dParseMs;
+    pResult->dTotalMs = stTimings.dTotalMs;
+    if (nResult != 0) {
+        return nResult;
+    }
+
+    strncpy_s(pResult->szMemberName, sizeof(pResult->szMemberName), stInfo.szFilename, _TRUNCATE);
+    strncpy_s(pResult->szCycleCount, sizeof(pResult->szCycleCount), stInfo.szCycleCount, _TRUNCATE);
+    strncpy_s(pResult->szTimeStamp, sizeof(pResult->szTimeStamp), stInfo.szTimeStamp, _TRUNCATE);
+    long long llCycleCount = -1;
+    if (bParseCSVInteger(stInfo.szCycleCount, strlen(stInfo.szCycleCount), &llCycleCount) && llCycleCount >= 0) {
+        pResult->llCycleCount = llCycleCount;
+    }
+    return 0;
+}
+
+int nBatteryCycleAnalyzeFile(const char* szPath, const batteryCycleOptionsT* pOptions,
+    batteryCycleResultT* pResult) {
+    extractOptionsT stOptions;
+    vGetExtractOptions(pOptions, &stOptions);
+    reportSourceT stSource = { szPath ? szPath : "", NULL, 0, NULL };
+    return nAnalyzeIntoResult(&stSource, "logs/BatteryBDC/", &stOptions,
+        pOptions ? pOptions->pfnLog : NULL, pOptions ? pOptions->pLogUserData : NULL, pResult);
+}
+
+int nBatteryCycleAnalyzeBuffer(const void* pData, size_t nSize, const batteryCycleOptionsT* pOptions,
+    batteryCycleResultT* pResult) {
+    extractOptionsT stOptions;
+    vGetExtractOptions(pOptions, &stOptions);
+    stOptions.bUseIndex = 0;
+    reportSourceT stSource = { NULL, (const unsigned char*)pData, pData ? nSize : 0, NULL };
+    return nAnalyzeIntoResult(&stSource, "logs/BatteryBDC/", &stOptions,
+        pOptions ? pOptions->pfnLog : NULL, pOptions ? pOptions->pLogUserData : NULL, pResult);
+}
+
+int nBatteryCycleAnalyzeStream(FILE* fp, const batteryCycleOptionsT* pOptions, batteryCycleResultT* pResult) {
+    extractOptionsT stOptions;
+    vGetExtractOptions(pOptions, &stOptions);
+    stOptions.bUseIndex = 0;
+    reportSourceT stSource = { NULL, NULL, 0, fp };
+    return nAnalyzeIntoResult(&stSource, "logs/BatteryBDC/", &stOptions,
+        pOptions ? pOptions->pfnLog : NULL, pOptions ? pOptions->pLogUserData : NULL, pResult);
+}
+
+/**
+ * Log callback of the command line tool, prints to stderr
+ * @param szMessage Message
+ * @param pUserData Unused
+ */
+void vPrintLogMessage(const char* szMessage, void* pUserData) {
+    (void)pUserData;
+    fprintf(stderr, "%s\n", szMessage);
+}
+
+/**
+ * Function to find and extract the latest BDC_Daily_ file
+ * @param szTargzPath Path to tar.gz file, "-" to read the archive from stdin
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options, NULL for defaults
+ * @return 0 on success, non-zero on error
+ */
+int nExtractLatestBdcDailyFile(
+    const char* szTargzPath,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions
+) {
+    if (!szTargzPath || !szTargetDir) {
+        fprintf(stderr, "Error: Invalid parameters\n");
+        return -1;
+    }
+
+    bool bStdin = strcmp(szTargzPath, "-") == 0;
+    printf("Parsing Sysdiagnose Report: %s\n", bStdin ? "<stdin>" : szTargzPath);
+
+    extractOptionsT stOptions;
+    memset(&stOptions, 0, sizeof(extractOptionsT));
+    if (pOptions) {
+        stOptions = *pOptions;
+    }
+
+    // A piped archive is streamed once, without index or temporary file
+    reportSourceT stSource = { szTargzPath, NULL, 0, NULL };
+    if (bStdin) {
+        _setmode(_fileno(stdin), _O_BINARY);
+        stSource.szPath = NULL;
+        stSource.fp = stdin;
+        stOptions.bUseIndex = 0;
+    }
+
+    // The command line is a client of the library like any other
+    batteryCycleResultT stResult;
+    int nResult = nAnalyzeIntoResult(&stSource, szTargetDir, &stOptions, vPrintLogMessage, NULL, &stResult);
+    if (nResult != 0) {
+        return nResult;
+    }
+
+    if (stResult.bStoppedEarly) {
+        if (stResult.ullTotal) {
+            printf("\nStopped after %.1f MB, about %.1f MB of %.1f MB not decompressed\n", stResult.ullScanned / 1e6,
+                (stResult.ullTotal - stResult.ullScanned) / 1e6, stResult.ullTotal / 1e6);
+        }
+        else {
+            printf("\nStopped after %.1f MB, the rest of the archive was not decompressed\n", stResult.ullScanned / 1e6);
+        }
+    }
+
+    // Print info about the latest file
+    printf("\nLatest BatteryBDC daily Log found %s%s\n", stResult.szMemberName,
+        stResult.bFromCache ? " (cached result)" : "");
+
+    printf("\nChecking Charging Cycle...\n");
+    printf("Battery Cycle Count: %s\nLast Charging Date: %s\n", stResult.szCycleCount, stResult.szTimeStamp);
+    return 0;
+}
+
+/**
+ * Load every row of every BDC_Daily_ file of a report and print what the history holds
+ * @param szTargzPath Path to the report, - for stdin
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options
+ * @return 0 on success, non-zero on error
+ */
+int nPrintBdcHistory(
+    const char* szTargzPath,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions
+) {
+    bool bStdin = strcmp(szTargzPath, "-") == 0;
+    printf("Parsing Sysdiagnose Report: %s\n", bStdin ? "<stdin>" : szTargzPath);
+
+    extractOptionsT stOptions = *pOptions;
+    reportSourceT stSource = { szTargzPath, NULL, 0, NULL };
+    if (bStdin) {
+        _setmode(_fileno(stdin), _O_BINARY);
+        stSource.szPath = NULL;
+        stSource.fp = stdin;
+        stOptions.bUseIndex = 0;
+    }
+
+    bdcTableT stTable;
+    int nResult = nLoadBdcHistory(&stSource, szTargetDir, &stOptions, &stTable);
+    if (nResult != 0) {
+        return nResult;
+    }
+
+    printf("\nLoaded %d BatteryBDC daily Logs with %llu rows\n\n", (int)stTable.vecMembers.size(),
+        (unsigned long long)stTable.nRows);
+    printf("%-48s %10s\n", "Log", "Rows");
+    for (size_t i = 0; i < stTable.vecMembers.size(); i++) {
+        printf("%-48s %10llu\n", stTable.vecMembers[i].stDate.szFilename,
+            (unsigned long long)stTable.vecMembers[i].nRows);
+    }
+
+    // Type and number of values of every column, timestamps with the time span they cover
+    static const char* const aszTypes[] = { "integer", "real", "timestamp", "text" };
+    printf("\n%-32s %-10s %10s\n", "Column", "Type", "Values");
+    for (size_t i = 0; i < stTable.vecColumns.size(); i++) {
+        const bdcColumnT* pColumn = &stTable.vecColumns[i];
+        size_t nValues = 0;
+        long long llFirst = BDC_MISSING_INTEGER;
+        long long llLast = BDC_MISSING_INTEGER;
+        for (size_t j = 0; j < stTable.nRows; j++) {
+            if (pColumn->nType == BDC_COLUMN_REAL) {
+                nValues += !isnan(pColumn->vecReals[j]);
+            }
+            else if (pColumn->nType == BDC_COLUMN_TEXT) {
+                nValues += !pColumn->vecTexts[j].empty();
+            }
+            else if (pColumn->vecIntegers[j] != BDC_MISSING_INTEGER) {
+                nValues++;
+                llFirst = llFirst == BDC_MISSING_INTEGER ? pColumn->vecIntegers[j] : llFirst;
+                llLast = pColumn->vecIntegers[j];
+            }
+        }
+
+        printf("%-32s %-10s %10llu", pColumn->strName.c_str(), aszTypes[pColumn->nType], (unsigned long long)nValues);
+        if (pColumn->nType == BDC_COLUMN_TIMESTAMP && nValues > 0) {
+            char szFirst[32];
+            char szLast[32];
+            vFormatCSVTimeStamp(llFirst, szFirst, sizeof(szFirst));
+            vFormatCSVTimeStamp(llLast, szLast, sizeof(szLast));
+            printf("  %s to %s", szFirst, szLast);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+/**
+ * Rows and columns of a report to export
+ */
+typedef struct {
+    std::vector<std::string> vecColumns; // Names of the columns, in output order
+    int nRows;                // One of the EXPORT_ROWS_ constants
+    unsigned long long ullFirstRow; // First row of EXPORT_ROWS_RANGE, 0 for the oldest row of the history
+    unsigned long long ullLastRow;  // Last row of EXPORT_ROWS_RANGE, included
+    int nFormat;              // One of the EXPORT_FORMAT_ constants
+    bool bStats;              // Export statistics of every column over the rows instead of the rows
+    bool bTrend;              // Export the trend of every column over the whole history instead of the rows
+} exportOptionsT;
+
+/**
+ * Output collected in a large buffer and written in few big writes
+ */
+typedef struct {
+    FILE* fp;                 // Destination
+    char* pBuffer;            // OUTPUT_BUFFER_SIZE bytes
+    size_t nUsed;             // Bytes waiting in the buffer
+    bool bFailed;             // A write failed, later output is dropped
+} outputWriterT;
+
+/**
+ * Set up an output writer
+ * @param pWriter Writer
+ * @param fp Destination, opened in binary mode for binary output
+ * @return 0 on success, -1 if the buffer cannot be allocated
+ */
+int nOpenOutputWriter(outputWriterT* pWriter, FILE* fp) {
+    pWriter->fp = fp;
+    pWriter->pBuffer = (char*)malloc(OUTPUT_BUFFER_SIZE);
+    pWriter->nUsed = 0;
+    pWriter->bFailed = false;
+    if (!pWriter->pBuffer) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Write out what the buffer of an output writer holds
+ * @param pWriter Writer
+ */
+void vFlushOutputWriter(outputWriterT* pWriter) {
+    if (pWriter->nUsed > 0 && !pWriter->bFailed &&
+        fwrite(pWriter->pBuffer, 1, pWriter->nUsed, pWriter->fp) != pWriter->nUsed) {
+        pWriter->bFailed = true;
+    }
+    pWriter->nUsed = 0;
+}
+
+/**
+ * Add data to an output writer, data larger than the buffer is written directly
+ * @param pWriter Writer
+ * @param pData Data
+ * @param nSize Size of the data
+ */
+void vWriteOutput(outputWriterT* pWriter, const void* pData, size_t nSize) {
+    if (pWriter->nUsed + nSize > OUTPUT_BUFFER_SIZE) {
+        vFlushOutputWriter(pWriter);
+    }
+    if (nSize >= OUTPUT_BUFFER_SIZE) {
+        if (!pWriter->bFailed && fwrite(pData, 1, nSize, pWriter->fp) != nSize) {
+            pWriter->bFailed = true;
+        }
+        return;
+    }
+    memcpy(pWriter->pBuffer + pWriter->nUsed, pData, nSize);
+    pWriter->nUsed += nSize;
+}
+
+/**
+ * Flush an output writer and free its buffer
+ * @param pWriter Writer
+ * @return 0 if everything was written, -1 otherwise
+ */
+int nCloseOutputWriter(outputWriterT* pWriter) {
+    vFlushOutputWriter(pWriter);
+    free(pWriter->pBuffer);
+    pWriter->pBuffer = NULL;
+    if (pWriter->bFailed || fflush(pWriter->fp) != 0) {
+        fprintf(stderr, "Error: Failed to write the output\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parse the row selection of an export, "last", "all", "N..M" or "N.." for N up to the last row
+ * @param szRows Selection
+ * @param pExport Receives the rows
+ * @return true if the selection is valid
+ */
+bool bParseExportRows(const char* szRows, exportOptionsT* pExport) {
+    if (strcmp(szRows, "last") == 0) {
+        pExport->nRows = EXPORT_ROWS_LAST;
+        return true;
+    }
+    if (strcmp(szRows, "all") == 0) {
+        pExport->nRows = EXPORT_ROWS_ALL;
+        return true;
+    }
+
+    const char* szDots = strstr(szRows, "..");
+    long long llFirst = 0;
+    long long llLast = LLONG_MAX;
+    if (!szDots || !bParseCSVInteger(szRows, szDots - szRows, &llFirst) || llFirst < 0 ||
+        (szDots[2] != '\0' && (!bParseCSVInteger(szDots + 2, strlen(szDots + 2), &llLast) || llLast < llFirst))) {
+        return false;
+    }
+    pExport->nRows = EXPORT_ROWS_RANGE;
+    pExport->ullFirstRow = (unsigned long long)llFirst;
+    pExport->ullLastRow = (unsigned long long)llLast;
+    return true;
+}
+
+/**
+ * Split a comma-separated column list of an export
+ * @param szColumns Column names separated by commas
+ * @param pExport Receives the names
+ * @return true if there is at least one name and none is empty
+ */
+bool bParseExportColumns(const char* szColumns, exportOptionsT* pExport) {
+    pExport->vecColumns.clear();
+    const char* szName = szColumns;
+    while (true) {
+        const char* szComma = strchr(szName, ',');
+        size_t nLen = szComma ? (size_t)(szComma - szName) : strlen(szName);
+        if (nLen == 0) {
+            return false;
+        }
+        pExport->vecColumns.push_back(std::string(szName, nLen));
+        if (!szComma) {
+            return true;
+        }
+        szName = szComma + 1;
+    }
+}
+
+/**
+ * Append a text as a CSV field, quoted only when it has to be
+ * @param pstrOut Output
+ * @param pText Text
+ * @param nLen Length of the text
+ */
+void vAppendCSVText(std::string* pstrOut, const char* pText, size_t nLen) {
+    bool bQuote = nLen > 0 && (pText[0] == ' ' || pText[0] == '\t' || pText[nLen - 1] == ' ' || pText[nLen - 1] == '\t');
+    for (size_t i = 0; i < nLen && !bQuote; i++) {
+        bQuote = pText[i] == ',' || pText[i] == '"' || pText[i] == '\n' || pText[i] == '\r';
+    }
+    if (!bQuote) {
+        pstrOut->append(pText, nLen);
+        return;
+    }
+
+    pstrOut->push_back('"');
+    for (size_t i = 0; i < nLen; i++) {
+        if (pText[i] == '"') {
+            pstrOut->push_back('"');
+        }
+        pstrOut->push_back(pText[i]);
+    }
+    pstrOut->push_back('"');
+}
+
+/**
+ * Append a text as a JSON string
+ * @param pstrOut Output
+ * @param pText Text, bytes from 0x80 on are copied as they are
+ * @param nLen Length of the text
+ */
+void vAppendJSONText(std::string* pstrOut, const char* pText, size_t nLen) {
+    static const char szHex[] = "0123456789abcdef";
+    pstrOut->push_back('"');
+    for (size_t i = 0; i < nLen; i++) {
+        unsigned char c = (unsigned char)pText[i];
+        if (c == '"' || c == '\\') {
+            pstrOut->push_back('\\');
+            pstrOut->push_back((char)c);
+        }
+        else if (c < 0x20) {
+            char szEscape[7] = { '\\', 'u', '0', '0', szHex[c >> 4], szHex[c & 15], '\0' };
+            pstrOut->append(szEscape, 6);
+        }
+        else {
+            pstrOut->push_back((char)c);
+        }
+    }
+    pstrOut->push_back('"');
+}
+
+/**
+ * Append a real as text, the shortest way that reads back the same
+ * @param pstrOut Output
+ * @param dValue Value, NaN for none
+ * @param nFormat EXPORT_FORMAT_CSV or EXPORT_FORMAT_NDJSON
+ */
+void vAppendExportReal(std::string* pstrOut, double dValue, int nFormat) {
+    bool bJson = nFormat == EXPORT_FORMAT_NDJSON;
+    if (isnan(dValue) || (bJson && isinf(dValue))) {
+        pstrOut->append(bJson ? "null" : "");
+        return;
+    }
+
+    char szValue[32];
+    snprintf(szValue, sizeof(szValue), "%.15g", dValue);
+    if (strtod(szValue, NULL) != dValue) {
+        snprintf(szValue, sizeof(szValue), "%.17g", dValue);
+    }
+    pstrOut->append(szValue);
+}
+
+/**
+ * Append a value of a history column as text, the shortest way that reads back the same
+ * @param pstrOut Output
+ * @param pColumn Column, NULL if the report does not have it
+ * @param nRow Row
+ * @param nFormat EXPORT_FORMAT_CSV or EXPORT_FORMAT_NDJSON
+ */
+void vAppendExportValue(std::string* pstrOut, const bdcColumnT* pColumn, size_t nRow, int nFormat) {
+    bool bJson = nFormat == EXPORT_FORMAT_NDJSON;
+    char szValue[32];
+    if (!pColumn) {
+        if (bJson) {
+            pstrOut->append("null");
+        }
+        return;
+    }
+
+    if (pColumn->nType == BDC_COLUMN_TEXT) {
+        const std::string& strText = pColumn->vecTexts[nRow];
+        if (bJson) {
+            vAppendJSONText(pstrOut, strText.data(), strText.size());
+        }
+        else {
+            vAppendCSVText(pstrOut, strText.data(), strText.size());
+        }
+        return;
+    }
+
+    if (pColumn->nType == BDC_COLUMN_REAL) {
+        vAppendExportReal(pstrOut, pColumn->vecReals[nRow], nFormat);
+        return;
+    }
+
+    long long llValue = pColumn->vecIntegers[nRow];
+    if (llValue == BDC_MISSING_INTEGER) {
+        pstrOut->append(bJson ? "null" : "");
+        return;
+    }
+    if (pColumn->nType == BDC_COLUMN_TIMESTAMP) {
+        vFormatCSVTimeStamp(llValue, szValue, sizeof(szValue));
+        if (bJson) {
+            vAppendJSONText(pstrOut, szValue, strlen(szValue));
+            return;
+        }
+    }
+    else {
+        snprintf(szValue, sizeof(szValue), "%lld", llValue);
+    }
+    pstrOut->append(szValue);
+}
+
+/**
+ * Append the start of an export, the CSV header or the binary signature and column names
+ * Binary exports are EXPORT_MAGIC, the number of columns as u32 and every column name as u32 length and bytes,
+ * followed by one block per report.
+ * @param pExport Export
+ * @param pstrOut Output
+ */
+void vAppendExportHeader(const exportOptionsT* pExport, std::string* pstrOut) {
+    if (pExport->bStats || pExport->bTrend) {
+        if (pExport->nFormat == EXPORT_FORMAT_CSV) {
+            pstrOut->append(pExport->bStats ? "Report,Column,Count,Min,Max,Mean,StdDev,P50,P90,P99\n" :
+                "Report,Column,Count,From,To,PerDay,Start,End,R2,RecentPerDay\n");
+        }
+    }
+    else if (pExport->nFormat == EXPORT_FORMAT_CSV) {
+        pstrOut->append("Report");
+        for (size_t i = 0; i < pExport->vecColumns.size(); i++) {
+            pstrOut->push_back(',');
+            vAppendCSVText(pstrOut, pExport->vecColumns[i].data(), pExport->vecColumns[i].size());
+        }
+        pstrOut->push_back('\n');
+    }
+    else if (pExport->nFormat == EXPORT_FORMAT_BINARY) {
+        pstrOut->append(EXPORT_MAGIC, 8);
+        unsigned int uColumns = (unsigned int)pExport->vecColumns.size();
+        pstrOut->append((const char*)&uColumns, sizeof(uColumns));
+        for (size_t i = 0; i < pExport->vecColumns.size(); i++) {
+            unsigned int uLen = (unsigned int)pExport->vecColumns[i].size();
+            pstrOut->append((const char*)&uLen, sizeof(uLen));
+            pstrOut->append(pExport->vecColumns[i]);
+        }
+    }
+}
+
+/**
+ * Escape a report path for the start of every CSV line or NDJSON object of an export
+ * @param szReport Report path
+ * @param nFormat EXPORT_FORMAT_CSV or EXPORT_FORMAT_NDJSON
+ * @param pstrReport Receives the CSV field or the opening of the object with its "Report" member
+ */
+void vEscapeExportReport(const char* szReport, int nFormat, std::string* pstrReport) {
+    if (nFormat == EXPORT_FORMAT_CSV) {
+        vAppendCSVText(pstrReport, szReport, strlen(szReport));
+    }
+    else {
+        pstrReport->append("{\"Report\":");
+        vAppendJSONText(pstrReport, szReport, strlen(szReport));
+    }
+}
+
+/**
+ * Append the statistics of the selected columns of a report's history over the selected rows, one line per column
+ * @param strReport Report path, escaped for the format
+ * @param vecColumns Columns in output order, NULL for those the report does not have
+ * @param nFirst First row
+ * @param nEnd Row after the last one
+ * @param pExport Export, CSV or NDJSON
+ * @param pstrOut Output
+ */
+void vAppendExportStats(const std::string& strReport, const std::vector<const bdcColumnT*>& vecColumns,
+    size_t nFirst, size_t nEnd, const exportOptionsT* pExport, std::string* pstrOut) {
+    static const char* const aszNames[] = { "Min", "Max", "Mean", "StdDev", "P50", "P90", "P99" };
+    bool bJson = pExport->nFormat == EXPORT_FORMAT_NDJSON;
+    char szCount[32];
+    for (size_t i = 0; i < vecColumns.size(); i++) {
+        bdcStatsT stStats = { 0, NAN, NAN, NAN, NAN, NAN, NAN, NAN };
+        if (vecColumns[i]) {
+            vAggregateBdcColumn(vecColumns[i], nFirst, nEnd, &stStats);
+        }
+        const double adValues[7] = { stStats.dMin, stStats.dMax, stStats.dMean, stStats.dStdDev,
+            stStats.dP50, stStats.dP90, stStats.dP99 };
+
+        pstrOut->append(strReport);
+        pstrOut->append(bJson ? ",\"Column\":" : ",");
+        if (bJson) {
+            vAppendJSONText(pstrOut, pExport->vecColumns[i].data(), pExport->vecColumns[i].size());
+        }
+        else {
+            vAppendCSVText(pstrOut, pExport->vecColumns[i].data(), pExport->vecColumns[i].size());
+        }
+        snprintf(szCount, sizeof(szCount), "%llu", stStats.ullCount);
+        pstrOut->append(bJson ? ",\"Count\":" : ",");
+        pstrOut->append(szCount);
+        for (int j = 0; j < 7; j++) {
+            pstrOut->push_back(',');
+            if (bJson) {
+                pstrOut->push_back('"');
+                pstrOut->append(aszNames[j]);
+                pstrOut->append("\":");
+            }
+            vAppendExportReal(pstrOut, adValues[j], pExport->nFormat);
+        }
+        pstrOut->append(bJson ? "}\n" : "\n");
+    }
+}
+
+/**
+ * Append the selected rows and columns of a report's history
+ * Binary blocks are the report path as u32 length and bytes, the type of every column as one byte
+ * (a BDC_COLUMN_ constant, integer for a column the report does not have), the number of rows as u64 and the rows.
+ * Integers and timestamps are i64 with INT64_MIN for no value, reals f64 with NaN for no value, texts u32 length
+ * and bytes, all little-endian.
+ * Statistics are written as one line per column with vAppendExportStats instead.
+ * @param szReport Report path, as written in the output
+ * @param pTable History of the report
+ * @param pExport Export
+ * @param pstrOut Output
+ */
+void vAppendExportRows(const char* szReport, const bdcTableT* pTable, const exportOptionsT* pExport,
+    std::string* pstrOut) {
+    // Columns are looked up by name once per report
+    std::vector<const bdcColumnT*> vecColumns(pExport->vecColumns.size(), (const bdcColumnT*)NULL);
+    for (size_t i = 0; i < vecColumns.size(); i++) {
+        for (size_t j = 0; j < pTable->vecColumns.size() && !vecColumns[i]; j++) {
+            if (pTable->vecColumns[j].strName == pExport->vecColumns[i]) {
+                vecColumns[i] = &pTable->vecColumns[j];
+            }
+        }
+    }
+
+    size_t nFirst = 0;
+    size_t nEnd = pTable->nRows;
+    if (pExport->nRows == EXPORT_ROWS_LAST) {
+        nFirst = nEnd > 0 ? nEnd - 1 : 0;
+    }
+    else if (pExport->nRows == EXPORT_ROWS_RANGE) {
+        nFirst = pExport->ullFirstRow < nEnd ? (size_t)pExport->ullFirstRow : nEnd;
+        nEnd = pExport->ullLastRow < nEnd ? (size_t)pExport->ullLastRow + 1 : nEnd;
+    }
+
+    size_t nReportLen = strlen(szReport);
+    if (pExport->nFormat == EXPORT_FORMAT_BINARY) {
+        unsigned int uLen = (unsigned int)nReportLen;
+        pstrOut->append((const char*)&uLen, sizeof(uLen));
+        pstrOut->append(szReport, nReportLen);
+        for (size_t i = 0; i < vecColumns.size(); i++) {
+            pstrOut->push_back((char)(vecColumns[i] ? vecColumns[i]->nType : BDC_COLUMN_INTEGER));
+        }
+        unsigned long long ullRows = nEnd - nFirst;
+        pstrOut->append((const char*)&ullRows, sizeof(ullRows));
+
+        for (size_t nRow = nFirst; nRow < nEnd; nRow++) {
+            for (size_t i = 0; i < vecColumns.size(); i++) {
+                const bdcColumnT* pColumn = vecColumns[i];
+                if (!pColumn) {
+                    long long llMissing = BDC_MISSING_INTEGER;
+                    pstrOut->append((const char*)&llMissing, sizeof(llMissing));
+                }
+                else if (pColumn->nType == BDC_COLUMN_TEXT) {
+                    unsigned int uTextLen = (unsigned int)pColumn->vecTexts[nRow].size();
+                    pstrOut->append((const char*)&uTextLen, sizeof(uTextLen));
+                    pstrOut->append(pColumn->vecTexts[nRow]);
+                }
+                else if (pColumn->nType == BDC_COLUMN_REAL) {
+                    pstrOut->append((const char*)&pColumn->vecReals[nRow], sizeof(double));
+                }
+                else {
+                    pstrOut->append((const char*)&pColumn->vecIntegers[nRow], sizeof(long long));
+                }
+            }
+        }
+        return;
+    }
+
+    // The report path is the same for every row and escaped once
+    std::string strReport;
+    vEscapeExportReport(szReport, pExport->nFormat, &strReport);
+    if (pExport->bStats) {
+        vAppendExportStats(strReport, vecColumns, nFirst, nEnd, pExport, pstrOut);
+        return;
+    }
+    for (size_t nRow = nFirst; nRow < nEnd; nRow++) {
+        pstrOut->append(strReport);
+        for (size_t i = 0; i < vecColumns.size(); i++) {
+            if (pExport->nFormat == EXPORT_FORMAT_NDJSON) {
+                pstrOut->push_back(',');
+                vAppendJSONText(pstrOut, pExport->vecColumns[i].data(), pExport->vecColumns[i].size());
+                pstrOut->push_back(':');
+            }
+            else {
+                pstrOut->push_back(',');
+            }
+            vAppendExportValue(pstrOut, vecColumns[i], nRow, pExport->nFormat);
+        }
+        pstrOut->append(pExport->nFormat == EXPORT_FORMAT_NDJSON ? "}\n" : "\n");
+    }
+}
+
+/**
+ * Append the trends of the selected columns of a report, one line per column
+ * From and To are the times of the earliest and latest value, Start and End the fitted line at those times.
+ * @param szReport Report path, as written in the output
+ * @param pTrend Trends of the report
+ * @param pExport Export, CSV or NDJSON
+ * @param pstrOut Output
+ */
+void vAppendExportTrend(const char* szReport, const bdcTrendSetT* pTrend, const exportOptionsT* pExport,
+    std::string* pstrOut) {
+    static const char* const aszNames[] = { "PerDay", "Start", "End", "R2", "RecentPerDay" };
+    bool bJson = pExport->nFormat == EXPORT_FORMAT_NDJSON;
+    std::string strReport;
+    vEscapeExportReport(szReport, pExport->nFormat, &strReport);
+
+    char szValue[32];
+    for (size_t i = 0; i < pTrend->vecTrends.size(); i++) {
+        const bdcTrendT* pColumnTrend = &pTrend->vecTrends[i];
+        bdcTrendLineT stLine;
+        vGetBdcTrendLine(pColumnTrend, &stLine);
+        const double adValues[5] = { stLine.dPerDay, stLine.dStart, stLine.dEnd, stLine.dR2, stLine.dRecentPerDay };
+
+        pstrOut->append(strReport);
+        pstrOut->append(bJson ? ",\"Column\":" : ",");
+        if (bJson) {
+            vAppendJSONText(pstrOut, pTrend->vecColumns[i].data(), pTrend->vecColumns[i].size());
+        }
+        else {
+            vAppendCSVText(pstrOut, pTrend->vecColumns[i].data(), pTrend->vecColumns[i].size());
+        }
+        snprintf(szValue, sizeof(szValue), "%llu", pColumnTrend->ullCount);
+        pstrOut->append(bJson ? ",\"Count\":" : ",");
+        pstrOut->append(szValue);
+
+        const long long allTimes[2] = { pColumnTrend->llFirst, pColumnTrend->llLast };
+        for (int j = 0; j < 2; j++) {
+            pstrOut->append(bJson ? (j == 0 ? ",\"From\":" : ",\"To\":") : ",");
+            if (pColumnTrend->ullCount == 0) {
+                pstrOut->append(bJson ? "null" : "");
+                continue;
+            }
+            vFormatCSVTimeStamp(allTimes[j], szValue, sizeof(szValue));
+            pstrOut->append(bJson ? "\"" : "");
+            pstrOut->append(szValue);
+            pstrOut->append(bJson ? "\"" : "");
+        }
+        for (int j = 0; j < 5; j++) {
+            pstrOut->push_back(',');
+            if (bJson) {
+                pstrOut->push_back('"');
+                pstrOut->append(aszNames[j]);
+                pstrOut->append("\":");
+            }
+            vAppendExportReal(pstrOut, adValues[j], pExport->nFormat);
+        }
+        pstrOut->append(bJson ? "}\n" : "\n");
+    }
+}
+
+/**
+ * Load a report and append its export, rows, statistics or trends
+ * @param pSource Report to load
+ * @param szReport Report path, as written in the output
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options
+ * @param pExport Export
+ * @param pstrOut Output, nothing is appended on error
+ * @return 0 on success, non-zero on error
+ */
+int nAppendExportReport(const reportSourceT* pSource, const char* szReport, const char* szTargetDir,
+    const extractOptionsT* pOptions, const exportOptionsT* pExport, std::string* pstrOut) {
+    if (pExport->bTrend) {
+        // Trends are fitted while the files stream past, the history is never held
+        bdcTrendSetT stTrend;
+        stTrend.vecColumns = pExport->vecColumns;
+        int nResult = nTrackBdcTrend(pSource, szTargetDir, pOptions, &stTrend);
+        if (nResult == 0) {
+            vAppendExportTrend(szReport, &stTrend, pExport, pstrOut);
+        }
+        return nResult;
+    }
+
+    bdcTableT stTable;
+    int nResult = nLoadBdcHistory(pSource, szTargetDir, pOptions, &stTable);
+    if (nResult == 0) {
+        vDeriveBdcColumns(&stTable, pExport->vecColumns);
+        vAppendExportRows(szReport, &stTable, pExport, pstrOut);
+    }
+    return nResult;
+}
+
+/**
+ * Export the selected rows and columns of one report to stdout
+ * @param szTargzPath Path to the report, - for stdin
+ * @param szTargetDir Target directory in archive
+ * @param pOptions Extraction options
+ * @param pExport Export
  * @return 0 on success, non-zero on error
  */
-int nExtractFromTargzWithCallback(
-    const char* szTargzPath,
-    const char* szTargetDir,
-    pfnFileMatcherCallback pfnMatcher,
-    void* pUserData
-) {
-    gzFile gzTarFile;
-    tarHeaderT stHeader;
-    char szBuffer[CHUNK];
-    unsigned long ulFileSize;
-    int nRet = 0;
+int nExportBdcRows(
+    const char* szTargzPath,
+    const char* szTargetDir,
+    const extractOptionsT* pOptions,
+    const exportOptionsT* pExport
+) {
+    bool bStdin = strcmp(szTargzPath, "-") == 0;
+    extractOptionsT stOptions = *pOptions;
+    reportSourceT stSource = { szTargzPath, NULL, 0, NULL };
+    if (bStdin) {
+        _setmode(_fileno(stdin), _O_BINARY);
+        stSource.szPath = NULL;
+        stSource.fp = stdin;
+        stOptions.bUseIndex = 0;
+    }
+
+    std::string strOut;
+    vAppendExportHeader(pExport, &strOut);
+    int nResult = nAppendExportReport(&stSource, bStdin ? "-" : szTargzPath, szTargetDir, &stOptions, pExport,
+        &strOut);
+    if (nResult != 0) {
+        return nResult;
+    }
+
+    outputWriterT stWriter;
+    if (nOpenOutputWriter(&stWriter, stdout) != 0) {
+        return -1;
+    }
+    vWriteOutput(&stWriter, strOut.data(), strOut.size());
+    return nCloseOutputWriter(&stWriter);
+}
+
+/**
+ * One report of a batch and its result
+ */
+typedef struct {
+    std::string strPath;      // Archive or extracted folder
+    batteryInfoT stInfo;      // Battery information found
+    std::string strExport;    // Exported rows, written out in input order
+    int nResult;              // 0 on success, non-zero on error
+    char szError[BATTERYCYCLE_VALUE_SIZE]; // First error message on failure, without "Error: "
+    bool bDone;               // The analysis finished, guarded by mtxOutput of the batch
+} batchJobT;
+
+/**
+ * Job queue of one batch worker, the owner takes jobs at the front and idle workers steal at the back
+ */
+typedef struct {
+    std::mutex mtxQueue;
+    std::deque<int> dqJobs;   // Job numbers
+} batchQueueT;
+
+/**
+ * Batch run shared by its workers
+ */
+typedef struct {
+    std::vector<batchJobT> vecJobs;
+    batchQueueT* pQueues;     // One queue per worker
+    int nWorkers;             // Number of workers
+    const extractOptionsT* pOptions; // Options for every report, nThreads is replaced by 1
+    bool bQuiet;              // Do not print results, for benchmarks
+    const exportOptionsT* pExport; // Rows to export instead of the results, NULL to print the results
+    outputWriterT stWriter;   // Output of an export, guarded by mtxOutput
+    std::mutex mtxOutput;
+    size_t nNextOutput;       // Next job to print, finished jobs wait here until it is their turn
+    int nFailed;              // Reports that could not be analyzed
+} batchRunT;
+
+/**
+ * Add the reports named by a batch argument
+ * A path that cannot be read is added as it is, so it fails as a report of its own.
+ * @param szArg An archive, an extracted report or a directory of archives and extracted reports
+ * @param pvecPaths Receives the report paths
+ */
+void vCollectBatchPaths(const char* szArg, std::vector<std::string>* pvecPaths) {
+    // Only a folder with the logs right inside is a report, a wrapping folder expands to the one within
+    DWORD dwAttributes = GetFileAttributesA(szArg);
+    char szLogs[MAX_PATH_LENGTH * 2];
+    snprintf(szLogs, sizeof(szLogs), "%s/logs/BatteryBDC", szArg);
+    DWORD dwLogs = GetFileAttributesA(szLogs);
+    if (dwAttributes == INVALID_FILE_ATTRIBUTES || !(dwAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+        (dwLogs != INVALID_FILE_ATTRIBUTES && (dwLogs & FILE_ATTRIBUTE_DIRECTORY))) {
+        pvecPaths->push_back(szArg);
+        return;
+    }
+
+    char szPattern[MAX_PATH_LENGTH * 2];
+    snprintf(szPattern, sizeof(szPattern), "%s/*", szArg);
+    WIN32_FIND_DATAA stFind;
+    HANDLE hFind = FindFirstFileA(szPattern, &stFind);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        pvecPaths->push_back(szArg);
+        return;
+    }
+
+    // Every entry is a report, except the index and cache files kept next to archives
+    std::vector<std::string> vecEntries;
+    do {
+        size_t nLen = strlen(stFind.cFileName);
+        if (strcmp(stFind.cFileName, ".") == 0 || strcmp(stFind.cFileName, "..") == 0 ||
+            (nLen > 6 && (_stricmp(stFind.cFileName + nLen - 6, INDEX_EXTENSION) == 0 ||
+                _stricmp(stFind.cFileName + nLen - 6, RESULT_CACHE_EXTENSION) == 0))) {
+            continue;
+        }
+        vecEntries.push_back(std::string(szArg) + "/" + stFind.cFileName);
+    } while (FindNextFileA(hFind, &stFind));
+    FindClose(hFind);
+
+    // Directory order depends on the file system, sorted names keep the output stable
+    std::sort(vecEntries.begin(), vecEntries.end());
+    pvecPaths->insert(pvecPaths->end(), vecEntries.begin(), vecEntries.end());
+}
+
+/**
+ * Add the reports listed in a file, one path per line, empty lines and lines starting with # are ignored
+ * @param szListPath Path to the list file
+ * @param pvecPaths Receives the report paths
+ * @return 0 on success, -1 if the list cannot be read
+ */
+int nReadBatchList(const char* szListPath, std::vector<std::string>* pvecPaths) {
+    FILE* fp = fopen(szListPath, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open %s\n", szListPath);
+        return -1;
+    }
+
+    char szLine[MAX_PATH_LENGTH * 2];
+    while (fgets(szLine, sizeof(szLine), fp)) {
+        size_t nLen = strcspn(szLine, "\r\n");
+        szLine[nLen] = '\0';
+        if (nLen > 0 && szLine[0] != '#') {
+            pvecPaths->push_back(szLine);
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * Print the result of a batch job as one line
+ * @param pJob Finished job
+ */
+void vPrintBatchResult(const batchJobT* pJob) {
+    if (pJob->nResult == 0) {
+        printf("%s: Battery Cycle Count: %s, Last Charging Date: %s\n", pJob->strPath.c_str(),
+            pJob->stInfo.szCycleCount, pJob->stInfo.szTimeStamp);
+    }
+    else {
+        printf("%s: Error: %s\n", pJob->strPath.c_str(),
+            pJob->szError[0] ? pJob->szError : "Failed to analyze report");
+    }
+}
+
+/**
+ * Log callback of a batch job, prefixes every message with the report it belongs to
+ * @param szMessage Message without trailing newline
+ * @param pUserData The batch job
+ */
+void vPrintBatchMessage(const char* szMessage, void* pUserData) {
+    fprintf(stderr, "%s: %s\n", ((const batchJobT*)pUserData)->strPath.c_str(), szMessage);
+}
+
+/**
+ * Take the next job of a batch worker, stealing from the other workers once its own queue is empty
+ * @param pRun Batch run
+ * @param nWorker Worker number
+ * @return Job number, -1 when no work is left
+ */
+int nTakeBatchJob(batchRunT* pRun, int nWorker) {
+    for (int i = 0; i < pRun->nWorkers; i++) {
+        batchQueueT* pQueue = &pRun->pQueues[(nWorker + i) % pRun->nWorkers];
+        std::lock_guard<std::mutex> lock(pQueue->mtxQueue);
+        if (!pQueue->dqJobs.empty()) {
+            int nJob;
+            if (i == 0) {
+                nJob = pQueue->dqJobs.front();
+                pQueue->dqJobs.pop_front();
+            }
+            else {
+                nJob = pQueue->dqJobs.back();
+                pQueue->dqJobs.pop_back();
+            }
+            return nJob;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Record a finished batch job and print every result whose predecessors are all printed
+ * @param pRun Batch run
+ * @param nJob Job number
+ */
+void vFinishBatchJob(batchRunT* pRun, int nJob) {
+    std::lock_guard<std::mutex> lock(pRun->mtxOutput);
+    pRun->vecJobs[nJob].bDone = true;
+    if (pRun->vecJobs[nJob].nResult != 0) {
+        pRun->nFailed++;
+    }
+
+    while (pRun->nNextOutput < pRun->vecJobs.size() && pRun->vecJobs[pRun->nNextOutput].bDone) {
+        batchJobT* pJob = &pRun->vecJobs[pRun->nNextOutput];
+        if (pRun->pExport) {
+            // Exported rows go out in one piece per report, failures only to stderr, where their errors already are
+            if (pJob->nResult != 0 && !pJob->szError[0]) {
+                fprintf(stderr, "%s: Error: Failed to analyze report\n", pJob->strPath.c_str());
+            }
+            vWriteOutput(&pRun->stWriter, pJob->strExport.data(), pJob->strExport.size());
+            std::string().swap(pJob->strExport);
+        }
+        else if (!pRun->bQuiet) {
+            vPrintBatchResult(pJob);
+        }
+        pRun->nNextOutput++;
+    }
+}
+
+/**
+ * Worker thread of a batch run, keeps its reader buffers across reports
+ * @param pRun Batch run
+ * @param nWorker Worker number
+ */
+void vBatchWorker(batchRunT* pRun, int nWorker) {
+    workerBuffersT stBuffers;
+    bool bBuffers = bAllocWorkerBuffers(&stBuffers);
+
+    // The pool already keeps every core busy, each report is read on its worker alone
+    extractOptionsT stOptions = *pRun->pOptions;
+    stOptions.nThreads = 1;
+    stOptions.pStats = NULL;
+    stOptions.pBuffers = bBuffers ? &stBuffers : NULL;
+
+    int nJob;
+    while ((nJob = nTakeBatchJob(pRun, nWorker)) >= 0) {
+        batchJobT* pJob = &pRun->vecJobs[nJob];
+        reportSourceT stSource = { pJob->strPath.c_str(), NULL, 0, NULL };
+
+        // Workers interleave their messages, each one names its report
+        logSinkT stSink;
+        stSink.pfnLog = vPrintBatchMessage;
+        stSink.pUserData = pJob;
+        stSink.szFirstError = pJob->szError;
+        g_pLogSink = &stSink;
+        if (pRun->pExport) {
+            // The rows are formatted on the worker, only writing them out is serialized
+            pJob->nResult = nAppendExportReport(&stSource, pJob->strPath.c_str(), "logs/BatteryBDC/", &stOptions,
+                pRun->pExport, &pJob->strExport);
+        }
+        else {
+            pJob->nResult = nAnalyzeReport(&stSource, "logs/BatteryBDC/", &stOptions, &pJob->stInfo,
+                NULL, NULL);
+        }
+        g_pLogSink = NULL;
+        vFinishBatchJob(pRun, nJob);
+    }
+
+    vFreeWorkerBuffers(&stBuffers);
+}
+
+/**
+ * Analyze many reports on a pool of workers, printing one line per report in input order
+ * @param vecPaths Reports to analyze
+ * @param pOptions Extraction options for every report
+ * @param nWorkers Number of workers
+ * @param bQuiet Do not print results
+ * @param pExport Rows to export to stdout instead of the results, in input order, NULL to print the results
+ * @return 0 if every report was analyzed, 1 if some failed
+ */
+int nRunBatch(const std::vector<std::string>& vecPaths, const extractOptionsT* pOptions, int nWorkers, bool bQuiet,
+    const exportOptionsT* pExport) {
+    batchRunT* pRun = new batchRunT();
+    pRun->pExport = pExport;
+    if (pExport) {
+        if (nOpenOutputWriter(&pRun->stWriter, stdout) != 0) {
+            delete pRun;
+            return 1;
+        }
+        std::string strHeader;
+        vAppendExportHeader(pExport, &strHeader);
+        vWriteOutput(&pRun->stWriter, strHeader.data(), strHeader.size());
+    }
+    pRun->nWorkers = nWorkers < (int)vecPaths.size() ? nWorkers : (int)vecPaths.size();
+    if (pRun->nWorkers < 1) {
+        pRun->nWorkers = 1;
+    }
+    pRun->pQueues = new batchQueueT[pRun->nWorkers];
+    pRun->pOptions = pOptions;
+    pRun->bQuiet = bQuiet;
 
-    // Open tar.gz file
-    gzTarFile = gzopen(szTargzPath, "rb");
-    if (!gzTarFile) {
-        fprintf(stderr, "Error: Cannot open %s\n", szTargzPath);
-        return -1;
+    // Jobs are dealt out round robin, so the workers move through the list together
+    pRun->vecJobs.resize(vecPaths.size());
+    for (size_t i = 0; i < vecPaths.size(); i++) {
+        pRun->vecJobs[i].strPath = vecPaths[i];
+        pRun->pQueues[i % pRun->nWorkers].dqJobs.push_back((int)i);
     }
 
-    // Main extraction loop
-    while (1) {
-        // Read the tar header
-        if (gzread(gzTarFile, &stHeader, TAR_BLOCK_SIZE) != TAR_BLOCK_SIZE) {
-            if (gzeof(gzTarFile)) {
-                // End of archive
+    std::vector<std::thread> vecWorkers;
+    for (int i = 0; i < pRun->nWorkers; i++) {
+        vecWorkers.push_back(std::thread(vBatchWorker, pRun, i));
+    }
+    for (size_t i = 0; i < vecWorkers.size(); i++) {
+        vecWorkers[i].join();
+    }
+
+    int nFailed = pRun->nFailed;
+    if (pExport && nCloseOutputWriter(&pRun->stWriter) != 0) {
+        nFailed++;
+    }
+    delete[] pRun->pQueues;
+    delete pRun;
+    return nFailed > 0 ? 1 : 0;
+}
+
+/**
+ * Benchmark batch throughput with 1, 2, 4, ... workers up to the thread count
+ * @param vecPaths Reports to analyze
+ * @param pOptions Extraction options, nThreads caps the worker count, the result cache is not used
+ * @return 0 on success
+ */
+int nRunBatchBenchmark(const std::vector<std::string>& vecPaths, const extractOptionsT* pOptions) {
+    int nMaxWorkers = nResolveThreadCount(pOptions);
+    extractOptionsT stOptions = *pOptions;
+    stOptions.szCacheDir = NULL;
+
+    printf("Benchmarking batch analysis of %d reports (best of %d runs)\n\n", (int)vecPaths.size(), BENCHMARK_RUNS);
+    printf("%8s %12s %12s %9s\n", "Workers", "Time (ms)", "Reports/s", "Speedup");
+
+    double dBaseMs = 0;
+    int nWorkers = 1;
+    while (true) {
+        double dBestMs = 0;
+        for (int nRun = 0; nRun < BENCHMARK_RUNS; nRun++) {
+            std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+            nRunBatch(vecPaths, &stOptions, nWorkers, true, NULL);
+            double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+            if (nRun == 0 || dMs < dBestMs) {
+                dBestMs = dMs;
+            }
+        }
+
+        if (nWorkers == 1) {
+            dBaseMs = dBestMs;
+        }
+        printf("%8d %12.1f %12.1f %8.2fx\n", nWorkers, dBestMs, vecPaths.size() / (dBestMs / 1000.0), dBaseMs / dBestMs);
+
+        if (nWorkers >= nMaxWorkers) {
+            break;
+        }
+        nWorkers = nWorkers * 2 < nMaxWorkers ? nWorkers * 2 : nMaxWorkers;
+    }
+
+    return 0;
+}
+
+#ifdef BATTERYCYCLE_WITH_SERVER
+/**
+ * One archive of a server request and its result
+ */
+typedef struct {
+    std::string strPath;      // Archive path, empty if the archive was sent inline or as a handle
+    std::vector<unsigned char> vecData; // Archive sent inline
+    HANDLE hFile;             // Archive handle passed by the client, NULL otherwise, the worker closes it
+    batteryCycleResultT stResult;
+    int nResult;
+    std::chrono::steady_clock::time_point tQueued; // When the request was received
+    double dQueueMs;          // Time spent waiting for a worker
+    bool bDone;               // Result is ready, guarded by the connection's mtxDone
+    struct serverConnectionT* pConnection; // Connection waiting for the result
+} serverJobT;
+
+/**
+ * Client connection of the server, served by its own thread
+ */
+typedef struct serverConnectionT {
+    SOCKET hSocket;           // Client socket, closed once the thread is joined
+    HANDLE hPeerProcess;      // Client process that passed handles are duplicated from, NULL until needed
+    std::thread thConnection;
+    std::atomic<bool> bFinished; // The connection thread is done and can be joined
+    std::mutex mtxDone;
+    std::condition_variable cvDone;
+    struct serverT* pServer;
+} serverConnectionT;
+
+/**
+ * Server state, the warm workers take archives from one shared queue
+ */
+typedef struct serverT {
+    SOCKET hListen;
+    std::mutex mtxJobs;
+    std::condition_variable cvJobs;
+    std::deque<serverJobT*> dqJobs;
+    std::atomic<bool> bStopping;
+    const extractOptionsT* pOptions;
+    unsigned long long ullMaxRequest; // Largest request accepted, the memory budget
+} serverT;
+
+/**
+ * Receive exactly nSize bytes from a socket
+ * @param hSocket Socket
+ * @param pBuffer Destination buffer
+ * @param nSize Number of bytes
+ * @return 1 on success, 0 if the connection was closed or failed
+ */
+int bReceiveAll(SOCKET hSocket, void* pBuffer, size_t nSize) {
+    char* pData = (char*)pBuffer;
+    while (nSize > 0) {
+        int nChunk = nSize > 0x40000000 ? 0x40000000 : (int)nSize;
+        int nReceived = recv(hSocket, pData, nChunk, 0);
+        if (nReceived <= 0) {
+            return 0;
+        }
+        pData += nReceived;
+        nSize -= nReceived;
+    }
+    return 1;
+}
+
+/**
+ * Send one response frame, a 4 byte little endian length and the payload
+ * @param hSocket Socket
+ * @param strPayload Payload, may be empty
+ * @return 1 on success, 0 if the connection failed
+ */
+int bSendFrame(SOCKET hSocket, const std::string& strPayload) {
+    unsigned int uLen = (unsigned int)strPayload.size();
+    std::string strFrame(4, '\0');
+    for (int i = 0; i < 4; i++) {
+        strFrame[i] = (char)((uLen >> (8 * i)) & 0xff);
+    }
+    strFrame += strPayload;
+
+    const char* pData = strFrame.data();
+    size_t nLeft = strFrame.size();
+    while (nLeft > 0) {
+        int nSent = send(hSocket, pData, (int)nLeft, 0);
+        if (nSent <= 0) {
+            return 0;
+        }
+        pData += nSent;
+        nLeft -= nSent;
+    }
+    return 1;
+}
+
+/**
+ * Format the response of one archive as tab separated key=value pairs
+ * @param pJob Finished job
+ * @return Response payload
+ */
+std::string strFormatServerResult(const serverJobT* pJob) {
+    const batteryCycleResultT* pResult = &pJob->stResult;
+    char szLine[BATTERYCYCLE_VALUE_SIZE * 3 + MAX_PATH_LENGTH * 2];
+    const char* szPath = pJob->strPath.empty() ? "-" : pJob->strPath.c_str();
+    int nLen;
+    if (pJob->nResult == 0) {
+        nLen = snprintf(szLine, sizeof(szLine), "status=ok\tpath=%s\tcycle_count=%s\ttimestamp=%s\tlog=%s\tcached=%d\t",
+            szPath, pResult->szCycleCount, pResult->szTimeStamp, pResult->szMemberName, pResult->bFromCache);
+    }
+    else {
+        nLen = snprintf(szLine, sizeof(szLine), "status=error\tpath=%s\terror=%s\t",
+            szPath, pResult->szError[0] ? pResult->szError : "Failed to analyze report");
+    }
+    if (nLen < 0 || (size_t)nLen >= sizeof(szLine)) {
+        nLen = (int)strlen(szLine);
+    }
+    snprintf(szLine + nLen, sizeof(szLine) - nLen,
+        "scanned=%llu\tqueue_ms=%.3f\tlookup_ms=%.3f\tscan_ms=%.3f\tparse_ms=%.3f\ttotal_ms=%.3f",
+        pResult->ullScanned, pJob->dQueueMs, pResult->dLookupMs, pResult->dScanMs, pResult->dParseMs,
+        pResult->dTotalMs);
+    return szLine;
+}
+
+/**
+ * Server worker, keeps its buffers and inflate state warm across all archives it analyzes
+ * @param pServer Server
+ */
+void vServerWorker(serverT* pServer) {
+    workerBuffersT stBuffers;
+    bool bBuffers = bAllocWorkerBuffers(&stBuffers);
+
+    // Like a batch, each archive is decoded on its worker alone
+    extractOptionsT stOptions = *pServer->pOptions;
+    stOptions.nThreads = 1;
+    stOptions.pBuffers = bBuffers ? &stBuffers : NULL;
+
+    while (true) {
+        serverJobT* pJob;
+        {
+            std::unique_lock<std::mutex> lock(pServer->mtxJobs);
+            pServer->cvJobs.wait(lock, [pServer] { return pServer->bStopping || !pServer->dqJobs.empty(); });
+            if (pServer->dqJobs.empty()) {
                 break;
             }
-            fprintf(stderr, "Error: Unexpected end of archive\n");
-            nRet = -1;
+            pJob = pServer->dqJobs.front();
+            pServer->dqJobs.pop_front();
+        }
+
+        pJob->dQueueMs = dElapsedMs(pJob->tQueued);
+        reportSourceT stSource = { NULL, NULL, 0, NULL };
+        HANDLE hMapping = NULL;
+        if (pJob->hFile) {
+            // A passed file is mapped like one opened by path, anything else, e.g. a pipe, is read as a stream
+            stSource.pData = pMapFileHandle(pJob->hFile, &stSource.nSize, &hMapping);
+            if (!stSource.pData) {
+                int nFd = _open_osfhandle((intptr_t)pJob->hFile, _O_RDONLY | _O_BINARY);
+                stSource.fp = nFd >= 0 ? _fdopen(nFd, "rb") : NULL;
+                if (!stSource.fp) {
+                    if (nFd >= 0) {
+                        _close(nFd);
+                    }
+                    else {
+                        CloseHandle(pJob->hFile);
+                    }
+                }
+            }
+        }
+        else if (pJob->strPath.empty()) {
+            stSource.pData = pJob->vecData.data();
+            stSource.nSize = pJob->vecData.size();
+        }
+        else {
+            stSource.szPath = pJob->strPath.c_str();
+        }
+
+        if (pJob->hFile && !stSource.pData && !stSource.fp) {
+            memset(&pJob->stResult, 0, sizeof(batteryCycleResultT));
+            strncpy_s(pJob->stResult.szError, BATTERYCYCLE_VALUE_SIZE, "Cannot read the passed handle", _TRUNCATE);
+            pJob->nResult = -1;
+        }
+        else {
+            pJob->nResult = nAnalyzeIntoResult(&stSource, "logs/BatteryBDC/", &stOptions, NULL, NULL, &pJob->stResult);
+        }
+
+        // Neither the inline archive nor the passed handle is needed for the response
+        std::vector<unsigned char>().swap(pJob->vecData);
+        if (hMapping) {
+            vUnmapFile((unsigned char*)stSource.pData, pJob->hFile, hMapping);
+        }
+        else if (stSource.fp) {
+            fclose(stSource.fp);
+        }
+        pJob->hFile = NULL;
+
+        serverConnectionT* pConnection = pJob->pConnection;
+        std::lock_guard<std::mutex> lock(pConnection->mtxDone);
+        pJob->bDone = true;
+        pConnection->cvDone.notify_one();
+    }
+
+    vFreeWorkerBuffers(&stBuffers);
+}
+
+/**
+ * Take over a handle the client opened, the counterpart of passing a descriptor over a Unix socket
+ * The client process is the peer of the socket, so clients can only pass handles of their own.
+ * @param pConnection Connection the handle was sent on
+ * @param szHandle Handle value in the client process, decimal or 0x hexadecimal
+ * @param phFile Receives the duplicated handle, owned by the server
+ * @return 0 on success, -1 on error
+ */
+int nDuplicatePeerHandle(serverConnectionT* pConnection, const char* szHandle, HANDLE* phFile) {
+    char* szEnd = NULL;
+    errno = 0;
+    unsigned long long ullHandle = strtoull(szHandle, &szEnd, 0);
+    if (errno != 0 || szEnd == szHandle || *szEnd != '\0' || ullHandle == 0) {
+        return -1;
+    }
+
+    if (!pConnection->hPeerProcess) {
+        ULONG ulPeerPid = 0;
+        DWORD dwBytes = 0;
+        if (WSAIoctl(pConnection->hSocket, SIO_AF_UNIX_GETPEERPID, NULL, 0, &ulPeerPid, sizeof(ulPeerPid),
+            &dwBytes, NULL, NULL) != 0) {
+            return -1;
+        }
+        pConnection->hPeerProcess = OpenProcess(PROCESS_DUP_HANDLE, FALSE, ulPeerPid);
+        if (!pConnection->hPeerProcess) {
+            return -1;
+        }
+    }
+
+    return DuplicateHandle(pConnection->hPeerProcess, (HANDLE)(ULONG_PTR)ullHandle, GetCurrentProcess(), phFile,
+        0, FALSE, DUPLICATE_SAME_ACCESS) ? 0 : -1;
+}
+
+/**
+ * Serve the requests of one client until it disconnects
+ * A request is a frame of a 4 byte little endian length and a payload starting with its type:
+ * 'P' and archive paths separated by newlines, 'H' and handle values of archives opened by the client
+ * separated by newlines, 'D' and one archive's content, or 'Q' to stop the server.
+ * Every archive is answered with one frame in request order, an empty frame ends the response.
+ * @param pConnection Connection
+ */
+void vServeConnection(serverConnectionT* pConnection) {
+    serverT* pServer = pConnection->pServer;
+    SOCKET hSocket = pConnection->hSocket;
+    std::vector<unsigned char> vecRequest;
+
+    while (!pServer->bStopping) {
+        unsigned char abLength[4];
+        if (!bReceiveAll(hSocket, abLength, sizeof(abLength))) {
+            break;
+        }
+        unsigned long long ullLength = abLength[0] | (abLength[1] << 8) | (abLength[2] << 16) |
+            ((unsigned long long)abLength[3] << 24);
+        if (ullLength == 0 || ullLength > pServer->ullMaxRequest) {
+            bSendFrame(hSocket, "status=error\terror=Request is empty or larger than the memory budget");
             break;
         }
 
-        // Check for end of archive (empty block)
-        if (stHeader.szName[0] == '\0') {
-            // Skip one more block to validate end of archive
-            gzread(gzTarFile, szBuffer, TAR_BLOCK_SIZE);
+        vecRequest.resize((size_t)ullLength);
+        if (!bReceiveAll(hSocket, vecRequest.data(), vecRequest.size())) {
             break;
         }
+        std::chrono::steady_clock::time_point tReceived = std::chrono::steady_clock::now();
 
-        // Validate file path for safety - prevent path traversal attacks
-        if (strstr(stHeader.szName, "../") || strstr(stHeader.szName, "..\\")) {
-            fprintf(stderr, "Warning: Skipping potentially unsafe path: %s\n", stHeader.szName);
-            // Skip this file's content
-            ulFileSize = ulParseOctal(stHeader.szSize, sizeof(stHeader.szSize));
-            size_t nBlocks = (ulFileSize + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
-            gzseek(gzTarFile, nBlocks * TAR_BLOCK_SIZE, SEEK_CUR);
+        if (vecRequest[0] == 'Q') {
+            pServer->bStopping = true;
+            bSendFrame(hSocket, "");
+            shutdown(pServer->hListen, SD_BOTH);
+            closesocket(pServer->hListen);
+            break;
+        }
+
+        // Every archive of the request goes to the shared queue at once
+        std::vector<serverJobT*> vecJobs;
+        if (vecRequest[0] == 'P' || vecRequest[0] == 'H') {
+            size_t nStart = 1;
+            while (nStart < vecRequest.size()) {
+                size_t nEnd = nStart;
+                while (nEnd < vecRequest.size() && vecRequest[nEnd] != '\n') {
+                    nEnd++;
+                }
+                size_t nLineEnd = nEnd > nStart && vecRequest[nEnd - 1] == '\r' ? nEnd - 1 : nEnd;
+                if (nLineEnd > nStart) {
+                    serverJobT* pJob = new serverJobT();
+                    std::string strLine((const char*)vecRequest.data() + nStart, nLineEnd - nStart);
+                    if (vecRequest[0] == 'P') {
+                        pJob->strPath = strLine;
+                    }
+                    else if (nDuplicatePeerHandle(pConnection, strLine.c_str(), &pJob->hFile) != 0) {
+                        // Answered right away, in its place among the other archives
+                        strncpy_s(pJob->stResult.szError, BATTERYCYCLE_VALUE_SIZE, "Cannot duplicate the handle",
+                            _TRUNCATE);
+                        pJob->nResult = -1;
+                        pJob->bDone = true;
+                    }
+                    vecJobs.push_back(pJob);
+                }
+                nStart = nEnd + 1;
+            }
+        }
+        else if (vecRequest[0] == 'D') {
+            serverJobT* pJob = new serverJobT();
+            pJob->vecData.assign(vecRequest.begin() + 1, vecRequest.end());
+            vecJobs.push_back(pJob);
+        }
+        else {
+            bSendFrame(hSocket, "status=error\terror=Unknown request type");
+            bSendFrame(hSocket, "");
             continue;
         }
 
-        // Get file size
-        ulFileSize = ulParseOctal(stHeader.szSize, sizeof(stHeader.szSize));
+        {
+            std::lock_guard<std::mutex> lock(pServer->mtxJobs);
+            for (size_t i = 0; i < vecJobs.size(); i++) {
+                vecJobs[i]->tQueued = tReceived;
+                vecJobs[i]->pConnection = pConnection;
+                if (!vecJobs[i]->bDone) {
+                    pServer->dqJobs.push_back(vecJobs[i]);
+                }
+            }
+        }
+        pServer->cvJobs.notify_all();
 
-        // Calculate number of blocks for this file and padding
-        size_t nBlocks = (ulFileSize + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
+        // Answer in request order, each result as soon as it and all before it are done
+        bool bConnected = true;
+        for (size_t i = 0; i < vecJobs.size(); i++) {
+            {
+                std::unique_lock<std::mutex> lock(pConnection->mtxDone);
+                pConnection->cvDone.wait(lock, [&vecJobs, i] { return vecJobs[i]->bDone; });
+            }
+            bConnected = bConnected && bSendFrame(hSocket, strFormatServerResult(vecJobs[i]));
+            delete vecJobs[i];
+        }
+        if (!bConnected || !bSendFrame(hSocket, "")) {
+            break;
+        }
+    }
 
-        // Check if it's a file and if it's in our target directory
-        if ((stHeader.cTypeflag == '0' || stHeader.cTypeflag == '\0') &&
-            bIsInDirectory(stHeader.szName, szTargetDir)) {
+    shutdown(hSocket, SD_BOTH);
+    pConnection->bFinished = true;
+}
 
-            // Extract the filename from the path
-            const char* szFilename = stHeader.szName;
-            const char* pSlash = strrchr(stHeader.szName, '/');
-            if (pSlash) {
-                szFilename = pSlash + 1;
+/**
+ * Join and release the connections whose threads have finished
+ * @param pvecConnections Connections, finished ones are removed
+ * @param bAll Wait for every connection
+ */
+void vReapServerConnections(std::vector<serverConnectionT*>* pvecConnections, bool bAll) {
+    for (size_t i = 0; i < pvecConnections->size();) {
+        serverConnectionT* pConnection = (*pvecConnections)[i];
+        if (bAll || pConnection->bFinished) {
+            pConnection->thConnection.join();
+            closesocket(pConnection->hSocket);
+            if (pConnection->hPeerProcess) {
+                CloseHandle(pConnection->hPeerProcess);
             }
+            delete pConnection;
+            pvecConnections->erase(pvecConnections->begin() + i);
+        }
+        else {
+            i++;
+        }
+    }
+}
 
-            // Skip if filename is empty (directory entry)
-            if (*szFilename == '\0') {
-                gzseek(gzTarFile, nBlocks * TAR_BLOCK_SIZE, SEEK_CUR);
-                continue;
-            }
+/**
+ * Serve analysis requests on a Unix domain socket until a client asks to stop
+ * @param szSocketPath Path of the socket, replaced if it exists
+ * @param pOptions Extraction options for every archive
+ * @param nWorkers Number of workers
+ * @return 0 on a requested stop, non-zero on error
+ */
+int nRunServer(const char* szSocketPath, const extractOptionsT* pOptions, int nWorkers) {
+    WSADATA stWsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &stWsaData) != 0) {
+        fprintf(stderr, "Error: Cannot initialize sockets\n");
+        return 1;
+    }
 
-            // Call the matcher callback to see if we should extract this file
-            if (pfnMatcher && !pfnMatcher(szFilename, pUserData)) {
-                // Matcher says skip this file
-                gzseek(gzTarFile, nBlocks * TAR_BLOCK_SIZE, SEEK_CUR);
-                continue;
-            }
+    struct sockaddr_un stAddress;
+    memset(&stAddress, 0, sizeof(stAddress));
+    stAddress.sun_family = AF_UNIX;
+    if (strncpy_s(stAddress.sun_path, sizeof(stAddress.sun_path), szSocketPath, _TRUNCATE) != 0 ||
+        strlen(szSocketPath) >= sizeof(stAddress.sun_path)) {
+        fprintf(stderr, "Error: Socket path %s is too long\n", szSocketPath);
+        WSACleanup();
+        return 1;
+    }
+
+    // A socket file left behind by an earlier server would make bind fail
+    remove(szSocketPath);
+    SOCKET hListen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (hListen == INVALID_SOCKET || bind(hListen, (struct sockaddr*)&stAddress, sizeof(stAddress)) == SOCKET_ERROR ||
+        listen(hListen, SOMAXCONN) == SOCKET_ERROR) {
+        fprintf(stderr, "Error: Cannot listen on %s\n", szSocketPath);
+        if (hListen != INVALID_SOCKET) {
+            closesocket(hListen);
+        }
+        WSACleanup();
+        return 1;
+    }
 
-            // Extract file content in chunks
-            size_t nRemaining = ulFileSize;
+    serverT* pServer = new serverT();
+    pServer->hListen = hListen;
+    pServer->bStopping = false;
+    pServer->pOptions = pOptions;
+    pServer->ullMaxRequest = ullResolveMemoryBudget(pOptions);
 
-            // Allocate memory for the full file content
-            char* szCsvBuf = (char*)malloc(ulFileSize + 1); // +1 for null terminator
-            if (!szCsvBuf) {
-                fprintf(stderr, "Error: Memory allocation failed for file content\n");
-                gzclose(gzTarFile);
-                return -2;
+    std::vector<std::thread> vecWorkers;
+    for (int i = 0; i < nWorkers; i++) {
+        vecWorkers.push_back(std::thread(vServerWorker, pServer));
+    }
+    printf("Listening on %s with %d workers\n", szSocketPath, nWorkers);
+    fflush(stdout);
+
+    std::vector<serverConnectionT*> vecConnections;
+    while (!pServer->bStopping) {
+        SOCKET hSocket = accept(hListen, NULL, NULL);
+        if (hSocket == INVALID_SOCKET) {
+            if (!pServer->bStopping) {
+                fprintf(stderr, "Error: Accepting a connection failed\n");
             }
+            break;
+        }
+
+        vReapServerConnections(&vecConnections, false);
+        serverConnectionT* pConnection = new serverConnectionT();
+        pConnection->hSocket = hSocket;
+        pConnection->hPeerProcess = NULL;
+        pConnection->bFinished = false;
+        pConnection->pServer = pServer;
+        pConnection->thConnection = std::thread(vServeConnection, pConnection);
+        vecConnections.push_back(pConnection);
+    }
+
+    // Idle clients are disconnected, the workers finish what is queued
+    int nRet = pServer->bStopping ? 0 : 1;
+    pServer->bStopping = true;
+    for (size_t i = 0; i < vecConnections.size(); i++) {
+        shutdown(vecConnections[i]->hSocket, SD_BOTH);
+    }
+    vReapServerConnections(&vecConnections, true);
+    pServer->cvJobs.notify_all();
+    for (size_t i = 0; i < vecWorkers.size(); i++) {
+        vecWorkers[i].join();
+    }
+    if (nRet != 0) {
+        closesocket(hListen);
+    }
+
+    delete pServer;
+    remove(szSocketPath);
+    WSACleanup();
+    return nRet;
+}
+#endif
 
-            // Ensure null-termination
-            szCsvBuf[ulFileSize] = '\0';
+/**
+ * Time a full decompression of an archive, best of BENCHMARK_RUNS runs
+ * @param szTargzPath Path to tar.gz file
+ * @param pOptions Extraction options for the run
+ * @param pBackend Backend to open the archive with, NULL to let pOpenArchiveReader choose
+ * @param szBuffer Scratch buffer of PARALLEL_CHUNK_SIZE bytes
+ * @param pdBestMs Receives the best time in milliseconds
+ * @param pullTotal Receives the number of uncompressed bytes
+ * @return 0 on success, 1 if the backend cannot serve the archive, -1 on error
+ */
+int nTimeDecompression(const char* szTargzPath, const extractOptionsT* pOptions, const inflateBackendT* pBackend,
+    char* szBuffer, double* pdBestMs, unsigned long long* pullTotal) {
+    for (int nRun = 0; nRun < BENCHMARK_RUNS; nRun++) {
+        std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
 
-            char* szCurrentBuf = szCsvBuf;
+        archiveReaderT* pReader = pBackend ? pBackend->pfnOpen(szTargzPath, pOptions)
+            : pOpenArchiveReader(szTargzPath, pOptions, NULL);
+        if (!pReader) {
+            return pBackend ? 1 : -1;
+        }
 
-            while (nRemaining > 0) {
-                size_t nToRead = (nRemaining > CHUNK) ? CHUNK : nRemaining;
-                size_t nBytesRead = gzread(gzTarFile, szBuffer, nToRead);
+        long long llRead;
+        *pullTotal = 0;
+        while ((llRead = pReader->pfnRead(pReader, szBuffer, PARALLEL_CHUNK_SIZE)) > 0) {
+            *pullTotal += llRead;
+        }
+        pReader->pfnClose(pReader);
 
-                if (nBytesRead != nToRead) {
-                    fprintf(stderr, "Error: Failed to read data (expected %lu, got %lu)\n",
-                        (unsigned long)nToRead, (unsigned long)nBytesRead);
-                    free(szCsvBuf);
-                    gzclose(gzTarFile);
-                    return -1;
-                }
+        if (llRead < 0) {
+            fprintf(stderr, "Error: Decompression failed\n");
+            return -1;
+        }
 
-                if (memcpy_s(szCurrentBuf, nRemaining, szBuffer, nBytesRead) != 0) {
-                    fprintf(stderr, "Error: Memory copy failed\n");
-                    free(szCsvBuf);
-                    gzclose(gzTarFile);
-                    return -3;
-                }
+        double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+        if (nRun == 0 || dMs < *pdBestMs) {
+            *pdBestMs = dMs;
+        }
+    }
 
-                szCurrentBuf += nBytesRead;
-                nRemaining -= nBytesRead;
+    return 0;
+}
+
+/**
+ * Print decompression times of an archive for 1, 2, 4, .. threads on the zlib based decoders
+ * @param szTargzPath Path to tar.gz file
+ * @param pOptions Extraction options, nThreads caps the thread count
+ * @param szBuffer Scratch buffer of PARALLEL_CHUNK_SIZE bytes
+ * @return 0 on success, -1 on error
+ */
+int nRunThreadScaling(const char* szTargzPath, const extractOptionsT* pOptions, char* szBuffer) {
+    int nMaxThreads = nResolveThreadCount(pOptions);
+    printf("%8s %12s %12s %9s\n", "Threads", "Time (ms)", "MB/s", "Speedup");
+
+    double dBaseMs = 0;
+    int nThreads = 1;
+    while (true) {
+        extractOptionsT stRunOptions = *pOptions;
+        stRunOptions.nThreads = nThreads;
+        stRunOptions.szBackend = astInflateBackends[0].szName;
+
+        double dBestMs = 0;
+        unsigned long long ullTotal = 0;
+        if (nTimeDecompression(szTargzPath, &stRunOptions, NULL, szBuffer, &dBestMs, &ullTotal) != 0) {
+            return -1;
+        }
+
+        if (nThreads == 1) {
+            dBaseMs = dBestMs;
+        }
+        printf("%8d %12.1f %12.1f %8.2fx\n", nThreads, dBestMs,
+            ullTotal / 1e6 / (dBestMs / 1000.0), dBaseMs / dBestMs);
+
+        if (nThreads >= nMaxThreads) {
+            break;
+        }
+        nThreads = nThreads * 2 < nMaxThreads ? nThreads * 2 : nMaxThreads;
+    }
+
+    return 0;
+}
+
+/**
+ * Write a gzip file of pseudo-random bytes, which deflate cannot compress
+ * @param szPath Path of the file to write
+ * @param szBuffer Scratch buffer of PARALLEL_CHUNK_SIZE bytes
+ * @return 0 on success, -1 on error
+ */
+int nWriteRandomGzip(const char* szPath, char* szBuffer) {
+    gzFile gzRandomFile = gzopen(szPath, "wb");
+    if (!gzRandomFile) {
+        return -1;
+    }
+
+    // xorshift64, the same payload every run
+    unsigned long long ullState = 0x9e3779b97f4a7c15ULL;
+    int nResult = 0;
+    for (size_t nWritten = 0; nWritten < BENCHMARK_RANDOM_SIZE && nResult == 0; nWritten += PARALLEL_CHUNK_SIZE) {
+        for (size_t i = 0; i < PARALLEL_CHUNK_SIZE; i += sizeof(ullState)) {
+            ullState ^= ullState << 13;
+            ullState ^= ullState >> 7;
+            ullState ^= ullState << 17;
+            memcpy(szBuffer + i, &ullState, sizeof(ullState));
+        }
+        if (gzwrite(gzRandomFile, szBuffer, PARALLEL_CHUNK_SIZE) != PARALLEL_CHUNK_SIZE) {
+            nResult = -1;
+        }
+    }
+
+    if (gzclose(gzRandomFile) != Z_OK) {
+        nResult = -1;
+    }
+    return nResult;
+}
+
+/**
+ * Benchmark decompression throughput of an archive per thread count and per inflate backend
+ * Thread scaling is also measured on an incompressible payload, where block starts are hard to find.
+ * @param szTargzPath Path to tar.gz file
+ * @param pOptions Extraction options, nThreads caps the thread count
+ * @return 0 on success, non-zero on error
+ */
+int nRunDecompressBenchmark(const char* szTargzPath, const extractOptionsT* pOptions) {
+    char* szBuffer = (char*)malloc(PARALLEL_CHUNK_SIZE);
+    if (!szBuffer) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -2;
+    }
+
+    printf("Benchmarking decompression of %s (best of %d runs)\n\n", szTargzPath, BENCHMARK_RUNS);
+    if (nRunThreadScaling(szTargzPath, pOptions, szBuffer) != 0) {
+        free(szBuffer);
+        return -1;
+    }
+
+    // The payload goes to a new file in the temp directory, GetTempFileNameA never reuses an existing one
+    char szTempDir[MAX_PATH_LENGTH];
+    char szRandomPath[MAX_PATH_LENGTH];
+    DWORD dwTempDir = GetTempPathA(sizeof(szTempDir), szTempDir);
+    printf("\nIncompressible payload (%d MB)\n", BENCHMARK_RANDOM_SIZE / (1024 * 1024));
+    if (dwTempDir == 0 || dwTempDir >= sizeof(szTempDir) || GetTempFileNameA(szTempDir, "bcb", 0, szRandomPath) == 0) {
+        printf("skipped (no temporary file)\n");
+    }
+    else if (nWriteRandomGzip(szRandomPath, szBuffer) != 0) {
+        printf("skipped (cannot write payload)\n");
+        remove(szRandomPath);
+    }
+    else {
+        int nRet = nRunThreadScaling(szRandomPath, pOptions, szBuffer);
+        remove(szRandomPath);
+        if (nRet != 0) {
+            free(szBuffer);
+            return -1;
+        }
+    }
+
+    // Single threaded backends against the same archive, relative to the streaming one
+    double dBaseMs = 0;
+    printf("\n%-12s %12s %12s %9s\n", "Backend", "Time (ms)", "MB/s", "Speedup");
+    for (int i = 0; i < INFLATE_BACKEND_COUNT; i++) {
+        double dBestMs = 0;
+        unsigned long long ullTotal = 0;
+        int nRet = nTimeDecompression(szTargzPath, pOptions, &astInflateBackends[i], szBuffer, &dBestMs, &ullTotal);
+        if (nRet < 0) {
+            free(szBuffer);
+            return -1;
+        }
+        if (nRet > 0) {
+            printf("%-12s %12s\n", astInflateBackends[i].szName, "skipped (exceeds memory budget)");
+            continue;
+        }
+
+        if (i == 0) {
+            dBaseMs = dBestMs;
+        }
+        printf("%-12s %12.1f %12.1f %8.2fx\n", astInflateBackends[i].szName, dBestMs,
+            ullTotal / 1e6 / (dBestMs / 1000.0), dBaseMs / dBestMs);
+    }
+
+    free(szBuffer);
+    return 0;
+}
+
+/**
+ * Benchmark end-to-end latency per input format, from opening the archive to the latest BDC_Daily_ content
+ * @param aszPaths Archives to compare, typically the same report in several formats
+ * @param nPaths Number of archives
+ * @param pOptions Extraction options for every run
+ * @return 0 on success, non-zero on error
+ */
+int nRunFormatBenchmark(const char* const* aszPaths, int nPaths, const extractOptionsT* pOptions) {
+    char* szBuffer = (char*)malloc(PARALLEL_CHUNK_SIZE);
+    if (!szBuffer) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -2;
+    }
+
+    printf("Benchmarking end-to-end latency per format (best of %d runs)\n\n", BENCHMARK_RUNS);
+    printf("%-8s %10s %12s %12s %15s  %s\n", "Format", "Size (MB)", "Decode (ms)", "MB/s", "End-to-end (ms)", "Archive");
+
+    for (int i = 0; i < nPaths; i++) {
+        int nFormat = nDetectInputFormat(aszPaths[i]);
+        if (nFormat == INPUT_FORMAT_UNKNOWN) {
+            fprintf(stderr, "Error: Cannot open %s\n", aszPaths[i]);
+            free(szBuffer);
+            return -1;
+        }
+
+        // Full decode of the tar stream, folders have none
+        double dDecodeMs = 0;
+        unsigned long long ullTotal = 0;
+        unsigned long long ullArchiveSize = 0;
+        unsigned char abTrailer[8];
+        if (nFormat != INPUT_FORMAT_DIRECTORY) {
+            bReadArchiveIdentity(aszPaths[i], &ullArchiveSize, abTrailer);
+            if (nTimeDecompression(aszPaths[i], pOptions, NULL, szBuffer, &dDecodeMs, &ullTotal) != 0) {
+                free(szBuffer);
+                return -1;
             }
+        }
 
-            // Process the CSV data
-            char szBufferTimestamp[MAX_BUFFER_SIZE] = { 0 };
-            char szBufferCycleCount[MAX_BUFFER_SIZE] = { 0 };
+        // The actual job, including any early stop or index the options ask for
+        double dBestMs = 0;
+        for (int nRun = 0; nRun < BENCHMARK_RUNS; nRun++) {
+            matcherDataT stData;
+            memset(&stData, 0, sizeof(matcherDataT));
+            stData.szPrefix = "BDC_Daily_version";
 
-            if (nGetCSVDataByColName(szCsvBuf, -1, "TimeStamp", szBufferTimestamp, sizeof(szBufferTimestamp)) != 0) {
-                fprintf(stderr, "Error: Failed to parse timestamp\n");
-                free(szCsvBuf);
-                break;
+            std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+            int nRet = nExtractFromTargzWithCallback(aszPaths[i], "logs/BatteryBDC/",
+                bLatestBdcDailyMatcher, nKeepLatestTailCallback, &stData, pOptions);
+            double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+            if (nRet != 0 || !stData.bFoundMatch) {
+                fprintf(stderr, "Error: No matching BDC_Daily_ files found in %s\n", aszPaths[i]);
+                free(szBuffer);
+                return -1;
             }
 
-            if (nGetCSVDataByColName(szCsvBuf, -1, "CycleCount", szBufferCycleCount, sizeof(szBufferCycleCount)) != 0) {
-                fprintf(stderr, "Error: Failed to parse CycleCount\n");
-                free(szCsvBuf);
-                break;
+            if (nRun == 0 || dMs < dBestMs) {
+                dBestMs = dMs;
             }
+        }
 
-            printf("Battery Cycle Count: %s\nLast Charging Date: %s\n",
-                szBufferCycleCount, szBufferTimestamp);
-
-            // Free the memory we allocated
-            free(szCsvBuf);
-            break;
-
-            // Skip padding if necessary - Note: This code is unreachable after break
-            // size_t nPadding = nBlocks * TAR_BLOCK_SIZE - ulFileSize;
-            // if (nPadding > 0) {
-            //     gzseek(gzTarFile, nPadding, SEEK_CUR);
-            // }
+        if (nFormat == INPUT_FORMAT_DIRECTORY) {
+            printf("%-8s %10s %12s %12s %15.1f  %s\n", szInputFormatName(nFormat), "-", "-", "-", dBestMs, aszPaths[i]);
         }
         else {
-            // Skip this file's data blocks
-            gzseek(gzTarFile, nBlocks * TAR_BLOCK_SIZE, SEEK_CUR);
+            printf("%-8s %10.1f %12.1f %12.1f %15.1f  %s\n", szInputFormatName(nFormat), ullArchiveSize / 1e6,
+                dDecodeMs, ullTotal / 1e6 / (dDecodeMs / 1000.0), dBestMs, aszPaths[i]);
         }
     }
 
-    gzclose(gzTarFile);
-    return nRet;
+    free(szBuffer);
+    return 0;
 }
 
 /**
- * File matcher that accepts files with specific extension
- * @param szFilename Filename to check
- * @param pUserData Pointer to extension string
- * @return 1 if matches, 0 otherwise
+ * Find the end of every field of CSV data a byte at a time, the way nGetCSVDataByColNames did before the block tokenizer
+ * @param pData CSV data
+ * @param nSize Size of the data
+ * @param pvecFieldEnds Receives the same offsets as from nTokenizeCSV
  */
-int bFileExtensionMatcher(const char* szFilename, void* pUserData) {
-    const char* szExtension = (const char*)pUserData;
-    const char* szFileExt = strrchr(szFilename, '.');
+void vTokenizeCSVBytewise(const char* pData, size_t nSize, std::vector<unsigned int>* pvecFieldEnds) {
+    pvecFieldEnds->clear();
+    const char* pEnd = pData + nSize;
+    const char* pLine = pData;
+    while (pLine < pEnd) {
+        const char* pLineEnd = (const char*)memchr(pLine, '\n', pEnd - pLine);
+        pLineEnd = pLineEnd ? pLineEnd : pEnd;
 
-    if (!szFileExt) return 0; // No extension
+        const char* pField = pLine;
+        while (true) {
+            const char* pFieldEnd = pFindCSVFieldEnd(pField, pLineEnd);
+            pvecFieldEnds->push_back((unsigned int)(pFieldEnd - pData));
+            if (pFieldEnd == pLineEnd) {
+                break;
+            }
+            pField = pFieldEnd + 1;
+        }
+        pLine = pLineEnd + 1;
+    }
+}
 
-    return _stricmp(szFileExt, szExtension) == 0;
+/**
+ * Find the type of a CSV value and parse it with the C library, the way nParseBdcValue did before the typed parsers
+ * @param pValue Value without blanks and quotes around it
+ * @param nLen Length of the value
+ * @param pllValue Receives integers and timestamps
+ * @param pdValue Receives reals
+ * @return Same as nParseBdcValue
+ */
+int nParseBdcValueLibc(const char* pValue, size_t nLen, long long* pllValue, double* pdValue) {
+    if (nLen == 0) {
+        return -1;
+    }
+    if (bParseCSVTimeStamp(pValue, nLen, pllValue)) {
+        return BDC_COLUMN_TIMESTAMP;
+    }
+
+    char szNumber[64];
+    char c = pValue[0];
+    if (nLen >= sizeof(szNumber) || !((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.')) {
+        return BDC_COLUMN_TEXT;
+    }
+    memcpy(szNumber, pValue, nLen);
+    szNumber[nLen] = '\0';
+
+    char* szEnd = NULL;
+    errno = 0;
+    long long llValue = strtoll(szNumber, &szEnd, 10);
+    if (*szEnd == '\0' && errno != ERANGE) {
+        *pllValue = llValue;
+        return BDC_COLUMN_INTEGER;
+    }
+    double dValue = strtod(szNumber, &szEnd);
+    if (*szEnd == '\0') {
+        *pdValue = dValue;
+        return BDC_COLUMN_REAL;
+    }
+    return BDC_COLUMN_TEXT;
 }
 
 /**
- * File matcher that uses a wildcard pattern (basic implementation)
- * @param szFilename Filename to check
- * @param pUserData Pointer to pattern string
- * @return 1 if matches, 0 otherwise
+ * Build a synthetic BDC_Daily_ log of a given size, with a quoted adapter name in every row
+ * @param ullSize Size in bytes, the last row may go over it
+ * @param pstrCsv Receives the CSV data
  */
-int bWildcardMatcher(const char* szFilename, void* pUserData) {
-    const char* szPattern = (const char*)pUserData;
+void vBuildSyntheticBdcLog(unsigned long long ullSize, std::string* pstrCsv) {
+    static const char* const aszAdapters[] = { "", "\"20W USB-C Power Adapter\"", "\"MagSafe Charger, 15W\"" };
+    pstrCsv->assign("TimeStamp,Temperature,Voltage,InstantAmperage,CurrentCapacity,NominalChargeCapacity,"
+        "AbsoluteCapacity,RawMaxCapacity,CycleCount,StateOfCharge,IsCharging,ExternalConnected,"
+        "AdapterPower,AdapterName,WeightedRa,DailyMaxSoc,DailyMinSoc\n");
+    pstrCsv->reserve((size_t)ullSize + MAX_BUFFER_SIZE);
 
-    // Simple wildcard matching for "*.ext" patterns
-    if (szPattern[0] == '*' && szPattern[1] == '.') {
-        const char* szFileExt = strrchr(szFilename, '.');
-        if (!szFileExt) return 0;
-        return _stricmp(szFileExt, szPattern + 1) == 0;
+    char szRow[MAX_BUFFER_SIZE];
+    unsigned int uSeed = 1;
+    for (int nRow = 0; pstrCsv->size() < ullSize; nRow++) {
+        uSeed = uSeed * 1103515245 + 12345;
+        int nCharging = (uSeed >> 16) & 1;
+        snprintf(szRow, sizeof(szRow), "2025-05-%02d %02d:%02d:%02d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%s,%d,%d,%d\n",
+            1 + nRow / 1440 % 28, nRow / 60 % 24, nRow % 60, (uSeed >> 8) % 60, 2900 + (int)(uSeed % 300),
+            3700 + (int)(uSeed % 500), nCharging ? 1500 : -480, 2800 - nRow % 500, 3100, 2950, 3300, 250 + nRow / 1440,
+            (int)(uSeed >> 20) % 101, nCharging, nCharging, nCharging ? 20 : 0, aszAdapters[nCharging ? 1 + nRow % 2 : 0],
+            (int)(uSeed % 200), 100, (int)(uSeed >> 24) % 50);
+        pstrCsv->append(szRow);
     }
+}
 
-    // Exact match
-    return strcmp(szFilename, szPattern) == 0;
-}/**
- * Parse date in format YYYY-MM-DD_HH:MM:SS
- * @param szDateStr Date string to parse
- * @param pDate Pointer to date structure to fill
- * @return 1 if successful, 0 if failed
+/**
+ * Benchmark tokenizing a synthetic BDC_Daily_ log with every CSV kernel against the byte at a time parser,
+ * converting its values and reducing them with every reduction kernel
+ * @param nMegabytes Size of the synthetic log
+ * @return 0 on success, non-zero on error
  */
-int bParseDate(const char* szDateStr, fileDateT* pDate) {
-    if (!szDateStr || !pDate) {
-        return 0; // Invalid parameters
+int nRunCSVBenchmark(int nMegabytes) {
+    std::string strCsv;
+    vBuildSyntheticBdcLog((unsigned long long)nMegabytes * 1024 * 1024, &strCsv);
+
+    printf("Benchmarking CSV tokenizing of %.1f MB of synthetic BDC data (best of %d runs)\n\n",
+        strCsv.size() / 1e6, BENCHMARK_RUNS);
+    printf("%-10s %12s %12s %9s\n", "Parser", "Time (ms)", "MB/s", "Speedup");
+
+    std::vector<unsigned int> vecExpected;
+    std::vector<unsigned int> vecFieldEnds;
+    double dBaseMs = 0;
+    for (int i = -1; i < CSV_KERNEL_COUNT; i++) {
+        const char* szName = i < 0 ? "bytewise" : astCsvKernels[i].szName;
+        if (i >= 0 && !astCsvKernels[i].pfnSupported()) {
+            printf("%-10s %12s\n", szName, "skipped (not supported by this CPU)");
+            continue;
+        }
+
+        double dBestMs = 0;
+        for (int nRun = 0; nRun < BENCHMARK_RUNS; nRun++) {
+            std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+            if (i < 0) {
+                vTokenizeCSVBytewise(strCsv.data(), strCsv.size(), &vecExpected);
+            }
+            else if (nTokenizeCSV(strCsv.data(), strCsv.size(), &astCsvKernels[i], &vecFieldEnds) != 0) {
+                return -1;
+            }
+            double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+            if (nRun == 0 || dMs < dBestMs) {
+                dBestMs = dMs;
+            }
+        }
+
+        // Every kernel has to find exactly the fields the reference parser finds
+        if (i >= 0 && vecFieldEnds != vecExpected) {
+            fprintf(stderr, "Error: CSV kernel %s disagrees with the bytewise parser\n", szName);
+            return -1;
+        }
+
+        if (i < 0) {
+            dBaseMs = dBestMs;
+        }
+        printf("%-10s %12.1f %12.1f %8.2fx\n", szName, dBestMs, strCsv.size() / 1e6 / (dBestMs / 1000.0),
+            dBaseMs / dBestMs);
     }
 
-    // Using sscanf_s which is the secure version of sscanf
-    int nResult = sscanf_s(szDateStr, "%d-%d-%d_%d:%d:%d",
-        &pDate->nYear, &pDate->nMonth, &pDate->nDay,
-        &pDate->nHour, &pDate->nMinute, &pDate->nSecond);
+    printf("\n%d fields, %s is used for this CPU\n\n", (int)vecExpected.size(), pGetCSVKernel()->szName);
 
-    if (nResult != 6) {
-        fprintf(stderr, "Error: Date parsing failed for %s\n", szDateStr);
-        return 0; // Failed to parse all date components
+    // Converting every field to its type, as loading the history does, with the C library and the typed parsers
+    printf("%-10s %12s %12s %9s\n", "Converter", "Time (ms)", "MB/s", "Speedup");
+    std::vector<long long> avecValues[2];
+    for (int i = 0; i < 2; i++) {
+        double dBestMs = 0;
+        for (int nRun = 0; nRun < BENCHMARK_RUNS; nRun++) {
+            avecValues[i].clear();
+            std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+            unsigned int uStart = 0;
+            for (size_t j = 0; j < vecExpected.size(); j++) {
+                const char* pValue = strCsv.data() + uStart;
+                const char* pValueEnd = strCsv.data() + vecExpected[j];
+                vTrimCSVField(&pValue, &pValueEnd);
+                uStart = vecExpected[j] + 1;
+
+                long long llValue = 0;
+                double dValue = 0;
+                int nType = i == 0 ? nParseBdcValueLibc(pValue, pValueEnd - pValue, &llValue, &dValue) :
+                    nParseBdcValue(pValue, pValueEnd - pValue, &llValue, &dValue);
+                if (nType == BDC_COLUMN_REAL) {
+                    memcpy(&llValue, &dValue, sizeof(llValue));
+                }
+                avecValues[i].push_back(nType == BDC_COLUMN_TEXT || nType < 0 ? nType : llValue);
+            }
+            double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+            if (nRun == 0 || dMs < dBestMs) {
+                dBestMs = dMs;
+            }
+        }
+
+        if (i > 0 && avecValues[i] != avecValues[0]) {
+            fprintf(stderr, "Error: Typed parsers disagree with the C library\n");
+            return -1;
+        }
+
+        if (i == 0) {
+            dBaseMs = dBestMs;
+        }
+        printf("%-10s %12.1f %12.1f %8.2fx\n", i == 0 ? "libc" : "typed", dBestMs,
+            strCsv.size() / 1e6 / (dBestMs / 1000.0), dBaseMs / dBestMs);
     }
 
-    // Validate date components
-    if (pDate->nYear < 1970 || pDate->nYear > 2100 ||
-        pDate->nMonth < 1 || pDate->nMonth > 12 ||
-        pDate->nDay < 1 || pDate->nDay > 31 ||
-        pDate->nHour < 0 || pDate->nHour > 23 ||
-        pDate->nMinute < 0 || pDate->nMinute > 59 ||
-        pDate->nSecond < 0 || pDate->nSecond > 59) {
-        fprintf(stderr, "Error: Invalid date components in %s\n", szDateStr);
-        return 0; // Invalid date components
+    // Reducing every field as one column of reals, text fields are empty values
+    std::vector<double> vecReals;
+    vecReals.reserve(vecExpected.size());
+    unsigned int uStart = 0;
+    for (size_t j = 0; j < vecExpected.size(); j++) {
+        const char* pValue = strCsv.data() + uStart;
+        const char* pValueEnd = strCsv.data() + vecExpected[j];
+        vTrimCSVField(&pValue, &pValueEnd);
+        uStart = vecExpected[j] + 1;
+
+        long long llValue = 0;
+        double dValue = 0;
+        int nType = nParseBdcValue(pValue, pValueEnd - pValue, &llValue, &dValue);
+        vecReals.push_back(nType == BDC_COLUMN_REAL ? dValue : nType == BDC_COLUMN_INTEGER ||
+            nType == BDC_COLUMN_TIMESTAMP ? (double)llValue : NAN);
     }
+    printf("\n%-10s %12s %12s %9s\n", "Reducer", "Time (ms)", "MB/s", "Speedup");
+    bdcSumsT stExpectedSums;
+    for (int i = 0; i < BDC_REDUCE_KERNEL_COUNT; i++) {
+        const bdcReduceKernelT* pKernel = &astBdcReduceKernels[i];
+        if (!pKernel->pfnSupported()) {
+            printf("%-10s %12s\n", pKernel->szName, "skipped (not supported by this CPU)");
+            continue;
+        }
 
-    // Convert to timestamp for easy comparison
-    struct tm stTimeinfo;
-    memset(&stTimeinfo, 0, sizeof(struct tm));
-    stTimeinfo.tm_year = pDate->nYear - 1900;
-    stTimeinfo.tm_mon = pDate->nMonth - 1;
-    stTimeinfo.tm_mday = pDate->nDay;
-    stTimeinfo.tm_hour = pDate->nHour;
-    stTimeinfo.tm_min = pDate->nMinute;
-    stTimeinfo.tm_sec = pDate->nSecond;
+        double dBestMs = 0;
+        bdcSumsT stSums;
+        for (int nRun = 0; nRun < BENCHMARK_RUNS; nRun++) {
+            vInitBdcSums(&stSums);
+            std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+            pKernel->pfnReduce(vecReals.data(), vecReals.size(), vecReals[0], &stSums);
+            double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+            if (nRun == 0 || dMs < dBestMs) {
+                dBestMs = dMs;
+            }
+        }
 
-    pDate->tTimestamp = mktime(&stTimeinfo);
-    if (pDate->tTimestamp == -1) {
-        fprintf(stderr, "Error: Failed to convert date to timestamp\n");
-        return 0;
+        // Every kernel adds in the same order and has to give the same bits
+        if (i == 0) {
+            stExpectedSums = stSums;
+            dBaseMs = dBestMs;
+        }
+        else if (memcmp(&stSums, &stExpectedSums, sizeof(stSums)) != 0) {
+            fprintf(stderr, "Error: Reduction kernel %s disagrees with the scalar one\n", pKernel->szName);
+            return -1;
+        }
+        printf("%-10s %12.1f %12.1f %8.2fx\n", pKernel->szName, dBestMs,
+            vecReals.size() * sizeof(double) / 1e6 / (dBestMs / 1000.0), dBaseMs / dBestMs);
     }
+    printf("\n%s is used for this CPU\n", pGetBdcReduceKernel()->szName);
+    return 0;
+}
 
-    return 1; // Successfully parsed
+/**
+ * Report a self-test check that failed
+ * @param bOk Result of the check
+ * @param szCheck What was checked
+ * @return bOk
+ */
+bool bSelfTestCheck(bool bOk, const char* szCheck) {
+    if (!bOk) {
+        fprintf(stderr, "Error: Self-test check failed: %s\n", szCheck);
+    }
+    return bOk;
 }
 
 /**
- * Callback function to find the latest BDC_Daily_ file
- * @param szFilename Filename to check
- * @param pUserData User data (matcherDataT)
- * @return 0 to continue searching without extracting
+ * Check every CSV kernel the CPU supports against the byte at a time parser, on edge cases at every
+ * position in a block and on a synthetic BDC_Daily_ log
+ * @return true if all checks passed
  */
-int bLatestBdcDailyMatcher(const char* szFilename, void* pUserData) {
-    matcherDataT* pData = (matcherDataT*)pUserData;
-    if (!pData || !szFilename) {
-        return 0;
+bool bSelfTestTokenizer(void) {
+    static const char* const aszCases[] = {
+        "", "\n", "a", "a,b", ",,\n,\n\n", "a,b\r\nc,d\r\n", "\"a,b\",c\n\"\",\"\"\"\"\n",
+        "x,\"say \"\"hi, there\"\"\",y\n", " \"padded\" , 12 ,\n", "last,row,without,newline",
+    };
+    std::vector<std::string> vecInputs;
+    for (size_t i = 0; i < sizeof(aszCases) / sizeof(aszCases[0]); i++) {
+        for (int nShift = 0; nShift <= CSV_BLOCK_SIZE + 1; nShift++) {
+            vecInputs.push_back(std::string(nShift, 'x') + aszCases[i]);
+        }
     }
 
-    // Check if file starts with the prefix
-    if (strncmp(szFilename, pData->szPrefix, strlen(pData->szPrefix)) != 0) {
-        return 0; // Not a BDC_Daily_ file
+    // A quoted field full of commas across several blocks, and a whole log
+    std::string strLong("\"");
+    for (int i = 0; i < 100; i++) {
+        strLong.append("ab,");
     }
+    vecInputs.push_back(strLong + "\",end\n" + strLong + "\"\n");
+    vecInputs.push_back(std::string());
+    vBuildSyntheticBdcLog(256 * 1024, &vecInputs.back());
 
-    // Get the date part (after the prefix)
-    const char* szDatePart = szFilename + strlen(pData->szPrefix);
+    bool bOk = true;
+    std::vector<unsigned int> vecExpected;
+    std::vector<unsigned int> vecFieldEnds;
+    vTokenizeCSVBytewise("a,,\"b,c\"\n", 9, &vecExpected);
+    bOk = bSelfTestCheck(vecExpected.size() == 3 && vecExpected[0] == 1 && vecExpected[1] == 2 &&
+        vecExpected[2] == 8, "byte at a time parser, comma in quotes") && bOk;
+    for (int i = 0; i < CSV_KERNEL_COUNT; i++) {
+        const csvKernelT* pKernel = &astCsvKernels[i];
+        if (!pKernel->pfnSupported()) {
+            continue;
+        }
+        bool bSame = true;
+        for (size_t j = 0; j < vecInputs.size() && bSame; j++) {
+            vTokenizeCSVBytewise(vecInputs[j].data(), vecInputs[j].size(), &vecExpected);
+            bSame = nTokenizeCSV(vecInputs[j].data(), vecInputs[j].size(), pKernel, &vecFieldEnds) == 0 &&
+                vecFieldEnds == vecExpected;
+        }
+        bOk = bSelfTestCheck(bSame, pKernel->szName) && bOk;
+    }
+    return bOk;
+}
 
-    szDatePart = strchr(szDatePart, '_');
+/**
+ * Check the typed value parsers against known values and against the C library
+ * @return true if all checks passed
+ */
+bool bSelfTestValues(void) {
+    static const struct {
+        const char* szValue;
+        int nType;
+        long long llValue;
+        double dValue;
+    } astCases[] = {
+        { "", -1, 0, 0 },
+        { "0", BDC_COLUMN_INTEGER, 0, 0 },
+        { "+5", BDC_COLUMN_INTEGER, 5, 0 },
+        { "-17", BDC_COLUMN_INTEGER, -17, 0 },
+        { "9223372036854775807", BDC_COLUMN_INTEGER, LLONG_MAX, 0 },
+        { "-9223372036854775808", BDC_COLUMN_INTEGER, LLONG_MIN, 0 },
+        { "9223372036854775808", BDC_COLUMN_REAL, 0, 9223372036854775808.0 },
+        { "3.25", BDC_COLUMN_REAL, 0, 3.25 },
+        { "-.5", BDC_COLUMN_REAL, 0, -0.5 },
+        { "1e3", BDC_COLUMN_REAL, 0, 1000 },
+        { "-1.5e-3", BDC_COLUMN_REAL, 0, -1.5e-3 },
+        { "-", BDC_COLUMN_TEXT, 0, 0 },
+        { ".", BDC_COLUMN_TEXT, 0, 0 },
+        { "1.2.3", BDC_COLUMN_TEXT, 0, 0 },
+        { "12abc", BDC_COLUMN_TEXT, 0, 0 },
+        { "Charger", BDC_COLUMN_TEXT, 0, 0 },
+        { "1970-01-01 00:00:00", BDC_COLUMN_TIMESTAMP, 0, 0 },
+        { "2025-05-14 13:53:59", BDC_COLUMN_TIMESTAMP, 1747230839, 0 },
+        { "2024-02-29T12:00:00", BDC_COLUMN_TIMESTAMP, 1709208000, 0 },
+        { "1969-12-31 23:59:59", BDC_COLUMN_TEXT, 0, 0 },
+        { "2025-13-01 00:00:00", BDC_COLUMN_TEXT, 0, 0 },
+    };
 
-    if (szDatePart == 0) {
-        return 0;
+    bool bOk = true;
+    for (size_t i = 0; i < sizeof(astCases) / sizeof(astCases[0]); i++) {
+        const char* szValue = astCases[i].szValue;
+        size_t nLen = strlen(szValue);
+        long long llValue = 0;
+        long long llLibc = 0;
+        double dValue = 0;
+        double dLibc = 0;
+        int nType = nParseBdcValue(szValue, nLen, &llValue, &dValue);
+        int nLibcType = nParseBdcValueLibc(szValue, nLen, &llLibc, &dLibc);
+        bool bValue = nType != BDC_COLUMN_REAL || dValue == astCases[i].dValue;
+        bValue = bValue && ((nType != BDC_COLUMN_INTEGER && nType != BDC_COLUMN_TIMESTAMP) ||
+            llValue == astCases[i].llValue);
+        bool bLibc = nLibcType == nType && (nType != BDC_COLUMN_REAL || dLibc == dValue) &&
+            (nType != BDC_COLUMN_INTEGER || llLibc == llValue);
+        bOk = bSelfTestCheck(nType == astCases[i].nType && bValue && bLibc, szValue[0] ? szValue : "empty value") && bOk;
     }
 
-    szDatePart++;
+    // Doubled quotes are undone, values that do not fit are cut off
+    char szBuffer[8];
+    size_t nCopied = 0;
+    csvFieldT stField = { "a\"\"b\"\"", 6 };
+    bOk = bSelfTestCheck(bCopyCSVField(&stField, szBuffer, sizeof(szBuffer), &nCopied) && nCopied == 4 &&
+        strcmp(szBuffer, "a\"b\"") == 0, "doubled quotes") && bOk;
+    stField.pData = "0123456789";
+    stField.nLen = 10;
+    bOk = bSelfTestCheck(!bCopyCSVField(&stField, szBuffer, sizeof(szBuffer), &nCopied) && nCopied == 7 &&
+        strcmp(szBuffer, "0123456") == 0, "value cut off") && bOk;
 
-    // Parse the date
-    fileDateT stCurrentFile;
-    memset(&stCurrentFile, 0, sizeof(fileDateT));
+    // Empty, quoted and typed fields of the last row
+    static const char szCsv[] = "Name,Empty,Quoted,Count,Time\n"
+        "first,,\"x\",1,2025-05-14 13:53:59\n"
+        "last, ,\"x, \"\"y\"\" z\", 42 ,2025-05-14 13:53:59\r\n";
+    char szEmpty[16];
+    char szQuoted[16];
+    csvColumnRequestT astColumns[5];
+    memset(astColumns, 0, sizeof(astColumns));
+    astColumns[0].szColName = "Empty";
+    astColumns[0].szResult = szEmpty;
+    astColumns[0].nBufSize = sizeof(szEmpty);
+    astColumns[0].nType = CSV_VALUE_TEXT;
+    astColumns[1].szColName = "Quoted";
+    astColumns[1].szResult = szQuoted;
+    astColumns[1].nBufSize = sizeof(szQuoted);
+    astColumns[1].nType = CSV_VALUE_TEXT;
+    astColumns[2].szColName = "Count";
+    astColumns[2].nType = CSV_VALUE_INTEGER;
+    astColumns[3].szColName = "Time";
+    astColumns[3].nType = CSV_VALUE_TIMESTAMP;
+    astColumns[4].szColName = "Missing";
+    astColumns[4].nType = CSV_VALUE_FIELD;
+    int nRet = nGetCSVDataByColNames(szCsv, sizeof(szCsv) - 1, -1, astColumns, 5);
+    bOk = bSelfTestCheck(nRet == -3 && astColumns[0].nStatus == 0 && szEmpty[0] == '\0' &&
+        astColumns[1].nStatus == 0 && strcmp(szQuoted, "x, \"y\" z") == 0 &&
+        astColumns[2].nStatus == 0 && astColumns[2].llValue == 42 &&
+        astColumns[3].nStatus == 0 && astColumns[3].llValue == 1747230839 && astColumns[4].nStatus == -3,
+        "columns of the last row") && bOk;
+    astColumns[2].szColName = "Name";
+    bOk = bSelfTestCheck(nGetCSVDataByColNames(szCsv, sizeof(szCsv) - 1, 0, astColumns + 2, 1) == -7,
+        "text in an integer column") && bOk;
+    std::vector<csvColumnRequestT> vecTooMany(MAX_COLUMNS + 1, astColumns[3]);
+    bOk = bSelfTestCheck(nGetCSVDataByColNames(szCsv, sizeof(szCsv) - 1, 0, vecTooMany.data(), MAX_COLUMNS + 1) == -1,
+        "too many columns") && bOk;
+    return bOk;
+}
 
-    if (strncpy_s(stCurrentFile.szFilename, sizeof(stCurrentFile.szFilename),
-        szFilename, _TRUNCATE) != 0) {
-        fprintf(stderr, "Error: Failed to copy filename\n");
-        return 0;
+/**
+ * Check every reduction kernel the CPU supports against the scalar one, and the statistics of a column
+ * @return true if all checks passed
+ */
+bool bSelfTestReductions(void) {
+    bool bOk = true;
+    std::vector<double> vecValues;
+    for (int i = 0; i < 67; i++) {
+        vecValues.push_back(i % 5 == 3 ? NAN : (i % 7 - 3) * 1234.5 + i * 0.1);
     }
+    for (int i = 1; i < BDC_REDUCE_KERNEL_COUNT; i++) {
+        const bdcReduceKernelT* pKernel = &astBdcReduceKernels[i];
+        if (!pKernel->pfnSupported()) {
+            continue;
+        }
 
-    if (!bParseDate(szDatePart, &stCurrentFile)) {
-        fprintf(stderr, "Error: Invalid date format\n");
-        return 0; // Invalid date format
+        // Every count up to a few blocks with a tail, the kernels have to give the same bits
+        bool bSame = true;
+        for (size_t nCount = 0; nCount <= vecValues.size() && bSame; nCount++) {
+            bdcSumsT stExpected;
+            bdcSumsT stSums;
+            vInitBdcSums(&stExpected);
+            vInitBdcSums(&stSums);
+            vReduceBdcScalar(vecValues.data(), nCount, 100, &stExpected);
+            pKernel->pfnReduce(vecValues.data(), nCount, 100, &stSums);
+            bSame = memcmp(&stSums, &stExpected, sizeof(stSums)) == 0;
+        }
+        bOk = bSelfTestCheck(bSame, pKernel->szName) && bOk;
     }
 
-    // First match or newer than previous match
-    if (!pData->bFoundMatch || stCurrentFile.tTimestamp > pData->stLatestFile.tTimestamp) {
-        pData->stLatestFile = stCurrentFile;
-        pData->bFoundMatch = 1;
+    // 1 to 10 with an empty value in between
+    bdcColumnT stColumn;
+    stColumn.nType = BDC_COLUMN_INTEGER;
+    stColumn.bTyped = true;
+    for (int i = 1; i <= 10; i++) {
+        stColumn.vecIntegers.push_back(i);
+        if (i == 4) {
+            stColumn.vecIntegers.push_back(BDC_MISSING_INTEGER);
+        }
     }
-
-    // We're only collecting information in this pass, not extracting yet
-    return 0;
+    bdcStatsT stStats;
+    vAggregateBdcColumn(&stColumn, 0, stColumn.vecIntegers.size(), &stStats);
+    bOk = bSelfTestCheck(stStats.ullCount == 10 && stStats.dMin == 1 && stStats.dMax == 10 && stStats.dMean == 5.5 &&
+        fabs(stStats.dStdDev - sqrt(8.25)) < 1e-12 && stStats.dP50 == 5.5 && fabs(stStats.dP90 - 9.1) < 1e-12 &&
+        fabs(stStats.dP99 - 9.91) < 1e-12, "statistics of 1 to 10") && bOk;
+    vAggregateBdcColumn(&stColumn, 4, 5, &stStats);
+    bOk = bSelfTestCheck(stStats.ullCount == 0 && bIsNaN(stStats.dMean) && bIsNaN(stStats.dP50),
+        "statistics of an empty value") && bOk;
+    vAggregateBdcColumn(&stColumn, 9, 10, &stStats);
+    bOk = bSelfTestCheck(stStats.ullCount == 1 && stStats.dMean == 9 && stStats.dStdDev == 0 && stStats.dP99 == 9,
+        "statistics of a single value") && bOk;
+    return bOk;
 }
 
 /**
- * Callback function to extract only the latest file (second pass)
- * @param szFilename Filename to check
- * @param pUserData User data (matcherDataT)
- * @return 1 if file should be extracted, 0 otherwise
+ * Check loading BDC_Daily_ files a byte at a time into a history table, with empty, quoted and
+ * widened values, a blank line, a new column and files out of date order
+ * @return true if all checks passed
  */
-int bExtractLatestFileMatcher(const char* szFilename, void* pUserData) {
-    matcherDataT* pData = (matcherDataT*)pUserData;
-    if (!pData || !szFilename) {
-        return 0;
+bool bSelfTestHistory(void) {
+    static const char* const aszFiles[2][2] = {
+        { "BDC_Daily_version_2025-05-14_00:00:00.csv",
+          "TimeStamp,CycleCount,Voltage,AdapterName\n"
+          "2025-05-14 10:00:00,10,4,\"20W, USB-C\"\n"
+          "\n"
+          "2025-05-14 11:00:00,,3.5,\"a \"\"fast\"\" one\"\r\n"
+          "2025-05-14 12:00:00,11" },
+        { "BDC_Daily_version_2025-05-13_00:00:00.csv",
+          "CycleCount,Extra\n"
+          "9,x\n" },
+    };
+
+    bdcTableT stTable;
+    stTable.nRows = 0;
+    bdcHistoryLoaderT stLoader;
+    stLoader.szPrefix = "BDC_Daily_version";
+    stLoader.pTable = &stTable;
+    stLoader.bHeaderDone = false;
+    stLoader.pFieldSchema = NULL;
+    stLoader.pTrend = NULL;
+    bool bOk = true;
+    for (int i = 0; i < 2; i++) {
+        const char* szData = aszFiles[i][1];
+        size_t nSize = strlen(szData);
+        int nRet = 0;
+        for (size_t j = 0; j < nSize && nRet == 0; j++) {
+            nRet = nLoadBdcHistoryCallback(aszFiles[i][0], szData + j, 1, j, &stLoader);
+        }
+        nRet = nRet == 0 ? nLoadBdcHistoryCallback(aszFiles[i][0], szData + nSize, 0, nSize, &stLoader) : nRet;
+        bOk = bSelfTestCheck(nRet == 0, aszFiles[i][0]) && bOk;
     }
+    vSortBdcTableByDate(&stTable);
 
-    // Only extract if this is the latest file we found
-    return strcmp(szFilename, pData->stLatestFile.szFilename) == 0;
+    const bdcColumnT* pTime = pFindBdcColumn(&stTable, "TimeStamp");
+    const bdcColumnT* pCycles = pFindBdcColumn(&stTable, "CycleCount");
+    const bdcColumnT* pVoltage = pFindBdcColumn(&stTable, "Voltage");
+    const bdcColumnT* pAdapter = pFindBdcColumn(&stTable, "AdapterName");
+    const bdcColumnT* pExtra = pFindBdcColumn(&stTable, "Extra");
+    if (!bSelfTestCheck(stTable.nRows == 4 && stTable.vecColumns.size() == 5 && pTime && pCycles && pVoltage &&
+        pAdapter && pExtra, "rows and columns")) {
+        return false;
+    }
+    bOk = bSelfTestCheck(pTime->nType == BDC_COLUMN_TIMESTAMP && pTime->vecIntegers[0] == BDC_MISSING_INTEGER &&
+        pTime->vecIntegers[1] == 1747216800, "timestamp column") && bOk;
+    bOk = bSelfTestCheck(pCycles->nType == BDC_COLUMN_INTEGER && pCycles->vecIntegers[0] == 9 &&
+        pCycles->vecIntegers[1] == 10 && pCycles->vecIntegers[2] == BDC_MISSING_INTEGER &&
+        pCycles->vecIntegers[3] == 11, "integer column with an empty value") && bOk;
+    bOk = bSelfTestCheck(pVoltage->nType == BDC_COLUMN_REAL && bIsNaN(pVoltage->vecReals[0]) &&
+        pVoltage->vecReals[1] == 4 && pVoltage->vecReals[2] == 3.5 && bIsNaN(pVoltage->vecReals[3]),
+        "integer column widened to real") && bOk;
+    bOk = bSelfTestCheck(pAdapter->nType == BDC_COLUMN_TEXT && pAdapter->vecTexts[1] == "20W, USB-C" &&
+        pAdapter->vecTexts[2] == "a \"fast\" one" && pAdapter->vecTexts[3].empty(), "quoted text column") && bOk;
+    bOk = bSelfTestCheck(pExtra->nType == BDC_COLUMN_TEXT && pExtra->vecTexts[0] == "x" && pExtra->vecTexts[1].empty(),
+        "column of a later file") && bOk;
+    return bOk;
 }
 
 /**
- * Function to find and extract the latest BDC_Daily_ file
- * @param szTargzPath Path to tar.gz file
- * @param szTargetDir Target directory in archive
- * @return 0 on success, non-zero on error
+ * Check fitting trends, from a single value up to a file of rows streamed through the trend callback
+ * @return true if all checks passed
  */
-int nExtractLatestBdcDailyFile(
-    const char* szTargzPath,
-    const char* szTargetDir
-) {
-    if (!szTargzPath || !szTargetDir) {
-        fprintf(stderr, "Error: Invalid parameters\n");
-        return -1;
-    }
+bool bSelfTestTrend(void) {
+    bool bOk = true;
+    bdcTrendSetT stTrend;
+    stTrend.vecColumns.push_back("CycleCount");
+    vInitBdcTrends(&stTrend);
+    bdcTrendT* pTrend = &stTrend.vecTrends[0];
+    bdcTrendLineT stLine;
 
-    // Setup matcher data
-    matcherDataT stData;
-    memset(&stData, 0, sizeof(matcherDataT));
-    stData.szPrefix = "BDC_Daily_version";
-    stData.bFoundMatch = 0;
+    // A single value has no line, two values two days apart fit exactly
+    vAddBdcTrendValue(pTrend, 1747216800, 10);
+    vGetBdcTrendLine(pTrend, &stLine);
+    bOk = bSelfTestCheck(bIsNaN(stLine.dPerDay) && bIsNaN(stLine.dStart) && bIsNaN(stLine.dR2) &&
+        bIsNaN(stLine.dRecentPerDay), "single value") && bOk;
+    vAddBdcTrendValue(pTrend, 1747389600, 14);
+    vGetBdcTrendLine(pTrend, &stLine);
+    bOk = bSelfTestCheck(stLine.dPerDay == 2 && stLine.dStart == 10 && stLine.dEnd == 14 && stLine.dR2 == 1,
+        "two values") && bOk;
 
-    // First pass: Find the latest file
-    printf("Parsing Sysdiagnose Report: %s\n", szTargzPath);
+    // A report with a single row exports a count and empty fits
+    static const char szFile[] = "BDC_Daily_version_2025-05-14_00:00:00.csv";
+    static const char szData[] = "TimeStamp,CycleCount\n2025-05-14 10:00:00,10\n";
+    bdcTableT stTable;
+    stTable.nRows = 0;
+    bdcHistoryLoaderT stLoader;
+    stLoader.szPrefix = "BDC_Daily_version";
+    stLoader.pTable = &stTable;
+    stLoader.bHeaderDone = false;
+    stLoader.pFieldSchema = NULL;
+    stLoader.pTrend = &stTrend;
+    vInitBdcTrends(&stTrend);
+    bool bLoaded = nTrackBdcTrendCallback(szFile, szData, sizeof(szData) - 1, 0, &stLoader) == 0 &&
+        nTrackBdcTrendCallback(szFile, szData + sizeof(szData) - 1, 0, sizeof(szData) - 1, &stLoader) == 0;
+    exportOptionsT stExport;
+    stExport.vecColumns = stTrend.vecColumns;
+    stExport.nRows = EXPORT_ROWS_ALL;
+    stExport.ullFirstRow = 0;
+    stExport.ullLastRow = 0;
+    stExport.nFormat = EXPORT_FORMAT_CSV;
+    stExport.bStats = false;
+    stExport.bTrend = true;
+    std::string strCsv;
+    std::string strJson;
+    vAppendExportTrend("r", &stTrend, &stExport, &strCsv);
+    stExport.nFormat = EXPORT_FORMAT_NDJSON;
+    vAppendExportTrend("r", &stTrend, &stExport, &strJson);
+    bOk = bSelfTestCheck(bLoaded && stTrend.ullFiles == 1 && stTrend.vecTrends[0].ullCount == 1 &&
+        strCsv == "r,CycleCount,1,2025-05-14 10:00:00,2025-05-14 10:00:00,,,,,\n", "single row as CSV") && bOk;
+    bOk = bSelfTestCheck(strJson.find("\"PerDay\":null,\"Start\":null,\"End\":null,\"R2\":null,\"RecentPerDay\":null}\n") !=
+        std::string::npos, "single row as NDJSON") && bOk;
+    return bOk;
+}
 
-    int nResult = nExtractFromTargzWithCallback(szTargzPath, szTargetDir,
-        bLatestBdcDailyMatcher, &stData);
-    if (nResult != 0) {
-        fprintf(stderr, "Error: Failed to analyze archive\n");
-        return nResult;
-    }
+/**
+ * One group of checks of the self-test
+ */
+typedef struct {
+    const char* szName;       // Name printed with the result
+    bool (*pfnRun)(void);     // Runs the checks, true if all of them passed
+} selfTestT;
 
-    if (!stData.bFoundMatch) {
-        fprintf(stderr, "Error: No matching BDC_Daily_ files found\n");
-        return -1;
-    }
+/**
+ * Check the CSV kernels, value parsers, reduction kernels, history loading and trends on built-in data,
+ * without a report
+ * @return 0 if every check passed, non-zero otherwise
+ */
+int nRunSelfTest(void) {
+    static const selfTestT astTests[] = {
+        { "CSV tokenizer", bSelfTestTokenizer },
+        { "Value parsers", bSelfTestValues },
+        { "Reductions", bSelfTestReductions },
+        { "History table", bSelfTestHistory },
+        { "Trends", bSelfTestTrend },
+    };
 
-    // Print info about the latest file
-    printf("\nLatest BatteryBDC daily Log found %s\n", stData.stLatestFile.szFilename);
+    int nFailed = 0;
+    for (size_t i = 0; i < sizeof(astTests) / sizeof(astTests[0]); i++) {
+        bool bOk = astTests[i].pfnRun();
+        printf("%-16s %s\n", astTests[i].szName, bOk ? "ok" : "FAILED");
+        nFailed += !bOk;
+    }
+    printf("\n%d of %d check groups failed\n", nFailed, (int)(sizeof(astTests) / sizeof(astTests[0])));
+    return nFailed > 0 ? 1 : 0;
+}
 
-    // Second pass: Extract only the latest file
-    printf("\nChecking Charging Cycle...\n");
-    return nExtractFromTargzWithCallback(szTargzPath, szTargetDir,
-        bExtractLatestFileMatcher, &stData);
+// The command line tool, left out when the file is built as a library
+#ifndef BATTERYCYCLE_NO_MAIN
+/**
+ * Print command line usage
+ * @param szProgram Program name
+ */
+void vPrintUsage(const char* szProgram) {
+    printf("Usage: %s [options] <Sysdiagnose Report .tar.gz, .tar.zst, .tar.xz, .tar.bz2, .tar or extracted folder>\n",
+        szProgram);
+    printf("Use - as the report to read the archive from stdin, e.g. a pipe or a socket\n");
+    printf("Options:\n");
+    printf("  -j, --threads <N>  Decompression threads (default: one per core)\n");
+    printf("  --bench            Benchmark decompression per thread count and backend, with several\n");
+    printf("                     archives compare end-to-end latency per format instead, with --batch\n");
+    printf("                     measure batch throughput per worker count\n");
+    printf("  --bench-csv <MB>   Benchmark the CSV tokenizer, value parsers and column reductions on a\n");
+    printf("                     synthetic BDC log of MB megabytes\n");
+    printf("  --self-test        Check the CSV, value and reduction kernels, history loading and trends on\n");
+    printf("                     built-in data, needs no report\n");
+    printf("  --index            Keep a random access index next to the archive for later runs\n");
+    printf("  --index-dir <DIR>  Keep the random access index in DIR instead\n");
+    printf("  --backend <NAME>   Inflate backend: auto");
+    for (int i = 0; i < INFLATE_BACKEND_COUNT; i++) {
+        printf(", %s", astInflateBackends[i].szName);
+    }
+    printf(" (default: auto)\n");
+    printf("  --memory-budget <MB>  Memory for whole-archive decompression (default: %llu)\n",
+        DEFAULT_MEMORY_BUDGET / (1024 * 1024));
+    printf("  --early-stop       Stop decompressing once the scan has passed the BatteryBDC directory\n");
+    printf("  --batch            Analyze every report given, directories are expanded into the reports inside,\n");
+    printf("                     one line per report in input order, -j sets the number of workers\n");
+    printf("  --file-list <FILE> Batch mode over the reports listed in FILE, one per line\n");
+    printf("  --cache-dir <DIR>  Remember results in DIR and answer repeated reports from there\n");
+    printf("  --read-ahead <MB>  Compressed data read ahead of streaming decompression (default: %d)\n",
+        DEFAULT_READ_AHEAD / (1024 * 1024));
+    printf("  --history          Load every row of every BatteryBDC daily log and summarize the columns\n");
+    printf("  --columns <A,B,..> Export these columns of the BatteryBDC daily logs (default: TimeStamp,CycleCount)\n");
+    printf("  --rows <ROWS>      Rows to export: last, all or N..M of the whole history, from 0 (default: last)\n");
+    printf("  --format <FORMAT>  Export format: csv, ndjson or binary (default: csv), also with --batch\n");
+    printf("  --stats <A,B,..>   Export count, min, max, mean, standard deviation and percentiles of these\n");
+    printf("                     columns over the rows instead (default: all), A/B for the ratio of two columns\n");
+    printf("  --trend <A,B,..>   Export the change per day and the fitted line of these columns over the whole\n");
+    printf("                     history instead, fitted while the logs stream past, e.g. CycleCount\n");
+#ifdef BATTERYCYCLE_WITH_SERVER
+    printf("  --serve <SOCKET>   Answer requests on a Unix domain socket, -j sets the number of workers\n");
+#endif
+    printf("Example: %s Sysdiagnose_.tar.gz\n", szProgram);
 }
 
 /**
@@ -751,12 +10054,238 @@ int nExtractLatestBdcDailyFile(
  * @return Exit status
  */
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <Sysdiagnose Report tar.gz File>\n", argv[0]);
-        printf("Example: %s Sysdiagnose_.tar.gz\n", argv[0]);
+    extractOptionsT stOptions;
+    memset(&stOptions, 0, sizeof(extractOptionsT));
+    const char* szTargzPath = NULL;
+    std::vector<const char*> vecPaths;
+    const char* szFileList = NULL;
+#ifdef BATTERYCYCLE_WITH_SERVER
+    const char* szSocketPath = NULL;
+#endif
+    int bBenchmark = 0;
+    int nCsvBenchmarkMb = 0;
+    int bSelfTest = 0;
+    int bBatch = 0;
+    int bHistory = 0;
+    int bExport = 0;
+    exportOptionsT stExport;
+    stExport.nRows = EXPORT_ROWS_LAST;
+    stExport.ullFirstRow = 0;
+    stExport.ullLastRow = 0;
+    stExport.nFormat = EXPORT_FORMAT_CSV;
+    stExport.bStats = false;
+    stExport.bTrend = false;
+    bool bRows = false;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc) {
+            stOptions.nThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench") == 0) {
+            bBenchmark = 1;
+        }
+        else if (strcmp(argv[i], "--bench-csv") == 0 && i + 1 < argc) {
+            nCsvBenchmarkMb = atoi(argv[++i]);
+            if (nCsvBenchmarkMb <= 0) {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--self-test") == 0) {
+            bSelfTest = 1;
+        }
+        else if (strcmp(argv[i], "--index") == 0) {
+            stOptions.bUseIndex = 1;
+        }
+        else if (strcmp(argv[i], "--index-dir") == 0 && i + 1 < argc) {
+            stOptions.bUseIndex = 1;
+            stOptions.szIndexDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            stOptions.szBackend = argv[++i];
+            if (_stricmp(stOptions.szBackend, "auto") != 0 && !pFindInflateBackend(stOptions.szBackend)) {
+                fprintf(stderr, "Error: Inflate backend %s is not available in this build\n", stOptions.szBackend);
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            stOptions.ullMemoryBudget = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+        }
+        else if (strcmp(argv[i], "--early-stop") == 0) {
+            stOptions.bStopAfterDirectory = 1;
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            bBatch = 1;
+        }
+        else if (strcmp(argv[i], "--history") == 0) {
+            bHistory = 1;
+        }
+        else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+            bExport = 1;
+            if (!bParseExportColumns(argv[++i], &stExport)) {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            bExport = 1;
+            bRows = true;
+            if (!bParseExportRows(argv[++i], &stExport)) {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            bExport = 1;
+            stExport.bStats = true;
+            if (!bParseExportColumns(argv[++i], &stExport)) {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--trend") == 0 && i + 1 < argc) {
+            bExport = 1;
+            stExport.bTrend = true;
+            if (!bParseExportColumns(argv[++i], &stExport)) {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            bExport = 1;
+            const char* szFormat = argv[++i];
+            if (strcmp(szFormat, "csv") == 0) {
+                stExport.nFormat = EXPORT_FORMAT_CSV;
+            }
+            else if (strcmp(szFormat, "ndjson") == 0) {
+                stExport.nFormat = EXPORT_FORMAT_NDJSON;
+            }
+            else if (strcmp(szFormat, "binary") == 0) {
+                stExport.nFormat = EXPORT_FORMAT_BINARY;
+            }
+            else {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--file-list") == 0 && i + 1 < argc) {
+            bBatch = 1;
+            szFileList = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            stOptions.szCacheDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--read-ahead") == 0 && i + 1 < argc) {
+            stOptions.ullReadAhead = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+        }
+#ifdef BATTERYCYCLE_WITH_SERVER
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            szSocketPath = argv[++i];
+        }
+#endif
+        else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+            vecPaths.push_back(argv[i]);
+        }
+        else {
+            vPrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Exports print their rows instead of the results
+    if (bExport) {
+        // Trends always cover the whole history, neither summary has a binary form
+        bool bSummary = stExport.bStats || stExport.bTrend;
+        if (bBenchmark || bHistory || (stExport.bStats && stExport.bTrend) || (stExport.bTrend && bRows) ||
+            (bSummary && stExport.nFormat == EXPORT_FORMAT_BINARY)) {
+            vPrintUsage(argv[0]);
+            return 1;
+        }
+        if (stExport.bStats && !bRows) {
+            // A summary of the last row alone says nothing, statistics cover the whole history by default
+            stExport.nRows = EXPORT_ROWS_ALL;
+        }
+        if (stExport.vecColumns.empty()) {
+            // Default columns for --rows and --format alone, statistics always name theirs
+            stExport.vecColumns.push_back("TimeStamp");
+            stExport.vecColumns.push_back("CycleCount");
+        }
+        if (stExport.nFormat == EXPORT_FORMAT_BINARY) {
+            _setmode(_fileno(stdout), _O_BINARY);
+        }
+    }
+
+    // The CSV benchmark and the self-test need no report
+    if (nCsvBenchmarkMb > 0 || bSelfTest) {
+        if (!vecPaths.empty() || bBatch || bBenchmark || bExport || (nCsvBenchmarkMb > 0 && bSelfTest)) {
+            vPrintUsage(argv[0]);
+            return 1;
+        }
+        return bSelfTest ? nRunSelfTest() : nRunCSVBenchmark(nCsvBenchmarkMb);
+    }
+
+#ifdef BATTERYCYCLE_WITH_SERVER
+    // The server gets its archives from its clients
+    if (szSocketPath) {
+        if (!vecPaths.empty() || bBatch || bBenchmark || bExport) {
+            vPrintUsage(argv[0]);
+            return 1;
+        }
+        return nRunServer(szSocketPath, &stOptions, nResolveThreadCount(&stOptions));
+    }
+#endif
+
+    // Batches take any number of reports, directories and lists
+    if (bBatch) {
+        std::vector<std::string> vecReports;
+        for (size_t i = 0; i < vecPaths.size(); i++) {
+            vCollectBatchPaths(vecPaths[i], &vecReports);
+        }
+        if (szFileList && nReadBatchList(szFileList, &vecReports) != 0) {
+            return 1;
+        }
+        if (vecReports.empty()) {
+            fprintf(stderr, "Error: No reports to analyze\n");
+            return 1;
+        }
+
+        if (bBenchmark) {
+            return nRunBatchBenchmark(vecReports, &stOptions);
+        }
+        return nRunBatch(vecReports, &stOptions, nResolveThreadCount(&stOptions), false, bExport ? &stExport : NULL);
+    }
+
+    // Only the benchmark compares several archives
+    if (vecPaths.empty() || (vecPaths.size() > 1 && !bBenchmark) || (bHistory && bBenchmark)) {
+        vPrintUsage(argv[0]);
         return 1;
     }
+    szTargzPath = vecPaths[0];
+
+    if (bBenchmark) {
+        // Benchmarks read their archives several times
+        for (size_t i = 0; i < vecPaths.size(); i++) {
+            if (strcmp(vecPaths[i], "-") == 0) {
+                vPrintUsage(argv[0]);
+                return 1;
+            }
+        }
+        if (vecPaths.size() > 1 || nDetectInputFormat(szTargzPath) != INPUT_FORMAT_GZIP) {
+            return nRunFormatBenchmark(vecPaths.data(), (int)vecPaths.size(), &stOptions);
+        }
+        return nRunDecompressBenchmark(szTargzPath, &stOptions);
+    }
+
+    if (bExport) {
+        return nExportBdcRows(szTargzPath, "logs/BatteryBDC/", &stOptions, &stExport);
+    }
+
+    if (bHistory) {
+        return nPrintBdcHistory(szTargzPath, "logs/BatteryBDC/", &stOptions);
+    }
 
     // Find and extract the latest BDC_Daily_ file
-    return nExtractLatestBdcDailyFile(argv[1], "logs/BatteryBDC/");
-}
\ No newline at end of file
+    return nExtractLatestBdcDailyFile(szTargzPath, "logs/BatteryBDC/", &stOptions);
+}
+#endif
\ No newline at end of file
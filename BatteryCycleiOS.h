@@ -0,0 +1,106 @@
+/**
+ * iOS Battery Health Analyzer library interface
+ *
+ * Build BatteryCycleiOS.cpp with BATTERYCYCLE_NO_MAIN to link it into another program,
+ * add BATTERYCYCLE_SHARED and BATTERYCYCLE_EXPORTS when building it as a shared library,
+ * and define BATTERYCYCLE_SHARED when using that shared library.
+ * All functions are reentrant, reports may be analyzed on several threads at once.
+ */
+#ifndef BATTERYCYCLEIOS_H
+#define BATTERYCYCLEIOS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#if defined(BATTERYCYCLE_SHARED) && defined(_WIN32)
+#ifdef BATTERYCYCLE_EXPORTS
+#define BATTERYCYCLE_API __declspec(dllexport)
+#else
+#define BATTERYCYCLE_API __declspec(dllimport)
+#endif
+#elif defined(BATTERYCYCLE_SHARED) && defined(__GNUC__)
+#define BATTERYCYCLE_API __attribute__((visibility("default")))
+#else
+#define BATTERYCYCLE_API
+#endif
+
+#define BATTERYCYCLE_NAME_SIZE 260    // Size of the member name in a result
+#define BATTERYCYCLE_VALUE_SIZE 1024  // Size of the values and the error message in a result
+
+/**
+ * Log callback type, receives every error and warning of an analysis
+ * @param szMessage Message without trailing newline, e.g. "Error: Cannot open x.tar.gz"
+ * @param pUserData User data from the options
+ */
+typedef void (*pfnBatteryCycleLogCallback)(const char* szMessage, void* pUserData);
+
+/**
+ * Options of an analysis, all zero for the defaults
+ */
+typedef struct {
+    int nThreads;             // Decompression threads, 0 for one per core
+    int bUseIndex;            // Load or build a random access index next to a gzip archive
+    const char* szIndexDir;   // Directory for index files, NULL to store them next to the archive
+    const char* szCacheDir;   // Directory of the result cache, NULL to disable it
+    const char* szBackend;    // Inflate backend name, NULL or "auto" to choose at runtime
+    unsigned long long ullMemoryBudget; // Bytes whole-buffer backends may use, 0 for the default
+    int bStopAfterDirectory;  // Stop once the scan has left the BatteryBDC directory again
+    unsigned long long ullReadAhead; // Compressed bytes the pipelined reader reads ahead, 0 for the default
+    pfnBatteryCycleLogCallback pfnLog; // Receives errors and warnings, NULL to only keep the first error
+    void* pLogUserData;       // User data for pfnLog
+} batteryCycleOptionsT;
+
+/**
+ * Result of an analysis
+ */
+typedef struct {
+    long long llCycleCount;   // Cycle count of the last row, -1 if it is not a number
+    char szCycleCount[BATTERYCYCLE_VALUE_SIZE]; // Cycle count as written in the log
+    char szTimeStamp[BATTERYCYCLE_VALUE_SIZE];  // Timestamp of the last row
+    char szMemberName[BATTERYCYCLE_NAME_SIZE];  // Name of the latest BDC_Daily_ file
+    char szError[BATTERYCYCLE_VALUE_SIZE];      // First error message on failure, without "Error: "
+    int bFromCache;           // Answered from the result cache
+    int bStoppedEarly;        // The scan stopped after the BatteryBDC directory
+    unsigned long long ullScanned; // Uncompressed tar bytes the scan went through
+    unsigned long long ullTotal;   // Uncompressed size of the whole archive, 0 if unknown
+    double dLookupMs;         // Fingerprinting the archive and looking it up in the result cache
+    double dScanMs;           // Decompressing the archive and finding the latest log
+    double dParseMs;          // Reading the values from the log
+    double dTotalMs;          // Whole analysis
+} batteryCycleResultT;
+
+/**
+ * Analyze a sysdiagnose report on disk
+ * @param szPath Path to a .tar.gz, .tar.zst, .tar.xz, .tar.bz2, .tar or extracted folder
+ * @param pOptions Options, NULL for defaults
+ * @param pResult Receives the result, also on failure
+ * @return 0 on success, non-zero on error
+ */
+BATTERYCYCLE_API int nBatteryCycleAnalyzeFile(const char* szPath, const batteryCycleOptionsT* pOptions,
+    batteryCycleResultT* pResult);
+
+/**
+ * Analyze a sysdiagnose report held in memory
+ * The buffer is decoded on the calling thread, the index options do not apply.
+ * @param pData Compressed or uncompressed tar, must stay valid during the call
+ * @param nSize Size of the data
+ * @param pOptions Options, NULL for defaults
+ * @param pResult Receives the result, also on failure
+ * @return 0 on success, non-zero on error
+ */
+BATTERYCYCLE_API int nBatteryCycleAnalyzeBuffer(const void* pData, size_t nSize, const batteryCycleOptionsT* pOptions,
+    batteryCycleResultT* pResult);
+
+/**
+ * Analyze a sysdiagnose report read front to back from a stream, e.g. stdin, a pipe or a socket
+ * Nothing is seeked and memory use does not depend on the size of the archive. The result
+ * cache and the index options do not apply, ullTotal is 0 when the scan stopped early.
+ * @param fp Compressed or uncompressed tar opened in binary mode, read up to where the scan ends and left open
+ * @param pOptions Options, NULL for defaults
+ * @param pResult Receives the result, also on failure
+ * @return 0 on success, non-zero on error
+ */
+BATTERYCYCLE_API int nBatteryCycleAnalyzeStream(FILE* fp, const batteryCycleOptionsT* pOptions,
+    batteryCycleResultT* pResult);
+
+#endif
\ No newline at end of file